@@ -0,0 +1,101 @@
+#include "arena.h"
+#include <cstdlib>
+
+Arena::Arena(ArenaStats* pstats):
+    m_chunks(nullptr),
+    m_current(0),
+    m_end(0),
+    m_num_allocations(0),
+    m_num_bytes(0),
+    m_pstats(pstats)
+{
+}
+
+Arena::~Arena()
+{
+    while (m_chunks)
+    {
+        ArenaChunk* next = m_chunks->m_next;
+        free(m_chunks);
+        m_chunks = next;
+    }
+}
+
+ArenaChunk* Arena::add_chunk(size_t size)
+{
+    ArenaChunk* chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + size);
+    if (!chunk)
+    {
+        std::cerr << "Out of memory" << std::endl;
+        exit(1);
+    }
+    if (m_pstats)
+        m_pstats->m_chunks.fetch_add(1, std::memory_order_relaxed);
+
+    // The first chunk stays at the head of the list, it is the one
+    // release() keeps
+    chunk->m_size = size;
+    if (m_chunks)
+    {
+        chunk->m_next = m_chunks->m_next;
+        m_chunks->m_next = chunk;
+    }
+    else
+    {
+        chunk->m_next = nullptr;
+        m_chunks = chunk;
+    }
+
+    m_current = (uintptr_t)(chunk + 1);
+    m_end = m_current + size;
+    return chunk;
+}
+
+void* Arena::allocate_slow(size_t size, size_t alignment)
+{
+    // The chunk that is kept has the usual size, a large allocation
+    // gets a chunk of its own that goes away with the next release
+    if (!m_chunks)
+    {
+        add_chunk(ARENA_CHUNK_SIZE);
+        if (size + alignment <= ARENA_CHUNK_SIZE)
+            return allocate(size, alignment);
+    }
+
+    add_chunk(std::max<size_t>(ARENA_CHUNK_SIZE, size + alignment));
+    return allocate(size, alignment);
+}
+
+void Arena::release()
+{
+    if (!m_chunks)
+        return;
+
+    ArenaChunk* chunk = m_chunks->m_next;
+    while (chunk)
+    {
+        ArenaChunk* next = chunk->m_next;
+        free(chunk);
+        chunk = next;
+    }
+    m_chunks->m_next = nullptr;
+    m_current = (uintptr_t)(m_chunks + 1);
+    m_end = m_current + m_chunks->m_size;
+
+    if (m_pstats && m_num_allocations)
+    {
+        m_pstats->m_allocations.fetch_add(m_num_allocations, std::memory_order_relaxed);
+        m_pstats->m_bytes.fetch_add(m_num_bytes, std::memory_order_relaxed);
+        m_pstats->m_releases.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_num_allocations = 0;
+    m_num_bytes = 0;
+}
+
+size_t Arena::num_chunks() const
+{
+    size_t n = 0;
+    for (ArenaChunk* chunk = m_chunks; chunk; chunk = chunk->m_next)
+        n++;
+    return n;
+}
@@ -0,0 +1,282 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include "common_include.h"
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief size of the chunks an arena takes from the heap, larger
+ * allocations get a chunk of their own
+ * 
+ */
+#define ARENA_CHUNK_SIZE 4096
+
+/**
+ * @brief Counters of all the arenas of the server. An arena adds
+ * its counts when it is released, so that allocating from it does
+ * not touch shared memory.
+ * 
+ */
+struct ArenaStats
+{
+    /**
+     * @brief number of objects allocated from arenas
+     * 
+     */
+    std::atomic<uint64_t>       m_allocations;
+
+    /**
+     * @brief number of bytes allocated from arenas
+     * 
+     */
+    std::atomic<uint64_t>       m_bytes;
+
+    /**
+     * @brief number of chunks taken from the heap
+     * 
+     */
+    std::atomic<uint64_t>       m_chunks;
+
+    /**
+     * @brief number of times an arena was released
+     * 
+     */
+    std::atomic<uint64_t>       m_releases;
+
+    ArenaStats():
+        m_allocations(0),
+        m_bytes(0),
+        m_chunks(0),
+        m_releases(0)
+    {
+    }
+};
+
+/**
+ * @brief A chunk of memory of an arena, the memory follows the
+ * header
+ * 
+ */
+struct ArenaChunk
+{
+    /**
+     * @brief the chunk taken before this one
+     * 
+     */
+    ArenaChunk*                 m_next;
+
+    /**
+     * @brief number of bytes after the header
+     * 
+     */
+    size_t                      m_size;
+};
+
+/**
+ * @brief A bump allocator for the objects of one request cycle of a
+ * connection.
+ * 
+ * Allocating moves a pointer forward in the current chunk, and
+ * freeing does nothing. Everything is freed in one step by
+ * release(), which keeps the first chunk for the next cycle, so a
+ * connection whose cycles fit in one chunk never goes to the heap
+ * again. An arena is used by one thread at a time, the one that
+ * owns the connection.
+ * 
+ */
+class Arena
+{
+public:
+    Arena(ArenaStats* pstats = nullptr);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena();
+
+    /**
+     * @brief allocate memory, it stays valid until release()
+     * 
+     * @param size number of bytes
+     * @param alignment the alignment, a power of two
+     * @return void* the memory
+     */
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        uintptr_t current = (m_current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (!m_current || current + size > m_end)
+            return allocate_slow(size, alignment);
+
+        m_current = current + size;
+        m_num_allocations++;
+        m_num_bytes += size;
+        return (void*)current;
+    }
+
+    /**
+     * @brief free everything that was allocated, in one step. The
+     * objects must have been destroyed already.
+     * 
+     */
+    void release();
+
+    /**
+     * @brief set the counters the arena adds its counts to
+     * 
+     * @param pstats the counters, nullptr for none
+     */
+    void set_stats(ArenaStats* pstats)
+    {
+        m_pstats = pstats;
+    }
+
+    /**
+     * @brief number of bytes allocated since the last release
+     * 
+     * @return size_t the number of bytes
+     */
+    size_t used() const
+    {
+        return m_num_bytes;
+    }
+
+    /**
+     * @brief number of chunks the arena holds
+     * 
+     * @return size_t the number of chunks
+     */
+    size_t num_chunks() const;
+
+private:
+    /**
+     * @brief the first chunk, the one release() keeps. The other
+     * chunks follow it, the newest first.
+     * 
+     */
+    ArenaChunk*                 m_chunks;
+
+    /**
+     * @brief the next free byte of the current chunk
+     * 
+     */
+    uintptr_t                   m_current;
+
+    /**
+     * @brief the end of the current chunk
+     * 
+     */
+    uintptr_t                   m_end;
+
+    /**
+     * @brief objects allocated since the last release
+     * 
+     */
+    uint64_t                    m_num_allocations;
+
+    /**
+     * @brief bytes allocated since the last release
+     * 
+     */
+    uint64_t                    m_num_bytes;
+
+    /**
+     * @brief where the counts go when the arena is released
+     * 
+     */
+    ArenaStats*                 m_pstats;
+
+    /**
+     * @brief take a chunk from the heap, allocations come from it
+     * from now on
+     * 
+     * @param size number of bytes after the header
+     * @return ArenaChunk* the chunk
+     */
+    ArenaChunk* add_chunk(size_t size);
+
+    /**
+     * @brief take a new chunk from the heap and allocate from it
+     * 
+     * @param size number of bytes
+     * @param alignment the alignment
+     * @return void* the memory
+     */
+    void* allocate_slow(size_t size, size_t alignment);
+};
+
+/**
+ * @brief An allocator for the standard library that allocates from
+ * an arena, for std::allocate_shared
+ * 
+ * @tparam T the type of the objects
+ */
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    /**
+     * @brief the arena, the allocator does not own it
+     * 
+     */
+    Arena*                      m_parena;
+
+    ArenaAllocator(Arena* parena):
+        m_parena(parena)
+    {
+    }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other):
+        m_parena(other.m_parena)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(m_parena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    /**
+     * @brief nothing is freed, the arena is released as a whole
+     * 
+     */
+    void deallocate(T*, size_t)
+    {
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return m_parena == other.m_parena;
+    }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const
+    {
+        return m_parena != other.m_parena;
+    }
+};
+
+/**
+ * @brief create an object that is shared, in an arena if there is
+ * one, on the heap otherwise. The object and its reference count
+ * are a single allocation.
+ * 
+ * @tparam T the type of the object
+ * @param parena the arena, nullptr for the heap
+ * @param args the arguments of the constructor
+ * @return std::shared_ptr<T> the object
+ */
+template<typename T, typename... Args>
+std::shared_ptr<T> arena_make_shared(Arena* parena, Args&&... args)
+{
+    if (!parena)
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    return std::allocate_shared<T>(
+            ArenaAllocator<T>(parena), std::forward<Args>(args)...);
+}
+
+#endif /* #ifndef ARENA_H_ */
@@ -0,0 +1,147 @@
+#include "arena.h"
+#include <cstdlib>
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+/**
+ * @brief number of Counted objects that are alive
+ * 
+ */
+static int num_alive = 0;
+
+/**
+ * @brief an object that counts how many of its kind are alive
+ * 
+ */
+struct Counted
+{
+    uint64_t                    m_value;
+
+    Counted(uint64_t value):
+        m_value(value)
+    {
+        num_alive++;
+    }
+
+    ~Counted()
+    {
+        num_alive--;
+    }
+};
+
+void test_allocate()
+{
+    std::cout << std::endl << "Tests to validate allocating from an arena" << std::endl;
+    {
+        Arena arena;
+        TEST(0 == arena.num_chunks(), "A new arena should hold no memory");
+
+        bool is_aligned = true;
+        for (size_t alignment = 1; alignment <= 64; alignment *= 2)
+        {
+            arena.allocate(1, 1);
+            void* p = arena.allocate(24, alignment);
+            if ((uintptr_t)p & (alignment - 1))
+                is_aligned = false;
+        }
+        TEST(is_aligned, "Allocations should be aligned");
+        TEST(1 == arena.num_chunks(), "Small allocations should share a chunk");
+
+        char* a = (char*)arena.allocate(16, 8);
+        char* b = (char*)arena.allocate(16, 8);
+        TEST(b == a + 16, "Allocations should be contiguous");
+    }
+    {
+        Arena arena;
+        for (int i = 0; i < 1000; i++)
+            arena.allocate(64);
+        TEST(arena.num_chunks() > 1, "A full chunk should be followed by another one");
+        TEST(64000 == arena.used(), "The bytes allocated should be counted");
+
+        arena.release();
+        TEST(1 == arena.num_chunks(), "A release should keep one chunk");
+        TEST(0 == arena.used(), "A release should free everything");
+    }
+    {
+        Arena arena;
+        void* first = arena.allocate(64);
+        arena.allocate(100000);
+        TEST(2 == arena.num_chunks(), "A large allocation should get a chunk of its own");
+        arena.release();
+        TEST(1 == arena.num_chunks(), "The large chunk should go away with the release");
+        TEST(first == arena.allocate(64), "The kept chunk should be reused");
+    }
+    {
+        Arena arena;
+        arena.allocate(100000);
+        arena.release();
+        TEST(1 == arena.num_chunks(), "A large first allocation should not be the kept chunk");
+    }
+}
+
+void test_stats()
+{
+    std::cout << std::endl << "Tests to validate the counters of arenas" << std::endl;
+    ArenaStats stats;
+    {
+        Arena arena(&stats);
+        arena.allocate(10);
+        arena.allocate(20);
+        TEST(1 == stats.m_chunks, "Taking a chunk should be counted at once");
+        TEST(0 == stats.m_allocations, "Allocations should not be counted before the release");
+
+        arena.release();
+        TEST(2 == stats.m_allocations && 30 == stats.m_bytes && 1 == stats.m_releases,
+            "Allocations should be counted at the release");
+
+        arena.release();
+        TEST(1 == stats.m_releases, "Releasing an empty arena should not be counted");
+
+        for (int i = 0; i < 10; i++)
+        {
+            arena.allocate(100);
+            arena.release();
+        }
+        TEST(1 == stats.m_chunks, "Cycles that fit in a chunk should not take more chunks");
+        TEST(11 == stats.m_releases, "Every release should be counted");
+    }
+}
+
+void test_make_shared()
+{
+    std::cout << std::endl << "Tests to validate shared objects in arenas" << std::endl;
+    {
+        Arena arena;
+        {
+            auto p = arena_make_shared<Counted>(&arena, 42);
+            TEST(42 == p->m_value && 1 == num_alive, "The object should be constructed");
+            TEST(arena.used() >= sizeof(Counted), "The object should come from the arena");
+            std::shared_ptr<Counted> q = p;
+        }
+        TEST(0 == num_alive, "The object should be destroyed with its last reference");
+        arena.release();
+    }
+    {
+        auto p = arena_make_shared<Counted>(nullptr, 7);
+        TEST(7 == p->m_value, "Without an arena the object should come from the heap");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_allocate();
+    test_stats();
+    test_make_shared();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
@@ -0,0 +1,639 @@
+/**
+ * @file bench_datastore.cpp
+ * @brief Measure the contention on the data store shards when the
+ * keys share a prefix and a few of them get most of the traffic.
+ * 
+ * The keys are "user:N" and "sess:N", picked with a Zipf
+ * distribution, 90% GET and 10% SET, from 1 thread up to the number
+ * of cores. The same load is run with:
+ * 1. the first character of the key modulo 10, as the server used
+ *    to pick the shard,
+ * 2. KeyHash over 16 and 64 shards.
+ * For each one the benchmark reports the operations per second, and
+ * the share of the operations that went to the busiest shard.
+ * 
+ * It then compares the hash table engines on one thread: HashTable,
+ * the table of DataStore, and std::unordered_map, which it used
+ * before. It reports the lookups per second of keys in random order,
+ * and the heap bytes per key, for short keys and values.
+ * 
+ * Last, it measures the latency of SET while a data store grows from
+ * empty to the same number of keys, with DataStore, which grows its
+ * table a little on every write, and with a std::unordered_map under
+ * a lock, which moves every key at once. Reader threads GET the keys
+ * already set meanwhile, and the latency of their GETs is reported
+ * too. The SETs and GETs are issued at a fixed rate, and the latency
+ * of each one counts from when it should have started, so that a
+ * stall counts for every operation held up by it.
+ * 
+ * Then it measures how reads scale with the number of threads, 99%
+ * GET and 1% SET on a single shard, with DataStore, whose readers
+ * take no lock, and with the same table under a reader-writer lock,
+ * whose cache line every reader writes.
+ * 
+ * Usage: ./bench_datastore [seconds per measurement] [max threads]
+ * [number of keys of the engine comparison and the growth]
+ * 
+ */
+#include "common_include.h"
+#include "data_store.h"
+#include "key_hash.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <malloc.h>
+#include <random>
+
+/**
+ * @brief number of keys of each prefix
+ * 
+ */
+#define BENCH_NUM_KEYS 100000
+
+/**
+ * @brief number of operations each thread has prepared, it goes
+ * through them in a loop
+ * 
+ */
+#define BENCH_OPS_PER_THREAD (1 << 16)
+
+/**
+ * @brief the exponent of the Zipf distribution of the keys
+ * 
+ */
+#define BENCH_ZIPF_EXPONENT 0.99
+
+/**
+ * @brief the SETs per second while the data store grows, well below
+ * what either store sustains
+ * 
+ */
+#define BENCH_GROWTH_RATE 250000
+
+/**
+ * @brief number of threads that GET keys already set while the data
+ * store grows
+ * 
+ */
+#define BENCH_GROWTH_READERS 2
+
+/**
+ * @brief the GETs per second of each of these threads
+ * 
+ */
+#define BENCH_GROWTH_READ_RATE 100000
+
+/**
+ * @brief how the shard of a key is picked
+ * 
+ */
+struct Partitioning
+{
+    /**
+     * @brief the name in the report
+     * 
+     */
+    const char*                 m_name;
+
+    /**
+     * @brief number of shards
+     * 
+     */
+    size_t                      m_num_shards;
+
+    /**
+     * @brief hash the keys instead of using their first character
+     * 
+     */
+    bool                        m_is_hashed;
+
+    size_t shard(const std::string& key, uint64_t seed) const
+    {
+        if (!m_is_hashed)
+            return key.empty() ? 0 : (size_t)key[0] % m_num_shards;
+        return KeyHash::hash(key, seed) & (m_num_shards - 1);
+    }
+};
+
+/**
+ * @brief an operation prepared in advance
+ * 
+ */
+struct BenchOp
+{
+    const std::string*          m_key;
+    size_t                      m_shard;
+    bool                        m_is_set;
+};
+
+/**
+ * @brief the keys, half of them with each prefix
+ * 
+ * @return std::vector<std::string> the keys
+ */
+static std::vector<std::string> make_keys()
+{
+    std::vector<std::string> keys;
+    for (int i = 0; i < BENCH_NUM_KEYS; i++)
+    {
+        keys.push_back("user:" + std::to_string(i));
+        keys.push_back("sess:" + std::to_string(i));
+    }
+    return keys;
+}
+
+/**
+ * @brief pick keys with a Zipf distribution
+ * 
+ * @param num_keys number of keys
+ * @param count number of keys to pick
+ * @param rng the random generator
+ * @return std::vector<size_t> the indexes of the keys
+ */
+static std::vector<size_t> zipf_indexes(size_t num_keys, size_t count, std::mt19937_64& rng)
+{
+    std::vector<double> cdf(num_keys);
+    double total = 0;
+    for (size_t i = 0; i < num_keys; i++)
+    {
+        total += 1.0 / pow(i + 1, BENCH_ZIPF_EXPONENT);
+        cdf[i] = total;
+    }
+
+    std::uniform_real_distribution<double> uniform(0, total);
+    std::vector<size_t> indexes;
+    for (size_t i = 0; i < count; i++)
+    {
+        auto it = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng));
+        indexes.push_back(std::min<size_t>(it - cdf.begin(), num_keys - 1));
+    }
+    return indexes;
+}
+
+/**
+ * @brief run the load on a set of shards
+ * 
+ * @param partitioning how the shards are picked
+ * @param ops the operations of every thread
+ * @param seconds how long to run
+ * @return double the operations per second
+ */
+static double run(
+    const Partitioning&                     partitioning,
+    const std::vector<std::vector<BenchOp> >&   ops,
+    double                                  seconds)
+{
+    std::unique_ptr<DataStore[]> shards(new DataStore[partitioning.m_num_shards]);
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> total(0);
+    std::vector<std::thread> threads;
+    std::string value = "$8\r\nvalue123\r\n";
+
+    for (auto& thread_ops: ops)
+    {
+        threads.emplace_back([&, value]() {
+            uint64_t done = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                for (auto& op: thread_ops)
+                {
+                    auto& shard = shards[op.m_shard];
+                    if (op.m_is_set)
+                        shard.set(*op.m_key, value);
+                    else
+                        shard.get(*op.m_key);
+                }
+                done += thread_ops.size();
+            }
+            total += done;
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& thread: threads)
+        thread.join();
+    double elapsed = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+    return total / elapsed;
+}
+
+/**
+ * @brief bytes of the heap in use
+ * 
+ * @return size_t the number of bytes
+ */
+static size_t heap_in_use()
+{
+    return mallinfo2().uordblks;
+}
+
+/**
+ * @brief free what an engine keeps for the readers that may still
+ * look at it, std::unordered_map keeps nothing
+ * 
+ * @param engine the engine
+ */
+template<typename Engine>
+static void collect(Engine&)
+{
+}
+
+static void collect(HashTable& table)
+{
+    RetireList reclaimable;
+    table.collect(reclaimable, true);
+}
+
+/**
+ * @brief fill an engine with keys, then look them up in random order
+ * until the time is up
+ * 
+ * @param name the name of the engine in the report
+ * @param keys the keys
+ * @param order the order of the lookups
+ * @param seconds how long to look up
+ * @param insert sets a key to a value in the engine
+ * @param find returns whether the engine has a key
+ */
+template<typename Engine, typename Insert, typename Find>
+static void bench_engine(
+    const char*                     name,
+    const std::vector<std::string>& keys,
+    const std::vector<uint32_t>&    order,
+    double                          seconds,
+    Insert                          insert,
+    Find                            find)
+{
+    size_t initial_heap = heap_in_use();
+    auto pengine = std::make_unique<Engine>();
+    for (auto& key: keys)
+        insert(*pengine, key, std::string("value:12"));
+    collect(*pengine);
+    size_t bytes = heap_in_use() - initial_heap;
+
+    size_t lookups = 0;
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        for (auto index: order)
+            found += find(*pengine, keys[index]);
+        lookups += order.size();
+        elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < seconds);
+
+    if (found != lookups)
+    {
+        std::cerr << name << ": keys are missing" << std::endl;
+        exit(1);
+    }
+    printf("%-20s %10zu %14.0f %12.1f\n",
+        name, keys.size(), lookups / elapsed, (double)bytes / keys.size());
+}
+
+/**
+ * @brief the data store as it was before HashTable, a
+ * std::unordered_map under a reader-writer lock
+ * 
+ */
+class MapStore
+{
+public:
+    bool set(const std::string& key, std::string&& value)
+    {
+        std::unique_lock lock(m_mutex);
+        m_map[key] = std::move(value);
+        return true;
+    }
+
+    template<typename F>
+    bool with_value(const std::string& key, F&& fn)
+    {
+        std::shared_lock lock(m_mutex);
+        auto it = m_map.find(key);
+        if (it == m_map.end())
+            return false;
+        fn(std::string_view(it->second));
+        return true;
+    }
+
+private:
+    std::unordered_map<std::string, std::string>    m_map;
+    std::shared_mutex                               m_mutex;
+};
+
+/**
+ * @brief the data store as it was before its readers took no lock, a
+ * HashTable under a reader-writer lock
+ * 
+ */
+class SharedLockStore
+{
+public:
+    bool set(const std::string& key, const std::string& value)
+    {
+        HashNode* pnode = HashNode::create(key, value, m_table.hash(key));
+        HashNode* previous;
+        {
+            std::unique_lock lock(m_mutex);
+            previous = m_table.insert(pnode);
+        }
+        if (previous)
+            HashNode::destroy(previous);
+        return true;
+    }
+
+    template<typename F>
+    bool with_value(const std::string& key, F&& fn)
+    {
+        uint64_t hash = m_table.hash(key);
+        std::shared_lock lock(m_mutex);
+        const HashNode* pnode = m_table.find(key, hash);
+        if (!pnode)
+            return false;
+        fn(pnode->value());
+        return true;
+    }
+
+private:
+    HashTable                                       m_table;
+    std::shared_mutex                               m_mutex;
+};
+
+/**
+ * @brief run 99% GET and 1% SET on one store from several threads
+ * 
+ * @param name the name of the store in the report
+ * @param keys the keys, they are all set first
+ * @param seconds how long to run
+ * @param max_threads the largest number of threads
+ */
+template<typename Store>
+static void bench_reads(
+    const char*                     name,
+    const std::vector<std::string>& keys,
+    double                          seconds,
+    int                             max_threads)
+{
+    auto pstore = std::make_unique<Store>();
+    std::string value = "value:12";
+    for (auto& key: keys)
+        pstore->set(key, value);
+
+    for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+    {
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> total(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; t++)
+        {
+            threads.emplace_back([&, t]() {
+                std::mt19937_64 rng(t);
+                std::vector<uint32_t> indexes(BENCH_OPS_PER_THREAD);
+                for (auto& index: indexes)
+                    index = rng() % keys.size();
+
+                uint64_t done = 0;
+                char buffer[64];
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    for (size_t i = 0; i < indexes.size(); i++)
+                    {
+                        auto& key = keys[indexes[i]];
+                        if (0 == i % 100)
+                            pstore->set(key, value);
+                        else
+                            pstore->with_value(key, [&](std::string_view v) {
+                                memcpy(buffer, v.data(), std::min(v.length(), sizeof(buffer)));
+                            });
+                    }
+                    done += indexes.size();
+                }
+                total += done;
+            });
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+        for (auto& thread: threads)
+            thread.join();
+        double elapsed = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start).count();
+        printf("%-20s %8d %14.0f\n", name, num_threads, total / elapsed);
+    }
+}
+
+/**
+ * @brief print the percentiles of latencies
+ * 
+ * @param name the name of the store in the report
+ * @param op the operation measured
+ * @param num_keys the number of keys
+ * @param latencies the latencies in nanoseconds, they are sorted
+ */
+static void print_latencies(
+    const char*             name,
+    const char*             op,
+    size_t                  num_keys,
+    std::vector<uint64_t>&  latencies)
+{
+    if (latencies.empty())
+        return;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))] / 1000.0;
+    };
+    printf("%-20s %4s %10zu %10.1f %10.1f %10.1f %10.1f\n",
+        name, op, num_keys, percentile(0.5), percentile(0.99), percentile(0.999),
+        latencies.back() / 1000.0);
+}
+
+/**
+ * @brief set keys in an empty store at BENCH_GROWTH_RATE, while
+ * BENCH_GROWTH_READERS threads get the keys already set at
+ * BENCH_GROWTH_READ_RATE each, and report the percentiles of the
+ * latency of both. The threads yield while they wait for their next
+ * operation, so that they also share a few cores.
+ * 
+ * @param name the name of the store in the report
+ * @param keys the keys
+ */
+template<typename Store>
+static void bench_growth(const char* name, const std::vector<std::string>& keys)
+{
+    using clock = std::chrono::steady_clock;
+    auto pstore = std::make_unique<Store>();
+    std::vector<uint64_t> latencies(keys.size());
+    std::vector<std::vector<uint64_t> > read_latencies(BENCH_GROWTH_READERS);
+    auto interval = std::chrono::nanoseconds(1000000000 / BENCH_GROWTH_RATE);
+    auto read_interval = std::chrono::nanoseconds(1000000000 / BENCH_GROWTH_READ_RATE);
+    std::atomic<size_t> num_set(0);
+    std::atomic<bool> stop(false);
+
+    auto start = clock::now();
+    std::vector<std::thread> readers;
+    for (int t = 0; t < BENCH_GROWTH_READERS; t++)
+    {
+        readers.emplace_back([&, t]() {
+            std::mt19937_64 rng(t);
+            auto& reader_latencies = read_latencies[t];
+            char buffer[64];
+            for (size_t i = 0; !stop.load(std::memory_order_relaxed); i++)
+            {
+                auto scheduled = start + read_interval * i;
+                while (clock::now() < scheduled)
+                    std::this_thread::yield();
+
+                size_t count = num_set.load(std::memory_order_acquire);
+                if (!count)
+                    continue;
+                pstore->with_value(keys[rng() % count], [&](std::string_view v) {
+                    memcpy(buffer, v.data(), std::min(v.length(), sizeof(buffer)));
+                });
+                reader_latencies.push_back(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock::now() - scheduled).count());
+            }
+        });
+    }
+
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        auto scheduled = start + interval * i;
+        while (clock::now() < scheduled)
+            std::this_thread::yield();
+        pstore->set(keys[i], std::string("value:12"));
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock::now() - scheduled).count();
+        num_set.store(i + 1, std::memory_order_release);
+    }
+
+    stop = true;
+    for (auto& reader: readers)
+        reader.join();
+
+    std::vector<uint64_t> all_reads;
+    for (auto& reader_latencies: read_latencies)
+        all_reads.insert(all_reads.end(), reader_latencies.begin(), reader_latencies.end());
+
+    print_latencies(name, "SET", keys.size(), latencies);
+    print_latencies(name, "GET", keys.size(), all_reads);
+}
+
+/**
+ * @brief compare HashTable with std::unordered_map
+ * 
+ * @param seconds time per measurement
+ * @param num_keys number of keys
+ */
+static void bench_engines(double seconds, size_t num_keys)
+{
+    std::vector<std::string> keys;
+    std::vector<uint32_t> order;
+    for (size_t i = 0; i < num_keys; i++)
+    {
+        keys.push_back("user:" + std::to_string(i));
+        order.push_back((uint32_t)i);
+    }
+    std::mt19937_64 rng(2);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    printf("\n%-20s %10s %14s %12s\n", "engine", "keys", "lookups/s", "bytes/key");
+    bench_engine<std::unordered_map<std::string, std::string> >(
+        "std::unordered_map", keys, order, seconds,
+        [](auto& map, const std::string& key, std::string&& value) {
+            map[key] = std::move(value);
+        },
+        [](auto& map, const std::string& key) {
+            return map.find(key) != map.end();
+        });
+    bench_engine<HashTable>(
+        "HashTable", keys, order, seconds,
+        [](auto& table, const std::string& key, std::string&& value) {
+            HashNode* previous = table.insert(
+                                    HashNode::create(key, std::move(value), table.hash(key)));
+            if (previous)
+                HashNode::destroy(previous);
+        },
+        [](auto& table, const std::string& key) {
+            return nullptr != table.find(key, table.hash(key));
+        });
+
+    printf("\n%-20s %4s %10s %10s %10s %10s %10s\n",
+        "growth", "op", "keys", "p50 us", "p99 us", "p99.9 us", "max us");
+    bench_growth<MapStore>("std::unordered_map", keys);
+    bench_growth<DataStore>("DataStore", keys);
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.5;
+    int max_threads = (argc > 2) ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+    long num_keys = (argc > 3) ? atol(argv[3]) : 1000000;
+    if (seconds <= 0 || max_threads <= 0 || num_keys <= 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [seconds per measurement] [max threads]" \
+            " [number of keys]" << std::endl;
+        return 1;
+    }
+
+    const Partitioning partitionings[] = {
+        {"first-char/10", 10, false},
+        {"keyhash/16", 16, true},
+        {"keyhash/64", 64, true},
+    };
+    auto keys = make_keys();
+    uint64_t seed = KeyHash::random_seed();
+    std::mt19937_64 rng(1);
+
+    // The same keys and operations for every partitioning
+    std::vector<std::vector<size_t> > indexes;
+    std::vector<std::vector<bool> > is_set;
+    for (int t = 0; t < max_threads; t++)
+    {
+        indexes.push_back(zipf_indexes(keys.size(), BENCH_OPS_PER_THREAD, rng));
+        is_set.emplace_back();
+        for (int i = 0; i < BENCH_OPS_PER_THREAD; i++)
+            is_set.back().push_back(0 == rng() % 10);
+    }
+
+    printf("%-15s %8s %14s %14s\n", "shards", "threads", "ops/s", "busiest shard");
+    for (auto& partitioning: partitionings)
+    {
+        for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+        {
+            std::vector<std::vector<BenchOp> > ops(num_threads);
+            std::vector<uint64_t> per_shard(partitioning.m_num_shards, 0);
+            for (int t = 0; t < num_threads; t++)
+            {
+                for (int i = 0; i < BENCH_OPS_PER_THREAD; i++)
+                {
+                    auto& key = keys[indexes[t][i]];
+                    size_t shard = partitioning.shard(key, seed);
+                    ops[t].push_back({&key, shard, is_set[t][i]});
+                    per_shard[shard]++;
+                }
+            }
+
+            double ops_per_second = run(partitioning, ops, seconds);
+            double busiest = (double)*std::max_element(per_shard.begin(), per_shard.end()) \
+                / ((double)num_threads * BENCH_OPS_PER_THREAD);
+            printf("%-15s %8d %14.0f %13.1f%%\n",
+                partitioning.m_name, num_threads, ops_per_second, busiest * 100);
+        }
+    }
+
+    bench_engines(seconds, num_keys);
+
+    printf("\n%-20s %8s %14s\n", "reads", "threads", "ops/s");
+    bench_reads<SharedLockStore>("shared lock", keys, seconds, max_threads);
+    bench_reads<DataStore>("epoch", keys, seconds, max_threads);
+    return 0;
+}
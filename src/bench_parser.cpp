@@ -0,0 +1,517 @@
+/**
+ * @file bench_parser.cpp
+ * @brief Measure the RESP parsers on the kinds of input a server
+ * receives, so that a change to a parser can be compared with the
+ * commit before it.
+ * 
+ * Every workload is run through:
+ * 1. RespParser, which builds objects from a complete input, and
+ *    parses an input that arrives in fragments again from the start,
+ * 2. RespStreamParser::parse_command(), which the server uses, and
+ *    continues where it stopped, for the workloads made of commands.
+ * 
+ * For each one the benchmark reports the commands and the megabytes
+ * per second, the percentiles of the time per command, and the
+ * number of heap allocations per command. The time is measured over
+ * batches of at least BENCH_BATCH_COMMANDS commands, so that reading
+ * the clock does not weigh on the small commands.
+ * 
+ * Usage: ./bench_parser [seconds per measurement] [--json file]
+ * With --json the results are also written as JSON to the file, or
+ * to the standard output if the file is "-", the table then goes to
+ * the standard error.
+ * 
+ */
+#include "common_include.h"
+#include "resp_parser.h"
+#include "resp_scan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+/**
+ * @brief the minimum number of commands timed together
+ * 
+ */
+#define BENCH_BATCH_COMMANDS 32
+
+/**
+ * @brief number of heap allocations made by the program
+ * 
+ */
+static size_t num_allocations = 0;
+
+void* operator new(size_t size)
+{
+    num_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+/**
+ * @brief keeps the compiler from dropping the work that is measured
+ * 
+ */
+static volatile size_t sink;
+
+/**
+ * @brief the parsers that are measured
+ * 
+ */
+typedef enum {
+    BENCH_RESP_PARSER = 0,
+    BENCH_COMMAND_PARSER,
+    BENCH_NUM_PARSERS
+} bench_parser_t;
+
+static const char* parser_names[] = {"RespParser", "command"};
+
+/**
+ * @brief inputs of one kind
+ * 
+ */
+struct Workload
+{
+    /**
+     * @brief name of the workload in the results
+     * 
+     */
+    std::string                 m_name;
+
+    /**
+     * @brief the inputs, each one is parsed completely before the
+     * next one, the way the data of one read is
+     * 
+     */
+    std::vector<std::string>    m_inputs;
+
+    /**
+     * @brief number of commands in each input
+     * 
+     */
+    size_t                      m_commands_per_input;
+
+    /**
+     * @brief the input arrives this many bytes at a time, 0 if it
+     * arrives at once
+     * 
+     */
+    size_t                      m_fragment;
+
+    /**
+     * @brief the commands are arrays of bulk strings, that
+     * parse_command() accepts
+     * 
+     */
+    bool                        m_is_command;
+};
+
+/**
+ * @brief the result of running one parser on one workload
+ * 
+ */
+struct BenchResult
+{
+    std::string                 m_workload;
+    const char*                 m_parser;
+    size_t                      m_commands;
+    double                      m_commands_per_sec;
+    double                      m_mb_per_sec;
+    double                      m_p50;
+    double                      m_p90;
+    double                      m_p99;
+    double                      m_allocations_per_command;
+};
+
+/**
+ * @brief encode a command the way clients send it
+ * 
+ * @param args the command and its arguments
+ * @return std::string the command
+ */
+static std::string encode(const std::vector<std::string>& args)
+{
+    std::string command = "*" + std::to_string(args.size()) + "\r\n";
+    for (auto& arg: args)
+        command += RespBulkString::encode(arg);
+    return command;
+}
+
+/**
+ * @brief SET and GET, one after the other, on different keys
+ * 
+ * @param count number of commands
+ * @param value_size size of the values
+ * @return std::vector<std::string> the commands
+ */
+static std::vector<std::string> get_set_commands(size_t count, size_t value_size)
+{
+    std::vector<std::string> commands;
+    for (size_t i = 0; i < count; i++)
+    {
+        std::string key = "key:" + std::to_string(i % 1000);
+        if (i % 2)
+            commands.push_back(encode({"GET", key}));
+        else
+            commands.push_back(encode({"SET", key, std::string(value_size, 'a' + i % 26)}));
+    }
+    return commands;
+}
+
+/**
+ * @brief concatenate commands into inputs of a given number of
+ * commands each
+ * 
+ * @param commands the commands
+ * @param per_input number of commands in an input
+ * @return std::vector<std::string> the inputs
+ */
+static std::vector<std::string> pipeline(
+    const std::vector<std::string>&     commands,
+    size_t                              per_input)
+{
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i + per_input <= commands.size(); i += per_input)
+    {
+        std::string input;
+        for (size_t j = i; j < i + per_input; j++)
+            input += commands[j];
+        inputs.push_back(input);
+    }
+    return inputs;
+}
+
+/**
+ * @brief arrays nested in arrays, with a bulk string at every level
+ * 
+ * @param depth number of levels
+ * @return std::string the array
+ */
+static std::string deep_array(int depth)
+{
+    std::string array;
+    for (int i = 0; i < depth; i++)
+        array += "*2\r\n$5\r\nlevel\r\n";
+    return array + "$4\r\nleaf\r\n";
+}
+
+/**
+ * @brief the workloads that are measured
+ * 
+ * @return std::vector<Workload> the workloads
+ */
+static std::vector<Workload> make_workloads()
+{
+    std::vector<Workload> workloads;
+
+    workloads.push_back({"small_get_set", get_set_commands(1024, 16), 1, 0, true});
+    workloads.push_back({"value_4k", get_set_commands(128, 4 << 10), 1, 0, true});
+    workloads.push_back({"value_64k", get_set_commands(16, 64 << 10), 1, 0, true});
+
+    std::vector<std::string> keys = {"DEL"};
+    for (int i = 0; i < 128; i++)
+        keys.push_back("key:" + std::to_string(i));
+    workloads.push_back({"wide_array_128", {encode(keys)}, 1, 0, true});
+
+    workloads.push_back({"deep_array_32", {deep_array(32)}, 1, 0, false});
+    workloads.push_back({"pipelined_64", pipeline(get_set_commands(1024, 16), 64), 64, 0, true});
+    workloads.push_back({"fragmented_16b", pipeline(get_set_commands(1024, 16), 16), 16, 16, true});
+    workloads.push_back({"fragmented_4k_value", get_set_commands(128, 4 << 10), 1, 1460, true});
+
+    return workloads;
+}
+
+/**
+ * @brief parse one input completely with RespParser. An input that
+ * arrives in fragments is parsed again from the start after every
+ * fragment, until it is complete.
+ * 
+ * @param input the input
+ * @param fragment size of the fragments, 0 for none
+ * @return size_t the number of commands parsed
+ */
+static size_t run_resp_parser(const std::string& input, size_t fragment)
+{
+    size_t available = fragment ? std::min(fragment, input.length()) : input.length();
+    size_t start = 0;
+    size_t commands = 0;
+
+    while (start < input.length())
+    {
+        RespParser parser(input.substr(start, available - start));
+        size_t parsed = 0;
+        while (parser.has_more_input())
+        {
+            auto [err, obj] = parser.get_generic_object();
+            if (ERROR_CURRENT_BEYOND_END == err)
+                break;
+            if (ERROR_SUCCESS != err)
+            {
+                std::cerr << "RespParser error " << err << std::endl;
+                exit(1);
+            }
+            commands++;
+            parsed = parser.get_parsed_length();
+        }
+
+        start += parsed;
+        if (start == input.length())
+            break;
+        if (available == input.length())
+        {
+            std::cerr << "RespParser could not parse the end of the input" << std::endl;
+            exit(1);
+        }
+        available = std::min(available + fragment, input.length());
+    }
+
+    return commands;
+}
+
+/**
+ * @brief parse one input completely with
+ * RespStreamParser::parse_command(), giving it more of the input
+ * after every fragment
+ * 
+ * @param parser the parser
+ * @param argv receives the arguments
+ * @param input the input
+ * @param fragment size of the fragments, 0 for none
+ * @return size_t the number of commands parsed
+ */
+static size_t run_stream_parser(
+    RespStreamParser&                   parser,
+    std::vector<std::string_view>&      argv,
+    const std::string&                  input,
+    size_t                              fragment)
+{
+    size_t available = fragment ? std::min(fragment, input.length()) : input.length();
+    size_t commands = 0;
+
+    parser.reset();
+    while (true)
+    {
+        auto err = parser.parse_command(input.data(), available, argv);
+        if (ERROR_SUCCESS == err)
+        {
+            commands++;
+            continue;
+        }
+
+        if (ERROR_CURRENT_BEYOND_END != err)
+        {
+            std::cerr << "RespStreamParser error " << err << std::endl;
+            exit(1);
+        }
+
+        if (available == input.length())
+            break;
+        available = std::min(available + fragment, input.length());
+    }
+
+    return commands;
+}
+
+/**
+ * @brief the value at a percentile of sorted samples
+ * 
+ * @param sorted the samples, sorted
+ * @param percentile the percentile, from 0 to 100
+ * @return double the value
+ */
+static double percentile(const std::vector<double>& sorted, double percentile)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = (size_t)(percentile / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+/**
+ * @brief run a parser on a workload until the time is up
+ * 
+ * @param workload the workload
+ * @param which the parser
+ * @param seconds how long to run it
+ * @return BenchResult the result
+ */
+static BenchResult run(const Workload& workload, bench_parser_t which, double seconds)
+{
+    RespStreamParser parser;
+    std::vector<std::string_view> argv;
+    std::vector<double> samples;
+    samples.reserve(1 << 20);
+
+    size_t commands = 0;
+    size_t bytes = 0;
+    size_t allocations = 0;
+    double elapsed = 0;
+    size_t next = 0;
+
+    while (elapsed < seconds && samples.size() < samples.capacity())
+    {
+        size_t batch_commands = 0;
+        size_t batch_bytes = 0;
+        size_t allocations_before = num_allocations;
+        auto start = std::chrono::steady_clock::now();
+
+        while (batch_commands < BENCH_BATCH_COMMANDS)
+        {
+            auto& input = workload.m_inputs[next];
+            next = (next + 1) % workload.m_inputs.size();
+
+            size_t parsed;
+            if (BENCH_RESP_PARSER == which)
+                parsed = run_resp_parser(input, workload.m_fragment);
+            else
+                parsed = run_stream_parser(
+                            parser, argv, input, workload.m_fragment);
+
+            if (parsed != workload.m_commands_per_input)
+            {
+                std::cerr << workload.m_name << ": " << parser_names[which] \
+                    << " parsed " << parsed << " commands instead of " \
+                    << workload.m_commands_per_input << std::endl;
+                exit(1);
+            }
+            batch_commands += parsed;
+            batch_bytes += input.length();
+        }
+
+        double batch_seconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start).count();
+        allocations += num_allocations - allocations_before;
+
+        samples.push_back(batch_seconds * 1e9 / batch_commands);
+        commands += batch_commands;
+        bytes += batch_bytes;
+        elapsed += batch_seconds;
+    }
+    sink = argv.size();
+
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.m_workload = workload.m_name;
+    result.m_parser = parser_names[which];
+    result.m_commands = commands;
+    result.m_commands_per_sec = commands / elapsed;
+    result.m_mb_per_sec = bytes / elapsed / 1e6;
+    result.m_p50 = percentile(samples, 50);
+    result.m_p90 = percentile(samples, 90);
+    result.m_p99 = percentile(samples, 99);
+    result.m_allocations_per_command = (double)allocations / commands;
+    return result;
+}
+
+/**
+ * @brief print a result as a line of the table
+ * 
+ * @param table where the table is printed
+ * @param result the result
+ */
+static void print_result(FILE* table, const BenchResult& result)
+{
+    fprintf(table, "%-20s %-11s %12.0f %10.1f %9.1f %9.1f %9.1f %10.2f\n",
+        result.m_workload.c_str(), result.m_parser,
+        result.m_commands_per_sec, result.m_mb_per_sec,
+        result.m_p50, result.m_p90, result.m_p99,
+        result.m_allocations_per_command);
+}
+
+/**
+ * @brief write the results as JSON
+ * 
+ * @param out where to write them
+ * @param results the results
+ */
+static void write_json(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << std::fixed << std::setprecision(3);
+    out << "{" << std::endl;
+    out << "  \"kernel\": \"" << RespScanner::kernel_name(RespScanner::get_kernel()) << "\"," << std::endl;
+    out << "  \"batch_commands\": " << BENCH_BATCH_COMMANDS << "," << std::endl;
+    out << "  \"results\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        auto& result = results[i];
+        out << "    {\"workload\": \"" << result.m_workload << "\"" \
+            << ", \"parser\": \"" << result.m_parser << "\"" \
+            << ", \"commands\": " << result.m_commands \
+            << ", \"commands_per_sec\": " << result.m_commands_per_sec \
+            << ", \"mb_per_sec\": " << result.m_mb_per_sec \
+            << ", \"p50_ns\": " << result.m_p50 \
+            << ", \"p90_ns\": " << result.m_p90 \
+            << ", \"p99_ns\": " << result.m_p99 \
+            << ", \"allocations_per_command\": " << result.m_allocations_per_command \
+            << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "  ]" << std::endl;
+    out << "}" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = 0.2;
+    const char* json_path = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--json") && i + 1 < argc)
+            json_path = argv[++i];
+        else
+            seconds = atof(argv[i]);
+    }
+
+    if (seconds <= 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [seconds per measurement] [--json file]" << std::endl;
+        return 1;
+    }
+
+    FILE* table = (json_path && 0 == strcmp(json_path, "-")) ? stderr : stdout;
+    std::vector<BenchResult> results;
+    fprintf(table, "%-20s %-11s %12s %10s %9s %9s %9s %10s\n",
+        "workload", "parser", "commands/s", "MB/s", "p50 ns", "p90 ns", "p99 ns", "allocs/cmd");
+
+    for (auto& workload: make_workloads())
+    {
+        for (int which = 0; which < BENCH_NUM_PARSERS; which++)
+        {
+            if (BENCH_COMMAND_PARSER == which && !workload.m_is_command)
+                continue;
+            results.push_back(run(workload, (bench_parser_t)which, seconds));
+            print_result(table, results.back());
+        }
+    }
+
+    if (json_path && 0 == strcmp(json_path, "-"))
+        write_json(std::cout, results);
+    else if (json_path)
+    {
+        std::ofstream out(json_path);
+        if (!out)
+        {
+            std::cerr << "Could not open " << json_path << std::endl;
+            return 1;
+        }
+        write_json(out, results);
+    }
+
+    return 0;
+}
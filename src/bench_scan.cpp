@@ -0,0 +1,218 @@
+/**
+ * @file bench_scan.cpp
+ * @brief Measure the throughput of the scanning kernels of the RESP
+ * parsers, and of the parsers that use them.
+ * 
+ * For values from 16 KB to 1 MB, the benchmark reports in GB/s:
+ * 1. the search for CR and LF with every kernel the CPU supports,
+ * 2. RespParser on a SET command with the value, the way the
+ *    parser tests build their inputs, with every kernel.
+ * It also compares the parsing of the length headers with strtol
+ * and with RespScanner::parse_decimal().
+ * 
+ * Usage: ./bench_scan [seconds per measurement]
+ * 
+ */
+#include "common_include.h"
+#include "resp_parser.h"
+#include "resp_scan.h"
+
+#include <chrono>
+#include <cstring>
+
+/**
+ * @brief the sizes of the values, in bytes
+ * 
+ */
+static const size_t value_sizes[] = {16 << 10, 64 << 10, 256 << 10, 1 << 20};
+
+/**
+ * @brief keeps the compiler from dropping the work that is measured
+ * 
+ */
+static volatile size_t sink;
+
+/**
+ * @brief run a function until the time is up
+ * 
+ * @param seconds how long to run it
+ * @param fn the function, it returns the number of bytes it went
+ * through
+ * @return double the throughput in GB/s
+ */
+template<typename F>
+static double measure(double seconds, F fn)
+{
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+
+    do
+    {
+        for (int i = 0; i < 16; i++)
+            bytes += fn();
+        elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < seconds);
+
+    return bytes / elapsed / 1e9;
+}
+
+/**
+ * @brief the kernels that the CPU supports
+ * 
+ * @return std::vector<resp_scan_kernel_t> the kernels
+ */
+static std::vector<resp_scan_kernel_t> supported_kernels()
+{
+    std::vector<resp_scan_kernel_t> kernels;
+    for (int kernel = 0; kernel < RESP_SCAN_NUM_KERNELS; kernel++)
+    {
+        if (RespScanner::is_supported((resp_scan_kernel_t)kernel))
+            kernels.push_back((resp_scan_kernel_t)kernel);
+    }
+    return kernels;
+}
+
+/**
+ * @brief print the throughput of every kernel, and the gain of the
+ * best one over the scalar one
+ * 
+ * @param size the size of the value
+ * @param results the throughput of every kernel
+ */
+static void print_results(
+    size_t                                          size,
+    const std::vector<std::pair<resp_scan_kernel_t, double> >&  results)
+{
+    std::cout << "  " << (size >> 10) << " KB:";
+    for (auto& [kernel, gbps]: results)
+        std::cout << " " << RespScanner::kernel_name(kernel) << " " << gbps << " GB/s";
+    if (results.size() > 1 && results.front().second > 0)
+        std::cout << " (" << results.back().second / results.front().second << "x)";
+    std::cout << std::endl;
+}
+
+/**
+ * @brief the search for CR and LF in a value that has none
+ * 
+ * @param seconds time per measurement
+ */
+static void bench_kernels(double seconds)
+{
+    std::cout << "CR/LF search:" << std::endl;
+    for (size_t size: value_sizes)
+    {
+        std::string value(size, 'x');
+        std::vector<std::pair<resp_scan_kernel_t, double> > results;
+
+        for (auto kernel: supported_kernels())
+        {
+            double gbps = measure(seconds, [&]() {
+                const char* found = RespScanner::find_line_break(
+                                        kernel, value.data(), value.data() + size);
+                sink = found - value.data();
+                return size;
+            });
+            results.push_back({kernel, gbps});
+        }
+        print_results(size, results);
+    }
+}
+
+/**
+ * @brief RespParser on a SET command that carries a value
+ * 
+ * @param seconds time per measurement
+ */
+static void bench_parser(double seconds)
+{
+    std::cout << "RespParser, SET with a value:" << std::endl;
+    auto initial = RespScanner::get_kernel();
+    for (size_t size: value_sizes)
+    {
+        std::string command = "*3\r\n$3\r\nset\r\n$1\r\nx\r\n$" \
+            + std::to_string(size) + "\r\n" + std::string(size, 'x') + "\r\n";
+        std::vector<std::pair<resp_scan_kernel_t, double> > results;
+
+        for (auto kernel: supported_kernels())
+        {
+            RespScanner::set_kernel(kernel);
+            double gbps = measure(seconds, [&]() {
+                RespParser parser(command);
+                auto [err, obj] = parser.get_generic_object();
+                if (ERROR_SUCCESS != err)
+                {
+                    std::cerr << "Parse error " << err << std::endl;
+                    exit(1);
+                }
+                sink = parser.get_parsed_length();
+                return command.length();
+            });
+            results.push_back({kernel, gbps});
+        }
+        print_results(size, results);
+    }
+    RespScanner::set_kernel(initial);
+}
+
+/**
+ * @brief the length headers of bulk strings, with strtol and with
+ * the bounded parser
+ * 
+ * @param seconds time per measurement
+ */
+static void bench_headers(double seconds)
+{
+    std::string headers;
+    for (int i = 0; i < 4096; i++)
+        headers += std::to_string((i * 7919) % 100000) + "\r\n";
+    const char* begin = headers.data();
+    const char* end = begin + headers.length();
+
+    double with_strtol = measure(seconds, [&]() {
+        size_t total = 0;
+        for (const char* p = begin; p < end;)
+        {
+            char* next;
+            total += strtol(p, &next, 10);
+            p = next + 2;
+        }
+        sink = total;
+        return headers.length();
+    });
+
+    double with_scanner = measure(seconds, [&]() {
+        size_t total = 0;
+        for (const char* p = begin; p < end;)
+        {
+            long value;
+            const char* next;
+            RespScanner::parse_decimal(p, end, value, next);
+            total += value;
+            p = next + 2;
+        }
+        sink = total;
+        return headers.length();
+    });
+
+    std::cout << "Length headers: strtol " << with_strtol << " GB/s, parse_decimal " \
+        << with_scanner << " GB/s (" << with_scanner / with_strtol << "x)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.2;
+    if (seconds <= 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [seconds per measurement]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Default kernel: " \
+        << RespScanner::kernel_name(RespScanner::get_kernel()) << std::endl;
+    bench_kernels(seconds);
+    bench_parser(seconds);
+    bench_headers(seconds);
+    return 0;
+}
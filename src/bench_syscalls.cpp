@@ -0,0 +1,280 @@
+/**
+ * @file bench_syscalls.cpp
+ * @brief Compare the system calls made per request, and the latency,
+ * of the network backends and execution modes.
+ * 
+ * For every configuration the benchmark starts ./server, opens a
+ * number of client connections that each run SET and GET requests in
+ * a loop, and reads the syscall counters reported by the INFO command
+ * before and after the load. The latency of every request is measured
+ * by the client.
+ * 
+ * Usage: ./bench_syscalls [connections] [requests per connection]
+ * 
+ */
+#include "common_include.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <cstring>
+#include <map>
+
+#define BENCH_PORT 6379
+
+/**
+ * @brief the counters of INFO that the benchmark reports
+ * 
+ */
+static const char* counter_names[] = {
+    "syscalls_accept",
+    "syscalls_read",
+    "syscalls_write",
+    "syscalls_epoll_wait",
+    "syscalls_epoll_ctl",
+    "syscalls_io_uring_enter",
+    "syscalls_other"
+};
+
+/**
+ * @brief connect to the server, retrying while it starts up
+ * 
+ * @return int the connected socket, -1 on failure
+ */
+static int connect_to_server()
+{
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(BENCH_PORT);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (0 == connect(fd, (struct sockaddr*)&address, sizeof(address)))
+        {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return fd;
+        }
+        close(fd);
+        usleep(50000);
+    }
+    return -1;
+}
+
+/**
+ * @brief send a request and read the response
+ * 
+ * A response is complete when it ends with CRLF and, for a bulk
+ * string, when the announced length has been received.
+ * 
+ * @param fd the connection
+ * @param request the encoded request
+ * @param response receives the response
+ * @return true on success
+ * @return false if the connection failed
+ */
+static bool round_trip(int fd, const std::string& request, std::string& response)
+{
+    size_t sent = 0;
+    while (sent < request.length())
+    {
+        ssize_t n = write(fd, request.data() + sent, request.length() - sent);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+
+    response.clear();
+    char buffer[4096];
+    while (true)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+            return false;
+        response.append(buffer, n);
+
+        size_t eol = response.find("\r\n");
+        if (std::string::npos == eol)
+            continue;
+        if ('$' != response[0])
+            return true;
+
+        long length = atol(response.c_str() + 1);
+        if (length < 0 || response.length() >= eol + 2 + length + 2)
+            return true;
+    }
+}
+
+/**
+ * @brief encode a command as a RESP array of bulk strings
+ * 
+ * @param args the command and its arguments
+ * @return std::string the encoded command
+ */
+static std::string encode(const std::vector<std::string>& args)
+{
+    std::stringstream ss;
+    ss << "*" << args.size() << "\r\n";
+    for (auto& arg: args)
+        ss << "$" << arg.length() << "\r\n" << arg << "\r\n";
+    return ss.str();
+}
+
+/**
+ * @brief read the counters reported by INFO
+ * 
+ * @return std::map<std::string, uint64_t> counter name to value
+ */
+static std::map<std::string, uint64_t> read_counters()
+{
+    std::map<std::string, uint64_t> counters;
+    std::string response;
+
+    int fd = connect_to_server();
+    if (fd < 0 || !round_trip(fd, encode({"info"}), response))
+    {
+        std::cerr << "INFO failed" << std::endl;
+        exit(1);
+    }
+    close(fd);
+
+    std::stringstream ss(response);
+    std::string line;
+    while (std::getline(ss, line))
+    {
+        size_t colon = line.find(':');
+        if (std::string::npos != colon)
+            counters[line.substr(0, colon)] = strtoull(line.c_str() + colon + 1, nullptr, 10);
+    }
+    return counters;
+}
+
+/**
+ * @brief run the benchmark against one server configuration
+ * 
+ * @param name the name of the configuration
+ * @param args the command line options of the server
+ * @param connections number of concurrent client connections
+ * @param requests requests sent on every connection
+ */
+static void run_benchmark(
+    const char*                     name,
+    std::vector<const char*>        args,
+    int                             connections,
+    int                             requests)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        exit(1);
+    }
+    if (0 == pid)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        args.insert(args.begin(), "./server");
+        args.push_back(nullptr);
+        execv("./server", (char* const*)args.data());
+        _exit(127);
+    }
+
+    auto before = read_counters();
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> clients;
+    std::vector<std::vector<double> > latencies(connections);
+    std::atomic<int> failures(0);
+    for (int c = 0; c < connections; c++)
+    {
+        clients.emplace_back([c, requests, &failures, &latencies]() {
+            int fd = connect_to_server();
+            if (fd < 0)
+            {
+                failures++;
+                return;
+            }
+
+            std::string response;
+            for (int i = 0; i < requests; i++)
+            {
+                std::string key = "bench:" + std::to_string(c) + ":" + std::to_string(i % 100);
+                auto request = (i & 1) ? encode({"get", key}) : encode({"set", key, "value"});
+                auto sent = std::chrono::steady_clock::now();
+                if (!round_trip(fd, request, response))
+                {
+                    failures++;
+                    break;
+                }
+                latencies[c].push_back(std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - sent).count());
+            }
+            close(fd);
+        });
+    }
+    for (auto& t: clients)
+        t.join();
+
+    auto elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+    auto after = read_counters();
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    double total = (double)connections * requests;
+    uint64_t commands = after["total_commands_processed"] - before["total_commands_processed"];
+    double all = 0;
+
+    std::vector<double> all_latencies;
+    for (auto& l: latencies)
+        all_latencies.insert(all_latencies.end(), l.begin(), l.end());
+    std::sort(all_latencies.begin(), all_latencies.end());
+
+    std::cout << name << ": " << commands << " commands, " \
+        << (uint64_t)(total / elapsed) << " req/s" << std::endl;
+    if (all_latencies.size())
+    {
+        std::cout << "  latency p50: " << all_latencies[all_latencies.size() / 2] \
+            << " us, p99: " << all_latencies[all_latencies.size() * 99 / 100] \
+            << " us" << std::endl;
+    }
+    if (failures)
+        std::cout << "  " << failures << " connections failed" << std::endl;
+    for (auto name: counter_names)
+    {
+        double per_request = (after[name] - before[name]) / total;
+        all += per_request;
+        std::cout << "  " << name << " per request: " << per_request << std::endl;
+    }
+    std::cout << "  total syscalls per request: " << all << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    int connections = (argc > 1) ? atoi(argv[1]) : 16;
+    int requests = (argc > 2) ? atoi(argv[2]) : 5000;
+
+    if (connections <= 0 || requests <= 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [connections] [requests]" << std::endl;
+        return 1;
+    }
+
+    run_benchmark("epoll", {"--backend", "epoll"}, connections, requests);
+    run_benchmark("epoll run-to-completion",
+        {"--backend", "epoll", "--execution", "run-to-completion"},
+        connections, requests);
+    run_benchmark("io_uring", {"--backend", "io_uring"}, connections, requests);
+    return 0;
+}
@@ -0,0 +1,319 @@
+/**
+ * @file bench_transport.cpp
+ * @brief Compare the throughput and the latency of clients that
+ * connect over TCP on the loopback interface with clients that
+ * connect over the Unix domain socket.
+ * 
+ * For every server configuration the benchmark starts ./server with
+ * a Unix domain socket, runs the same load over TCP and then over
+ * the Unix domain socket, and reports both. Every client connection
+ * runs SET and GET requests in a loop, one request at a time, so the
+ * latency is a full round trip through the transport.
+ * 
+ * Usage: ./bench_transport [connections] [requests per connection]
+ * 
+ */
+#include "common_include.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <cstring>
+
+#define BENCH_PORT 6379
+#define BENCH_UNIX_SOCKET "/tmp/bench_transport.sock"
+
+/**
+ * @brief the result of running the load over one transport
+ * 
+ */
+struct TransportResult
+{
+    double                      m_requests_per_sec;
+    double                      m_p50;
+    double                      m_p99;
+    int                         m_failures;
+};
+
+/**
+ * @brief connect to the server, retrying while it starts up
+ * 
+ * @param is_unix connect to the Unix domain socket instead of TCP
+ * @return int the connected socket, -1 on failure
+ */
+static int connect_to_server(bool is_unix)
+{
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        int fd = socket(is_unix ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+
+        int rc;
+        if (is_unix)
+        {
+            struct sockaddr_un address;
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            strncpy(address.sun_path, BENCH_UNIX_SOCKET, sizeof(address.sun_path) - 1);
+            rc = connect(fd, (struct sockaddr*)&address, sizeof(address));
+        }
+        else
+        {
+            struct sockaddr_in address;
+            memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_port = htons(BENCH_PORT);
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            rc = connect(fd, (struct sockaddr*)&address, sizeof(address));
+        }
+
+        if (0 == rc)
+        {
+            int one = 1;
+            if (!is_unix)
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return fd;
+        }
+        close(fd);
+        usleep(50000);
+    }
+    return -1;
+}
+
+/**
+ * @brief send a request and read the response
+ * 
+ * A response is complete when it ends with CRLF and, for a bulk
+ * string, when the announced length has been received.
+ * 
+ * @param fd the connection
+ * @param request the encoded request
+ * @param response receives the response
+ * @return true on success
+ * @return false if the connection failed
+ */
+static bool round_trip(int fd, const std::string& request, std::string& response)
+{
+    size_t sent = 0;
+    while (sent < request.length())
+    {
+        ssize_t n = write(fd, request.data() + sent, request.length() - sent);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+
+    response.clear();
+    char buffer[4096];
+    while (true)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+            return false;
+        response.append(buffer, n);
+
+        size_t eol = response.find("\r\n");
+        if (std::string::npos == eol)
+            continue;
+        if ('$' != response[0])
+            return true;
+
+        long length = atol(response.c_str() + 1);
+        if (length < 0 || response.length() >= eol + 2 + length + 2)
+            return true;
+    }
+}
+
+/**
+ * @brief encode a command as a RESP array of bulk strings
+ * 
+ * @param args the command and its arguments
+ * @return std::string the encoded command
+ */
+static std::string encode(const std::vector<std::string>& args)
+{
+    std::stringstream ss;
+    ss << "*" << args.size() << "\r\n";
+    for (auto& arg: args)
+        ss << "$" << arg.length() << "\r\n" << arg << "\r\n";
+    return ss.str();
+}
+
+/**
+ * @brief read a counter reported by INFO
+ * 
+ * @param name the name of the counter
+ * @return uint64_t its value
+ */
+static uint64_t read_counter(const std::string& name)
+{
+    std::string response;
+
+    int fd = connect_to_server(false);
+    if (fd < 0 || !round_trip(fd, encode({"info"}), response))
+    {
+        std::cerr << "INFO failed" << std::endl;
+        exit(1);
+    }
+    close(fd);
+
+    size_t pos = response.find(name + ":");
+    if (std::string::npos == pos)
+        return 0;
+    return strtoull(response.c_str() + pos + name.length() + 1, nullptr, 10);
+}
+
+/**
+ * @brief run the load over one transport
+ * 
+ * @param is_unix use the Unix domain socket instead of TCP
+ * @param connections number of concurrent client connections
+ * @param requests requests sent on every connection
+ * @return TransportResult the throughput and the latencies
+ */
+static TransportResult run_load(bool is_unix, int connections, int requests)
+{
+    std::vector<std::thread> clients;
+    std::vector<std::vector<double> > latencies(connections);
+    std::atomic<int> failures(0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < connections; c++)
+    {
+        clients.emplace_back([c, is_unix, requests, &failures, &latencies]() {
+            int fd = connect_to_server(is_unix);
+            if (fd < 0)
+            {
+                failures++;
+                return;
+            }
+
+            std::string response;
+            for (int i = 0; i < requests; i++)
+            {
+                std::string key = "bench:" + std::to_string(c) + ":" + std::to_string(i % 100);
+                auto request = (i & 1) ? encode({"get", key}) : encode({"set", key, "value"});
+                auto sent = std::chrono::steady_clock::now();
+                if (!round_trip(fd, request, response))
+                {
+                    failures++;
+                    break;
+                }
+                latencies[c].push_back(std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - sent).count());
+            }
+            close(fd);
+        });
+    }
+    for (auto& t: clients)
+        t.join();
+
+    auto elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all_latencies;
+    for (auto& l: latencies)
+        all_latencies.insert(all_latencies.end(), l.begin(), l.end());
+    std::sort(all_latencies.begin(), all_latencies.end());
+
+    TransportResult result;
+    result.m_requests_per_sec = all_latencies.size() / elapsed;
+    result.m_p50 = all_latencies.size() ? all_latencies[all_latencies.size() / 2] : 0;
+    result.m_p99 = all_latencies.size() ? all_latencies[all_latencies.size() * 99 / 100] : 0;
+    result.m_failures = failures;
+    return result;
+}
+
+/**
+ * @brief print the result of one transport
+ * 
+ * @param transport the name of the transport
+ * @param result the result
+ */
+static void print_result(const char* transport, const TransportResult& result)
+{
+    std::cout << "  " << transport << ": " << (uint64_t)result.m_requests_per_sec \
+        << " req/s, latency p50: " << result.m_p50 << " us, p99: " \
+        << result.m_p99 << " us" << std::endl;
+    if (result.m_failures)
+        std::cout << "  " << result.m_failures << " connections failed" << std::endl;
+}
+
+/**
+ * @brief run the benchmark against one server configuration
+ * 
+ * @param name the name of the configuration
+ * @param args the command line options of the server
+ * @param connections number of concurrent client connections
+ * @param requests requests sent on every connection
+ */
+static void run_benchmark(
+    const char*                     name,
+    std::vector<const char*>        args,
+    int                             connections,
+    int                             requests)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        exit(1);
+    }
+    if (0 == pid)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        args.insert(args.begin(), "./server");
+        args.push_back("--unixsocket");
+        args.push_back(BENCH_UNIX_SOCKET);
+        args.push_back(nullptr);
+        execv("./server", (char* const*)args.data());
+        _exit(127);
+    }
+
+    uint64_t unix_before = read_counter("total_unix_connections_received");
+    auto tcp = run_load(false, connections, requests);
+    auto local = run_load(true, connections, requests);
+    uint64_t unix_after = read_counter("total_unix_connections_received");
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    unlink(BENCH_UNIX_SOCKET);
+
+    std::cout << name << ":" << std::endl;
+    print_result("tcp ", tcp);
+    print_result("unix", local);
+    if (tcp.m_p50 > 0)
+    {
+        std::cout << "  unix p50 latency is " \
+            << (int)(100 - 100 * local.m_p50 / tcp.m_p50) \
+            << "% lower, " << (unix_after - unix_before) \
+            << " unix connections accepted" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int connections = (argc > 1) ? atoi(argv[1]) : 16;
+    int requests = (argc > 2) ? atoi(argv[2]) : 5000;
+
+    if (connections <= 0 || requests <= 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [connections] [requests]" << std::endl;
+        return 1;
+    }
+
+    run_benchmark("epoll", {"--backend", "epoll"}, connections, requests);
+    run_benchmark("epoll run-to-completion",
+        {"--backend", "epoll", "--execution", "run-to-completion"},
+        connections, requests);
+    run_benchmark("reactor", {"--mode", "reactor"}, connections, requests);
+    run_benchmark("io_uring", {"--backend", "io_uring"}, connections, requests);
+    return 0;
+}
@@ -15,6 +15,7 @@
 #include <atomic>
 #include <new>
 #include <sstream>
+#include <string_view>
 #include <shared_mutex>
 #include <mutex>
 #include <thread>
@@ -0,0 +1,52 @@
+#include "connection_table.h"
+
+ConnectionSlot* ConnectionTable::get_or_create_slot(int fd)
+{
+    if (fd < 0 || fd >= CONNECTION_TABLE_CHUNK_SIZE * CONNECTION_TABLE_MAX_CHUNKS)
+        return nullptr;
+
+    auto& chunk = m_chunks[fd / CONNECTION_TABLE_CHUNK_SIZE];
+    ConnectionSlot* slots = chunk.load(std::memory_order_acquire);
+    if (!slots)
+    {
+        std::unique_lock lock(m_grow_mutex);
+        slots = chunk.load(std::memory_order_acquire);
+        if (!slots)
+        {
+            slots = new (std::nothrow) ConnectionSlot[CONNECTION_TABLE_CHUNK_SIZE];
+            if (!slots)
+            {
+                std::cerr << "Out of memory" << std::endl;
+                exit(1);
+            }
+            chunk.store(slots, std::memory_order_release);
+        }
+    }
+
+    return &slots[fd & (CONNECTION_TABLE_CHUNK_SIZE - 1)];
+}
+
+bool ConnectionTable::insert(int fd, std::shared_ptr<State> pstate)
+{
+    ConnectionSlot* slot = get_or_create_slot(fd);
+    if (!slot)
+        return false;
+
+    pstate->m_generation = slot->m_generation.load(std::memory_order_relaxed) + 1;
+    slot->m_owner = pstate;
+    slot->m_state.store(pstate.get(), std::memory_order_release);
+    slot->m_generation.store(pstate->m_generation, std::memory_order_release);
+    return true;
+}
+
+void ConnectionTable::remove(int fd)
+{
+    ConnectionSlot* slot = const_cast<ConnectionSlot*>(get_slot(fd));
+    if (!slot || !slot->m_state.load(std::memory_order_relaxed))
+        return;
+
+    // Lookups with the old generation fail from here on
+    slot->m_generation.fetch_add(1, std::memory_order_acq_rel);
+    slot->m_state.store(nullptr, std::memory_order_release);
+    slot->m_owner.reset();
+}
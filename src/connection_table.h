@@ -0,0 +1,214 @@
+#ifndef CONNECTION_TABLE_H_
+#define CONNECTION_TABLE_H_
+
+#include "common_include.h"
+#include "state.h"
+
+/**
+ * @brief number of slots allocated at a time, must be a power of 2
+ * 
+ */
+#define CONNECTION_TABLE_CHUNK_SIZE 1024
+
+/**
+ * @brief largest number of chunks, the table holds file descriptors
+ * up to CONNECTION_TABLE_CHUNK_SIZE * CONNECTION_TABLE_MAX_CHUNKS
+ * 
+ */
+#define CONNECTION_TABLE_MAX_CHUNKS 1024
+
+/**
+ * @brief The record of one file descriptor in the connection table.
+ * Every record has its own cache line, so that threads working on
+ * different connections do not share lines.
+ * 
+ */
+struct alignas(64) ConnectionSlot
+{
+    /**
+     * @brief the connection, nullptr if the fd is not in use. This
+     * is what lookups read.
+     * 
+     */
+    std::atomic<State*>                     m_state;
+
+    /**
+     * @brief incremented every time the fd is given to a new
+     * connection
+     * 
+     */
+    std::atomic<uint32_t>                   m_generation;
+
+    /**
+     * @brief keeps the connection alive while it is in the table
+     * 
+     */
+    std::shared_ptr<State>                  m_owner;
+
+    ConnectionSlot():
+        m_state(nullptr),
+        m_generation(0)
+    {
+    }
+};
+
+/**
+ * @brief The connections of the pipeline, indexed by their file
+ * descriptor.
+ * 
+ * File descriptors are small and dense, so the table is an array of
+ * slots and a lookup is an index, with no hashing and no lock. The
+ * array is allocated in chunks as larger file descriptors show up,
+ * and chunks are never freed, so a lookup never sees memory go away.
+ * 
+ * A connection is only inserted by the thread that accepted it and
+ * only removed by the thread that owns it, while epoll does not
+ * report it. Lookups therefore never race with the insertion or the
+ * removal of the same connection. The generation of a slot tells an
+ * event that was meant for an earlier connection on the same fd
+ * apart from one for the current connection.
+ * 
+ */
+class ConnectionTable
+{
+public:
+    ConnectionTable()
+    {
+        for (auto& chunk: m_chunks)
+            chunk.store(nullptr);
+    }
+
+    ConnectionTable(const ConnectionTable&) = delete;
+    ConnectionTable& operator=(const ConnectionTable&) = delete;
+
+    ~ConnectionTable()
+    {
+        for (auto& chunk: m_chunks)
+            delete[] chunk.load();
+    }
+
+    /**
+     * @brief add a connection. Its m_generation is set to the new
+     * generation of the slot.
+     * 
+     * @param fd the file descriptor of the connection
+     * @param pstate the connection
+     * @return true on success
+     * @return false if fd is out of the range of the table
+     */
+    bool insert(int fd, std::shared_ptr<State> pstate);
+
+    /**
+     * @brief remove a connection, if it is in the table
+     * 
+     * @param fd the file descriptor of the connection
+     */
+    void remove(int fd);
+
+    /**
+     * @brief find a connection
+     * 
+     * @param fd the file descriptor of the connection
+     * @return std::shared_ptr<State> the connection, nullptr if the
+     * fd is not in use
+     */
+    std::shared_ptr<State> lookup(int fd) const
+    {
+        const ConnectionSlot* slot = get_slot(fd);
+        State* p = slot ? slot->m_state.load(std::memory_order_acquire) : nullptr;
+        return p ? p->shared_from_this() : std::shared_ptr<State>(nullptr);
+    }
+
+    /**
+     * @brief find a connection, if it is still the one that had the
+     * fd at the given generation
+     * 
+     * @param fd the file descriptor of the connection
+     * @param generation the generation of the connection
+     * @return std::shared_ptr<State> the connection, nullptr if the
+     * fd is not in use or now belongs to another connection
+     */
+    std::shared_ptr<State> lookup(int fd, uint32_t generation) const
+    {
+        const ConnectionSlot* slot = get_slot(fd);
+        if (!slot || generation != slot->m_generation.load(std::memory_order_acquire))
+            return std::shared_ptr<State>(nullptr);
+        State* p = slot->m_state.load(std::memory_order_acquire);
+        return p ? p->shared_from_this() : std::shared_ptr<State>(nullptr);
+    }
+
+    /**
+     * @brief pack a file descriptor and a generation, so that they
+     * can be stored in the user data of an event
+     * 
+     * @param fd the file descriptor
+     * @param generation its generation
+     * @return uint64_t the packed value
+     */
+    static uint64_t make_key(int fd, uint32_t generation)
+    {
+        return ((uint64_t)generation << 32) | (uint32_t)fd;
+    }
+
+    /**
+     * @brief the file descriptor of a packed value
+     * 
+     * @param key the value made by make_key
+     * @return int the file descriptor
+     */
+    static int key_fd(uint64_t key)
+    {
+        return (int)(uint32_t)key;
+    }
+
+    /**
+     * @brief the generation of a packed value
+     * 
+     * @param key the value made by make_key
+     * @return uint32_t the generation
+     */
+    static uint32_t key_generation(uint64_t key)
+    {
+        return (uint32_t)(key >> 32);
+    }
+
+private:
+    /**
+     * @brief the chunks of slots, allocated on first use
+     * 
+     */
+    std::atomic<ConnectionSlot*>            m_chunks[CONNECTION_TABLE_MAX_CHUNKS];
+
+    /**
+     * @brief serializes the allocation of chunks
+     * 
+     */
+    std::mutex                              m_grow_mutex;
+
+    /**
+     * @brief find the slot of a file descriptor
+     * 
+     * @param fd the file descriptor
+     * @return const ConnectionSlot* the slot, nullptr if its chunk
+     * has not been allocated
+     */
+    const ConnectionSlot* get_slot(int fd) const
+    {
+        if (fd < 0 || fd >= CONNECTION_TABLE_CHUNK_SIZE * CONNECTION_TABLE_MAX_CHUNKS)
+            return nullptr;
+        ConnectionSlot* chunk = m_chunks[fd / CONNECTION_TABLE_CHUNK_SIZE].load(
+                                    std::memory_order_acquire);
+        return chunk ? &chunk[fd & (CONNECTION_TABLE_CHUNK_SIZE - 1)] : nullptr;
+    }
+
+    /**
+     * @brief find the slot of a file descriptor, allocating its
+     * chunk if needed
+     * 
+     * @param fd the file descriptor
+     * @return ConnectionSlot* the slot, nullptr if fd is out of range
+     */
+    ConnectionSlot* get_or_create_slot(int fd);
+};
+
+#endif /* #ifndef CONNECTION_TABLE_H_ */
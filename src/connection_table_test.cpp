@@ -0,0 +1,87 @@
+#include "connection_table.h"
+#include <cstdlib>
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+void test_insert_lookup()
+{
+    std::cout << std::endl << "Tests to validate inserting and finding connections" << std::endl;
+    {
+        ConnectionTable table;
+        TEST(!table.lookup(5), "An unused fd should not be found");
+
+        auto state = State::create_state(5);
+        TEST(table.insert(5, state), "A connection should be inserted");
+        TEST(table.lookup(5) == state, "A connection should be found by its fd");
+        TEST(table.lookup(5, state->m_generation) == state, \
+            "A connection should be found with its generation");
+        TEST(!table.lookup(6), "Other fds should not be affected");
+
+        auto far = State::create_state(100000);
+        TEST(table.insert(100000, far), "A large fd should get its own chunk");
+        TEST(table.lookup(100000) == far && table.lookup(5) == state, \
+            "Connections in different chunks should be found");
+
+        TEST(!table.insert(-1, state), "A negative fd should be refused");
+        TEST(!table.insert(CONNECTION_TABLE_CHUNK_SIZE * CONNECTION_TABLE_MAX_CHUNKS, state), \
+            "An fd beyond the table should be refused");
+
+        TEST(64 == alignof(ConnectionSlot) && 64 == sizeof(ConnectionSlot), \
+            "Every slot should have its own cache line");
+    }
+}
+
+void test_reuse()
+{
+    std::cout << std::endl << "Tests to validate the reuse of a file descriptor" << std::endl;
+    {
+        ConnectionTable table;
+        auto first = State::create_state(7);
+        table.insert(7, first);
+        uint32_t generation = first->m_generation;
+
+        table.remove(7);
+        TEST(!table.lookup(7) && !table.lookup(7, generation), "A removed connection should not be found");
+        TEST(1 == first.use_count(), \
+            "The table should release a removed connection");
+
+        auto second = State::create_state(7);
+        table.insert(7, second);
+        TEST(second->m_generation != generation, "A reused fd should get a new generation");
+        TEST(!table.lookup(7, generation), "An event for the old connection should be dropped");
+        TEST(table.lookup(7, second->m_generation) == second, "The new connection should be found");
+
+        table.remove(7);
+        table.remove(7);
+        TEST(!table.lookup(7), "Removing twice should be harmless");
+    }
+}
+
+void test_key()
+{
+    std::cout << std::endl << "Tests to validate packing an fd with its generation" << std::endl;
+    {
+        uint64_t key = ConnectionTable::make_key(12345, 0xfffffffe);
+        TEST(12345 == ConnectionTable::key_fd(key), "The fd should be unpacked");
+        TEST(0xfffffffe == ConnectionTable::key_generation(key), "The generation should be unpacked");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_insert_lookup();
+    test_reuse();
+    test_key();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
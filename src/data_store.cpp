@@ -1,30 +1,48 @@
 #include "data_store.h"
 
-bool DataStore::set(const std::string& key, const std::string& value)
+bool DataStore::insert(HashNode* pnode)
+{
+    HashNode* previous;
+    RetireList reclaimable;
+    {
+        std::unique_lock lock(m_mutex);
+        try
+        {
+            previous = m_table.insert(pnode);
+        }
+        catch (...)
+        {
+            previous = pnode;
+        }
+        if (previous && previous != pnode)
+            m_table.retire(previous);
+        m_table.collect(reclaimable);
+    }
+
+    reclaimable.free_all();
+    if (previous != pnode)
+        return true;
+    HashNode::destroy(pnode);
+    return false;
+}
+
+bool DataStore::set(std::string_view key, const std::string& value)
 {
-    std::unique_lock lock(m_mutex);
     try
     {
-        m_map[key] = value;
+        return insert(HashNode::create(key, value, m_table.hash(key)));
     }
-    catch(...)
+    catch (...)
     {
         return false;
     }
-
-    return true;
 }
 
-bool DataStore::del(const std::string& key)
+bool DataStore::set(std::string_view key, std::string&& value)
 {
-    std::unique_lock lock(m_mutex);
     try
     {
-        auto it = m_map.find(key);
-        if (it == m_map.end())
-            return false;
-        m_map.erase(it);
-        return true;
+        return insert(HashNode::create(key, std::move(value), m_table.hash(key)));
     }
     catch (...)
     {
@@ -32,18 +50,49 @@ bool DataStore::del(const std::string& key)
     }
 }
 
-std::tuple<bool, std::string> DataStore::get(const std::string& key)
+bool DataStore::del(std::string_view key)
+{
+    uint64_t hash = m_table.hash(key);
+    HashNode* pnode;
+    RetireList reclaimable;
+    {
+        std::unique_lock lock(m_mutex);
+        pnode = m_table.remove(key, hash);
+        if (pnode)
+            m_table.retire(pnode);
+        m_table.collect(reclaimable);
+    }
+
+    reclaimable.free_all();
+    return nullptr != pnode;
+}
+
+std::tuple<bool, std::string> DataStore::get(std::string_view key)
 {
-    std::shared_lock lock(m_mutex);
+    std::string value;
     try
     {
-        auto it = m_map.find(key);
-        if (it == m_map.end())
-            return std::make_tuple(false, std::string(""));
-        return std::make_tuple(true, m_map[key]);
+        bool found = with_value(key, [&](std::string_view v) {
+            value.assign(v.data(), v.length());
+        });
+        return std::make_tuple(found, std::move(value));
     }
     catch (...)
     {
         return std::make_tuple(false, std::string(""));
     }
+}
+
+bool DataStore::migrate(size_t num_groups)
+{
+    bool is_migrating;
+    RetireList reclaimable;
+    {
+        std::unique_lock lock(m_mutex);
+        is_migrating = m_table.migrate(num_groups);
+        m_table.collect(reclaimable, true);
+    }
+
+    reclaimable.free_all();
+    return is_migrating;
 }
\ No newline at end of file
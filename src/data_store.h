@@ -2,32 +2,51 @@
 #define DATA_STORE_H_
 
 #include "common_include.h"
+#include "hash_table.h"
 
 /**
  * @brief This class implements a data store. In essence
  * this is a hash table, with synchronization added
- * for thread safety.
+ * for thread safety. The table is a HashTable, an open
+ * addressing table with one allocation per key.
+ * 
+ * The writers take the mutex of the data store, the readers take
+ * no lock: they look the key up in an Epoch read section, and the
+ * writers retire the nodes they replace or remove. What no reader
+ * can see any more is freed after a write, once the lock is
+ * released.
  * 
  * The orchestrator maintains an array of several of these
- * for even greater parallelism.
+ * for even greater parallelism. Each one starts on its own cache
+ * line, so that the locks of neighbouring shards do not share one.
  * 
  */
-class DataStore
+class alignas(64) DataStore
 {
 private:
     /**
-     * @brief The hash map for key-value pairs
-     * keys are strings, and values are serialized
-     * RESP objects
+     * @brief The hash table for key-value pairs
+     * keys are strings, and values are the raw bytes
+     * that were set, any bytes including NUL
      * 
      */
-    std::unordered_map<std::string, std::string>    m_map;
+    HashTable                                       m_table;
 
     /**
-     * @brief the mutex to serialize the hash table
+     * @brief the mutex to serialize the writers of the hash table
      * 
      */
-    mutable std::shared_mutex                       m_mutex;
+    std::mutex                                      m_mutex;
+
+    /**
+     * @brief put a node in the table, and retire the node it
+     * replaces
+     * 
+     * @param pnode the node, freed on failure
+     * @return true success
+     * @return false failure
+     */
+    bool insert(HashNode* pnode);
 
 public:
     /**
@@ -38,7 +57,20 @@ public:
      * @return true success
      * @return false failure
      */
-    bool set(const std::string& key, const std::string& value);
+    bool set(std::string_view key, const std::string& value);
+
+    /**
+     * @brief set a key-value, taking the value over if it is large.
+     * The node of the key is built before the lock is taken, and the
+     * one it replaces is freed after the lock is released, so that a
+     * large value does not hold the key's partition for long.
+     * 
+     * @param key 
+     * @param value the value, moved from
+     * @return true success
+     * @return false failure
+     */
+    bool set(std::string_view key, std::string&& value);
 
     /**
      * @brief delete a key
@@ -47,7 +79,7 @@ public:
      * @return true success
      * @return false failure
      */
-    bool del(const std::string& key);
+    bool del(std::string_view key);
 
     /**
      * @brief fetch a value for a key
@@ -58,19 +90,57 @@ public:
      * 1. whether the key was found or not
      * 2. The value
      */
-    std::tuple<bool, std::string> get(const std::string& key);
+    std::tuple<bool, std::string> get(std::string_view key);
+
+    /**
+     * @brief look at the value of a key without copying it. It takes
+     * no lock and never waits for the writers. The function runs in
+     * an Epoch read section, it should not take long: nothing that
+     * is retired meanwhile can be freed.
+     * 
+     * @tparam F a function taking the value as a std::string_view
+     * @param key 
+     * @param fn called with the value if the key is found
+     * @return true if the key was found
+     * @return false otherwise
+     */
+    template<typename F>
+    bool with_value(std::string_view key, F&& fn) const
+    {
+        uint64_t hash = m_table.hash(key);
+        Epoch::Guard guard;
+        const HashNode* pnode = m_table.find(key, hash);
+        if (!pnode)
+            return false;
+        fn(pnode->value());
+        return true;
+    }
+
+    /**
+     * @brief move part of the table to its new slots while it is
+     * growing, so that a table that gets few writes ends its growth
+     * too. The inserts and removes move the rest. It also frees what
+     * was retired and no reader can see any more, even if little
+     * was.
+     * 
+     * @param num_groups the number of groups of slots to move
+     * @return true if the table is still growing
+     * @return false otherwise
+     */
+    bool migrate(size_t num_groups);
 
     /**
      * @brief Set a key value pair
      * 
      * @param key 
-     * @param value 
+     * @param value a C string, the std::string overloads take
+     * values with NUL bytes
      * @return true success
      * @return false failure
      */
     bool set(const char* key, const char* value)
     {
-        return set(std::string(key), std::string(value));
+        return set(std::string_view(key), std::string(value));
     }
 
     /**
@@ -82,11 +152,11 @@ public:
      */
     bool del(const char* key)
     {
-        return del(std::string(key));
+        return del(std::string_view(key));
     }
 
     /**
-     * @brief fetch a ey
+     * @brief fetch a key
      * 
      * @param key 
      * @return std::tuple<bool, std::string> 
@@ -96,7 +166,7 @@ public:
      */
     std::tuple<bool, std::string> get(const char* key)
     {
-        return get(std::string(key));
+        return get(std::string_view(key));
     }
 };
 
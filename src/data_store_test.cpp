@@ -1,6 +1,7 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <pthread.h>
+#include <random>
 #include "data_store.h"
 
 #define TEST(x, y) {\
@@ -43,9 +44,118 @@ void basic_tests()
     }
 }
 
+void value_tests()
+{
+    std::cout << std::endl << "Running value tests " << std::endl;
+
+    {
+        DataStore m;
+        std::string value("a\0b\r\n", 5);
+        TEST(m.set(std::string("bin"), value), "Should be able to set a binary value");
+
+        auto [succ, readValue] = m.get(std::string("bin"));
+        TEST(succ && readValue == value, "A value with NUL bytes should be read back whole");
+
+        std::string_view seen;
+        bool found = m.with_value(std::string("bin"), [&](std::string_view v) { seen = v; });
+        TEST(found && seen == value, "with_value should see the stored bytes");
+
+        bool called = false;
+        found = m.with_value(std::string("missing"), [&](std::string_view) { called = true; });
+        TEST(!found && !called, "with_value should not call the function for a missing key");
+
+        std::string large(1 << 20, 'x');
+        TEST(m.set(std::string("bin"), std::move(large)), "Should be able to move a value in");
+        found = m.with_value(std::string("bin"), [&](std::string_view v) { seen = v; });
+        TEST(found && (1 << 20) == seen.length(), "The moved value should replace the previous one");
+    }
+}
+
+void concurrency_tests()
+{
+    std::cout << std::endl << "Running concurrency tests " << std::endl;
+
+    {
+        // The readers take no lock, they must see every key that was
+        // written while the table grows, and the replaced and removed
+        // values must not be freed under them
+        DataStore m;
+        const int num_keys = 200000;
+        std::atomic<int> written(0);
+        std::atomic<bool> done(false);
+        std::atomic<int> errors(0);
+        std::atomic<uint64_t> reads(0);
+
+        std::thread writer([&]() {
+            for (int i = 0; i < num_keys; i++)
+            {
+                m.set("key:" + std::to_string(i), "value:" + std::to_string(i));
+                written.store(i + 1, std::memory_order_release);
+                m.set(std::string("hot"), "hot:" + std::to_string(i));
+                if (i & 1)
+                    m.del(std::string("flip"));
+                else
+                    m.set(std::string("flip"), std::string(100, 'f'));
+            }
+            done = true;
+        });
+
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 3; t++)
+        {
+            readers.emplace_back([&, t]() {
+                std::mt19937 rng(t);
+                while (!done)
+                {
+                    int n = written.load(std::memory_order_acquire);
+                    if (!n)
+                        continue;
+                    int i = rng() % n;
+                    std::string expected = "value:" + std::to_string(i);
+                    std::string value;
+                    bool found = m.with_value("key:" + std::to_string(i), [&](std::string_view v) {
+                        value.assign(v.data(), v.length());
+                    });
+                    if (!found || value != expected)
+                        errors++;
+
+                    found = m.with_value(std::string("hot"), [&](std::string_view v) {
+                        value.assign(v.data(), v.length());
+                    });
+                    if (!found || 0 != value.compare(0, 4, "hot:"))
+                        errors++;
+
+                    found = m.with_value(std::string("flip"), [&](std::string_view v) {
+                        value.assign(v.data(), v.length());
+                    });
+                    if (found && value != std::string(100, 'f'))
+                        errors++;
+                    reads++;
+                }
+            });
+        }
+
+        writer.join();
+        for (auto& reader: readers)
+            reader.join();
+        TEST(0 == errors && reads > 0, "Readers should see every written key while the writer grows the table");
+
+        bool all_found = true;
+        for (int i = 0; i < num_keys; i += 1000)
+        {
+            auto [found, value] = m.get("key:" + std::to_string(i));
+            if (!found || value != "value:" + std::to_string(i))
+                all_found = false;
+        }
+        TEST(all_found, "Every key should be found once the writer is done");
+    }
+}
+
 int main(int argc, char** argv)
 {
     basic_tests();
+    value_tests();
+    concurrency_tests();
 
     std::cout << std::endl << "All tests passed" << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "epoch.h"
+
+std::atomic<uint64_t> Epoch::m_epoch(1);
+std::atomic<EpochRecord*> Epoch::m_precords(nullptr);
+thread_local EpochRecord* Epoch::m_precord = nullptr;
+
+/**
+ * @brief gives the record of a thread back when it exits
+ * 
+ */
+struct EpochRelease
+{
+    EpochRecord*                            m_precord = nullptr;
+
+    ~EpochRelease()
+    {
+        if (m_precord)
+            m_precord->m_in_use.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local EpochRelease epoch_release;
+
+EpochRecord* Epoch::register_thread()
+{
+    EpochRecord* precord = nullptr;
+    for (EpochRecord* p = m_precords.load(std::memory_order_acquire); p; p = p->m_pnext)
+    {
+        bool in_use = false;
+        if (!p->m_in_use.load(std::memory_order_relaxed) &&
+            p->m_in_use.compare_exchange_strong(in_use, true))
+        {
+            precord = p;
+            break;
+        }
+    }
+
+    if (!precord)
+    {
+        precord = new EpochRecord();
+        precord->m_epoch.store(0);
+        precord->m_in_use.store(true);
+        precord->m_pnext = m_precords.load(std::memory_order_relaxed);
+        while (!m_precords.compare_exchange_weak(precord->m_pnext, precord))
+            ;
+    }
+
+    precord->m_depth = 0;
+    m_precord = precord;
+    epoch_release.m_precord = precord;
+    return precord;
+}
+
+uint64_t Epoch::reclaimable()
+{
+    uint64_t min = m_epoch.fetch_add(1) + 1;
+
+    // Pairs with the fence of enter(): a reader whose record is not
+    // seen here will see everything that was unlinked before
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (EpochRecord* p = m_precords.load(std::memory_order_acquire); p; p = p->m_pnext)
+    {
+        uint64_t epoch = p->m_epoch.load(std::memory_order_relaxed);
+        if (epoch && epoch < min)
+            min = epoch;
+    }
+    return min;
+}
+
+void Epoch::synchronize()
+{
+    uint64_t epoch = now();
+    while (reclaimable() <= epoch)
+        std::this_thread::yield();
+}
+
+void RetireList::add(void* p, void (*free_fn)(void*))
+{
+    try
+    {
+        m_entries.push_back({Epoch::now(), p, free_fn});
+    }
+    catch (...)
+    {
+        Epoch::synchronize();
+        free_fn(p);
+    }
+}
+
+void RetireList::collect(RetireList& reclaimable, bool force)
+{
+    if (m_entries.empty())
+        return;
+    if (m_entries.front().m_epoch >= m_safe_epoch &&
+        (force || m_entries.size() >= EPOCH_COLLECT_BATCH))
+        m_safe_epoch = Epoch::reclaimable();
+
+    size_t count = 0;
+    while (count < m_entries.size() && m_entries[count].m_epoch < m_safe_epoch)
+        count++;
+    if (!count)
+        return;
+
+    // Nothing is lost if there is no memory to move the objects,
+    // they are freed the next time
+    try
+    {
+        if (reclaimable.m_entries.empty() && count == m_entries.size())
+            reclaimable.m_entries.swap(m_entries);
+        else
+        {
+            reclaimable.m_entries.insert(reclaimable.m_entries.end(),
+                m_entries.begin(), m_entries.begin() + count);
+            m_entries.erase(m_entries.begin(), m_entries.begin() + count);
+        }
+    }
+    catch (...)
+    {
+    }
+}
+
+void RetireList::free_all()
+{
+    for (auto& entry: m_entries)
+        entry.m_free(entry.m_p);
+    m_entries.clear();
+}
@@ -0,0 +1,256 @@
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+#include "common_include.h"
+#include <cstdint>
+
+/**
+ * @brief number of entries a RetireList holds before it looks at the
+ * readers again to find which ones can be freed. Each look moves the
+ * global epoch, whose cache line every reader reads.
+ * 
+ */
+#define EPOCH_COLLECT_BATCH 32
+
+/**
+ * @brief The epoch of one thread, on its own cache line, so that a
+ * reader only ever writes to its own line.
+ * 
+ */
+struct alignas(64) EpochRecord
+{
+    /**
+     * @brief the global epoch when the thread entered its read
+     * section, 0 outside of one
+     * 
+     */
+    std::atomic<uint64_t>                   m_epoch;
+
+    /**
+     * @brief whether a thread owns the record. Records are never
+     * freed, the one of a thread that exits is reused.
+     * 
+     */
+    std::atomic<bool>                       m_in_use;
+
+    /**
+     * @brief depth of the nested read sections of the owner
+     * 
+     */
+    uint32_t                                m_depth;
+
+    /**
+     * @brief the next record, records are only ever added
+     * 
+     */
+    EpochRecord*                            m_pnext;
+};
+
+/**
+ * @brief Epoch based reclamation, so that readers can go through a
+ * structure without a lock while writers change it.
+ * 
+ * A reader enters a read section before it looks at the structure,
+ * and leaves it when it no longer uses anything it found there: it
+ * stores the global epoch in its own record, and takes no lock and
+ * never waits. A writer that unlinks an object does not free it: it
+ * retires it, tagged with the global epoch. Every reader that could
+ * have seen it entered at that epoch or before, so the object is
+ * freed once every reader in a section entered after it.
+ * 
+ */
+class Epoch
+{
+public:
+    /**
+     * @brief enter a read section, they nest
+     * 
+     */
+    static void enter()
+    {
+        EpochRecord* precord = m_precord ? m_precord : register_thread();
+        if (precord->m_depth++)
+            return;
+        precord->m_epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        // The writers must see the record before the reader looks
+        // at anything
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief leave a read section, nothing found in it can be used
+     * after the outermost one
+     * 
+     */
+    static void exit()
+    {
+        EpochRecord* precord = m_precord;
+        if (--precord->m_depth)
+            return;
+        precord->m_epoch.store(0, std::memory_order_release);
+    }
+
+    /**
+     * @brief A read section, for the lifetime of the guard
+     * 
+     */
+    class Guard
+    {
+    public:
+        Guard()
+        {
+            enter();
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard()
+        {
+            exit();
+        }
+    };
+
+    /**
+     * @brief the global epoch, the tag of an object that was just
+     * unlinked
+     * 
+     * @return uint64_t the epoch
+     */
+    static uint64_t now()
+    {
+        return m_epoch.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief move the global epoch on, and find which objects no
+     * reader can see any more
+     * 
+     * @return uint64_t the objects tagged below it can be freed
+     */
+    static uint64_t reclaimable();
+
+    /**
+     * @brief wait until every object retired until now can be
+     * freed. It spins while readers are in their sections.
+     * 
+     */
+    static void synchronize();
+
+private:
+    /**
+     * @brief the global epoch, it starts at 1 since 0 marks a record
+     * outside of a read section
+     * 
+     */
+    static std::atomic<uint64_t>            m_epoch;
+
+    /**
+     * @brief the records of every thread that ever read
+     * 
+     */
+    static std::atomic<EpochRecord*>        m_precords;
+
+    /**
+     * @brief the record of this thread, nullptr until it first
+     * reads
+     * 
+     */
+    static thread_local EpochRecord*        m_precord;
+
+    /**
+     * @brief take a free record for this thread, or add one. It is
+     * given back when the thread exits.
+     * 
+     * @return EpochRecord* the record
+     */
+    static EpochRecord* register_thread();
+};
+
+/**
+ * @brief Objects that were retired and wait for their readers to
+ * leave, in the order they were retired. It is not synchronized,
+ * the writer that owns it locks it.
+ * 
+ */
+class RetireList
+{
+public:
+    RetireList():
+        m_safe_epoch(0)
+    {
+    }
+
+    RetireList(const RetireList&) = delete;
+    RetireList& operator=(const RetireList&) = delete;
+
+    /**
+     * @brief free every object, there must be no reader left
+     * 
+     */
+    ~RetireList()
+    {
+        free_all();
+    }
+
+    /**
+     * @brief retire an object that readers cannot find any more. It
+     * does not throw: if the entry cannot be allocated, it waits for
+     * the readers and frees the object at once.
+     * 
+     * @param p the object
+     * @param free_fn frees it
+     */
+    void add(void* p, void (*free_fn)(void*));
+
+    /**
+     * @brief move the objects no reader can see any more to another
+     * list, to be freed without the lock of this one. The readers
+     * are only looked at every EPOCH_COLLECT_BATCH objects, or when
+     * forced.
+     * 
+     * @param reclaimable the list the objects are moved to
+     * @param force look at the readers even if there are few objects
+     */
+    void collect(RetireList& reclaimable, bool force = false);
+
+    /**
+     * @brief free every object now
+     * 
+     */
+    void free_all();
+
+    /**
+     * @brief number of objects waiting
+     * 
+     * @return size_t the number of objects
+     */
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t                            m_epoch;
+        void*                               m_p;
+        void                                (*m_free)(void*);
+    };
+
+    /**
+     * @brief the objects, their epochs never decrease
+     * 
+     */
+    std::vector<Entry>                      m_entries;
+
+    /**
+     * @brief the objects tagged below it could be freed the last
+     * time the readers were looked at
+     * 
+     */
+    uint64_t                                m_safe_epoch;
+};
+
+#endif /* #ifndef EPOCH_H_ */
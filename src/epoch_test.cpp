@@ -0,0 +1,136 @@
+#include <cstdlib>
+#include <unistd.h>
+#include <pthread.h>
+#include "epoch.h"
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+/**
+ * @brief number of objects freed by count_free()
+ * 
+ */
+static std::atomic<int> num_freed(0);
+
+static void count_free(void* p)
+{
+    num_freed++;
+}
+
+void test_read_sections()
+{
+    std::cout << std::endl << "Tests to validate the read sections" << std::endl;
+    {
+        RetireList retired;
+        RetireList reclaimable;
+        num_freed = 0;
+
+        std::atomic<int> step(0);
+        std::thread reader([&]() {
+            Epoch::enter();
+            step = 1;
+            while (step != 2)
+                std::this_thread::yield();
+            Epoch::exit();
+            step = 3;
+        });
+        while (step != 1)
+            std::this_thread::yield();
+
+        retired.add(nullptr, count_free);
+        retired.collect(reclaimable, true);
+        TEST(0 == reclaimable.size() && 1 == retired.size(),
+            "An object should not be freed while a reader that may see it is in its section");
+
+        step = 2;
+        while (step != 3)
+            std::this_thread::yield();
+        retired.collect(reclaimable, true);
+        TEST(1 == reclaimable.size() && 0 == retired.size(),
+            "An object should be freed once its readers left their sections");
+        reclaimable.free_all();
+        TEST(1 == num_freed, "Freeing a list should free its objects");
+        reader.join();
+    }
+    {
+        RetireList retired;
+        RetireList reclaimable;
+
+        Epoch::enter();
+        Epoch::enter();
+        Epoch::exit();
+        retired.add(nullptr, count_free);
+        retired.collect(reclaimable, true);
+        TEST(0 == reclaimable.size(), "Leaving a nested section should not end the outer one");
+        Epoch::exit();
+        retired.collect(reclaimable, true);
+        TEST(1 == reclaimable.size(), "Leaving the outer section should end it");
+    }
+    {
+        RetireList retired;
+        RetireList reclaimable;
+
+        // The reader enters after the epoch moved on from the one
+        // of the first object, and before the second one is retired
+        retired.add(nullptr, count_free);
+        Epoch::reclaimable();
+        Epoch::Guard guard;
+        retired.add(nullptr, count_free);
+        retired.collect(reclaimable, true);
+        TEST(1 == reclaimable.size() && 1 == retired.size(),
+            "A reader should only hold the objects retired since it entered");
+    }
+}
+
+void test_collect()
+{
+    std::cout << std::endl << "Tests to validate collecting retired objects" << std::endl;
+    {
+        RetireList retired;
+        RetireList reclaimable;
+        num_freed = 0;
+
+        for (int i = 0; i < EPOCH_COLLECT_BATCH - 1; i++)
+            retired.add(nullptr, count_free);
+        retired.collect(reclaimable);
+        TEST(0 == reclaimable.size(), "A few objects should wait for more before the readers are looked at");
+
+        retired.add(nullptr, count_free);
+        retired.collect(reclaimable);
+        TEST(EPOCH_COLLECT_BATCH == reclaimable.size() && 0 == retired.size(),
+            "A batch of objects should be collected");
+    }
+    TEST(EPOCH_COLLECT_BATCH == num_freed, "A list should free its objects when it is destroyed");
+    {
+        // The threads come and go, their records are reused
+        for (int i = 0; i < 100; i++)
+        {
+            std::thread reader([]() {
+                Epoch::Guard guard;
+            });
+            reader.join();
+        }
+        RetireList retired;
+        RetireList reclaimable;
+        retired.add(nullptr, count_free);
+        retired.collect(reclaimable, true);
+        TEST(1 == reclaimable.size(), "A thread that exited should not hold objects");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_read_sections();
+    test_collect();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
@@ -0,0 +1,356 @@
+#include "hash_table.h"
+
+/**
+ * @brief the control bytes of an empty table, one group of empty
+ * slots that no lookup ever goes past
+ * 
+ */
+alignas(HASH_GROUP_SIZE) static int8_t empty_group[HASH_GROUP_SIZE] = {};
+
+/**
+ * @brief the view of every table that has no slots
+ * 
+ */
+static HashView empty_view;
+
+/**
+ * @brief free the slots of a table that were retired
+ * 
+ * @param p the control bytes, the start of the allocation
+ */
+static void free_retired_slots(void* p)
+{
+    free(p);
+}
+
+/**
+ * @brief free a view that was retired
+ * 
+ * @param p the view
+ */
+static void free_retired_view(void* p)
+{
+    delete (HashView*)p;
+}
+
+/**
+ * @brief allocate a node and fill in its header and its key
+ * 
+ * @param key the key
+ * @param inline_length number of bytes of the value that follow the
+ * key
+ * @param hash the hash of the key
+ * @return HashNode* the node
+ */
+static HashNode* allocate_node(std::string_view key, size_t inline_length, uint64_t hash)
+{
+    HashNode* pnode = (HashNode*)::operator new(sizeof(HashNode) + key.length() + inline_length);
+    pnode->m_hash = hash;
+    pnode->m_key_length = (uint32_t)key.length();
+    pnode->m_value_length = (uint32_t)inline_length;
+    pnode->m_pexternal = nullptr;
+    memcpy((char*)(pnode + 1), key.data(), key.length());
+    return pnode;
+}
+
+HashNode* HashNode::create(std::string_view key, std::string_view value, uint64_t hash)
+{
+    if (value.length() >= HASH_EXTERNAL_VALUE_SIZE)
+        return create(key, std::string(value), hash);
+
+    HashNode* pnode = allocate_node(key, value.length(), hash);
+    memcpy((char*)(pnode + 1) + key.length(), value.data(), value.length());
+    return pnode;
+}
+
+HashNode* HashNode::create(std::string_view key, std::string&& value, uint64_t hash)
+{
+    if (value.length() < HASH_EXTERNAL_VALUE_SIZE)
+        return create(key, std::string_view(value), hash);
+
+    HashNode* pnode = allocate_node(key, 0, hash);
+    try
+    {
+        pnode->m_pexternal = new std::string(std::move(value));
+    }
+    catch (...)
+    {
+        ::operator delete(pnode);
+        throw;
+    }
+    return pnode;
+}
+
+void HashNode::destroy(HashNode* pnode)
+{
+    delete pnode->m_pexternal;
+    ::operator delete(pnode);
+}
+
+HashSlots::HashSlots():
+    m_ctrl(empty_group),
+    m_slots(nullptr),
+    m_group_mask(0)
+{
+}
+
+HashSlots HashSlots::allocate(size_t num_groups)
+{
+    // Large blocks are fresh pages from the kernel, which are already
+    // zeroed and only touched when a slot is used, so the slots of a
+    // large table are allocated in no time. The 16 bytes alignment of
+    // malloc is the one of the SSE2 loads.
+    size_t capacity = num_groups * HASH_GROUP_SIZE;
+    void* memory = calloc(capacity, 1 + sizeof(HashNode*));
+    if (!memory)
+        throw std::bad_alloc();
+
+    HashSlots slots;
+    slots.m_ctrl = (int8_t*)memory;
+    slots.m_slots = (HashNode**)(slots.m_ctrl + capacity);
+    slots.m_group_mask = num_groups - 1;
+    return slots;
+}
+
+void HashSlots::release()
+{
+    if (m_slots)
+        free(m_ctrl);
+    *this = HashSlots();
+}
+
+size_t HashSlots::find_free_index(uint64_t hash) const
+{
+    size_t group = (hash >> 7) & m_group_mask;
+
+    for (size_t step = 1;; step++)
+    {
+        uint32_t mask = HashGroup::match_free(m_ctrl + group * HASH_GROUP_SIZE);
+        if (mask)
+            return group * HASH_GROUP_SIZE + __builtin_ctz(mask);
+        group = (group + step) & m_group_mask;
+    }
+}
+
+HashTable::HashTable():
+    m_pview(&empty_view),
+    m_pnext_view(nullptr),
+    m_migrate_group(0),
+    m_old_size(0),
+    m_size(0),
+    m_growth_left(0),
+    m_num_deleted(0),
+    m_node_bytes(0),
+    m_seed(KeyHash::random_seed())
+{
+}
+
+HashTable::~HashTable()
+{
+    clear();
+}
+
+HashNode* HashTable::insert(HashNode* pnode)
+{
+    if (is_migrating())
+        migrate(HASH_MIGRATE_GROUPS_PER_OP);
+
+    HashSlots* pslots = &m_current;
+    auto [index, pfound] = m_current.find_index(pnode->key(), pnode->m_hash);
+    if (!pfound && is_migrating())
+    {
+        pslots = &m_old;
+        std::tie(index, pfound) = m_old.find_index(pnode->key(), pnode->m_hash);
+    }
+    if (pfound)
+    {
+        HashNode* previous = pslots->m_slots[index];
+        pslots->store_slot(index, pnode);
+        m_node_bytes += pnode->memory_usage();
+        m_node_bytes -= previous->memory_usage();
+        return previous;
+    }
+
+    // The nodes left in the old slots have room saved for them
+    if (m_growth_left <= m_old_size)
+        reserve_one();
+
+    place(pnode);
+    m_size++;
+    m_node_bytes += pnode->memory_usage();
+    return nullptr;
+}
+
+HashNode* HashTable::remove(std::string_view key, uint64_t hash)
+{
+    if (is_migrating())
+        migrate(HASH_MIGRATE_GROUPS_PER_OP);
+
+    auto [index, pfound] = m_current.find_index(key, hash);
+    if (!pfound)
+    {
+        if (!is_migrating())
+            return nullptr;
+        std::tie(index, pfound) = m_old.find_index(key, hash);
+        if (!pfound)
+            return nullptr;
+
+        // The old slots are freed once their nodes are moved, their
+        // deleted slots are not counted
+        HashNode* pnode = m_old.m_slots[index];
+        m_old.store_ctrl(index, HASH_CTRL_DELETED);
+        m_old.store_slot(index, nullptr);
+        m_old_size--;
+        m_size--;
+        m_node_bytes -= pnode->memory_usage();
+        return pnode;
+    }
+
+    HashNode* pnode = m_current.m_slots[index];
+    m_node_bytes -= pnode->memory_usage();
+    m_size--;
+
+    // A group that has an empty slot was never full, so no lookup
+    // went past it and the slot can be empty again. Otherwise the
+    // lookups must go on past it.
+    const int8_t* ctrl = m_current.m_ctrl + (index & ~(size_t)(HASH_GROUP_SIZE - 1));
+    if (HashGroup::match(ctrl, HASH_CTRL_EMPTY))
+    {
+        m_current.store_ctrl(index, HASH_CTRL_EMPTY);
+        m_growth_left++;
+    }
+    else
+    {
+        m_current.store_ctrl(index, HASH_CTRL_DELETED);
+        m_num_deleted++;
+    }
+    m_current.store_slot(index, nullptr);
+    return pnode;
+}
+
+bool HashTable::migrate(size_t num_groups)
+{
+    if (!is_migrating())
+        return false;
+
+    size_t end = m_old.m_group_mask + 1;
+    if (num_groups < end - m_migrate_group)
+        end = m_migrate_group + num_groups;
+    for (; m_migrate_group < end; m_migrate_group++)
+    {
+        size_t first = m_migrate_group * HASH_GROUP_SIZE;
+        for (size_t i = first; i < first + HASH_GROUP_SIZE; i++)
+        {
+            // A moved slot is deleted, the lookups of the old slots
+            // must go on past it to the nodes that are not moved yet
+            if (m_old.m_ctrl[i] >= 0)
+                continue;
+            place(m_old.m_slots[i]);
+            m_old.store_ctrl(i, HASH_CTRL_DELETED);
+            m_old.store_slot(i, nullptr);
+            m_old_size--;
+        }
+    }
+
+    if (m_migrate_group <= m_old.m_group_mask && m_old_size)
+        return true;
+
+    // Readers may still look in the old slots
+    publish(m_pnext_view);
+    m_pnext_view = nullptr;
+    m_retired.add(m_old.m_ctrl, free_retired_slots);
+    m_old = HashSlots();
+    m_migrate_group = 0;
+    m_old_size = 0;
+    return false;
+}
+
+void HashTable::clear()
+{
+    for (HashSlots* pslots: {&m_current, &m_old})
+    {
+        for (size_t i = 0; i < pslots->capacity(); i++)
+        {
+            if (pslots->m_ctrl[i] < 0)
+                HashNode::destroy(pslots->m_slots[i]);
+        }
+        pslots->release();
+    }
+    publish(&empty_view);
+    delete m_pnext_view;
+    m_pnext_view = nullptr;
+    m_retired.free_all();
+    m_migrate_group = 0;
+    m_old_size = 0;
+    m_size = 0;
+    m_growth_left = 0;
+    m_num_deleted = 0;
+    m_node_bytes = 0;
+}
+
+void HashTable::place(HashNode* pnode)
+{
+    size_t index = m_current.find_free_index(pnode->m_hash);
+    if (HASH_CTRL_EMPTY == m_current.m_ctrl[index])
+        m_growth_left--;
+    else
+        m_num_deleted--;
+    m_current.store_slot(index, pnode);
+    m_current.store_ctrl(index, HashSlots::ctrl_of(pnode->m_hash));
+}
+
+void HashTable::publish(HashView* pview)
+{
+    HashView* previous = m_pview.exchange(pview, std::memory_order_acq_rel);
+    if (previous != &empty_view)
+        m_retired.add(previous, free_retired_view);
+}
+
+void HashTable::reserve_one()
+{
+    // Growing as fast as the keys are added leaves room for all the
+    // old nodes, this is only a safety net
+    migrate((size_t)-1);
+    if (m_growth_left)
+        return;
+
+    // Many deleted slots are reused by moving the nodes to slots of
+    // the same size, the table only grows when it is really full
+    size_t num_groups = m_current.m_slots ? m_current.m_group_mask + 1 : 0;
+    if (!num_groups)
+        num_groups = 1;
+    else if (m_size >= max_load(capacity()) / 2)
+        num_groups *= 2;
+    HashSlots slots = HashSlots::allocate(num_groups);
+    HashView* pgrowing = nullptr;
+    HashView* pgrown = nullptr;
+    try
+    {
+        pgrowing = new HashView{slots, m_current};
+        pgrown = new HashView{slots, HashSlots()};
+    }
+    catch (...)
+    {
+        delete pgrowing;
+        slots.release();
+        throw;
+    }
+
+    // A table that had no slots has nothing to move
+    if (m_current.m_slots)
+    {
+        publish(pgrowing);
+        m_pnext_view = pgrown;
+    }
+    else
+    {
+        publish(pgrown);
+        delete pgrowing;
+    }
+    m_old = m_current;
+    m_current = slots;
+    m_migrate_group = 0;
+    m_old_size = m_size;
+    m_growth_left = max_load(m_current.capacity());
+    m_num_deleted = 0;
+}
@@ -0,0 +1,693 @@
+#ifndef HASH_TABLE_H_
+#define HASH_TABLE_H_
+
+#include "common_include.h"
+#include "epoch.h"
+#include "key_hash.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HASH_TABLE_X86 1
+#endif
+
+/**
+ * @brief number of slots whose control bytes are compared at once
+ * 
+ */
+#define HASH_GROUP_SIZE 16
+
+/**
+ * @brief control byte of a slot that has never been used since the
+ * slots were allocated, a lookup stops at a group that has one. It
+ * is 0, so that zeroed memory is a table of empty slots.
+ * 
+ */
+#define HASH_CTRL_EMPTY ((int8_t)0)
+
+/**
+ * @brief control byte of a slot whose entry was deleted or moved to
+ * the new slots, a lookup goes on past it
+ * 
+ */
+#define HASH_CTRL_DELETED ((int8_t)1)
+
+/**
+ * @brief number of groups moved to the new slots by every insert and
+ * remove while the table is growing. One is enough for the move to
+ * end before the new slots are full.
+ * 
+ */
+#define HASH_MIGRATE_GROUPS_PER_OP 1
+
+/**
+ * @brief values at least this long have their own allocation, a
+ * value that is moved into a node keeps it. Shorter values follow
+ * the key.
+ * 
+ */
+#define HASH_EXTERNAL_VALUE_SIZE 4096
+
+/**
+ * @brief An entry of the hash table, in a single allocation: the
+ * header, then the bytes of the key, then the bytes of the value.
+ * A node is not modified once it is in a table: setting a key puts
+ * a new node in its slot.
+ * 
+ */
+struct HashNode
+{
+    /**
+     * @brief the hash of the key, so that growing the table does not
+     * hash the keys again and most mismatches are found without
+     * comparing keys
+     * 
+     */
+    uint64_t                    m_hash;
+
+    /**
+     * @brief number of bytes of the key
+     * 
+     */
+    uint32_t                    m_key_length;
+
+    /**
+     * @brief number of bytes of the value when it follows the key
+     * 
+     */
+    uint32_t                    m_value_length;
+
+    /**
+     * @brief a large value that was moved in, nullptr when the value
+     * follows the key
+     * 
+     */
+    std::string*                m_pexternal;
+
+    /**
+     * @brief the key, stored after the node
+     * 
+     * @return std::string_view the key
+     */
+    std::string_view key() const
+    {
+        return std::string_view((const char*)(this + 1), m_key_length);
+    }
+
+    /**
+     * @brief the value
+     * 
+     * @return std::string_view the value
+     */
+    std::string_view value() const
+    {
+        if (m_pexternal)
+            return *m_pexternal;
+        return std::string_view((const char*)(this + 1) + m_key_length, m_value_length);
+    }
+
+    /**
+     * @brief number of bytes allocated for the node, and for its
+     * value if it has its own allocation
+     * 
+     * @return size_t the number of bytes
+     */
+    size_t memory_usage() const
+    {
+        if (m_pexternal)
+            return sizeof(HashNode) + m_key_length + sizeof(std::string) + m_pexternal->capacity();
+        return sizeof(HashNode) + m_key_length + m_value_length;
+    }
+
+    /**
+     * @brief allocate a node with a copy of the value
+     * 
+     * @param key the key
+     * @param value the value
+     * @param hash the hash of the key, from HashTable::hash()
+     * @return HashNode* the node, it throws std::bad_alloc on failure
+     */
+    static HashNode* create(std::string_view key, std::string_view value, uint64_t hash);
+
+    /**
+     * @brief allocate a node, taking a large value over instead of
+     * copying it
+     * 
+     * @param key the key
+     * @param value the value, moved from if it is at least
+     * HASH_EXTERNAL_VALUE_SIZE long
+     * @param hash the hash of the key, from HashTable::hash()
+     * @return HashNode* the node, it throws std::bad_alloc on failure
+     */
+    static HashNode* create(std::string_view key, std::string&& value, uint64_t hash);
+
+    /**
+     * @brief free a node
+     * 
+     * @param pnode the node
+     */
+    static void destroy(HashNode* pnode);
+};
+
+/**
+ * @brief Comparisons of the control bytes of a group of slots. Each
+ * returns a bit mask with bit i set when slot i of the group
+ * matches. SSE2 compares the 16 bytes at once, the scalar version
+ * is for other CPUs.
+ * 
+ */
+class HashGroup
+{
+public:
+    /**
+     * @brief the slots whose control byte is a given one
+     * 
+     * @param ctrl the control bytes of the group
+     * @param value the control byte to look for
+     * @return uint32_t the bit mask
+     */
+    static uint32_t match(const int8_t* ctrl, int8_t value)
+    {
+#if defined(HASH_TABLE_X86) && defined(__SSE2__)
+        __m128i group = _mm_load_si128((const __m128i*)ctrl);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < HASH_GROUP_SIZE; i++)
+            mask |= (uint32_t)(value == __atomic_load_n(ctrl + i, __ATOMIC_RELAXED)) << i;
+        return mask;
+#endif
+    }
+
+    /**
+     * @brief the slots that are empty or deleted, the ones with the
+     * sign bit clear
+     * 
+     * @param ctrl the control bytes of the group
+     * @return uint32_t the bit mask
+     */
+    static uint32_t match_free(const int8_t* ctrl)
+    {
+#if defined(HASH_TABLE_X86) && defined(__SSE2__)
+        return ~(uint32_t)_mm_movemask_epi8(_mm_load_si128((const __m128i*)ctrl)) & 0xffff;
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < HASH_GROUP_SIZE; i++)
+            mask |= (uint32_t)(__atomic_load_n(ctrl + i, __ATOMIC_RELAXED) >= 0) << i;
+        return mask;
+#endif
+    }
+};
+
+/**
+ * @brief The slots of a hash table: the control bytes, HASH_GROUP_SIZE
+ * per group, followed by the node pointers, in one allocation.
+ * 
+ */
+struct HashSlots
+{
+    /**
+     * @brief the control bytes. Without an allocation they point to
+     * a shared group of empty slots, so that a lookup needs no test
+     * for it.
+     * 
+     */
+    int8_t*                     m_ctrl;
+
+    /**
+     * @brief the nodes, nullptr if there are no slots
+     * 
+     */
+    HashNode**                  m_slots;
+
+    /**
+     * @brief the number of groups minus one
+     * 
+     */
+    size_t                      m_group_mask;
+
+    /**
+     * @brief returned by the lookups for a key that is not there
+     * 
+     */
+    static constexpr size_t npos = (size_t)-1;
+
+    HashSlots();
+
+    /**
+     * @brief allocate zeroed slots, all of them empty
+     * 
+     * @param num_groups the number of groups, a power of two
+     * @return HashSlots the slots, it throws std::bad_alloc on failure
+     */
+    static HashSlots allocate(size_t num_groups);
+
+    /**
+     * @brief free the slots, not the nodes, and become empty
+     * 
+     */
+    void release();
+
+    /**
+     * @brief number of slots
+     * 
+     * @return size_t the number of slots
+     */
+    size_t capacity() const
+    {
+        return m_slots ? (m_group_mask + 1) * HASH_GROUP_SIZE : 0;
+    }
+
+    /**
+     * @brief the control byte of a slot that holds a key, the sign
+     * bit and the low 7 bits of its hash
+     * 
+     * @param hash the hash of the key
+     * @return int8_t the control byte
+     */
+    static int8_t ctrl_of(uint64_t hash)
+    {
+        return (int8_t)(0x80 | (hash & 0x7f));
+    }
+
+    /**
+     * @brief find the slot of a key. Readers may call it while the
+     * writer changes the slots: the writer fills a slot before its
+     * control byte, and clears it after, so a control byte that
+     * matches leads to a node that is valid, or to nullptr. On x86 a
+     * group of control bytes is loaded in one instruction, a group
+     * the writer is changing gives the old or the new byte of each
+     * slot.
+     * 
+     * @param key the key
+     * @param hash its hash
+     * @return std::tuple<size_t, const HashNode*> a tuple of two
+     * items:
+     * 1. the index of the slot, npos if the key is not there
+     * 2. its node, the one that was compared to the key
+     */
+    std::tuple<size_t, const HashNode*> find_index(std::string_view key, uint64_t hash) const
+    {
+        int8_t h2 = ctrl_of(hash);
+        size_t group = (hash >> 7) & m_group_mask;
+
+        __builtin_prefetch(m_slots + group * HASH_GROUP_SIZE);
+        for (size_t step = 1;; step++)
+        {
+            const int8_t* ctrl = m_ctrl + group * HASH_GROUP_SIZE;
+            for (uint32_t mask = HashGroup::match(ctrl, h2); mask; mask &= mask - 1)
+            {
+                size_t index = group * HASH_GROUP_SIZE + __builtin_ctz(mask);
+                const HashNode* pnode = __atomic_load_n(m_slots + index, __ATOMIC_ACQUIRE);
+                if (pnode && pnode->m_hash == hash && pnode->key() == key)
+                    return std::make_tuple(index, pnode);
+            }
+            if (HashGroup::match(ctrl, HASH_CTRL_EMPTY))
+                return std::make_tuple(npos, nullptr);
+            group = (group + step) & m_group_mask;
+        }
+    }
+
+    /**
+     * @brief find the first empty or deleted slot on the probe
+     * sequence of a hash. There must be one.
+     * 
+     * @param hash the hash
+     * @return size_t the index of the slot
+     */
+    size_t find_free_index(uint64_t hash) const;
+
+    /**
+     * @brief set the node of a slot, for the readers to see
+     * 
+     * @param index the index of the slot
+     * @param pnode the node, nullptr to clear the slot
+     */
+    void store_slot(size_t index, HashNode* pnode)
+    {
+        __atomic_store_n(m_slots + index, pnode, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @brief set the control byte of a slot, for the readers to see
+     * 
+     * @param index the index of the slot
+     * @param ctrl the control byte
+     */
+    void store_ctrl(size_t index, int8_t ctrl)
+    {
+        __atomic_store_n(m_ctrl + index, ctrl, __ATOMIC_RELEASE);
+    }
+};
+
+/**
+ * @brief The slots readers look in. It is not modified: the table
+ * publishes a new one when it starts or ends growing.
+ * 
+ */
+struct HashView
+{
+    /**
+     * @brief the slots new keys go to
+     * 
+     */
+    HashSlots                   m_current;
+
+    /**
+     * @brief the slots being moved to m_current, empty if the table
+     * is not growing
+     * 
+     */
+    HashSlots                   m_old;
+};
+
+/**
+ * @brief An open addressing hash table from string keys to string
+ * values, in the style of the Swiss tables.
+ * 
+ * Every slot has a control byte, empty, deleted, or the sign bit
+ * and the low 7 bits of the hash of its key. The control bytes are
+ * kept apart from the slots, in groups of 16 that are compared with
+ * one SSE2 instruction, so a lookup reads one group of control
+ * bytes, and then only the nodes whose 7 bits match, nearly always
+ * the right one. The bits of the hash above those 7 pick the first
+ * group, the following groups are probed in triangular steps until
+ * one with an empty slot. The slots of the first group are fetched
+ * together with its control bytes, their addresses do not depend on
+ * them.
+ * 
+ * A slot only holds a pointer to its node, which has the hash, the
+ * key and the value in one allocation, instead of the three of a
+ * std::unordered_map entry. Nodes are built and freed by the caller,
+ * so that this can be done without holding the lock of the table.
+ * Short keys are not kept in the slots: room for a key in every
+ * slot, used or not, costs more than it saves in the nodes, and a
+ * slot that is reused could not be read by the readers without a
+ * lock.
+ * The table grows when 7/8 of the slots are used or deleted. It does
+ * not move every node at once, which would stall the shard for a
+ * long time with millions of keys: it allocates the new slots, which
+ * come zeroed from the kernel, and keeps the old ones until their
+ * nodes are moved, a group at a time by every insert and remove, and
+ * by migrate(). Meanwhile, new keys go to the new slots, and lookups
+ * look in both.
+ * 
+ * A single writer at a time may change the table, DataStore locks
+ * it, while any number of readers look keys up without a lock, in
+ * an Epoch read section. Nodes are never modified, a slot gets a
+ * new node instead, and what the readers may still see is retired
+ * rather than freed: the nodes the writer removes or replaces, the
+ * slots that are not used any more after growing, and the views of
+ * the slots. The writer collects them and frees them once every
+ * reader that may have seen them has left its read section.
+ * 
+ */
+class HashTable
+{
+public:
+    HashTable();
+
+    HashTable(const HashTable&) = delete;
+    HashTable& operator=(const HashTable&) = delete;
+
+    ~HashTable();
+
+    /**
+     * @brief the hash of a key, for this table. It needs no lock.
+     * 
+     * @param key the key
+     * @return uint64_t the hash
+     */
+    uint64_t hash(std::string_view key) const
+    {
+        return KeyHash::hash(key, m_seed);
+    }
+
+    /**
+     * @brief look up a key. It takes no lock, the caller must be in
+     * an Epoch read section, or be the writer.
+     * 
+     * The old slots are looked in before the new ones, since a node
+     * that moves is put in the new slots before it is removed from
+     * the old ones. A miss is only trusted if the view did not
+     * change meanwhile, its nodes could have moved to slots it does
+     * not know.
+     * 
+     * @param key the key
+     * @param hash the hash of the key
+     * @return const HashNode* the node of the key, nullptr if it is
+     * not there. It stays valid until the read section ends.
+     */
+    const HashNode* find(std::string_view key, uint64_t hash) const
+    {
+        for (;;)
+        {
+            const HashView* pview = m_pview.load(std::memory_order_acquire);
+            if (pview->m_old.m_slots)
+            {
+                auto [index, pnode] = pview->m_old.find_index(key, hash);
+                if (pnode)
+                    return pnode;
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+
+            auto [index, pnode] = pview->m_current.find_index(key, hash);
+            if (pnode)
+                return pnode;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (pview == m_pview.load(std::memory_order_relaxed))
+                return nullptr;
+        }
+    }
+
+    /**
+     * @brief add a node, it replaces the node with the same key
+     * 
+     * @param pnode the node, the table owns it from now on
+     * @return HashNode* the node it replaced, the caller must free
+     * it, nullptr if the key was not there. It throws std::bad_alloc
+     * if the table must grow and cannot, the caller still owns the
+     * node then.
+     */
+    HashNode* insert(HashNode* pnode);
+
+    /**
+     * @brief remove a key
+     * 
+     * @param key the key
+     * @param hash the hash of the key
+     * @return HashNode* the node of the key, the caller must free
+     * it, nullptr if the key was not there
+     */
+    HashNode* remove(std::string_view key, uint64_t hash);
+
+    /**
+     * @brief move nodes from the old slots to the new ones while the
+     * table is growing
+     * 
+     * @param num_groups the number of old groups to move
+     * @return true if there are still nodes to move
+     * @return false if the table is not growing anymore
+     */
+    bool migrate(size_t num_groups);
+
+    /**
+     * @brief whether the table is growing, with nodes left in the old
+     * slots
+     * 
+     * @return true if it is growing
+     */
+    bool is_migrating() const
+    {
+        return nullptr != m_old.m_slots;
+    }
+
+    /**
+     * @brief retire a node that insert() replaced or remove()
+     * removed, it is freed once no reader may see it
+     * 
+     * @param pnode the node
+     */
+    void retire(HashNode* pnode)
+    {
+        m_retired.add(pnode, [](void* p) { HashNode::destroy((HashNode*)p); });
+    }
+
+    /**
+     * @brief take what was retired and that no reader may see any
+     * more, for the writer to free without its lock
+     * 
+     * @param reclaimable the list the nodes and slots are moved to
+     * @param force look at the readers even if little was retired
+     */
+    void collect(RetireList& reclaimable, bool force = false)
+    {
+        m_retired.collect(reclaimable, force);
+    }
+
+    /**
+     * @brief remove and free every node, and free the slots and
+     * everything that was retired. There must be no reader.
+     * 
+     */
+    void clear();
+
+    /**
+     * @brief number of keys
+     * 
+     * @return size_t the number of keys
+     */
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * @brief number of slots, not counting the old slots of a table
+     * that is growing
+     * 
+     * @return size_t the number of slots
+     */
+    size_t capacity() const
+    {
+        return m_current.capacity();
+    }
+
+    /**
+     * @brief bytes allocated for the slots and the nodes
+     * 
+     * @return size_t the number of bytes
+     */
+    size_t memory_usage() const
+    {
+        return (m_current.capacity() + m_old.capacity()) * (1 + sizeof(HashNode*)) + m_node_bytes;
+    }
+
+    /**
+     * @brief number of nodes, slots and views that were retired and
+     * are not freed yet
+     * 
+     * @return size_t the number of objects
+     */
+    size_t retired() const
+    {
+        return m_retired.size();
+    }
+
+private:
+    /**
+     * @brief the slots new keys go to
+     * 
+     */
+    HashSlots                   m_current;
+
+    /**
+     * @brief while the table grows, the slots whose nodes are being
+     * moved to m_current, else empty
+     * 
+     */
+    HashSlots                   m_old;
+
+    /**
+     * @brief the slots the readers look in, m_current and m_old as
+     * of the last time the table started or ended growing
+     * 
+     */
+    std::atomic<HashView*>      m_pview;
+
+    /**
+     * @brief while the table grows, the view to publish when it ends,
+     * allocated in advance so that ending cannot fail
+     * 
+     */
+    HashView*                   m_pnext_view;
+
+    /**
+     * @brief what was retired and readers may still see
+     * 
+     */
+    RetireList                  m_retired;
+
+    /**
+     * @brief the next group of m_old to move
+     * 
+     */
+    size_t                      m_migrate_group;
+
+    /**
+     * @brief number of nodes left in m_old
+     * 
+     */
+    size_t                      m_old_size;
+
+    /**
+     * @brief number of keys
+     * 
+     */
+    size_t                      m_size;
+
+    /**
+     * @brief number of empty slots of m_current that can still be
+     * filled before the table must grow. The nodes of m_old will
+     * take some of them.
+     * 
+     */
+    size_t                      m_growth_left;
+
+    /**
+     * @brief number of deleted slots in m_current
+     * 
+     */
+    size_t                      m_num_deleted;
+
+    /**
+     * @brief bytes allocated for the nodes in the table
+     * 
+     */
+    size_t                      m_node_bytes;
+
+    /**
+     * @brief the seed of the hash. It is not the one that picks the
+     * shard, whose bits are the same for all the keys of a table.
+     * 
+     */
+    uint64_t                    m_seed;
+
+    /**
+     * @brief put a node in a free slot of m_current
+     * 
+     * @param pnode the node
+     */
+    void place(HashNode* pnode);
+
+    /**
+     * @brief make a view the one readers look in, and retire the
+     * previous one
+     * 
+     * @param pview the view
+     */
+    void publish(HashView* pview);
+
+    /**
+     * @brief make room for at least one more key. It ends the growth
+     * in progress if there is one, then starts growing the table, or
+     * moving its nodes to slots of the same size if most of the
+     * used slots are deleted ones.
+     * 
+     */
+    void reserve_one();
+
+    /**
+     * @brief number of slots that may be used or deleted at once
+     * 
+     * @param capacity the number of slots
+     * @return size_t the number of slots
+     */
+    static size_t max_load(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+};
+
+#endif /* #ifndef HASH_TABLE_H_ */
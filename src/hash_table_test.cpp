@@ -0,0 +1,260 @@
+#include <cstdlib>
+#include <unistd.h>
+#include <pthread.h>
+#include <random>
+#include "hash_table.h"
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+/**
+ * @brief set a key in a table, the way DataStore does
+ * 
+ * @param table the table
+ * @param key the key
+ * @param value the value
+ */
+static void set(HashTable& table, std::string_view key, std::string_view value)
+{
+    HashNode* previous = table.insert(HashNode::create(key, value, table.hash(key)));
+    if (previous)
+        HashNode::destroy(previous);
+}
+
+/**
+ * @brief look up a key in a table
+ * 
+ * @param table the table
+ * @param key the key
+ * @return const HashNode* the node, nullptr if the key is not there
+ */
+static const HashNode* find(const HashTable& table, std::string_view key)
+{
+    return table.find(key, table.hash(key));
+}
+
+/**
+ * @brief remove a key from a table
+ * 
+ * @param table the table
+ * @param key the key
+ * @return true if it was there
+ */
+static bool erase(HashTable& table, std::string_view key)
+{
+    HashNode* pnode = table.remove(key, table.hash(key));
+    if (pnode)
+        HashNode::destroy(pnode);
+    return nullptr != pnode;
+}
+
+void test_basic()
+{
+    std::cout << std::endl << "Tests to validate the basic operations" << std::endl;
+    {
+        HashTable table;
+        TEST(nullptr == find(table, "missing") && 0 == table.capacity(),
+            "An empty table should find nothing and have no slots");
+        TEST(!erase(table, "missing"), "Erasing from an empty table should fail");
+
+        set(table, "foo", "bar");
+        TEST(1 == table.size() && nullptr != find(table, "foo") && "bar" == find(table, "foo")->value(),
+            "An inserted key should be found");
+        const HashNode* pfirst = find(table, "foo");
+        HashNode* previous = table.insert(HashNode::create("foo", std::string_view("baz"), table.hash("foo")));
+        TEST(pfirst == previous && 1 == table.size() && "baz" == find(table, "foo")->value(),
+            "Inserting a key again should replace its node and return the old one");
+        HashNode::destroy(previous);
+
+        std::string binary_key("k\0y", 3);
+        set(table, binary_key, std::string_view("v\0\r\n", 4));
+        TEST(nullptr == find(table, "k") && std::string("v\0\r\n", 4) == find(table, binary_key)->value(),
+            "Keys and values should be binary safe");
+
+        set(table, "", "empty");
+        TEST("empty" == find(table, "")->value(), "The empty key should be a key like any other");
+
+        TEST(erase(table, "foo") && nullptr == find(table, "foo") && 2 == table.size(),
+            "An erased key should not be found");
+        TEST(!erase(table, "foo"), "Erasing a key twice should fail");
+
+        table.clear();
+        TEST(0 == table.size() && 0 == table.capacity() && nullptr == find(table, ""),
+            "A cleared table should be empty");
+    }
+    {
+        HashTable table;
+        set(table, "stable", "value");
+        const HashNode* pnode = find(table, "stable");
+        for (int i = 0; i < 10000; i++)
+            set(table, "key:" + std::to_string(i), "");
+        TEST(pnode == find(table, "stable") && "value" == pnode->value(),
+            "A node should stay in place while the table grows");
+        TEST(table.capacity() >= table.size() * 8 / 7 &&
+            0 == (table.capacity() & (table.capacity() - 1)),
+            "The capacity should be a power of two above the maximum load");
+    }
+    {
+        HashTable table;
+        std::string large(HASH_EXTERNAL_VALUE_SIZE, 'x');
+        const char* data = large.data();
+        HashNode* pnode = HashNode::create("large", std::move(large), table.hash("large"));
+        TEST(data == pnode->value().data() && HASH_EXTERNAL_VALUE_SIZE == pnode->value().length(),
+            "A large value that is moved in should keep its allocation");
+        table.insert(pnode);
+
+        std::string small(100, 's');
+        pnode = HashNode::create("small", std::move(small), table.hash("small"));
+        TEST(std::string(100, 's') == pnode->value() &&
+            (const char*)(pnode + 1) + 5 == pnode->value().data(),
+            "A small value should follow the key");
+        table.insert(pnode);
+    }
+}
+
+void test_against_model()
+{
+    std::cout << std::endl << "Tests to compare the table with std::unordered_map" << std::endl;
+    {
+        HashTable table;
+        std::unordered_map<std::string, std::string> model;
+        std::mt19937_64 rng(42);
+        bool same = true;
+
+        // Few keys and many erases, so that the deleted slots are
+        // reused and cleared by rehashes at the same size
+        for (int i = 0; i < 200000; i++)
+        {
+            std::string key = "user:" + std::to_string(rng() % 3000);
+            switch (rng() % 3)
+            {
+                case 0:
+                    set(table, key, std::to_string(i));
+                    model[key] = std::to_string(i);
+                    break;
+                case 1:
+                    if (erase(table, key) != (model.erase(key) > 0))
+                        same = false;
+                    break;
+                default:
+                    {
+                        const HashNode* pnode = find(table, key);
+                        auto it = model.find(key);
+                        if ((nullptr == pnode) != (model.end() == it) ||
+                            (pnode && pnode->value() != it->second))
+                            same = false;
+                    }
+                    break;
+            }
+        }
+        TEST(same, "Every operation should give the same result as the model");
+        TEST(table.size() == model.size(), "The table should have as many keys as the model");
+
+        bool all_found = true;
+        for (auto& [key, value]: model)
+        {
+            const HashNode* pnode = find(table, key);
+            if (!pnode || pnode->value() != value)
+                all_found = false;
+        }
+        TEST(all_found, "Every key of the model should be in the table");
+        TEST(table.capacity() <= 8192, "Churn on few keys should not grow the table");
+    }
+}
+
+void test_growth()
+{
+    std::cout << std::endl << "Tests to validate growing the table incrementally" << std::endl;
+    {
+        HashTable table;
+        int num_keys = 0;
+        while (!table.is_migrating() || table.capacity() < 4096)
+            set(table, "key:" + std::to_string(num_keys++), "value");
+        size_t capacity = table.capacity();
+        TEST(table.memory_usage() > capacity * (1 + sizeof(void*)),
+            "A growing table should keep its old slots");
+
+        bool all_found = true;
+        for (int i = 0; i < num_keys; i++)
+        {
+            if (!find(table, "key:" + std::to_string(i)))
+                all_found = false;
+        }
+        TEST(all_found, "The keys of the old and the new slots should be found");
+
+        // Half of the keys are removed while they are in the old
+        // slots or just moved, and as many new keys come in
+        bool all_erased = true;
+        for (int i = 0; i < num_keys; i += 2)
+        {
+            if (!erase(table, "key:" + std::to_string(i)))
+                all_erased = false;
+            set(table, "new:" + std::to_string(i), "value");
+        }
+        TEST(all_erased && (size_t)num_keys == table.size(),
+            "Keys should be removed from the old and the new slots");
+        TEST(!table.is_migrating() && capacity == table.capacity(),
+            "Every insert and remove should move nodes, until none is left");
+
+        all_found = true;
+        for (int i = 0; i < num_keys; i++)
+        {
+            bool expected = (i & 1);
+            if (expected != (nullptr != find(table, "key:" + std::to_string(i))))
+                all_found = false;
+        }
+        TEST(all_found, "Only the keys that were not removed should be found");
+    }
+    {
+        HashTable table;
+        int num_keys = 0;
+        while (!table.is_migrating() || table.capacity() < 4096)
+            set(table, "key:" + std::to_string(num_keys++), "value");
+        size_t memory = table.memory_usage();
+        size_t steps = 0;
+        while (table.migrate(1))
+            steps++;
+        TEST(steps > 1 && !table.is_migrating() &&
+            memory - table.memory_usage() == table.capacity() / 2 * (1 + sizeof(void*)),
+            "migrate() should move the nodes a group at a time, then free the old slots");
+        TEST(!table.migrate(1), "migrate() should do nothing when the table is not growing");
+    }
+}
+
+void test_memory()
+{
+    std::cout << std::endl << "Tests to validate the memory accounting" << std::endl;
+    {
+        HashTable table;
+        const int num_keys = 100000;
+        for (int i = 0; i < num_keys; i++)
+            set(table, "user:" + std::to_string(i), "value");
+
+        size_t per_key = table.memory_usage() / num_keys;
+        TEST(per_key < 64, "A short key and value should take less than 64 bytes");
+
+        for (int i = 0; i < num_keys; i++)
+            erase(table, "user:" + std::to_string(i));
+        TEST(0 == table.size() && table.memory_usage() == table.capacity() * (1 + sizeof(void*)),
+            "Erasing every key should free every node");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_basic();
+    test_against_model();
+    test_growth();
+    test_memory();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
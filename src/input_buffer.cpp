@@ -0,0 +1,116 @@
+#include "input_buffer.h"
+
+BufferPool& BufferPool::instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::~BufferPool()
+{
+    for (auto& free_list: m_free)
+    {
+        for (auto buffer: free_list)
+            free(buffer);
+        free_list.clear();
+    }
+}
+
+int BufferPool::get_class(size_t size)
+{
+    int size_class = 0;
+    size_t class_size = INPUT_BUFFER_MIN_SIZE;
+
+    while (class_size < size)
+    {
+        class_size <<= 1;
+        size_class++;
+    }
+
+    return (size_class < NUM_CLASSES) ? size_class : -1;
+}
+
+char* BufferPool::allocate(size_t& size)
+{
+    int size_class = get_class(size);
+    char* buffer = nullptr;
+
+    if (size_class >= 0)
+    {
+        size = (size_t)INPUT_BUFFER_MIN_SIZE << size_class;
+
+        std::unique_lock lock(m_mutex);
+        if (!m_free[size_class].empty())
+        {
+            buffer = m_free[size_class].back();
+            m_free[size_class].pop_back();
+        }
+    }
+    else
+    {
+        // Not pooled, rounded up to a whole page
+        size = (size + INPUT_BUFFER_MIN_SIZE - 1) & ~(size_t)(INPUT_BUFFER_MIN_SIZE - 1);
+    }
+
+    if (!buffer)
+        buffer = (char*)malloc(size);
+
+    if (!buffer)
+    {
+        std::cerr << "Out of memory" << std::endl;
+        exit(1);
+    }
+
+    return buffer;
+}
+
+void BufferPool::release(char* buffer, size_t size)
+{
+    int size_class = get_class(size);
+    if (size_class >= 0)
+    {
+        std::unique_lock lock(m_mutex);
+        if (m_free[size_class].size() * size < INPUT_BUFFER_POOL_BYTES)
+        {
+            try
+            {
+                m_free[size_class].push_back(buffer);
+                return;
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    free(buffer);
+}
+
+void InputBuffer::reserve(size_t n)
+{
+    if (writable() >= n)
+        return;
+
+    size_t used = size();
+
+    // Moving the data to the front is enough
+    if (m_data && m_capacity - used >= n)
+    {
+        memmove(m_data, m_data + m_begin, used);
+        m_begin = 0;
+        m_end = used;
+        return;
+    }
+
+    size_t capacity = std::max(m_capacity * 2, used + n);
+    char* data = BufferPool::instance().allocate(capacity);
+    if (used)
+        memcpy(data, m_data + m_begin, used);
+    if (m_data)
+        BufferPool::instance().release(m_data, m_capacity);
+
+    m_data = data;
+    m_capacity = capacity;
+    m_begin = 0;
+    m_end = used;
+}
@@ -0,0 +1,310 @@
+#ifndef INPUT_BUFFER_H_
+#define INPUT_BUFFER_H_
+
+#include "common_include.h"
+#include <cstring>
+
+/**
+ * @brief size of the smallest buffer, every connection that has
+ * received data holds at least this much
+ * 
+ */
+#define INPUT_BUFFER_MIN_SIZE 4096
+
+/**
+ * @brief largest buffer kept in the pool, larger ones are
+ * allocated and freed directly
+ * 
+ */
+#define INPUT_BUFFER_MAX_POOLED_SIZE (1024 * 1024)
+
+/**
+ * @brief largest single read, the read size doubles up to this
+ * while the reads keep filling the buffer
+ * 
+ */
+#define INPUT_BUFFER_MAX_READ_SIZE (1024 * 1024)
+
+/**
+ * @brief number of bytes of idle buffers that the pool keeps for
+ * every size
+ * 
+ */
+#define INPUT_BUFFER_POOL_BYTES (4 * 1024 * 1024)
+
+/**
+ * @brief Pool of buffers, one free list for every power of two
+ * from INPUT_BUFFER_MIN_SIZE to INPUT_BUFFER_MAX_POOLED_SIZE.
+ * 
+ * Connections take their buffers from here and give them back
+ * when they shrink or close, so that buffers are reused instead of
+ * going through the allocator on every request.
+ * 
+ */
+class BufferPool
+{
+public:
+    /**
+     * @brief get the pool shared by all the connections
+     * 
+     * @return BufferPool& the pool
+     */
+    static BufferPool& instance();
+
+    /**
+     * @brief get a buffer
+     * 
+     * @param size the minimum size, it is rounded up to the size of
+     * the buffer that is returned
+     * @return char* the buffer
+     */
+    char* allocate(size_t& size);
+
+    /**
+     * @brief give a buffer back
+     * 
+     * @param buffer the buffer
+     * @param size its size, as returned by allocate
+     */
+    void release(char* buffer, size_t size);
+
+    ~BufferPool();
+
+private:
+    /**
+     * @brief number of different pooled sizes
+     * 
+     */
+    static const int NUM_CLASSES = 9;
+
+    /**
+     * @brief the idle buffers of every size
+     * 
+     */
+    std::vector<char*>          m_free[NUM_CLASSES];
+
+    /**
+     * @brief protects the free lists
+     * 
+     */
+    std::mutex                  m_mutex;
+
+    /**
+     * @brief find the size class of a buffer
+     * 
+     * @param size the size of the buffer
+     * @return int the size class, -1 if it is not pooled
+     */
+    static int get_class(size_t size);
+};
+
+/**
+ * @brief The data received on a connection that has not been
+ * parsed yet.
+ * 
+ * The socket is read directly into the free space at the end of the
+ * buffer and the parser reads the data in place, nothing is copied
+ * in between. Parsed commands are consumed from the front. The
+ * unread data is moved back to the front of the buffer only when
+ * there is not enough space left at the end, so the buffer is used
+ * as a ring without having to wrap the data around.
+ * 
+ * The buffer grows when a large value is being received, and the
+ * size of the reads doubles while they keep filling the buffer, so
+ * that a large payload takes few system calls. Once all the data
+ * has been consumed, a large buffer is given back to the pool.
+ * 
+ */
+class InputBuffer
+{
+public:
+    /**
+     * @brief the memory, nullptr until the first read
+     * 
+     */
+    char*                       m_data;
+
+    /**
+     * @brief size of m_data
+     * 
+     */
+    size_t                      m_capacity;
+
+    /**
+     * @brief offset of the first byte that has not been consumed
+     * 
+     */
+    size_t                      m_begin;
+
+    /**
+     * @brief offset after the last byte received
+     * 
+     */
+    size_t                      m_end;
+
+    /**
+     * @brief the free space the next read will have
+     * 
+     */
+    size_t                      m_read_size;
+
+    InputBuffer():
+        m_data(nullptr),
+        m_capacity(0),
+        m_begin(0),
+        m_end(0),
+        m_read_size(INPUT_BUFFER_MIN_SIZE)
+    {
+    }
+
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    ~InputBuffer()
+    {
+        if (m_data)
+            BufferPool::instance().release(m_data, m_capacity);
+    }
+
+    /**
+     * @brief the data that has not been consumed
+     * 
+     * @return const char* the first byte
+     */
+    const char* data() const
+    {
+        return m_data + m_begin;
+    }
+
+    /**
+     * @brief number of bytes that have not been consumed
+     * 
+     * @return size_t the number of bytes
+     */
+    size_t size() const
+    {
+        return m_end - m_begin;
+    }
+
+    /**
+     * @brief is there any data that has not been consumed
+     * 
+     * @return true if there is none
+     */
+    bool empty() const
+    {
+        return m_end == m_begin;
+    }
+
+    /**
+     * @brief where the next read must write
+     * 
+     * @return char* the first free byte
+     */
+    char* write_ptr()
+    {
+        return m_data + m_end;
+    }
+
+    /**
+     * @brief how much the next read may write
+     * 
+     * @return size_t number of free bytes at the end
+     */
+    size_t writable() const
+    {
+        return m_capacity - m_end;
+    }
+
+    /**
+     * @brief make room for the next read
+     * 
+     * @param expected total number of bytes the data must have
+     * before the next command can be parsed, 0 if it is not known.
+     * The buffer is sized to hold all of it at once.
+     */
+    void prepare_read(size_t expected = 0)
+    {
+        size_t needed = m_read_size;
+        if (expected > size() && expected - size() > needed)
+            needed = expected - size();
+        reserve(needed);
+    }
+
+    /**
+     * @brief account for bytes written by a read at write_ptr()
+     * 
+     * @param n the number of bytes read
+     */
+    void commit(size_t n)
+    {
+        // A read that fills all the space suggests more is coming
+        if (n == writable() && m_read_size < INPUT_BUFFER_MAX_READ_SIZE)
+            m_read_size *= 2;
+        m_end += n;
+    }
+
+    /**
+     * @brief copy data to the end of the buffer
+     * 
+     * @param data the data
+     * @param n its length
+     */
+    void append(const char* data, size_t n)
+    {
+        reserve(n);
+        memcpy(write_ptr(), data, n);
+        m_end += n;
+    }
+
+    /**
+     * @brief remove parsed bytes from the front
+     * 
+     * @param n the number of bytes
+     */
+    void consume(size_t n)
+    {
+        m_begin += n;
+        if (m_begin >= m_end)
+            m_begin = m_end = 0;
+    }
+
+    /**
+     * @brief drop all the data
+     * 
+     */
+    void clear()
+    {
+        m_begin = m_end = 0;
+    }
+
+    /**
+     * @brief give a large buffer back to the pool once all of its
+     * data has been consumed, and start reading small again
+     * 
+     */
+    void shrink()
+    {
+        if (!empty())
+            return;
+
+        m_read_size = INPUT_BUFFER_MIN_SIZE;
+        if (m_capacity <= INPUT_BUFFER_MIN_SIZE)
+            return;
+
+        BufferPool::instance().release(m_data, m_capacity);
+        m_data = nullptr;
+        m_capacity = 0;
+        m_begin = m_end = 0;
+    }
+
+    /**
+     * @brief make sure there are at least n free bytes at the end,
+     * by moving the data to the front or by growing the buffer
+     * 
+     * @param n the number of bytes
+     */
+    void reserve(size_t n);
+};
+
+#endif /* #ifndef INPUT_BUFFER_H_ */
@@ -0,0 +1,102 @@
+#include "input_buffer.h"
+#include <cstdlib>
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+void test_append_consume()
+{
+    std::cout << std::endl << "Tests to validate appending and consuming" << std::endl;
+    {
+        InputBuffer buffer;
+        TEST(buffer.empty(), "A new buffer should be empty");
+        TEST(nullptr == buffer.m_data, "A new buffer should not allocate memory");
+
+        std::string data("a\0b\r\nc", 6);
+        buffer.append(data.data(), data.length());
+        TEST(6 == buffer.size(), "Binary data should be appended completely");
+        TEST(std::string(buffer.data(), buffer.size()) == data, "Binary data should be preserved");
+
+        buffer.consume(2);
+        TEST(std::string(buffer.data(), buffer.size()) == data.substr(2), "Consumed bytes should be removed");
+        buffer.consume(4);
+        TEST(buffer.empty() && 0 == buffer.m_begin, "A fully consumed buffer should start over");
+    }
+}
+
+void test_reserve()
+{
+    std::cout << std::endl << "Tests to validate making room for reads" << std::endl;
+    {
+        InputBuffer buffer;
+        buffer.prepare_read();
+        TEST(INPUT_BUFFER_MIN_SIZE == buffer.writable(), "The first read should get the smallest buffer");
+
+        std::string data(INPUT_BUFFER_MIN_SIZE - 10, 'x');
+        memcpy(buffer.write_ptr(), data.data(), data.length());
+        buffer.commit(data.length());
+        buffer.consume(data.length() - 5);
+        char* before = buffer.m_data;
+
+        buffer.reserve(100);
+        TEST(before == buffer.m_data, "Moving the data to the front should be preferred to growing");
+        TEST(0 == buffer.m_begin && 5 == buffer.size(), "The data should be moved to the front");
+
+        buffer.reserve(3 * INPUT_BUFFER_MIN_SIZE);
+        TEST(buffer.writable() >= 3 * INPUT_BUFFER_MIN_SIZE, "The buffer should grow when needed");
+        TEST(std::string(buffer.data(), buffer.size()) == "xxxxx", "Growing should keep the data");
+    }
+    {
+        InputBuffer buffer;
+        buffer.prepare_read();
+        size_t first = buffer.writable();
+        buffer.commit(first);
+        buffer.consume(first);
+        buffer.prepare_read();
+        TEST(buffer.writable() >= 2 * first, "A read that fills the buffer should double the next read");
+
+        buffer.shrink();
+        TEST(nullptr == buffer.m_data, "An empty large buffer should be released");
+        buffer.prepare_read();
+        TEST(INPUT_BUFFER_MIN_SIZE == buffer.writable(), "After shrinking, reads should start small");
+    }
+    {
+        InputBuffer buffer;
+        buffer.prepare_read(10 * INPUT_BUFFER_MIN_SIZE);
+        TEST(buffer.writable() >= 10 * INPUT_BUFFER_MIN_SIZE, "The buffer should be sized for an expected value");
+    }
+}
+
+void test_pool()
+{
+    std::cout << std::endl << "Tests to validate the buffer pool" << std::endl;
+    {
+        size_t size = 5000;
+        char* p = BufferPool::instance().allocate(size);
+        TEST(2 * INPUT_BUFFER_MIN_SIZE == size, "Sizes should be rounded up to a power of two");
+        BufferPool::instance().release(p, size);
+
+        size_t size2 = 6000;
+        char* p2 = BufferPool::instance().allocate(size2);
+        TEST(p == p2, "Released buffers should be reused");
+        BufferPool::instance().release(p2, size2);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_append_consume();
+    test_reserve();
+    test_pool();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
@@ -0,0 +1,146 @@
+#ifndef KEY_HASH_H_
+#define KEY_HASH_H_
+
+#include "common_include.h"
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+/**
+ * @brief The hash of the keys, it picks the data store shard of a
+ * key.
+ * 
+ * This is wyhash (final version 4, public domain): a few 64x64 to
+ * 128 bit multiplications per 16 bytes, with every byte of the key
+ * mixed into every bit of the result. Keys that only differ after a
+ * common prefix such as "user:" are spread as well as random ones.
+ * The hash is seeded, so that clients cannot pick keys that all
+ * land in the same shard without knowing the seed.
+ * 
+ */
+class KeyHash
+{
+public:
+    /**
+     * @brief hash a key
+     * 
+     * @param key the key, any bytes
+     * @param seed the seed
+     * @return uint64_t the hash
+     */
+    static uint64_t hash(std::string_view key, uint64_t seed)
+    {
+        const uint8_t* p = (const uint8_t*)key.data();
+        size_t len = key.length();
+        uint64_t a;
+        uint64_t b;
+
+        seed ^= mix(seed ^ m_secret[0], m_secret[1]);
+        if (len <= 16)
+        {
+            if (len >= 4)
+            {
+                a = (read4(p) << 32) | read4(p + ((len >> 3) << 2));
+                b = (read4(p + len - 4) << 32) | read4(p + len - 4 - ((len >> 3) << 2));
+            }
+            else if (len > 0)
+            {
+                a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+                b = 0;
+            }
+            else
+                a = b = 0;
+        }
+        else
+        {
+            size_t i = len;
+            if (i >= 48)
+            {
+                uint64_t seed1 = seed;
+                uint64_t seed2 = seed;
+                do
+                {
+                    seed = mix(read8(p) ^ m_secret[1], read8(p + 8) ^ seed);
+                    seed1 = mix(read8(p + 16) ^ m_secret[2], read8(p + 24) ^ seed1);
+                    seed2 = mix(read8(p + 32) ^ m_secret[3], read8(p + 40) ^ seed2);
+                    p += 48;
+                    i -= 48;
+                } while (i >= 48);
+                seed ^= seed1 ^ seed2;
+            }
+            while (i > 16)
+            {
+                seed = mix(read8(p) ^ m_secret[1], read8(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+            a = read8(p + i - 16);
+            b = read8(p + i - 8);
+        }
+
+        a ^= m_secret[1];
+        b ^= seed;
+        multiply(a, b);
+        return mix(a ^ m_secret[0] ^ len, b ^ m_secret[1]);
+    }
+
+    /**
+     * @brief a seed that differs from one run of the server to the
+     * next
+     * 
+     * @return uint64_t the seed
+     */
+    static uint64_t random_seed()
+    {
+        std::random_device device;
+        return ((uint64_t)device() << 32) ^ device();
+    }
+
+private:
+    /**
+     * @brief the constants of wyhash
+     * 
+     */
+    static constexpr uint64_t m_secret[4] = {
+        0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+        0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+    /**
+     * @brief multiply two numbers into 128 bits
+     * 
+     * @param a receives the low 64 bits
+     * @param b receives the high 64 bits
+     */
+    static void multiply(uint64_t& a, uint64_t& b)
+    {
+        __uint128_t product = (__uint128_t)a * b;
+        a = (uint64_t)product;
+        b = (uint64_t)(product >> 64);
+    }
+
+    /**
+     * @brief fold the 128 bit product of two numbers into 64 bits
+     * 
+     */
+    static uint64_t mix(uint64_t a, uint64_t b)
+    {
+        multiply(a, b);
+        return a ^ b;
+    }
+
+    static uint64_t read8(const uint8_t* p)
+    {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint64_t read4(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+};
+
+#endif /* #ifndef KEY_HASH_H_ */
@@ -0,0 +1,92 @@
+#include <cstdlib>
+#include <unistd.h>
+#include <pthread.h>
+#include "key_hash.h"
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+void test_hash()
+{
+    std::cout << std::endl << "Tests to validate hashing keys" << std::endl;
+    {
+        TEST(KeyHash::hash("user:1000", 1) == KeyHash::hash(std::string("user:1000"), 1),
+            "The same key should have the same hash");
+        TEST(KeyHash::hash("user:1000", 1) != KeyHash::hash("user:1000", 2),
+            "The seed should change the hash");
+        TEST(KeyHash::hash("user:1000", 1) != KeyHash::hash("user:1001", 1),
+            "Keys that differ in their last byte should have different hashes");
+        TEST(KeyHash::hash(std::string_view("a\0b", 3), 1) != KeyHash::hash(std::string_view("a\0c", 3), 1),
+            "Bytes after a NUL should be hashed");
+    }
+    {
+        // Every length goes through a different path, and must only
+        // read the bytes of the key
+        std::string buffer(200, 'k');
+        std::set<uint64_t> hashes;
+        for (size_t len = 0; len <= 100; len++)
+            hashes.insert(KeyHash::hash(std::string_view(buffer.data() + 50, len), 7));
+        TEST(101 == hashes.size(), "Keys of every length up to 100 should have different hashes");
+
+        bool stable = true;
+        for (size_t len = 0; len <= 100; len++)
+        {
+            std::string key(len, 'k');
+            if (KeyHash::hash(key, 7) != KeyHash::hash(std::string_view(buffer.data() + 50, len), 7))
+                stable = false;
+        }
+        TEST(stable, "The hash should not depend on the bytes around the key");
+    }
+}
+
+void test_distribution()
+{
+    std::cout << std::endl << "Tests to validate the distribution of keys to shards" << std::endl;
+    {
+        const int num_shards = 16;
+        const int num_keys = 160000;
+        std::vector<int> counts(num_shards, 0);
+        uint64_t seed = KeyHash::random_seed();
+
+        for (int i = 0; i < num_keys; i++)
+        {
+            std::string key = ((i & 1) ? "user:" : "sess:") + std::to_string(i);
+            counts[KeyHash::hash(key, seed) & (num_shards - 1)]++;
+        }
+
+        auto [min, max] = std::minmax_element(counts.begin(), counts.end());
+        int expected = num_keys / num_shards;
+        TEST(*min > expected * 95 / 100 && *max < expected * 105 / 100,
+            "Keys with common prefixes should be spread evenly over the shards");
+    }
+    {
+        std::vector<int> bits(64, 0);
+        const int num_keys = 10000;
+        for (int i = 0; i < num_keys; i++)
+        {
+            uint64_t h = KeyHash::hash("user:" + std::to_string(i), 3);
+            for (int bit = 0; bit < 64; bit++)
+                bits[bit] += (h >> bit) & 1;
+        }
+        auto [min, max] = std::minmax_element(bits.begin(), bits.end());
+        TEST(*min > num_keys * 45 / 100 && *max < num_keys * 55 / 100,
+            "Every bit of the hash should be set for about half of the keys");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_hash();
+    test_distribution();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
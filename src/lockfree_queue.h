@@ -0,0 +1,155 @@
+#ifndef LOCKFREE_QUEUE_H_
+#define LOCKFREE_QUEUE_H_
+
+#include "common_include.h"
+#include <cstdint>
+
+/**
+ * @brief A bounded lock-free queue that supports multiple
+ * producers and multiple consumers.
+ * 
+ * This is the array based queue described by Dmitry Vyukov.
+ * Every cell carries a sequence number that tells a producer
+ * whether the cell is free, and a consumer whether the cell
+ * has been filled. Producers and consumers only contend on
+ * the head and tail counters, there are no locks.
+ * 
+ * @tparam T type of the items, must be default constructible
+ * and move assignable
+ */
+template <typename T>
+class LockFreeQueue
+{
+private:
+    /**
+     * @brief one slot of the ring
+     * 
+     */
+    struct Cell
+    {
+        std::atomic<size_t>     m_sequence;
+        T                       m_data;
+    };
+
+    /**
+     * @brief the ring of cells, the size is a power of 2
+     * 
+     */
+    Cell*                                   m_buffer;
+
+    /**
+     * @brief size of the ring minus one, used to wrap around
+     * 
+     */
+    size_t                                  m_mask;
+
+    /**
+     * @brief position of the next enqueue, on its own cache line
+     * 
+     */
+    alignas(64) std::atomic<size_t>         m_enqueue_pos;
+
+    /**
+     * @brief position of the next dequeue, on its own cache line
+     * 
+     */
+    alignas(64) std::atomic<size_t>         m_dequeue_pos;
+
+public:
+    /**
+     * @brief Construct a new queue
+     * 
+     * @param capacity maximum number of items, it is rounded up
+     * to a power of 2
+     */
+    LockFreeQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        m_buffer = new Cell[size];
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+            m_buffer[i].m_sequence.store(i, std::memory_order_relaxed);
+        m_enqueue_pos.store(0, std::memory_order_relaxed);
+        m_dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    ~LockFreeQueue()
+    {
+        delete[] m_buffer;
+    }
+
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+    /**
+     * @brief add an item to the queue
+     * 
+     * @param data the item, it is moved into the queue on success
+     * @return true on success
+     * @return false if the queue is full
+     */
+    bool push(T& data)
+    {
+        Cell* cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (0 == diff)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+
+        cell->m_data = std::move(data);
+        cell->m_sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief remove an item from the queue
+     * 
+     * @param data receives the item on success
+     * @return true on success
+     * @return false if the queue is empty
+     */
+    bool pop(T& data)
+    {
+        Cell* cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (0 == diff)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+
+        data = std::move(cell->m_data);
+        cell->m_data = T();
+        cell->m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif /* #ifndef LOCKFREE_QUEUE_H_ */
@@ -12,102 +12,222 @@ void close_and_cleanup(
     std::shared_ptr<State> m_pstate,
     Orchestrator* m_porchestrator)
 {
+    // Marked before it is released, the idle reaper may lock it next
+    m_pstate->m_state = STATE_CLOSING;
     m_pstate->m_mutex.unlock();
     m_porchestrator->remove_socket(fd);
     close(fd);
 }
 
 /**
- * @brief create a server socket to listen on
+ * @brief create the server sockets to listen on, one for every
+ * accepting thread
  * 
  */
 void Orchestrator::create_server_socket()
+{
+    // The io_uring backend accepts on a single socket
+    int count = (NETWORK_BACKEND_IO_URING == m_config.m_backend) ?
+                    1 : m_config.m_num_acceptors;
+
+    for (int i = 0; i < count; i++)
+    {
+        int fd = create_listen_socket();
+        if (fd < 0)
+        {
+            assert(0);
+            exit(1);
+        }
+        m_server_sockets.push_back(fd);
+    }
+    m_server_socket = m_server_sockets[0];
+
+    create_unix_server_socket();
+}
+
+/**
+ * @brief create the Unix domain socket to listen on, if one is
+ * configured. A stale socket file left at the path is replaced.
+ * 
+ */
+void Orchestrator::create_unix_server_socket()
+{
+    if (m_config.m_unix_socket.empty())
+        return;
+
+    m_unix_server_socket = create_unix_listen_socket();
+    if (m_unix_server_socket < 0)
+    {
+        assert(0);
+        exit(1);
+    }
+}
+
+/**
+ * @brief create a non-blocking Unix domain socket listening on
+ * the configured path, with the configured permissions
+ * 
+ * @return int the socket, -1 on failure
+ */
+int Orchestrator::create_unix_listen_socket()
+{
+    struct sockaddr_un      address;
+    const std::string&      path        = m_config.m_unix_socket;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Unix socket path too long '" << path << "'" << std::endl;
+        return -1;
+    }
+    memcpy(address.sun_path, path.c_str(), path.length());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        std::cerr << "Could not create socket, errno = " << errno << std::endl;
+        return -1;
+    }
+
+    // A socket file cannot be bound twice, the one left behind by a
+    // server that did not exit cleanly is removed first
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)))
+    {
+        perror("bind");
+        std::cerr << "bind failed with error = " << errno << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    if (m_config.m_unix_socket_perm &&
+        chmod(path.c_str(), m_config.m_unix_socket_perm))
+    {
+        perror("chmod");
+        std::cerr << "chmod failed with error = " << errno << std::endl;
+        close(fd);
+        unlink(path.c_str());
+        return -1;
+    }
+
+    if (listen(fd, m_config.m_backlog) < 0)
+    {
+        perror("listen");
+        std::cerr << "listen failed with error = " << errno << std::endl;
+        close(fd);
+        unlink(path.c_str());
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief create a non-blocking socket listening on the configured
+ * address and port. SO_REUSEPORT is set, so that several of them
+ * can share the port.
+ * 
+ * @return int the socket, -1 on failure
+ */
+int Orchestrator::create_listen_socket()
 {
     int                     opt         = 1;
     struct sockaddr_in      address;
-    m_server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_server_socket <= 0)
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(m_config.m_port);
+    if (1 != inet_pton(AF_INET, m_config.m_bind_address.c_str(), &address.sin_addr))
+    {
+        std::cerr << "Invalid bind address '" << m_config.m_bind_address \
+            << "'" << std::endl;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
     {
         perror("socket");
         std::cerr << "Could not create socket, errno = " << errno << std::endl;
-        assert(0);
-        exit(1);
+        return -1;
     }
 
-    if (setsockopt(
-            m_server_socket,
-            SOL_SOCKET,
-            SO_REUSEADDR | SO_REUSEPORT,
-            &opt,
-            sizeof(opt)))
+    // With SO_REUSEPORT the kernel balances the incoming connections
+    // between all the sockets bound to the port
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))
     {
         perror("setsockopt");
         std::cerr << "setsockopt failed with error = " << errno << std::endl;
-        assert(0);
-        exit(1);
+        close(fd);
+        return -1;
     }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORTNUM);
 
-    if (bind(
-            m_server_socket,
-            (struct sockaddr*)&address,
-            sizeof(address)))
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)))
     {
         perror("bind");
         std::cerr << "bind failed with error = " << errno << std::endl;
-        assert(0);
-        exit(1);
+        close(fd);
+        return -1;
     }
 
-    if (listen(m_server_socket, 10) < 0)
+    if (listen(fd, m_config.m_backlog) < 0)
     {
         perror("listen");
         std::cerr << "listen failed with error = " << errno << std::endl;
-        exit(1);
+        close(fd);
+        return -1;
     }
+
+    return fd;
 }
 
 /**
- * @brief spawn a thread that loops to accpept new connections
+ * @brief spawn the threads that loop to accept new connections,
+ * one per server socket, and one for the Unix domain socket
  * 
  * @return true on successful launch
  * @return false on unsuccessful launch
  */
 bool Orchestrator::spawn_accepting_thread()
 {
-    int retval;
-    if (0 != (retval = pthread_create(
-        &m_accepting_thread_id,
-        NULL,
-        Orchestrator::accepting_thread_pthread_fn,
-        this)))
+    std::vector<int> listen_sockets = m_server_sockets;
+    if (m_unix_server_socket >= 0)
+        listen_sockets.push_back(m_unix_server_socket);
+
+    for (auto listen_socket: listen_sockets)
     {
-        std::cerr << "pthread_create failed with rc = " << retval \
-                << " errno = " << errno << std::endl;
-        return false;
+        AcceptorThreadArg* arg = new (std::nothrow) AcceptorThreadArg;
+        if (!arg)
+        {
+            std::cerr << "Out of memory" << std::endl;
+            return false;
+        }
+        arg->m_porchestrator = this;
+        arg->m_listen_socket = listen_socket;
+        arg->m_is_unix = (listen_socket == m_unix_server_socket);
+
+        pthread_t tid;
+        int retval;
+        if (0 != (retval = pthread_create(
+            &tid,
+            NULL,
+            Orchestrator::accepting_thread_pthread_fn,
+            arg)))
+        {
+            std::cerr << "pthread_create failed with rc = " << retval \
+                    << " errno = " << errno << std::endl;
+            delete arg;
+            return false;
+        }
+        m_accepting_thread_ids.push_back(tid);
     }
 
     return true;
 }
 
-/**
- * @brief signal handler used to trap SIGUSR1
- * The signal mechanism is used to interrupt the epoll_wait
- * system call. In case a new connection is accepted, it
- * must be added to the epoll structure immediately.
- * 
- * @param signo the signal 
- * @param info 
- * @param context 
- */
-void sigusr1_handler(int signo, siginfo_t *info, void *context)
-{
-    std::cout << "sigusr1 delivered" << std::endl;
-    return;
-}
-
 /**
  * @brief spawn the thread that calls epoll for ready sockets
  * 
@@ -132,179 +252,395 @@ bool Orchestrator::spawn_epoll_thread()
     return true;
 }
 /**
- * @brief loop and accept connections on the listening socket
- * Once a connection is received, it then adds it to the queue
- * which the epoll thread uses, and wakes up the epoll thread.
+ * @brief loop and accept connections on a listening socket
+ * Once a connection is received, it is registered with epoll
+ * and will be picked up by the epoll thread once readable.
+ * 
+ * The socket is non-blocking. Every time it becomes readable, all
+ * the pending connections are accepted, up to ACCEPT_BATCH_SIZE at
+ * a time, and registered together, so that a burst of connections
+ * takes the locks once per batch instead of once per connection.
  * 
+ * @param listen_socket the listening socket
+ * @param is_unix is it the Unix domain socket
  */
-void Orchestrator::accepting_thread_loop()
+void Orchestrator::accepting_thread_loop(int listen_socket, bool is_unix)
 {
-    struct sockaddr_in address;
-    int addrlen;
+    std::vector<int> batch;
+    batch.reserve(ACCEPT_BATCH_SIZE);
 
-    while(true)
+    while (!m_is_destroying)
     {
-        addrlen = sizeof(address);
-        int new_socket = accept(
-                            m_server_socket,
-                            (struct sockaddr*)&address,
-                            (socklen_t*)&addrlen);
-        if (new_socket < 0)
-        {
-            perror("accept");
-            std::cerr << "accept failed with rc = " << new_socket;
-            std::cerr << " errno = " << errno << std::endl;
-            continue;
-        }
-
-        int flags = fcntl(new_socket, F_GETFL, 0);
-        if (0 != fcntl(new_socket, F_SETFL, flags | O_NONBLOCK))
-        {
-            std::cerr << new_socket << \
-                    ": could not set nonblocking" << std::endl;
-        }
+        bool is_failing = false;
 
-        std::unique_lock    lock(m_all_sockets_mtx);
-        try
+        batch.clear();
+        while (batch.size() < ACCEPT_BATCH_SIZE)
         {
-            auto state = State::create_state(new_socket);
-            if (state)
+            ServerStats::add(m_stats.m_syscalls_accept);
+            int new_socket = accept4(
+                                listen_socket,
+                                nullptr,
+                                nullptr,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (new_socket < 0)
             {
-                state->m_state = STATE_ACCEPTED;
-                m_all_sockets[new_socket] = state;
+                if (EINTR == errno)
+                    continue;
+                if (EAGAIN != errno && EWOULDBLOCK != errno)
+                {
+                    perror("accept4");
+                    std::cerr << "accept failed, errno = " << errno << std::endl;
+                    is_failing = true;
+                }
+                break;
             }
+            batch.push_back(new_socket);
         }
-        catch (...)
+
+        if (batch.size())
         {
-            std::cerr << "Unknown exception" << std::endl;
-            assert(0);
-            exit(1);
+            register_connections(batch, is_unix);
+            continue;
         }
-        lock.unlock();
 
-        std::unique_lock    lock2(m_epoll_sockets_mtx);
-        try
+        // Out of file descriptors, or a similar error: the pending
+        // connection stays in the queue, give it some time instead
+        // of spinning on it
+        if (is_failing)
         {
-            m_epoll_sockets.insert(new_socket);
+            usleep(10000);
+            continue;
         }
-        catch(const std::exception& e)
+
+        struct pollfd pfd = {listen_socket, POLLIN, 0};
+        ServerStats::add(m_stats.m_syscalls_other);
+        if (poll(&pfd, 1, 1000) < 0 && EINTR != errno)
+            perror("poll");
+    }
+}
+
+/**
+ * @brief create the state of newly accepted connections and
+ * register them with epoll
+ * 
+ * @param fds the accepted sockets
+ * @param is_unix did they come through the Unix domain socket
+ */
+void Orchestrator::register_connections(const std::vector<int>& fds, bool is_unix)
+{
+    m_stats.add_accepted(fds.size(), is_unix);
+
+    // Adding a ready socket to epoll wakes up epoll_wait by
+    // itself, there is no need to signal the epoll thread
+    for (auto fd: fds)
+    {
+        auto state = admit_client(fd);
+        if (!state)
+            continue;
+        state->m_state = STATE_ACCEPTED;
+        if (!m_connections.insert(fd, state))
         {
-            std::cerr << "Unknown exception" << std::endl;
-            assert(0);
-            exit(1);
+            std::cerr << fd << ": File descriptor too large" << std::endl;
+            close(fd);
+            continue;
         }
-        lock2.unlock();
 
-        std::cerr << new_socket << \
-            ": Accepted, waking up epoll thread" << std::endl;
-        
-        wakeup_epoll_thread();
+        state->m_state = STATE_WAITING_FOR_EPOLL;
+        if (!epoll_register(fd, state->m_generation))
+        {
+            remove_socket(fd);
+            close(fd);
+            continue;
+        }
+        watch_connection(state);
     }
 }
 
 /**
- * @brief Add a file descriptor to queue for epoll
- * This queue is monitored by the thread which executes
- * epoll.
- * The thread is woken up.
+ * @brief create the state of a newly accepted client, or turn it
+ * away if --maxclients clients are connected already
  * 
- * @param fd file descriptor to monitor for changes
+ * @param fd the accepted socket
+ * @return std::shared_ptr<State> the state, nullptr if the socket
+ * was closed
  */
-void Orchestrator::add_to_epoll_queue(int fd)
+std::shared_ptr<State> Orchestrator::admit_client(int fd)
 {
-    std::unique_lock lock(m_epoll_sockets_mtx);
-    try
+    uint64_t clients = m_stats.m_connected_clients.fetch_add(1) + 1;
+    if (m_config.m_max_clients && clients > (uint64_t)m_config.m_max_clients)
     {
-        m_epoll_sockets.insert(fd);
+        m_stats.m_connected_clients.fetch_sub(1);
+        ServerStats::add(m_stats.m_rejected_connections);
+
+        // The socket is new, the error fits in its buffer
+        ServerStats::add(m_stats.m_syscalls_write);
+        if (write(fd, MAX_CLIENTS_ERROR, strlen(MAX_CLIENTS_ERROR)) < 0)
+            perror("write");
+        close(fd);
+        return nullptr;
     }
-    catch(...)
+
+    auto pstate = State::create_state(fd);
+    if (!pstate)
     {
-        std::cerr << "Unknown exception" << std::endl;
-        assert(0);
-        exit(1);
+        m_stats.m_connected_clients.fetch_sub(1);
+        std::cerr << fd << ": Out of memory, closing" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    pstate->m_pclient_count = &m_stats.m_connected_clients;
+    pstate->m_arena.set_stats(&m_stats.m_arena);
+    pstate->m_parser.set_limits(m_config.m_request_limits);
+    return pstate;
+}
+
+/**
+ * @brief Add a file descriptor back to the set monitored
+ * by epoll. The socket is already registered, so it only
+ * needs to be re-armed.
+ * 
+ * The state is reset and released only once the socket is armed,
+ * so a state that is not locked is always waiting in epoll. The
+ * idle reaper relies on it.
+ * 
+ * @param pstate the locked state of the socket to monitor for
+ * changes
+ */
+void Orchestrator::add_to_epoll_queue(std::shared_ptr<State> pstate)
+{
+    int fd = pstate->m_socket;
+    if (!epoll_rearm(fd, pstate->m_generation))
+    {
+        close_and_cleanup(fd, pstate, this);
+        return;
     }
-    lock.unlock();
     std::cerr << fd << ": Added to epoll queue" << std::endl;
-    wakeup_epoll_thread();
+    pstate->reset(STATE_WAITING_FOR_EPOLL);
 }
 
 /**
- * @brief Wake up the epoll thread by sending it a signal
+ * @brief how often the timer of a connection looks at it
  * 
+ * @return uint64_t the shortest enabled timeout in milliseconds,
+ * 0 if none is enabled
  */
-void Orchestrator::wakeup_epoll_thread()
+uint64_t Orchestrator::get_timeout_check_ms()
 {
-    // force the epoll thread to wakeup by sending SIGUSR1
-    pthread_kill(m_epoll_thread_id, SIGUSR1);
+    uint64_t idle_ms = (uint64_t)m_config.m_idle_timeout * 1000;
+    uint64_t request_ms = (uint64_t)m_config.m_request_timeout * 1000;
+
+    if (!idle_ms || !request_ms)
+        return idle_ms + request_ms;
+    return std::min(idle_ms, request_ms);
 }
 
 /**
- * @brief remove all monitoring file descriptors from epoll
- * This is the unsafe version of the function, and the caller
- * must hold the m_epoll_sockets_mtx lock before calling it
+ * @brief find whether a connection has timed out, against the
+ * request timeout if a command is partially received, against the
+ * idle timeout otherwise
+ * 
+ * @param pstate the owned state of the connection
+ * @param now_ms the current time
+ * @return std::tuple<bool, uint64_t> whether it timed out, and if
+ * not when to look at it again
  */
-void Orchestrator::epoll_empty_unsafe()
+std::tuple<bool, uint64_t> Orchestrator::check_timeout(
+    std::shared_ptr<State> pstate,
+    uint64_t now_ms)
 {
-    for (auto fd: m_epoll_sockets)
+    uint64_t check_ms = get_timeout_check_ms();
+    uint64_t timeout_s = pstate->is_in_request() ?
+        m_config.m_request_timeout : m_config.m_idle_timeout;
+
+    if (!timeout_s)
+        return {false, now_ms + check_ms};
+
+    uint64_t deadline = pstate->m_last_activity + timeout_s * 1000;
+    if (now_ms >= deadline)
+        return {true, 0};
+    return {false, std::min(deadline, now_ms + check_ms)};
+}
+
+/**
+ * @brief count a connection closed by a timeout
+ * 
+ * @param pstate the state of the connection
+ */
+void Orchestrator::count_timeout(std::shared_ptr<State> pstate)
+{
+    if (pstate->is_in_request())
+        ServerStats::add(m_stats.m_request_timeout_disconnects);
+    else
+        ServerStats::add(m_stats.m_idle_disconnects);
+}
+
+/**
+ * @brief start the timer of a newly registered connection
+ * 
+ * @param pstate the state of the connection
+ */
+void Orchestrator::watch_connection(std::shared_ptr<State> pstate)
+{
+    uint64_t check_ms = get_timeout_check_ms();
+    if (!check_ms)
+        return;
+
+    std::weak_ptr<State> weak = pstate;
+    pstate->m_timer.m_callback = [this, weak]() { on_connection_timer(weak); };
+    m_timers.schedule(pstate->m_timer, TimerWheel::clock_ms() + check_ms);
+}
+
+/**
+ * @brief the timer of a connection expired, close it if it timed
+ * out. Runs on the epoll thread.
+ * 
+ * A state that is not locked is armed in epoll: add_to_epoll_queue
+ * releases it only once the socket is re-armed.
+ * 
+ * @param weak the state of the connection
+ */
+void Orchestrator::on_connection_timer(std::weak_ptr<State> weak)
+{
+    auto pstate = weak.lock();
+    if (!pstate)
+        return;
+
+    uint64_t now = TimerWheel::clock_ms();
+    if (!pstate->m_mutex.try_lock())
     {
-        struct epoll_event event;
-        event.data.fd = fd;
-        event.events = EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLERR | EPOLLET;
-        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, &event))
-        {
-            if (ENOENT != errno)
-            {
-                perror("epoll_ctl");
-                std::cerr << "epoll_ctl failed fd = " << fd \
-                    <<" errno = " << errno << std::endl;
-            }
-        }
+        m_timers.schedule(pstate->m_timer, now + get_timeout_check_ms());
+        return;
+    }
+
+    // Closed by a worker, between its unlock and the removal
+    if (STATE_CLOSING == pstate->m_state)
+    {
+        pstate->m_mutex.unlock();
+        return;
     }
+
+    auto [is_expired, next] = check_timeout(pstate, now);
+    if (is_expired)
+    {
+        std::cerr << pstate->m_socket << ": Connection timed out" << std::endl;
+        count_timeout(pstate);
+        close_and_cleanup(pstate->m_socket, pstate, this);
+        return;
+    }
+
+    pstate->m_mutex.unlock();
+    m_timers.schedule(pstate->m_timer, next);
 }
 
 /**
- * @brief remove all monitoring file descriptors from epoll
+ * @brief Wake up the epoll thread by writing to the eventfd
  * 
  */
-void Orchestrator::epoll_empty()
+void Orchestrator::wakeup_epoll_thread()
 {
-    std::shared_lock lock(m_epoll_sockets_mtx);
-    return epoll_empty_unsafe();
+    uint64_t one = 1;
+    ServerStats::add(m_stats.m_syscalls_other);
+    if (sizeof(one) != write(m_wakeup_fd, &one, sizeof(one)) &&
+        EAGAIN != errno)
+    {
+        perror("write");
+        std::cerr << "could not wake up epoll thread, errno = " \
+            << errno << std::endl;
+    }
 }
 
 /**
- * @brief rebuild the epoll monitor from the set of fd's
+ * @brief register a newly accepted socket with epoll
+ * 
+ * This is done only once for every socket.
  * 
- * This is the unsafe version of the function. the caller
- * must hold the mutex before calling it.
+ * @param fd the file descriptor to register
+ * @param generation the generation of the connection in
+ * m_connections, it comes back with the events
+ * @return true on success
+ * @return false on failure
+ */
+bool Orchestrator::epoll_register(int fd, uint32_t generation)
+{
+    struct epoll_event event;
+    event.data.u64 = ConnectionTable::make_key(fd, generation);
+    event.events = CLIENT_EPOLL_EVENTS;
+    ServerStats::add(m_stats.m_syscalls_epoll_ctl);
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event))
+    {
+        perror("epoll_ctl");
+        std::cerr << "epoll_ctl add failed fd = " << fd \
+            << " errno = " << errno << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief re-arm a one-shot socket so that epoll reports it
+ * again when it becomes readable, or writable
+ * 
+ * @param fd the file descriptor to re-arm
+ * @param generation the generation of the connection in
+ * m_connections
+ * @param events the events to wait for
+ * @return true on success
+ * @return false on failure
+ */
+bool Orchestrator::epoll_rearm(int fd, uint32_t generation, uint32_t events)
+{
+    struct epoll_event event;
+    event.data.u64 = ConnectionTable::make_key(fd, generation);
+    event.events = events;
+    ServerStats::add(m_stats.m_syscalls_epoll_ctl);
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event))
+    {
+        perror("epoll_ctl");
+        std::cerr << "epoll_ctl mod failed fd = " << fd \
+            << " errno = " << errno << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief remove a socket from the epoll set
  * 
+ * @param fd the file descriptor to remove
  */
-void Orchestrator::epoll_rearm_unsafe()
+void Orchestrator::epoll_unregister(int fd)
 {
-    for (auto fd: m_epoll_sockets)
+    struct epoll_event event;
+    ServerStats::add(m_stats.m_syscalls_epoll_ctl);
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, &event))
     {
-        struct epoll_event event;
-        event.data.fd = fd;
-        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event))
+        if (ENOENT != errno && EBADF != errno)
         {
-            if (ENOENT != errno)
-            {
-                perror("epoll_ctl");
-                std::cerr << "epoll_ctl failed, errno = " \
-                    << errno << std::endl;
-            }
+            perror("epoll_ctl");
+            std::cerr << "epoll_ctl del failed fd = " << fd \
+                << " errno = " << errno << std::endl;
         }
     }
 }
 
 /**
- * @brief rebuild the epoll monitor from the set of fd's
+ * @brief adjust the size of the epoll batch after a call to
+ * epoll_wait returned n_fd events
+ * 
+ * The batch doubles when it was completely filled, as there are
+ * probably more events pending. It is halved when less than a
+ * quarter of it was used, so that an idle server does not keep
+ * a large buffer around.
  * 
+ * @param n_fd number of events returned by epoll_wait
  */
-void Orchestrator::epoll_rearm()
+void Orchestrator::resize_epoll_batch(int n_fd)
 {
-    std::unique_lock lock(m_epoll_sockets_mtx);
-    return epoll_rearm_unsafe();
+    size_t size = m_epoll_events.size();
+    if ((size_t)n_fd == size && size < MAX_EPOLL_EVENTS)
+        m_epoll_events.resize(std::min<size_t>(size * 2, MAX_EPOLL_EVENTS));
+    else if ((size_t)n_fd < size / 4 && size > MIN_EPOLL_EVENTS)
+        m_epoll_events.resize(std::max<size_t>(size / 2, MIN_EPOLL_EVENTS));
 }
 
 /**
@@ -313,85 +649,58 @@ void Orchestrator::epoll_rearm()
  * Loops and calls epoll. When a ready socket is found, it is
  * posted to the thread pool which processes it.
  * 
+ * Sockets are armed in one-shot mode, so a socket that is reported
+ * here is disabled in epoll until the worker re-arms it.
+ * 
  */
 void Orchestrator::epoll_thread_loop()
 {
-    int retval;
-    struct epoll_event events[MAX_EPOLL_EVENTS + 1];
+    m_epoll_events.resize(MIN_EPOLL_EVENTS);
+    m_rehash_timer.m_callback = [this]() { on_rehash_timer(); };
+    m_timers.schedule(m_rehash_timer, TimerWheel::clock_ms() + REHASH_CRON_MS);
 
-    struct sigaction action;
-    action.sa_sigaction = &sigusr1_handler;
-    action.sa_flags = SA_SIGINFO  | SA_RESTART;
-    if (retval = sigaction(SIGUSR1, &action, NULL))
+    while(!m_is_destroying)
     {
-        perror("sigaction");
-        std::cerr << "Fatal: sigaction failed with rc = " << retval;
-        std::cerr << " errno = " << errno << std::endl;
-        exit(1);
-    }
+        // Wake up for the next timer, and at least once a second
+        int timeout = m_timers.next_timeout(TimerWheel::clock_ms());
+        if (timeout < 0 || timeout > 1000)
+            timeout = 1000;
 
-    while(true)
-    {
-        //std::cerr << "epoll looping" << std::endl;
-        std::unordered_set<int> ready_fds;
-        epoll_empty();
-        epoll_rearm();
-        bzero(events, sizeof(events));
+        ServerStats::add(m_stats.m_syscalls_epoll_wait);
         int n_fd = epoll_wait(
             m_epoll_fd,
-            events,
-            MAX_EPOLL_EVENTS,
-            1000);
-        if (n_fd)
+            m_epoll_events.data(),
+            m_epoll_events.size(),
+            timeout);
+        m_timers.advance(TimerWheel::clock_ms());
+        if (n_fd < 0)
         {
-            // Take both locks to maintain lock heirarchy
-            std::shared_lock lock0(m_all_sockets_mtx);
-            std::unique_lock lock(m_epoll_sockets_mtx);
-            try
-            {    
-                for (int i = 0; i < n_fd; i++)
-                {
-                    if (0 == events[i].events)
-                        continue;
-                    ready_fds.insert(events[i].data.fd);
-                    std::cerr << events[i].data.fd << \
-                        ": ePOll, ready for read" << std::endl;
-                }
-            }
-            catch(...)
+            if (EINTR != errno)
             {
-                std::cerr << __FILE__ << ":" << __LINE__;
-                std::cerr << " Error inserting into set" << std::endl;
-            }
-
-            epoll_empty_unsafe();
-            for (auto fd: ready_fds)
-            {
-                auto it = m_epoll_sockets.find(fd);
-                if (it != m_epoll_sockets.end())
-                    m_epoll_sockets.erase(it);
+                perror("epoll_wait");
+                std::cerr << "epoll_wait failed, errno = " \
+                    << errno << std::endl;
             }
+            continue;
+        }
 
-            if (ready_fds.size())
+        for (int i = 0; i < n_fd; i++)
+        {
+            uint64_t key = m_epoll_events[i].data.u64;
+            int fd = ConnectionTable::key_fd(key);
+            if (fd == m_wakeup_fd)
             {
-                std::unique_lock lock2(m_processing_sockets_mtx);
-                try
-                {
-                    for (auto fd: ready_fds)
-                        m_processing_sockets.insert(fd);
-                }
-                catch(...)
-                {
-                    std::cerr << __FILE__ << ":" << __LINE__;
-                    std::cerr << " Error inserting into set" << std::endl;
-                }
+                uint64_t count;
+                ServerStats::add(m_stats.m_syscalls_other);
+                while (read(m_wakeup_fd, &count, sizeof(count)) > 0)
+                    ServerStats::add(m_stats.m_syscalls_other);
+                continue;
             }
-
-            lock0.unlock();
-            lock.unlock();
-            for (auto fd: ready_fds)
-                create_processing_job(fd);
+            std::cerr << fd << ": ePOll, ready for read" << std::endl;
+            create_processing_job(fd, ConnectionTable::key_generation(key));
         }
+
+        resize_epoll_batch(n_fd);
     }
 }
 
@@ -404,35 +713,66 @@ void Orchestrator::epoll_thread_loop()
  * process it.
  * 
  * @param fd file descriptor to be posted for read
+ * @param generation the generation that epoll reported, the
+ * event is dropped if the fd now belongs to another connection
  */
-void Orchestrator::create_processing_job(int fd)
+void Orchestrator::create_processing_job(int fd, uint32_t generation)
 {
-    std::shared_ptr<State>      p(nullptr);
+    auto p = m_connections.lookup(fd, generation);
+    if (!p)
+    {
+        std::cerr << fd << ": Event for a closed connection" << std::endl;
+        return;
+    }
 
+    // The socket was waiting for a slow client to make room for its
+    // responses. The state is still locked by the write that stopped.
+    if (STATE_WAITING_FOR_WRITE == p->m_state)
     {
-        std::shared_mutex(m_all_sockets_mtx);
-        assert(m_all_sockets.find(fd) != m_all_sockets.end());
-        p = m_all_sockets[fd];
-        assert(!!p);
-        p->m_mutex.lock();
+        if (!add_to_write_queue(p))
+        {
+            std::cerr << fd << ": Add to write queue failed" << std::endl;
+            close_and_cleanup(fd, p, this);
+        }
+        return;
     }
 
+    p->m_mutex.lock();
     p->m_state = STATE_WAITING_FOR_READ_JOB;
 
-    SocketReadJob* job = new (std::nothrow) SocketReadJob(this, p);
-    if (!job)
+    std::shared_ptr<JobInterface> job;
+    RunToCompletionJob* prtc_job = nullptr;
+    if (EXECUTION_RUN_TO_COMPLETION == m_config.m_execution)
+        job.reset(prtc_job = new (std::nothrow) RunToCompletionJob(this, p));
+    else
+        job.reset(new (std::nothrow) SocketReadJob(this, p));
+
+    int rc = 1;
+    if (job)
     {
-        std::cerr << "Out of memory" << std::endl;
-        return;
+        rc = m_processing_threadpool->add_job(job, true);
+
+        // No slot is left, the job still runs to answer every command
+        // with an error, which is quick
+        if (THREAD_POOL_SATURATED == rc && prtc_job)
+        {
+            prtc_job->m_is_shedding = true;
+            rc = m_processing_threadpool->add_job(job);
+        }
     }
+    else
+        std::cerr << "Out of memory" << std::endl;
 
-    if (0 != m_processing_threadpool->add_job(\
-                            std::shared_ptr<JobInterface>(job)))
+    // The state is unlocked and the socket goes back to epoll, which
+    // reports it again since its data is still unread
+    if (0 != rc)
     {
-        std::cerr << "Error adding job to processing threadpool" << std::endl;
+        std::cerr << fd << ": Error adding job to processing threadpool" << std::endl;
+        add_to_epoll_queue(p);
+        return;
     }
-    else
-        std::cerr << fd << ": Added a job to read the data" << std::endl;
+
+    std::cerr << fd << ": Added a job to read the data" << std::endl;
 }
 
 /**
@@ -443,13 +783,32 @@ void Orchestrator::create_processing_job(int fd)
  */
 bool Orchestrator::create_epoll_fd()
 {
-    m_epoll_fd = epoll_create1(0);
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
     if (m_epoll_fd < 0)
     {
         perror("epoll_create");
         std::cerr << "epoll create failed, errno = " << errno;
         return false;
     }
+
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup_fd < 0)
+    {
+        perror("eventfd");
+        std::cerr << "eventfd create failed, errno = " << errno;
+        return false;
+    }
+
+    struct epoll_event event;
+    event.data.u64 = 0;
+    event.data.fd = m_wakeup_fd;
+    event.events = EPOLLIN;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &event))
+    {
+        perror("epoll_ctl");
+        std::cerr << "could not add eventfd to epoll, errno = " << errno;
+        return false;
+    }
     return true;
 }
 
@@ -462,38 +821,12 @@ bool Orchestrator::create_epoll_fd()
 void Orchestrator::remove_socket(int fd)
 {
     std::cerr << fd << ": removing from all queues" << std::endl;
-    {
-        std::unique_lock lock(m_all_sockets_mtx);
-        auto it = m_all_sockets.find(fd);
-        if (it != m_all_sockets.end())
-        {
-            auto state = m_all_sockets[fd];
-            state->m_mutex.lock();
-            m_all_sockets.erase(it);
-            state->m_mutex.unlock();
-        }
-    }
+    if (m_epoll_fd >= 0)
+        epoll_unregister(fd);
 
-    {
-        std::unique_lock lock(m_epoll_sockets_mtx);
-        auto it = m_epoll_sockets.find(fd);
-        if (it != m_epoll_sockets.end())
-            m_epoll_sockets.erase(it);
-    }
-
-    {
-        std::unique_lock lock(m_processing_sockets_mtx);
-        auto it = m_processing_sockets.find(fd);
-        if (it != m_processing_sockets.end())
-            m_processing_sockets.erase(it);
-    }
-
-    {
-        std::unique_lock lock(m_write_sockets_mtx);
-        auto it = m_write_sockets.find(fd);
-        if (it != m_write_sockets.end())
-            m_write_sockets.erase(it);
-    }
+    // The connection must leave the table before the fd is closed,
+    // a new connection may get the same fd as soon as it is
+    m_connections.remove(fd);
 }
 
 /**
@@ -503,24 +836,22 @@ void Orchestrator::remove_socket(int fd)
  * 
  * 
  * @param pstate is the state associated with the file descriptor
- * @return true on successful posting
- * @return false on failure to post
+ * @return int 0 on successful posting, THREAD_POOL_SATURATED if
+ * --max-inflight commands are already queued or running, another
+ * number on failure to post
  */
-bool Orchestrator::add_to_parse_and_run_queue(
+int Orchestrator::add_to_parse_and_run_queue(
                     std::shared_ptr<State> pstate)
 {
     ParseAndRunJob* job = new (std::nothrow) ParseAndRunJob(this, pstate);
     if (!job)
     {
         std::cerr << "Out of memory" << std::endl;
-        return false;
+        return 1;
     }
 
-    if (0 != m_parse_and_run_threadpool->add_job(\
-                            std::shared_ptr<JobInterface>(job)))
-        return false;
-    
-    return true;
+    return m_parse_and_run_threadpool->add_job(
+                std::shared_ptr<JobInterface>(job), true);
 }
 
 /**
@@ -533,6 +864,22 @@ bool Orchestrator::add_to_parse_and_run_queue(
  */
 bool Orchestrator::add_to_write_queue(std::shared_ptr<State> pstate)
 {
+    // The io_uring backend sends the responses from its own thread
+    if (m_uring)
+    {
+        m_uring->queue_send(pstate);
+        return true;
+    }
+
+    // Only part of a command was received, there is nothing to
+    // write and the socket goes straight back to epoll
+    if (pstate->m_responses.empty() && pstate->m_output.empty() &&
+        !pstate->m_is_error)
+    {
+        add_to_epoll_queue(pstate);
+        return true;
+    }
+
     SocketWriteJob* job = new (std::nothrow) SocketWriteJob(this, pstate);
     if (!job)
     {
@@ -546,6 +893,148 @@ bool Orchestrator::add_to_write_queue(std::shared_ptr<State> pstate)
     return true;
 }
 
+/**
+ * @brief parse and run every complete command in the data read
+ * from a client. The responses are added to the state in order,
+ * and an incomplete command at the end of the data is left in
+ * it for the next read.
+ * 
+ * @param pstate the state of the client
+ * @param stop_at_slow_command stop before a slow command, it is
+ * left at the start of the input
+ * @param is_shedding answer every command with an error instead
+ * of running it
+ * @return true if all the complete commands were run
+ * @return false if it stopped before a slow command
+ */
+bool Orchestrator::run_pipelined_commands(
+    std::shared_ptr<State>  pstate,
+    bool                    stop_at_slow_command,
+    bool                    is_shedding)
+{
+    auto& parser = pstate->m_parser;
+    static RespPreencoded<RespError> overloaded_reply(
+        "-" OVERLOADED_ERROR "\r\n", OVERLOADED_ERROR);
+    std::shared_ptr<AbstractRespObject> overloaded;
+
+    if (is_shedding)
+        overloaded = overloaded_reply.share();
+
+    while (true)
+    {
+        size_t command_start = parser.parsed_length();
+        auto err = parser.parse_command(
+                    pstate->m_input.data(),
+                    pstate->m_input.size(),
+                    pstate->m_argv);
+
+        // The rest of the command has not been received yet, the
+        // parser continues from where it stopped after the next read
+        if (ERROR_CURRENT_BEYOND_END == err)
+            break;
+
+        if (ERROR_SUCCESS != err)
+        {
+            pstate->m_is_error = true;
+            pstate->m_responses.push_back(make_parse_error(pstate, err));
+            break;
+        }
+
+        auto [is_valid, cmd_type] = is_valid_command(pstate->m_argv);
+        // A streamed argument is no longer in the input, such a
+        // command is not handed over to be parsed again
+        if (stop_at_slow_command && is_valid && !parser.streamed_value() &&
+            is_slow_command(pstate->m_argv, cmd_type))
+        {
+            // The slow command is parsed again by whoever runs it
+            pstate->m_input.consume(command_start);
+            parser.reset();
+            return false;
+        }
+
+        // Every command gets the same error, its parsed form is
+        // enough to stay in step with the client
+        if (is_shedding)
+        {
+            ServerStats::add(m_stats.m_rejected_commands);
+            pstate->m_responses.push_back(overloaded);
+            continue;
+        }
+
+        if (is_valid && COMMAND_GET == cmd_type)
+        {
+            queue_get(pstate, pstate->m_argv);
+            continue;
+        }
+
+        auto [is_fatal, response] = do_operation(
+                                        pstate->m_argv, is_valid, cmd_type,
+                                        &pstate->m_arena, parser.streamed_value());
+        if (response)
+            pstate->m_responses.push_back(response);
+
+        if (is_fatal)
+        {
+            // The connection is closed after the responses so far
+            // are written, the remaining commands are dropped
+            pstate->m_is_error = true;
+            if (!response)
+                pstate->set_default_special_error();
+            break;
+        }
+    }
+
+    if (pstate->m_is_error)
+    {
+        pstate->m_input.clear();
+        parser.reset();
+        return true;
+    }
+
+    // Only the command that is still incomplete is kept
+    size_t parsed_length = parser.parsed_length();
+    if (parsed_length)
+    {
+        pstate->m_input.consume(parsed_length);
+        parser.discard(parsed_length);
+    }
+    return true;
+}
+
+/**
+ * @brief write all the responses of a state to its socket,
+ * with as few system calls as possible
+ * 
+ * All the responses are handed to a single writev(). If the socket
+ * buffer fills up, the rest is written once it drains.
+ * 
+ * @param pstate the state of the client
+ * @return true on success
+ * @return false if the write failed, the connection must be
+ * closed
+ */
+output_status_t Orchestrator::write_responses(std::shared_ptr<State> pstate)
+{
+    pstate->queue_responses();
+
+    auto status = pstate->m_output.write_to(pstate->m_socket, m_stats);
+    if (OUTPUT_PENDING == status && exceeds_output_limits(pstate))
+        return OUTPUT_ERROR;
+
+    return status;
+}
+
+bool Orchestrator::exceeds_output_limits(std::shared_ptr<State> pstate)
+{
+    if (!pstate->m_output.exceeds_limits(m_config.m_output_limits))
+        return false;
+
+    std::cerr << pstate->m_socket << ": output buffer limit exceeded, " \
+        << pstate->m_output.size() << " bytes waiting, closing" << std::endl;
+    ServerStats::add(m_stats.m_output_limit_disconnects);
+    return true;
+}
+
 /**
  * TODO: Refactor this function, into three different classes
  * for each command: set, get and del
@@ -553,53 +1042,36 @@ bool Orchestrator::add_to_write_queue(std::shared_ptr<State> pstate)
  * and actual action
  */
 /**
- * @brief given an abstract object, find whether it is a valid
- * command or not.
+ * @brief given the arguments of a command, find whether it is a
+ * valid command or not.
  * 
  * When a command is received from the client, it is parsed.
  * After parsing, this function will decide whether it is a valid
  * command or not
  * 
- * @param p the parsed input in object form
+ * @param argv the command and its arguments
  * @return std::tuple<bool, command_type_t> a tuple of two items:
  * 1. whether it is valid or not
  * 2. the type of command if it is valid
  */
 std::tuple<bool, command_type_t>
-Orchestrator::is_valid_command(std::shared_ptr<AbstractRespObject> p)
+Orchestrator::is_valid_command(const std::vector<std::string_view>& argv)
 {
-    if (! p->m_is_aggregate)
-        return std::make_tuple(false, COMMAND_INVALID);
-    
-    RespArray* p_array_obj = static_cast<RespArray*>(p.get());
-    auto array = p_array_obj->get_array();
+    if (argv.size() && argv[0] == "info")
+        return std::make_tuple(true, COMMAND_INFO);
 
-    if (array.size() <= 1)
+    if (argv.size() <= 1)
         return std::make_tuple(false, COMMAND_INVALID);
 
-    auto command_string = array[0]->to_string();
-    command_type_t type = COMMAND_INVALID;
+    auto command = argv[0];
 
-    if (command_string == std::string("get") || 
-        command_string == std::string("del"))
+    if (command == "get")
+        return std::make_tuple(true, COMMAND_GET);
+    else if (command == "del")
+        return std::make_tuple(true, COMMAND_DEL);
+    else if (command == "set")
     {
-        if (command_string == std::string("get"))
-            type = COMMAND_GET;
-        else
-            type = COMMAND_DEL;
-
-        if (array.size() >= 2 && 
-            (RESP_BULK_STRING == array[1]->m_datatype ||
-                RESP_STRING == array[1]->m_datatype))
-            return std::make_tuple(true, type);
-        else
-            return std::make_tuple(false, COMMAND_INVALID);
-    }
-    else if (command_string == std::string("set"))
-    {
-        if (array.size() >= 3 &&
-            (RESP_BULK_STRING == array[1]->m_datatype ||
-                RESP_STRING == array[1]->m_datatype))
+        if (argv.size() >= 3)
             return std::make_tuple(true, COMMAND_SET);
         else
             return std::make_tuple(false, COMMAND_INVALID);
@@ -608,36 +1080,171 @@ Orchestrator::is_valid_command(std::shared_ptr<AbstractRespObject> p)
         return std::make_tuple(false, COMMAND_INVALID);
 }
 
+/**
+ * @brief allocate the data stores, they must be empty
+ * 
+ * @param num_shards the number of data stores, a power of two
+ */
+void Orchestrator::create_datastores(size_t num_shards)
+{
+    delete[] m_datastore;
+    m_datastore = new DataStore[num_shards];
+    m_shard_mask = num_shards - 1;
+}
+
+void Orchestrator::rehash_datastores(size_t first, size_t step)
+{
+    auto deadline = std::chrono::steady_clock::now() + \
+                    std::chrono::microseconds(REHASH_CRON_BUDGET_US);
+
+    for (size_t i = first; i <= m_shard_mask; i += step)
+    {
+        while (m_datastore[i].migrate(REHASH_CRON_GROUPS))
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return;
+        }
+    }
+}
+
+void Orchestrator::on_rehash_timer()
+{
+    rehash_datastores(0, 1);
+    m_timers.schedule(m_rehash_timer, TimerWheel::clock_ms() + REHASH_CRON_MS);
+}
+
 /**
  * @brief Get the partition id of the hash table, based on the
  * key.
  * 
  * For performance reasons, instead of using a single hash,
  * we use multiple hashes, and the decision to choose the
- * correct hash is taken based on the first character of the key.
+ * correct hash is taken based on the hash of the key.
  * 
  * This is done because on high load, a single hash would be
  * affected by lock contention. Using several hashes will
  * reduce the lock contention.
  * 
- * Additionally, reader-writer locks are used to increase
- * concurrency even more.
+ * Additionally, only the writers of a data store lock it, its
+ * readers take no lock.
  * 
  * @param varname name of the variable
  * @return int partition id of the correct hash to use
  */
-int Orchestrator::get_partition(const std::string& varname)
+int Orchestrator::get_partition(std::string_view varname)
 {
-    if (0 == varname.length())
-        return 0;
-    char x = varname[0];
-    return x % NUM_DATASTORES;
+    return (int)(KeyHash::hash(varname, m_hash_seed) & m_shard_mask);
+}
+
+/**
+ * @brief In reactor mode, get the reactor that owns the
+ * partition of a key
+ * 
+ * @param key the key
+ * @return int index of the reactor in m_reactors
+ */
+int Orchestrator::get_owner_reactor(std::string_view key)
+{
+    return get_partition(key) % m_reactors.size();
+}
+
+/**
+ * @brief In reactor mode, create one reactor per configured
+ * core and start them
+ * 
+ * The reactors are pinned to the cores this process is allowed
+ * to run on, in order.
+ * 
+ * @return true on success
+ * @return false on failure
+ */
+bool Orchestrator::spawn_reactors()
+{
+    cpu_set_t       cpuset;
+    std::vector<int> cpus;
+
+    CPU_ZERO(&cpuset);
+    if (0 == sched_getaffinity(0, sizeof(cpuset), &cpuset))
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &cpuset))
+                cpus.push_back(cpu);
+    }
+
+    int num_reactors = m_config.m_num_reactors;
+    if (num_reactors <= 0)
+        num_reactors = cpus.size() ? cpus.size() : 1;
+
+    // Every reactor owns at least one shard. Nothing has been
+    // stored yet, the shards can be replaced.
+    size_t num_shards = m_shard_mask + 1;
+    if (num_shards < (size_t)num_reactors)
+    {
+        while (num_shards < (size_t)num_reactors)
+            num_shards <<= 1;
+        create_datastores(num_shards);
+        std::cerr << "Using " << num_shards << " data store shards" << std::endl;
+    }
+
+    // All the reactors must exist before any of them starts,
+    // since they forward commands to each other
+    for (int i = 0; i < num_reactors; i++)
+    {
+        int cpu = cpus.size() ? cpus[i % cpus.size()] : -1;
+        Reactor* preactor = new (std::nothrow) Reactor(this, i, cpu);
+        if (!preactor)
+        {
+            std::cerr << "Out of memory" << std::endl;
+            return false;
+        }
+        m_reactors.push_back(preactor);
+    }
+
+    for (auto preactor: m_reactors)
+    {
+        if (!preactor->start())
+        {
+            std::cerr << "Failed to start reactor " << preactor->m_id \
+                << std::endl;
+            return false;
+        }
+    }
+
+    std::cerr << "Started " << m_reactors.size() << " reactors" << std::endl;
+    return true;
+}
+
+/**
+ * @brief is a command slow enough that it should not run on a
+ * run-to-completion worker. INFO formats every counter, and a DEL
+ * on many keys takes as many locks.
+ * 
+ * @param argv the command and its arguments
+ * @param cmd_type its type
+ * @return true if it is slow
+ */
+bool Orchestrator::is_slow_command(
+    const std::vector<std::string_view>&    argv,
+    command_type_t                          cmd_type)
+{
+    if (COMMAND_INFO == cmd_type)
+        return true;
+
+    if (COMMAND_DEL == cmd_type)
+        return argv.size() > SLOW_COMMAND_KEYS + 1;
+
+    return false;
 }
 
 /**
  * @brief given a parsed command, perform the requested operations
  * 
- * @param command command after parsing, as received from client
+ * @param argv the command and its arguments, as received from
+ * client
+ * @param parena the arena the response is allocated from, nullptr
+ * to allocate it from the heap
+ * @param pstreamed the bytes of the last argument if the parser
+ * streamed it, nullptr otherwise. The command may move them.
  * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
  * a tuple containing two items
  * 1. has there been a fatal error, which mandates the
@@ -646,45 +1253,97 @@ int Orchestrator::get_partition(const std::string& varname)
  *    and sent to the client as response.
  */
 std::tuple<bool, std::shared_ptr<AbstractRespObject> >
-Orchestrator::do_operation(std::shared_ptr<AbstractRespObject> command)
+Orchestrator::do_operation(
+    const std::vector<std::string_view>&    argv,
+    Arena*                                  parena,
+    std::string*                            pstreamed)
 {
-    // TODO: Fill this up
-    auto [is_valid, cmd_type] = is_valid_command(command);
-    if (!is_valid)
+    auto [is_valid, cmd_type] = is_valid_command(argv);
+    return do_operation(argv, is_valid, cmd_type, parena, pstreamed);
+}
+
+/**
+ * @brief the response to a request that could not be parsed. A
+ * request over a limit gets a short error, since its data may be
+ * large, any other one gets the unparsed input back.
+ * 
+ * @param pstate the connection
+ * @param err the parse error
+ * @return std::shared_ptr<AbstractRespObject> the response
+ */
+std::shared_ptr<AbstractRespObject>
+Orchestrator::make_parse_error(std::shared_ptr<State> pstate, resp_parse_error_t err)
+{
+    int fd = pstate->m_socket;
+    const char* message = RespLimits::error_message(err);
+    if (message)
     {
-        RespError* error = new (std::nothrow) RespError("Invalid command");
-        if (!error)
-        {
-            std::cerr << "Out of memory, exiting" << std::endl;
-            exit(1);
-        }
-        return std::make_tuple(
-            false,
-            std::shared_ptr<AbstractRespObject>((AbstractRespObject*)error));
+        std::cerr << fd << ": Request over a limit, " << message << std::endl;
+        return make_response<RespError>(&pstate->m_arena, message);
     }
 
+    auto& parser = pstate->m_parser;
+    std::string unparsed(
+        pstate->m_input.data() + parser.parsed_length(),
+        pstate->m_input.size() - parser.parsed_length());
+    std::cerr << fd << ": Could not parse command '" \
+        << unparsed << "'" << std::endl;
+
+    return make_response<RespError>(
+            &pstate->m_arena,
+            std::string("Unable to parse '")
+                + unparsed
+                + std::string("'. Try again."));
+}
+
+/**
+ * @brief perform a command that has already been validated
+ * 
+ * @param argv the command and its arguments, as received from
+ * client
+ * @param is_valid whether is_valid_command accepted it
+ * @param cmd_type the type returned by is_valid_command
+ * @param parena the arena the response is allocated from, nullptr
+ * to allocate it from the heap
+ * @param pstreamed the streamed last argument, as for do_operation
+ * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> >
+ * as for do_operation
+ */
+std::tuple<bool, std::shared_ptr<AbstractRespObject> >
+Orchestrator::do_operation(
+    const std::vector<std::string_view>&    argv,
+    bool                                    is_valid,
+    command_type_t                          cmd_type,
+    Arena*                                  parena,
+    std::string*                            pstreamed)
+{
+    // TODO: Fill this up
+    ServerStats::add(m_stats.m_commands_processed);
+    if (!is_valid)
+        return std::make_tuple(false, RespReplies::invalid_command());
+
     if (COMMAND_GET == cmd_type)
-        return do_get(command);
+        return do_get(argv, parena);
     else if (COMMAND_SET == cmd_type)
-        return do_set(command);
+        return do_set(argv, parena, pstreamed);
     else if (COMMAND_DEL == cmd_type)
-        return do_del(command);
+        return do_del(argv, parena);
+    else if (COMMAND_INFO == cmd_type)
+        return do_info(argv, parena);
 
-    RespError* error = \
-               new (std::nothrow) RespError(std::string("generic error"));
-    if (!error)
-    {
-        std::cerr << "Out of memory. exiting" << std::endl;
-        exit(1);
-    }
-    std::shared_ptr<AbstractRespObject> p((AbstractRespObject*)error);
-    return std::make_tuple(false, p);
+    return std::make_tuple(
+        false,
+        make_response<RespError>(parena, "generic error"));
 }
 
 /**
  * @brief in case of a SET command, perform the action
  * 
- * @param pobj command after parsing, as received from client
+ * @param argv the command and its arguments, as received from
+ * client
+ * @param parena the arena the response is allocated from
+ * @param pstreamed the value if the parser streamed it, it is
+ * moved to the data store
  * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
  * a tuple containing two items
  * 1. has there been a fatal error, which mandates the
@@ -693,45 +1352,36 @@ Orchestrator::do_operation(std::shared_ptr<AbstractRespObject> command)
  *    and sent to the client as response.
  */
 std::tuple<bool, std::shared_ptr<AbstractRespObject> >
-Orchestrator::do_set(std::shared_ptr<AbstractRespObject> pobj)
+Orchestrator::do_set(
+    const std::vector<std::string_view>&    argv,
+    Arena*                                  parena,
+    std::string*                            pstreamed)
 {
-    RespArray* p_array_obj = static_cast<RespArray*>(pobj.get());
-    auto array = p_array_obj->get_array();
-    auto varname = array[1]->to_string();
-    auto partition = get_partition(varname);
-    auto value = array[2]->serialize();
+    auto partition = get_partition(argv[1]);
 
-    auto success = m_datastore[partition].set(varname.c_str(), value.c_str());
-    if (success)
-    {
-        auto *p = new (std::nothrow) RespString(std::string("OK"));
-        if (!p)
-        {
-            std::cerr << "Outo of memory" << std::endl;
-            exit(1);
-        }
-        return std::make_tuple(
-            false, 
-            std::shared_ptr<AbstractRespObject>(\
-                static_cast<AbstractRespObject*>(p)));
-    }
+    // The raw bytes are stored. A streamed value is already in its
+    // final allocation.
+    std::string value;
+    if (pstreamed)
+        value = std::move(*pstreamed);
+    else
+        value.assign(argv[2].data(), argv[2].length());
 
-    RespError* err_obj = new RespError("Failed to set the value");
-    if (!err_obj)
-    {
-        std::cerr << "Out of memory " << std::endl;
-        exit(1);
-    }
+    auto success = m_datastore[partition].set(argv[1], std::move(value));
+    if (success)
+        return std::make_tuple(false, RespReplies::ok());
 
     return std::make_tuple(
         false,
-        std::shared_ptr<AbstractRespObject>((AbstractRespObject*)err_obj));
+        make_response<RespError>(parena, "Failed to set the value"));
 }
 
 /**
  * @brief In case of the GET command, perform the action
  * 
- * @param pobj command after parsing, as received from client
+ * @param argv the command and its arguments, as received from
+ * client
+ * @param parena the arena the response is allocated from
  * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
  * a tuple containing two items
  * 1. has there been a fatal error, which mandates the
@@ -740,74 +1390,76 @@ Orchestrator::do_set(std::shared_ptr<AbstractRespObject> pobj)
  *    and sent to the client as response.
  */
 std::tuple<bool, std::shared_ptr<AbstractRespObject> >
-Orchestrator::do_get(std::shared_ptr<AbstractRespObject> pobj)
+Orchestrator::do_get(const std::vector<std::string_view>& argv, Arena* parena)
 {
-    RespArray* p_array_obj = static_cast<RespArray*>(pobj.get());
-    auto array = p_array_obj->get_array();
-    auto varname = array[1]->to_string();
-    auto partition = get_partition(varname);
-    
-    auto [found, value] = m_datastore[partition].get(varname.c_str());
-
-    if (!found)
-    {
-        auto *p = new (std::nothrow) RespBulkString(std::string(""));
-        if (!p)
-        {
-            std::cerr << "Outo of memory" << std::endl;
-            exit(1);
-        }
+    auto partition = get_partition(argv[1]);
 
-        p->set_null(true);
-        return std::make_tuple(
-            false, 
-            std::shared_ptr<AbstractRespObject>(\
-                static_cast<AbstractRespObject*>(p)));
-    }
+    // The value is only valid in the callback, the reply gets a
+    // copy. A client served by this thread gets its value through
+    // queue_get() instead, without the copy.
+    std::shared_ptr<AbstractRespObject> response;
+    bool found = m_datastore[partition].with_value(
+                    argv[1], [&](std::string_view value) {
+        response = make_response<RespBulkString>(parena, std::string(value));
+    });
 
-    RespParser parser(value);
-    auto [err, ret] = parser.get_generic_object();
-    if (ERROR_SUCCESS != err)
-    {
-        std::cerr << "IMPORTANT: could not parse value from hash '"\
-            << value << "'" << std::endl;
+    if (!found)
+        return std::make_tuple(false, RespReplies::null());
+    return std::make_tuple(false, response);
+}
 
-        auto *p = new (std::nothrow) RespBulkString(std::string(""));
-        if (!p)
-        {
-            std::cerr << "Outo of memory" << std::endl;
-            exit(1);
-        }
+/**
+ * @brief perform a GET command for a client whose responses are
+ * written by the calling thread. The responses queued before it
+ * are serialized first, then the bulk string header and the value
+ * are serialized from the data store straight into the output
+ * buffer, in the Epoch read section of the lookup.
+ * 
+ * @param pstate the client, its output buffer must not be in use
+ * by a write
+ * @param argv the command and its arguments, as received from
+ * client
+ */
+void Orchestrator::queue_get(
+    std::shared_ptr<State>                  pstate,
+    const std::vector<std::string_view>&    argv)
+{
+    ServerStats::add(m_stats.m_commands_processed);
+    auto partition = get_partition(argv[1]);
 
-        p->set_null(true);
-        return std::make_tuple(
-            false, 
-            std::shared_ptr<AbstractRespObject>(\
-                static_cast<AbstractRespObject*>(p)));
-    }
+    pstate->queue_responses();
+    auto& output = pstate->m_output;
+    std::string& out = output.begin_append();
+    bool found = m_datastore[partition].with_value(
+                    argv[1], [&](std::string_view value) {
+        RespBulkString::encode_to(out, value);
+    });
 
-    return std::make_tuple(true, ret);
+    if (!found)
+        out.append("$-1\r\n", 5);
+    output.end_append();
 }
 
 /**
  * @brief delete one variable from the appropriate hash
  * 
- * @param pobj command after parsing, as received from the client
+ * @param key the key to delete
  * @return true on successful deletion
  * @return false on failure to delete for any reason, including
  * if the item was not present in the first place.
  */
-bool Orchestrator::do_del_internal(std::shared_ptr<AbstractRespObject> pobj)
+bool Orchestrator::do_del_internal(std::string_view key)
 {
-    auto key = pobj->to_string();
     auto partition = get_partition(key);
-    return m_datastore[partition].del(key.c_str());
+    return m_datastore[partition].del(key);
 }
 
 /**
  * @brief perform the DEL command
  * 
- * @param pobj command after parsing, as received from client
+ * @param argv the command and its arguments, as received from
+ * client
+ * @param parena the arena the response is allocated from
  * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
  * a tuple containing two items
  * 1. has there been a fatal error, which mandates the
@@ -816,30 +1468,79 @@ bool Orchestrator::do_del_internal(std::shared_ptr<AbstractRespObject> pobj)
  *    and sent to the client as response.
  */
 std::tuple<bool, std::shared_ptr<AbstractRespObject> >
-Orchestrator::do_del(std::shared_ptr<AbstractRespObject> pobj)
+Orchestrator::do_del(const std::vector<std::string_view>& argv, Arena* parena)
 {
-    RespArray* p_array_obj = static_cast<RespArray*>(pobj.get());
-    auto array = p_array_obj->get_array();
-    
     int del_count = 0;
-    for (int i = 1; i < array.size(); i++)
+    for (size_t i = 1; i < argv.size(); i++)
     {
-        if (do_del_internal(array[i]))
+        if (do_del_internal(argv[i]))
             del_count++;
     }
 
-    RespInteger* ret = new (std::nothrow) RespInteger(del_count);
-    if (!ret)
+    return std::make_tuple(false, make_integer(parena, del_count));
+}
+
+/**
+ * @brief perform the INFO command. The sections to report may be
+ * named after the command, as with Redis. Every counter is in the
+ * Stats section, which "all", "default" and "everything" include.
+ * 
+ * @param argv the command and its arguments, as received from
+ * client
+ * @param parena the arena the response is allocated from
+ * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
+ * a tuple containing two items
+ * 1. has there been a fatal error, which mandates the
+ *    client connection must be closed
+ * 2. the statistics as a bulk string, empty if none of the
+ *    sections named exists
+ */
+std::tuple<bool, std::shared_ptr<AbstractRespObject> >
+Orchestrator::do_info(const std::vector<std::string_view>& argv, Arena* parena)
+{
+    static const char* stats_sections[] = {
+        "stats", "all", "default", "everything"
+    };
+
+    bool has_stats = (argv.size() <= 1);
+    for (size_t i = 1; i < argv.size() && !has_stats; i++)
     {
-        std::cerr << "Out of memory " << std::endl;
-        exit(1);
+        for (auto section: stats_sections)
+        {
+            if (argv[i].length() == strlen(section) &&
+                0 == strncasecmp(argv[i].data(), section, argv[i].length()))
+                has_stats = true;
+        }
     }
 
     return std::make_tuple(
         false,
-        std::shared_ptr<AbstractRespObject>(
-            static_cast<AbstractRespObject*>(ret)));
+        make_response<RespBulkString>(
+            parena, has_stats ? m_stats.to_string() : std::string()));
+}
+
+/**
+ * @brief In pipeline mode with the io_uring backend, start the
+ * io_uring backend on the server socket, and the Unix domain
+ * socket if there is one
+ * 
+ * @return true on success
+ * @return false if io_uring is not usable, the epoll path
+ * must be used
+ */
+bool Orchestrator::start_uring_backend()
+{
+    m_uring = new (std::nothrow) UringBackend(this);
+    if (m_uring && m_uring->init() &&
+        m_uring->start(m_server_socket, m_unix_server_socket))
+    {
+        std::cerr << "Using the io_uring backend" << std::endl;
+        return true;
+    }
 
+    delete m_uring;
+    m_uring = nullptr;
+    return false;
 }
 
 /**
@@ -849,7 +1550,24 @@ Orchestrator::do_del(std::shared_ptr<AbstractRespObject> pobj)
  */
 int Orchestrator::run_server()
 {
+    // The reactors share the Unix domain socket, it must exist
+    // before they start
+    if (SERVER_MODE_REACTOR == m_config.m_mode)
+    {
+        create_unix_server_socket();
+        return spawn_reactors() ? 0 : -1;
+    }
+
     create_server_socket();
+
+    if (NETWORK_BACKEND_IO_URING == m_config.m_backend)
+    {
+        if (start_uring_backend())
+            return 0;
+        std::cerr << "io_uring is not available, "\
+            "falling back to epoll" << std::endl;
+    }
+
     if (!create_epoll_fd())
     {
         std::cerr << "failed to create epoll socket." << std::endl;
@@ -869,7 +1587,117 @@ int Orchestrator::run_server()
     return 0;
 }
 
-#define BUFSIZE 513
+
+/**
+ * @brief read everything that is available on the socket of a
+ * client into its input buffer
+ * 
+ * @param pstate the state of the client
+ * @return true on success, m_is_error is set if the peer has
+ * closed its side
+ * @return false if the connection must be closed
+ */
+bool Orchestrator::read_input(std::shared_ptr<State> pstate)
+{
+    auto fd = pstate->m_socket;
+    auto& input = pstate->m_input;
+    auto& parser = pstate->m_parser;
+    size_t total_bytes = 0;
+    int read_bytes;
+    int save_errno;
+
+    // Read straight into the free space of the input buffer. When a
+    // large value is being received, the buffer is sized for it, and
+    // a value that is streamed is read straight into its storage.
+    do
+    {
+        auto [window, window_size] = parser.stream_window(input.size());
+        ServerStats::add(m_stats.m_syscalls_read);
+        if (window)
+        {
+            read_bytes = read(fd, window, window_size);
+            save_errno = errno;
+            if (read_bytes > 0)
+                parser.commit_streamed(read_bytes);
+        }
+        else
+        {
+            input.prepare_read(parser.expected_length());
+            read_bytes = read(fd, input.write_ptr(), input.writable());
+            save_errno = errno;
+            if (read_bytes > 0)
+                input.commit(read_bytes);
+        }
+        if (read_bytes > 0)
+            total_bytes += read_bytes;
+    } while (read_bytes > 0);
+
+    if (total_bytes)
+        pstate->m_last_activity = TimerWheel::clock_ms();
+
+    if ((-1 == read_bytes && EAGAIN != save_errno) ||
+        (0 == read_bytes && 0 == total_bytes) ||
+        !pstate->is_in_request())
+    {
+        perror("read");
+        std::cerr << fd << ": error, read " << read_bytes << \
+            " bytes, err = " << errno << std::endl;
+        return false;
+    }
+
+    // The peer has closed its side, answer the commands that were
+    // received and then close
+    if (0 == read_bytes)
+        pstate->m_is_error = true;
+
+    return true;
+}
+
+/**
+ * @brief write the responses of a client, then either close the
+ * connection, wait for the socket to be writable, or re-arm it
+ * for the next read
+ * 
+ * @param pstate the state of the client
+ * @return int 0 on success
+ */
+int Orchestrator::send_responses(std::shared_ptr<State> pstate)
+{
+    pstate->m_state = STATE_IN_WRITE_LOOP;
+    auto fd = pstate->m_socket;
+
+    auto status = write_responses(pstate);
+    if (OUTPUT_ERROR == status)
+    {
+        std::cout << fd << ": Write failed, error = " << errno << std::endl;
+        close_and_cleanup(fd, pstate, this);
+        return -1;
+    }
+
+    if (OUTPUT_PENDING == status)
+    {
+        // The client is not reading fast enough. Instead of holding
+        // this thread, wait for the socket to drain, the epoll thread
+        // then posts another write job.
+        pstate->m_state = STATE_WAITING_FOR_WRITE;
+        if (!epoll_rearm(fd, pstate->m_generation, CLIENT_EPOLL_WRITE_EVENTS))
+        {
+            close_and_cleanup(fd, pstate, this);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (pstate->m_is_error)
+        close_and_cleanup(fd, pstate, this);
+    else
+    {
+        std::cerr << fd << ": Adding back to epoll queue" << std::endl;
+        add_to_epoll_queue(pstate);
+    }
+
+    return 0;
+}
 
 /**
  * @brief Reads from a socket and stores the values the state
@@ -885,31 +1713,23 @@ int SocketReadJob::run()
     m_pstate->m_state = STATE_IN_READ_LOOP;
     auto fd = m_pstate->m_socket;
     std::cerr << fd << ": Picked up for reading" << std::endl;
-    char buffer[BUFSIZE];
 
-    int read_bytes;
-    int save_errno;
-    
-    do 
+    if (!m_porchestrator->read_input(m_pstate))
     {
-        bzero(buffer, sizeof(buffer));
-        read_bytes = read(fd, buffer, BUFSIZE);
-        save_errno = errno;
-        if (read_bytes > 0)
-            m_pstate->m_read_data += buffer;
-    } while (read_bytes > 0);
+        close_and_cleanup(fd, m_pstate, m_porchestrator);
+        return -1;
+    }
 
-    if ((-1 == read_bytes && EAGAIN != save_errno) ||
-        m_pstate->m_read_data == std::string(""))
+    // The parse and run pool is overloaded, answer at once instead
+    // of making the client wait in its queue
+    int rc = m_porchestrator->add_to_parse_and_run_queue(m_pstate);
+    if (THREAD_POOL_SATURATED == rc)
     {
-        perror("read");
-        std::cerr << fd << ": error, read " << read_bytes << \
-            " bytes, err = " << errno << std::endl;
-        close_and_cleanup(fd, m_pstate, m_porchestrator);
-        return read_bytes;
+        m_porchestrator->run_pipelined_commands(m_pstate, false, true);
+        return m_porchestrator->send_responses(m_pstate);
     }
 
-    if (false == m_porchestrator->add_to_parse_and_run_queue(m_pstate))
+    if (0 != rc)
     {
         std::cerr << fd << ": Adding to parse queue failed" << std::endl;
         close_and_cleanup(fd, m_pstate, m_porchestrator);
@@ -934,46 +1754,7 @@ int ParseAndRunJob::run()
     auto fd = m_pstate->m_socket;
     std::cerr << fd << ": Picked up for parsing" << std::endl;
 
-
-    RespParser parser(m_pstate->m_read_data);
-    auto [err, parsed_obj] = parser.get_generic_object();
-    if (ERROR_SUCCESS != err)
-    {
-        std::cerr << fd << ": Could not parse command '" \
-            << m_pstate->m_read_data << "'" << std::endl;
-
-        m_pstate->m_is_error = true;
-
-        RespError* e = new RespError(
-            std::string("Unable to parse '") 
-                + std::string(m_pstate->m_read_data)
-                + std::string("'. Try again."));
-
-        m_pstate->m_response = \
-               std::shared_ptr<AbstractRespObject>((AbstractRespObject*)e);
-
-        if (false == m_porchestrator->add_to_write_queue(m_pstate))
-        {
-            std::cerr << fd << ": Add to write queue failed" << std::endl;
-            close_and_cleanup(fd, m_pstate, m_porchestrator);
-            return -1;
-        }
-
-        return -1;
-    }
-
-    m_pstate->m_object = parsed_obj;
-
-    auto [is_fatal, response] = m_porchestrator->do_operation(
-                                    m_pstate->m_object);
-    m_pstate->m_response = response;
-
-    if (is_fatal)
-    {
-        m_pstate->m_is_error = true;
-        if (!response)
-            m_pstate->set_default_special_error();
-    }
+    m_porchestrator->run_pipelined_commands(m_pstate);
 
     if (false == m_porchestrator->add_to_write_queue(m_pstate))
     {
@@ -984,9 +1765,7 @@ int ParseAndRunJob::run()
 
     std::cerr << fd << ": Added to write queue" << std::endl;
 
-
-    return 0;
-
+    return m_pstate->m_is_error ? -1 : 0;
 }
 
 /**
@@ -997,48 +1776,49 @@ int ParseAndRunJob::run()
  */
 int SocketWriteJob::run()
 {
-    m_pstate->m_state = STATE_PARSING;
-    auto fd = m_pstate->m_socket;
-
-    std::cerr << fd << ": Picked up write job";
-
-    char default_buffer[] = "-ERROR\r\n";
-    char* buffer;
-    std::string response_string;
-
-    if (m_pstate->m_special_error[0])
-        buffer = m_pstate->m_special_error;
-    else if (m_pstate->m_response)
-    {
-        response_string = m_pstate->m_response->serialize();
-        buffer = const_cast<char*>(response_string.c_str());
-    }
-    else
-    {
-        buffer = default_buffer;
-    }
+    std::cerr << m_pstate->m_socket << ": Picked up write job";
 
-    int buflen = strlen(buffer);
+    return m_porchestrator->send_responses(m_pstate);
+}
 
-    auto bytes_written = write(fd, buffer, buflen);
+/**
+ * @brief read, run and answer the commands of the socket
+ * 
+ * @return int 0 on success
+ */
+int RunToCompletionJob::run()
+{
+    m_pstate->m_state = STATE_IN_READ_LOOP;
+    auto fd = m_pstate->m_socket;
 
-    if (bytes_written < 0)
+    if (!m_porchestrator->read_input(m_pstate))
     {
-        perror("write");
-        std::cout << fd << ": Write failed with rc = " << bytes_written \
-            << " error = " << errno << std::endl;
         close_and_cleanup(fd, m_pstate, m_porchestrator);
         return -1;
     }
 
-    if (m_pstate->m_is_error)
-        close_and_cleanup(fd, m_pstate, m_porchestrator);
-    else
+    m_pstate->m_state = STATE_PARSING;
+    if (!m_porchestrator->run_pipelined_commands(
+                m_pstate, !m_is_shedding, m_is_shedding))
     {
-        std::cerr << fd << ": Adding back to epoll queue" << std::endl;
-        m_pstate->reset();
-        m_porchestrator->add_to_epoll_queue(fd);
+        // A slow command is next. It and the commands after it go
+        // through the parse and write pools, this worker moves on,
+        // unless the parse pool is overloaded.
+        int rc = m_porchestrator->add_to_parse_and_run_queue(m_pstate);
+        if (THREAD_POOL_SATURATED == rc)
+        {
+            m_porchestrator->run_pipelined_commands(m_pstate, false, true);
+            return m_porchestrator->send_responses(m_pstate);
+        }
+
+        if (0 != rc)
+        {
+            std::cerr << fd << ": Adding to parse queue failed" << std::endl;
+            close_and_cleanup(fd, m_pstate, m_porchestrator);
+            return -1;
+        }
+        return 0;
     }
 
-    return 0;
+    return m_porchestrator->send_responses(m_pstate);
 }
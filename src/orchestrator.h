@@ -4,8 +4,16 @@
 #include "common_include.h"
 #include "thread_pool.h"
 #include "resp_parser.h"
+#include "resp_scan.h"
+#include "arena.h"
 #include "data_store.h"
+#include "key_hash.h"
 #include "state.h"
+#include "server_config.h"
+#include "reactor.h"
+#include "uring_backend.h"
+#include "stats.h"
+#include "connection_table.h"
 
 #include <unistd.h>
 #include <stdio.h>
@@ -13,18 +21,102 @@
 #include <stdlib.h>
 #include <netinet/in.h>
 #include <string.h>
+#include <strings.h>
 #include <signal.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 
-#define NUM_DATASTORES 10
-#define PORTNUM 6379
-#define MAX_EPOLL_EVENTS 10
+/*
+ * Largest number of connections an accepting thread takes from the
+ * listen queue before registering them together.
+ */
+#define ACCEPT_BATCH_SIZE 64
+
+/*
+ * The number of events fetched by a single epoll_wait() adapts
+ * to the load. It starts at MIN_EPOLL_EVENTS, doubles every time
+ * a call fills the whole batch, and shrinks back when the batch
+ * is mostly empty.
+ */
+#define MIN_EPOLL_EVENTS 16
+#define MAX_EPOLL_EVENTS 4096
+
+/*
+ * Events a client socket is armed with. The socket is registered
+ * once, when it is accepted. EPOLLONESHOT disables it after one
+ * event is delivered, so the socket is owned by exactly one worker
+ * until it is re-armed with EPOLL_CTL_MOD.
+ */
+#define CLIENT_EPOLL_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLONESHOT | EPOLLET)
+
+/*
+ * Events a client socket is armed with while the client is too
+ * slow to take its responses. The socket is not read until all of
+ * them have been written.
+ */
+#define CLIENT_EPOLL_WRITE_EVENTS (EPOLLOUT | EPOLLONESHOT | EPOLLET)
+
+/*
+ * A DEL on more keys than this is a slow command, in run-to-completion
+ * mode it is handed over to the parse and run pool.
+ */
+#define SLOW_COMMAND_KEYS 32
+
+/*
+ * Sent to a client that connects while --maxclients clients are
+ * connected, before it is disconnected
+ */
+#define MAX_CLIENTS_ERROR "-ERR max number of clients reached\r\n"
+
+/*
+ * The answer to every command that is shed because the server is
+ * overloaded
+ */
+#define OVERLOADED_ERROR "ERR server is overloaded, try again later"
+
+/*
+ * Every event loop moves on the data stores that are growing this
+ * often, this many groups of slots at a time, and for at most this
+ * many microseconds
+ */
+#define REHASH_CRON_MS 100
+#define REHASH_CRON_GROUPS 64
+#define REHASH_CRON_BUDGET_US 1000
 
 class Orchestrator;
 class SocketReadJob;
 class ParseAndRunJob;
 
+/**
+ * @brief what an accepting thread is started with
+ * 
+ */
+struct AcceptorThreadArg
+{
+    /**
+     * @brief the orchestrator object
+     * 
+     */
+    Orchestrator*               m_porchestrator;
+
+    /**
+     * @brief the listening socket of the thread
+     * 
+     */
+    int                         m_listen_socket;
+
+    /**
+     * @brief is the listening socket the Unix domain socket
+     * 
+     */
+    bool                        m_is_unix;
+};
+
 /**
  * @brief enum defines the different types of commands
  * 
@@ -52,7 +144,12 @@ typedef enum
      * @brief set command
      * 
      */
-    COMMAND_SET
+    COMMAND_SET,
+    /**
+     * @brief info command, reports the server statistics
+     * 
+     */
+    COMMAND_INFO
 } command_type_t;
 
 /**
@@ -175,6 +272,56 @@ public:
     int run();
 };
 
+/**
+ * @brief Job that serves a ready socket from start to end in
+ * run-to-completion mode
+ * 
+ * It reads the socket, runs the commands and writes the responses
+ * on the same thread, without handing the state over to the other
+ * pools. A slow command, and the commands after it, are handed over
+ * to the parse and run pool, so that the worker is not held up.
+ * 
+ */
+class RunToCompletionJob: public JobInterface
+{
+public:
+    /**
+     * @brief state associated with the socket
+     * 
+     */
+    std::shared_ptr<State>      m_pstate;
+
+    /**
+     * @brief pointer to the orchestrator object
+     * 
+     */
+    Orchestrator*               m_porchestrator;
+
+    /**
+     * @brief the server was overloaded when the job was queued, the
+     * commands are answered with an error instead of being run
+     * 
+     */
+    bool                        m_is_shedding;
+
+    RunToCompletionJob(
+        Orchestrator*           porch,
+        std::shared_ptr<State>  pstate,
+        bool                    is_shedding = false)
+    {
+        m_porchestrator = porch;
+        m_pstate = pstate;
+        m_is_shedding = is_shedding;
+    }
+
+    /**
+     * @brief read, run and answer the commands of the socket
+     * 
+     * @return int 0 on success
+     */
+    int run();
+};
+
 /**
  * @brief This class orchestrates the entire server
  * 
@@ -195,36 +342,21 @@ public:
  *    connections.
  * 2. A thread that runs epoll() on all accepted sockets to see
  *    which sockets are ready for reading.
+ *
+ * Each socket is added to epoll exactly once, when it is accepted,
+ * in one-shot edge-triggered mode. Once the response is written,
+ * the socket is re-armed with a single EPOLL_CTL_MOD, so the cost
+ * of epoll is proportional to the active connections and not
+ * to all the connections.
  * 
- * TODO: Define a lock heirarchy.
- * Need to spend more time on it to figure out if this is the
- * most logical heirarchy or something else makes more sense
- * Mostly locks should not be held simultaneously.
- * But in case they need to, this should be the order
- * 
- * 1. m_all_sockets_mtx
- * 2. State.m_mutex
- * 3. m_epoll_sockets_mtx
- * 4. m_write_sockets_mtx
- * 5. m_write_sockets_mtx
+ * The connections are found by their file descriptor in
+ * m_connections, without taking a lock. Where a connection is in
+ * the pipeline is recorded in its State::m_state, so the only lock
+ * on the way of a request is State::m_mutex, held by the job that
+ * owns the connection.
  */
 class Orchestrator
 {
-    /**
-     * TODO: Define a lock heirarchy.
-     * Need to spend more time on it to figure out if this is the
-     * most logical heirarchy or something else makes more sense
-     * Mostly locks should not be held simultaneously.
-     * But in case they need to, this should be the order
-     * 
-     * 1. m_all_sockets_mtx
-     * 2. State.m_mutex
-     * 3. m_epoll_sockets_mtx
-     * 4. m_write_sockets_mtx
-     * 5. m_write_sockets_mtx
-     */
-
-    
 public:
     /**
      * @brief The server socket on which the thread is listening
@@ -234,57 +366,51 @@ public:
     int                                             m_server_socket;
 
     /**
-     * @brief A map of all valid sockets, to its associated state
-     * This state gets passed to all worker threads, but
-     * this is the master table in case we need it.
+     * @brief one listening socket per accepting thread, all bound
+     * to the same port. The first one is m_server_socket.
      * 
      */
-    std::unordered_map<int, std::shared_ptr<State>> m_all_sockets;
+    std::vector<int>                                m_server_sockets;
 
     /**
-     * @brief shared mutex to synchronize m_all_sockets
+     * @brief the Unix domain socket listening for clients on the
+     * same host, -1 if there is none. It feeds the same pipeline,
+     * or the same reactors, as the TCP sockets.
      * 
      */
-    std::shared_mutex                               m_all_sockets_mtx;
+    int                                             m_unix_server_socket;
 
     /**
-     * @brief Thread pool to schedule jobs to read from the socket
+     * @brief the timers of the pipeline, driven by the epoll thread.
+     * It is declared before m_connections, so that it outlives the
+     * states whose timers it holds.
      * 
      */
-    ThreadPool*                                     m_read_threadpool;
+    TimerWheel                                      m_timers;
 
     /**
-     * @brief Sockets which are currently not ready and are being
-     * monitored if they become ready at any point of time
+     * @brief In pipeline mode, the timer of the cron that moves on
+     * the data stores that are growing
      * 
      */
-    std::unordered_set<int>                         m_epoll_sockets;
+    TimerEntry                                      m_rehash_timer;
 
     /**
-     * @brief lock to synchronize m_epoll_sockets
+     * @brief All valid sockets and their associated state, indexed
+     * by file descriptor. The state gets passed to all worker
+     * threads, but this is the master table in case we need it.
      * 
      */
-    std::shared_mutex                               m_epoll_sockets_mtx;
+    ConnectionTable                                 m_connections;
 
     /**
-     * @brief Thread pool to schedule jobs to parse the data
-     * already read from the socket and then take the appropriate action
+     * @brief Thread pool to schedule jobs to read from the sockets
+     * that epoll reported. In run-to-completion mode the same job
+     * also runs the commands and writes the responses.
      * 
      */
     ThreadPool*                                     m_processing_threadpool;
  
-    /**
-     * @brief Not really used
-     * 
-     */
-    std::unordered_set<int>                         m_processing_sockets;
- 
-    /**
-     * @brief Not really used
-     * 
-     */
-    std::shared_mutex                               m_processing_sockets_mtx;
-
     /**
      * @brief The thread pool to parse and run all jobs
      * 
@@ -298,23 +424,24 @@ public:
     ThreadPool*                                     m_write_threadpool;
 
     /**
-     * @brief Not really used
+     * @brief Datastores are the hash tables, a power of two of them
+     * partitioned by the hash of the key for greater parallelism
      * 
      */
-    std::unordered_set<int>                         m_write_sockets;
+    DataStore*                                      m_datastore;
 
     /**
-     * @brief Not really used
+     * @brief the number of data stores minus one, the partition of
+     * a key is its hash masked with it
      * 
      */
-    std::shared_mutex                               m_write_sockets_mtx;
+    uint64_t                                        m_shard_mask;
 
     /**
-     * @brief Datastores are the hash tables, we use 10 hash-tables
-     * partitioned by the first character for greater parallelism
+     * @brief the seed of the hash of the keys, picked at startup
      * 
      */
-    DataStore                                       m_datastore[NUM_DATASTORES];
+    uint64_t                                        m_hash_seed;
 
     /**
      * @brief In case the server is asked to shut down, all threads
@@ -326,11 +453,11 @@ public:
     bool                                            m_is_destroying;
 
     /**
-     * @brief The thread id that listens for new connections and accepts
+     * @brief The threads that listen for new connections and accept
      * them.
      * 
      */
-    pthread_t                                       m_accepting_thread_id;
+    std::vector<pthread_t>                          m_accepting_thread_ids;
 
     /**
      * @brief The thread id that executes epoll to look for connections
@@ -345,15 +472,79 @@ public:
      */
     int                                             m_epoll_fd;
 
-    Orchestrator():
+    /**
+     * @brief eventfd that is part of the epoll set. Writing to it
+     * interrupts epoll_wait
+     * 
+     */
+    int                                             m_wakeup_fd;
+
+    /**
+     * @brief buffer that receives the events from epoll_wait. Its
+     * size adapts to the number of ready sockets, between
+     * MIN_EPOLL_EVENTS and MAX_EPOLL_EVENTS
+     * 
+     */
+    std::vector<struct epoll_event>                 m_epoll_events;
+
+    /**
+     * @brief the configuration the server was started with
+     * 
+     */
+    ServerConfig                                    m_config;
+
+    /**
+     * @brief In reactor mode, the reactors. Reactor i owns every
+     * data store partition p for which p % m_reactors.size() == i
+     * 
+     */
+    std::vector<Reactor*>                           m_reactors;
+
+    /**
+     * @brief In pipeline mode with the io_uring backend, the backend
+     * that replaces the accept, epoll, read and write stages
+     * 
+     */
+    UringBackend*                                   m_uring;
+
+    /**
+     * @brief statistics reported by the INFO command
+     * 
+     */
+    ServerStats                                     m_stats;
+
+    Orchestrator(const ServerConfig& config = ServerConfig()):
         m_server_socket(-1),
-        m_epoll_fd(-1)
+        m_unix_server_socket(-1),
+        m_processing_threadpool(nullptr),
+        m_parse_and_run_threadpool(nullptr),
+        m_write_threadpool(nullptr),
+        m_datastore(nullptr),
+        m_shard_mask(0),
+        m_hash_seed(KeyHash::random_seed()),
+        m_epoll_fd(-1),
+        m_wakeup_fd(-1),
+        m_config(config),
+        m_uring(nullptr)
     {
-        ThreadPoolFactory tfp;
-        m_read_threadpool = tfp.create_thread_pool(8, false);
-        m_processing_threadpool = tfp.create_thread_pool(8, false);
-        m_write_threadpool = tfp.create_thread_pool(8, false);
-        m_parse_and_run_threadpool = tfp.create_thread_pool(8, false);
+        create_datastores(m_config.m_num_shards);
+
+        // The reactors do all the work on their own threads,
+        // the pools are only needed by the pipeline
+        if (SERVER_MODE_PIPELINE == m_config.m_mode)
+        {
+            ThreadPoolFactory tfp;
+            m_processing_threadpool = tfp.create_thread_pool(8, false);
+            m_write_threadpool = tfp.create_thread_pool(8, false);
+            m_parse_and_run_threadpool = tfp.create_thread_pool(8, false);
+
+            // The limit applies to the pools that run the commands
+            if (m_parse_and_run_threadpool)
+                m_parse_and_run_threadpool->m_max_inflight = m_config.m_max_inflight;
+            if (m_processing_threadpool &&
+                EXECUTION_RUN_TO_COMPLETION == m_config.m_execution)
+                m_processing_threadpool->m_max_inflight = m_config.m_max_inflight;
+        }
         m_is_destroying = false;
     }
 
@@ -363,28 +554,63 @@ public:
          * It is important to first call destroy before deleting it
          * Otherwise, it might lead to threads working on deleted objects
          */
-        if (m_read_threadpool)
-            m_read_threadpool->destroy();
         if (m_processing_threadpool)
             m_processing_threadpool->destroy();
         if (m_write_threadpool)
             m_write_threadpool->destroy();
         if (m_parse_and_run_threadpool)
             m_parse_and_run_threadpool->destroy();
-        delete m_read_threadpool;
         delete m_processing_threadpool;
         delete m_write_threadpool;
         delete m_parse_and_run_threadpool;
+
+        m_is_destroying = true;
+        for (auto preactor: m_reactors)
+            delete preactor;
+        delete m_uring;
+        delete[] m_datastore;
+
+        if (m_unix_server_socket >= 0)
+        {
+            close(m_unix_server_socket);
+            unlink(m_config.m_unix_socket.c_str());
+        }
     }
 
     /**
-     * @brief create a server socket to listen on
+     * @brief create the server sockets to listen on, one for every
+     * accepting thread
      * 
      */
     void create_server_socket();
 
     /**
-     * @brief spawn a thread that loops to accpept new connections
+     * @brief create a non-blocking socket listening on the configured
+     * address and port. SO_REUSEPORT is set, so that several of them
+     * can share the port.
+     * 
+     * @return int the socket, -1 on failure
+     */
+    int create_listen_socket();
+
+    /**
+     * @brief create the Unix domain socket to listen on, if one is
+     * configured. A stale socket file left at the path is replaced.
+     * 
+     */
+    void create_unix_server_socket();
+
+    /**
+     * @brief create a non-blocking Unix domain socket listening on
+     * the configured path, with the configured permissions
+     * 
+     * @return int the socket, -1 on failure
+     */
+    int create_unix_listen_socket();
+
+    /**
+     * @brief spawn the threads that loop to accept new connections,
+     * one per server socket, and one for the Unix domain socket
      * 
      * @return true on successful launch
      * @return false on unsuccessful launch
@@ -392,12 +618,23 @@ public:
     bool spawn_accepting_thread();
 
     /**
-     * @brief loop and accept connections on the listening socket
-     * Once a connection is received, it then adds it to the queue
-     * which the epoll thread uses, and wakes up the epoll thread.
+     * @brief loop and accept connections on a listening socket
+     * Once a connection is received, it is registered with epoll
+     * and will be picked up by the epoll thread once readable.
+     * 
+     * @param listen_socket the listening socket
+     * @param is_unix is it the Unix domain socket
+     */
+    void accepting_thread_loop(int listen_socket, bool is_unix);
+
+    /**
+     * @brief create the state of newly accepted connections and
+     * register them with epoll
      * 
+     * @param fds the accepted sockets
+     * @param is_unix did they come through the Unix domain socket
      */
-    void accepting_thread_loop();
+    void register_connections(const std::vector<int>& fds, bool is_unix);
 
     /**
      * @brief spawn the thread that calls epoll for ready sockets
@@ -417,13 +654,14 @@ public:
     void epoll_thread_loop();
 
     /**
-     * @brief Wake up the epoll thread by sending it a signal
+     * @brief Wake up the epoll thread by writing to the eventfd
      * 
      */  
     void wakeup_epoll_thread();
 
     /**
-     * @brief creates the file descriptor on which epoll is run
+     * @brief creates the file descriptor on which epoll is run,
+     * and the eventfd used to wake up the epoll thread
      * 
      * @return true on success
      * @return false on failure
@@ -431,40 +669,54 @@ public:
     bool create_epoll_fd();
 
     /**
-     * @brief removes a socket from all queues and frees
-     * any data structure associated with the file descriptor
+     * @brief adjust the size of the epoll batch after a call to
+     * epoll_wait returned n_fd events
      * 
-     * @param fd the file descriptor to remove
+     * @param n_fd number of events returned by epoll_wait
      */
-    void remove_socket(int fd);
+    void resize_epoll_batch(int n_fd);
 
     /**
-     * @brief rebuild the epoll monitor from the set of fd's
+     * @brief removes a socket from all queues and frees
+     * any data structure associated with the file descriptor
      * 
+     * @param fd the file descriptor to remove
      */
-    void epoll_rearm();
+    void remove_socket(int fd);
 
     /**
-     * @brief rebuild the epoll monitor from the set of fd's
+     * @brief register a newly accepted socket with epoll
      * 
-     * This is the unsafe version of the function. the caller
-     * must hold the mutex before calling it.
+     * This is done only once for every socket.
      * 
+     * @param fd the file descriptor to register
+     * @param generation the generation of the connection in
+     * m_connections, it comes back with the events
+     * @return true on success
+     * @return false on failure
      */
-    void epoll_rearm_unsafe();
+    bool epoll_register(int fd, uint32_t generation);
 
     /**
-     * @brief remove all monitoring file descriptors from epoll
+     * @brief re-arm a one-shot socket so that epoll reports it
+     * again when it becomes readable, or writable
      * 
+     * @param fd the file descriptor to re-arm
+     * @param generation the generation of the connection in
+     * m_connections
+     * @param events the events to wait for
+     * @return true on success
+     * @return false on failure
      */
-    void epoll_empty();
+    bool epoll_rearm(int fd, uint32_t generation,
+                        uint32_t events = CLIENT_EPOLL_EVENTS);
 
     /**
-     * @brief remove all monitoring file descriptors from epoll
-     * This is the unsafe version of the function, and the caller
-     * must hold the m_epoll_sockets_mtx lock before calling it
+     * @brief remove a socket from the epoll set
+     * 
+     * @param fd the file descriptor to remove
      */
-    void epoll_empty_unsafe();
+    void epoll_unregister(int fd);
 
     /**
      * @brief creates a processing job for a ready to read fd
@@ -475,8 +727,10 @@ public:
      * process it.
      * 
      * @param fd file descriptor to be posted for read
+     * @param generation the generation that epoll reported, the
+     * event is dropped if the fd now belongs to another connection
      */
-    void create_processing_job(int fd);
+    void create_processing_job(int fd, uint32_t generation);
 
     /**
      * @brief add the state associated with a file descriptor
@@ -485,10 +739,11 @@ public:
      * 
      * 
      * @param pstate is the state associated with the file descriptor
-     * @return true on successful posting
-     * @return false on failure to post
+     * @return int 0 on successful posting, THREAD_POOL_SATURATED if
+     * --max-inflight commands are already queued or running, another
+     * number on failure to post
      */
-    bool add_to_parse_and_run_queue(std::shared_ptr<State> pstate);
+    int add_to_parse_and_run_queue(std::shared_ptr<State> pstate);
 
     /**
      * @brief add the state associated with a file descriptor to the
@@ -500,10 +755,89 @@ public:
      */
     bool add_to_write_queue(std::shared_ptr<State> pstate);
 
+    /**
+     * @brief read everything that is available on the socket of a
+     * client into its input buffer
+     * 
+     * @param pstate the state of the client
+     * @return true on success, m_is_error is set if the peer has
+     * closed its side
+     * @return false if the connection must be closed
+     */
+    bool read_input(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief parse and run every complete command in the data read
+     * from a client. The responses are added to the state in order,
+     * and an incomplete command at the end of the data is left in
+     * it for the next read.
+     * 
+     * @param pstate the state of the client
+     * @param stop_at_slow_command stop before a slow command, it is
+     * left at the start of the input
+     * @param is_shedding the server is overloaded, every command is
+     * answered with an error instead of being run
+     * @return true if all the complete commands were run
+     * @return false if it stopped before a slow command
+     */
+    bool run_pipelined_commands(
+        std::shared_ptr<State>  pstate,
+        bool                    stop_at_slow_command = false,
+        bool                    is_shedding = false);
+
+    /**
+     * @brief create the state of a newly accepted client, unless
+     * --maxclients clients are connected already. A client that is
+     * turned away gets an error and its socket is closed.
+     * 
+     * @param fd the accepted socket
+     * @return std::shared_ptr<State> the state of the client, nullptr
+     * if the socket was closed
+     */
+    std::shared_ptr<State> admit_client(int fd);
+
+    /**
+     * @brief write the responses of a client, then either close the
+     * connection, wait for the socket to be writable, or re-arm it
+     * for the next read
+     * 
+     * @param pstate the state of the client
+     * @return int 0 on success
+     */
+    int send_responses(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief write the responses of a state to its socket, with as
+     * few system calls as possible. What the socket does not accept
+     * is kept in the output buffer of the state.
+     * 
+     * @param pstate the state of the client
+     * @return output_status_t OUTPUT_DONE when everything has been
+     * written, OUTPUT_PENDING if the rest must be written once the
+     * socket is writable, OUTPUT_ERROR if the connection must be
+     * closed
+     */
+    output_status_t write_responses(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief check the responses waiting for a client against the
+     * configured output limits
+     * 
+     * @param pstate the state of the client
+     * @return true if the client is too slow and must be
+     * disconnected
+     */
+    bool exceeds_output_limits(std::shared_ptr<State> pstate);
+
     /**
      * @brief given a parsed command, perform the requested operations
      * 
-     * @param command command after parsing, as received from client
+     * @param argv the command and its arguments, as received from
+     * client
+     * @param parena the arena the response is allocated from, nullptr
+     * to allocate it from the heap
+     * @param pstreamed the bytes of the last argument if the parser
+     * streamed it, nullptr otherwise. The command may move them.
      * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
      * a tuple containing two items
      * 1. has there been a fatal error, which mandates the
@@ -512,12 +846,95 @@ public:
      *    and sent to the client as response.
      */
     std::tuple<bool, std::shared_ptr<AbstractRespObject> >
-        do_operation(std::shared_ptr<AbstractRespObject> command);
+        do_operation(
+            const std::vector<std::string_view>&    argv,
+            Arena*                                  parena = nullptr,
+            std::string*                            pstreamed = nullptr);
+
+    /**
+     * @brief perform a command that has already been validated
+     * 
+     * @param argv the command and its arguments, as received from
+     * client
+     * @param is_valid whether is_valid_command accepted it
+     * @param cmd_type the type returned by is_valid_command
+     * @param parena the arena the response is allocated from, nullptr
+     * to allocate it from the heap
+     * @param pstreamed the streamed last argument, as for do_operation
+     * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> >
+     * as for do_operation
+     */
+    std::tuple<bool, std::shared_ptr<AbstractRespObject> >
+        do_operation(
+            const std::vector<std::string_view>&    argv,
+            bool                                    is_valid,
+            command_type_t                          cmd_type,
+            Arena*                                  parena = nullptr,
+            std::string*                            pstreamed = nullptr);
+
+    /**
+     * @brief create a response, in the arena of the request if
+     * there is one
+     * 
+     * @tparam T the type of the response
+     * @param parena the arena, nullptr to allocate from the heap
+     * @param args the arguments of the constructor of T
+     * @return std::shared_ptr<AbstractRespObject> the response
+     */
+    template<typename T, typename... Args>
+    static std::shared_ptr<AbstractRespObject>
+        make_response(Arena* parena, Args&&... args)
+    {
+        return arena_make_shared<T>(parena, std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief create an integer response, the preencoded one if
+     * there is one for the value
+     * 
+     * @param parena the arena, nullptr to allocate from the heap
+     * @param value the integer
+     * @return std::shared_ptr<AbstractRespObject> the response
+     */
+    static std::shared_ptr<AbstractRespObject>
+        make_integer(Arena* parena, int value)
+    {
+        auto preencoded = RespReplies::integer(value);
+        if (preencoded)
+            return preencoded;
+        return make_response<RespInteger>(parena, value);
+    }
+
+    /**
+     * @brief the response to a request that could not be parsed.
+     * The connection is closed after it is sent.
+     * 
+     * @param pstate the connection
+     * @param err the parse error
+     * @return std::shared_ptr<AbstractRespObject> the response
+     */
+    static std::shared_ptr<AbstractRespObject>
+        make_parse_error(std::shared_ptr<State> pstate, resp_parse_error_t err);
+
+    /**
+     * @brief is a command slow enough that it should not run on a
+     * run-to-completion worker. INFO formats every counter, and a DEL
+     * on many keys takes as many locks.
+     * 
+     * @param argv the command and its arguments
+     * @param cmd_type its type
+     * @return true if it is slow
+     */
+    bool is_slow_command(
+        const std::vector<std::string_view>&    argv,
+        command_type_t                          cmd_type);
 
     /**
      * @brief In case of the GET command, perform the action
      * 
-     * @param pobj command after parsing, as received from client
+     * @param argv the command and its arguments, as received from
+     * client
+     * @param parena the arena the response is allocated from
      * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
      * a tuple containing two items
      * 1. has there been a fatal error, which mandates the
@@ -526,12 +943,30 @@ public:
      *    and sent to the client as response.
      */    
     std::tuple<bool, std::shared_ptr<AbstractRespObject> >
-        do_get(std::shared_ptr<AbstractRespObject> p);
+        do_get(const std::vector<std::string_view>& argv, Arena* parena);
+
+    /**
+     * @brief perform a GET command for a client whose responses are
+     * written by the calling thread, serializing the value straight
+     * into its output buffer
+     * 
+     * @param pstate the client, its output buffer must not be in use
+     * by a write
+     * @param argv the command and its arguments, as received from
+     * client
+     */
+    void queue_get(
+            std::shared_ptr<State>                  pstate,
+            const std::vector<std::string_view>&    argv);
 
     /**
      * @brief in case of a SET command, perform the action
      * 
-     * @param pobj command after parsing, as received from client
+     * @param argv the command and its arguments, as received from
+     * client
+     * @param parena the arena the response is allocated from
+     * @param pstreamed the value if the parser streamed it, it is
+     * moved to the data store
      * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
      * a tuple containing two items
      * 1. has there been a fatal error, which mandates the
@@ -540,12 +975,17 @@ public:
      *    and sent to the client as response.
      */
     std::tuple<bool, std::shared_ptr<AbstractRespObject> >
-        do_set(std::shared_ptr<AbstractRespObject> p);
+        do_set(
+            const std::vector<std::string_view>&    argv,
+            Arena*                                  parena,
+            std::string*                            pstreamed);
 
     /**
      * @brief perform the DEL command
      * 
-     * @param pobj command after parsing, as received from client
+     * @param argv the command and its arguments, as received from
+     * client
+     * @param parena the arena the response is allocated from
      * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
      * a tuple containing two items
      * 1. has there been a fatal error, which mandates the
@@ -554,17 +994,34 @@ public:
      *    and sent to the client as response.
      */
     std::tuple<bool, std::shared_ptr<AbstractRespObject> >
-        do_del(std::shared_ptr<AbstractRespObject> p);
+        do_del(const std::vector<std::string_view>& argv, Arena* parena);
+
+    /**
+     * @brief perform the INFO command, for all the sections or the
+     * ones named after it
+     * 
+     * @param argv the command and its arguments, as received from
+     * client
+     * @param parena the arena the response is allocated from
+     * @return std::tuple<bool, std::shared_ptr<AbstractRespObject> > 
+     * a tuple containing two items
+     * 1. has there been a fatal error, which mandates the
+     *    client connection must be closed
+     * 2. the statistics as a bulk string, empty if none of the
+     *    sections named exists
+     */
+    std::tuple<bool, std::shared_ptr<AbstractRespObject> >
+        do_info(const std::vector<std::string_view>& argv, Arena* parena);
 
     /**
      * @brief delete one variable from the appropriate hash
      * 
-     * @param pobj command after parsing, as received from the client
+     * @param key the key to delete
      * @return true on successful deletion
      * @return false on failure to delete for any reason, including
      * if the item was not present in the first place.
      */
-    bool do_del_internal(std::shared_ptr<AbstractRespObject> pobj);
+    bool do_del_internal(std::string_view key);
 
 
     /**
@@ -572,14 +1029,18 @@ public:
      * new connections. A static glue is required because
      * pthread cannot deal object methods
      * 
-     * @param arg passed by the pthread, contains the pointer
-     * to the orchestrator object
+     * @param arg passed by the pthread, an AcceptorThreadArg
+     * allocated by the caller, it is freed here
      * @return void* returns nullptr
      */
     static void* accepting_thread_pthread_fn(void* arg)
     {
-        Orchestrator* ptr = static_cast<Orchestrator*>(arg);
-        ptr->accepting_thread_loop();
+        AcceptorThreadArg* ptr = static_cast<AcceptorThreadArg*>(arg);
+        Orchestrator* porch = ptr->m_porchestrator;
+        int listen_socket = ptr->m_listen_socket;
+        bool is_unix = ptr->m_is_unix;
+        delete ptr;
+        porch->accepting_thread_loop(listen_socket, is_unix);
         return nullptr;
     }
 
@@ -607,30 +1068,116 @@ public:
      * and actual action
      */
     /**
-     * @brief given an abstract object, find whether it is a valid
-     * command or not.
+     * @brief given the arguments of a command, find whether it is a
+     * valid command or not.
      * 
      * When a command is received from the client, it is parsed.
      * After parsing, this function will decide whether it is a valid
      * command or not
      * 
-     * @param p the parsed input in object form
+     * @param argv the command and its arguments
      * @return std::tuple<bool, command_type_t> a tuple of two items:
      * 1. whether it is valid or not
      * 2. the type of command if it is valid
      */
     std::tuple<bool, command_type_t>
-        is_valid_command(std::shared_ptr<AbstractRespObject> p);
+        is_valid_command(const std::vector<std::string_view>& argv);
     
     /**
-     * @brief Add a file descriptor to queue for epoll
-     * This queue is monitored by the thread which executes
-     * epoll.
-     * The thread is woken up.
+     * @brief Add a file descriptor back to the set monitored
+     * by epoll. The socket is already registered, so it only
+     * needs to be re-armed.
+     * 
+     * The state is reset and released only once the socket is armed,
+     * so a state that is not locked is always waiting in epoll. The
+     * idle reaper relies on it.
+     * 
+     * @param pstate the locked state of the socket to monitor for
+     * changes
+     */
+    void add_to_epoll_queue(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief how often the timer of a connection must look at it,
+     * the shortest of the enabled timeouts
+     * 
+     * @return uint64_t the period in milliseconds, 0 if no timeout
+     * is enabled
+     */
+    uint64_t get_timeout_check_ms();
+
+    /**
+     * @brief find whether a connection has timed out. A connection
+     * with a partial command in its input buffer is held to the
+     * request timeout, any other one to the idle timeout.
+     * 
+     * The caller must own the state, the input buffer is read.
+     * 
+     * @param pstate the state of the connection
+     * @param now_ms the current time, from TimerWheel::clock_ms()
+     * @return std::tuple<bool, uint64_t> a tuple of two items:
+     * 1. whether the connection has timed out
+     * 2. if not, when it must be looked at again
+     */
+    std::tuple<bool, uint64_t> check_timeout(
+        std::shared_ptr<State> pstate,
+        uint64_t now_ms);
+
+    /**
+     * @brief count a connection that is closed because it timed
+     * out, in the statistic of its timeout
+     * 
+     * @param pstate the state of the connection
+     */
+    void count_timeout(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief In pipeline mode, start the timer that closes the
+     * connection once it times out. Nothing is done if no timeout
+     * is enabled.
      * 
-     * @param fd file descriptor to monitor for changes
+     * @param pstate the state of a connection that was just
+     * registered with epoll
      */
-    void add_to_epoll_queue(int fd);
+    void watch_connection(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief In pipeline mode, the timer of a connection expired.
+     * It runs on the epoll thread.
+     * 
+     * The timer does not move on every request, it only looks at
+     * the time of the last activity when it expires. A connection
+     * whose state is locked is being served, or is waiting for the
+     * client to read its responses, so it is looked at again later.
+     * 
+     * @param weak the state of the connection, if it still exists
+     */
+    void on_connection_timer(std::weak_ptr<State> weak);
+
+    /**
+     * @brief move on the data stores that are growing, for at most
+     * REHASH_CRON_BUDGET_US, and free what they retired that no
+     * reader can see any more. It is the cron of every event loop,
+     * each one takes care of its own shards.
+     * 
+     * @param first the first shard
+     * @param step the distance between two shards
+     */
+    void rehash_datastores(size_t first, size_t step);
+
+    /**
+     * @brief In pipeline mode, the timer of the rehash cron expired.
+     * It runs on the epoll thread, and looks after every shard.
+     * 
+     */
+    void on_rehash_timer();
+
+    /**
+     * @brief allocate the data stores, they must be empty
+     * 
+     * @param num_shards the number of data stores, a power of two
+     */
+    void create_datastores(size_t num_shards);
 
     /**
      * @brief Get the partition id of the hash table, based on the
@@ -638,19 +1185,48 @@ public:
      * 
      * For performance reasons, instead of using a single hash,
      * we use multiple hashes, and the decision to choose the
-     * correct hash is taken based on the first character of the key.
+     * correct hash is taken based on the hash of the key.
      * 
      * This is done because on high load, a single hash would be
      * affected by lock contention. Using several hashes will
      * reduce the lock contention.
      * 
-     * Additionally, reader-writer locks are used to increase
-     * concurrency even more.
+     * Additionally, only the writers of a data store lock it, its
+     * readers take no lock.
      * 
      * @param varname name of the variable
      * @return int partition id of the correct hash to use
      */
-    int get_partition(const std::string& s);
+    int get_partition(std::string_view varname);
+
+    /**
+     * @brief In reactor mode, get the reactor that owns the
+     * partition of a key
+     * 
+     * @param key the key
+     * @return int index of the reactor in m_reactors
+     */
+    int get_owner_reactor(std::string_view key);
+
+    /**
+     * @brief In reactor mode, create one reactor per configured
+     * core and start them
+     * 
+     * @return true on success
+     * @return false on failure
+     */
+    bool spawn_reactors();
+
+    /**
+     * @brief In pipeline mode with the io_uring backend, start the
+     * io_uring backend on the server socket, and the Unix domain
+     * socket if there is one
+     * 
+     * @return true on success
+     * @return false if io_uring is not usable, the epoll path
+     * must be used
+     */
+    bool start_uring_backend();
 
     /**
      * @brief run a server
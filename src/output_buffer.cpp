@@ -0,0 +1,119 @@
+#include "output_buffer.h"
+
+std::string& OutputBuffer::begin_append()
+{
+    // Only the first chunk can be partially written, appending to it
+    // does not move the data that is still to be written, fill_iovec
+    // is called again for every write
+    if (m_chunks.empty() || m_chunks.back().length() >= OUTPUT_CHUNK_SIZE)
+    {
+        m_chunks.push_back(std::move(m_spare));
+        m_spare.clear();
+    }
+
+    m_append_start = m_chunks.back().length();
+    return m_chunks.back();
+}
+
+void OutputBuffer::end_append()
+{
+    auto& chunk = m_chunks.back();
+    m_size += chunk.length() - m_append_start;
+
+    // Nothing was appended to a new chunk, give it back
+    if (chunk.empty())
+    {
+        if (m_spare.capacity() < chunk.capacity())
+            m_spare = std::move(chunk);
+        m_chunks.pop_back();
+    }
+}
+
+int OutputBuffer::fill_iovec(struct iovec* iov, int max) const
+{
+    int count = 0;
+    size_t offset = m_offset;
+
+    for (auto& chunk: m_chunks)
+    {
+        if (count == max)
+            break;
+        iov[count].iov_base = (void*)(chunk.data() + offset);
+        iov[count].iov_len = chunk.length() - offset;
+        count++;
+        offset = 0;
+    }
+
+    return count;
+}
+
+void OutputBuffer::consume(size_t n)
+{
+    m_size -= n;
+    while (n)
+    {
+        size_t left = m_chunks.front().length() - m_offset;
+        if (n < left)
+        {
+            m_offset += n;
+            return;
+        }
+        n -= left;
+        if (m_spare.capacity() < m_chunks.front().capacity() &&
+            m_chunks.front().capacity() <= OUTPUT_CHUNK_SIZE * 2)
+        {
+            m_spare = std::move(m_chunks.front());
+            m_spare.clear();
+        }
+        m_chunks.pop_front();
+        m_offset = 0;
+    }
+}
+
+output_status_t OutputBuffer::write_to(int fd, ServerStats& stats)
+{
+    struct iovec iov[IOV_MAX];
+
+    while (!empty())
+    {
+        int count = fill_iovec(iov, IOV_MAX);
+        ServerStats::add(stats.m_syscalls_write);
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            if (EAGAIN == errno || EWOULDBLOCK == errno)
+                return OUTPUT_PENDING;
+            perror("writev");
+            return OUTPUT_ERROR;
+        }
+        consume(written);
+    }
+
+    m_is_over_soft_limit = false;
+    return OUTPUT_DONE;
+}
+
+bool OutputBuffer::exceeds_limits(const OutputLimits& limits)
+{
+    if (limits.m_hard_limit && m_size > limits.m_hard_limit)
+        return true;
+
+    if (!limits.m_soft_limit || m_size <= limits.m_soft_limit)
+    {
+        m_is_over_soft_limit = false;
+        return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (!m_is_over_soft_limit)
+    {
+        m_is_over_soft_limit = true;
+        m_soft_limit_since = now;
+        return false;
+    }
+
+    return now - m_soft_limit_since >= \
+        std::chrono::seconds(limits.m_soft_seconds);
+}
@@ -0,0 +1,250 @@
+#ifndef OUTPUT_BUFFER_H_
+#define OUTPUT_BUFFER_H_
+
+#include "common_include.h"
+#include "stats.h"
+#include <sys/uio.h>
+#include <limits.h>
+#include <chrono>
+
+/**
+ * @brief the result of writing an output buffer to a socket
+ * 
+ */
+typedef enum
+{
+    /**
+     * @brief everything has been written
+     * 
+     */
+    OUTPUT_DONE,
+
+    /**
+     * @brief the socket buffer is full, the rest must be written
+     * once the socket is writable again
+     * 
+     */
+    OUTPUT_PENDING,
+
+    /**
+     * @brief the write failed, or the client is too slow, the
+     * connection must be closed
+     * 
+     */
+    OUTPUT_ERROR
+} output_status_t;
+
+/**
+ * @brief Limits on the data waiting to be written to a client
+ * that does not read its responses fast enough. A limit of 0 means
+ * there is no limit.
+ * 
+ */
+struct OutputLimits
+{
+    /**
+     * @brief the client is disconnected as soon as more than this
+     * is waiting
+     * 
+     */
+    size_t                      m_hard_limit;
+
+    /**
+     * @brief the client is disconnected if more than this has been
+     * waiting for m_soft_seconds
+     * 
+     */
+    size_t                      m_soft_limit;
+
+    /**
+     * @brief how long the soft limit may be exceeded
+     * 
+     */
+    int                         m_soft_seconds;
+
+    OutputLimits():
+        m_hard_limit(256 * 1024 * 1024),
+        m_soft_limit(64 * 1024 * 1024),
+        m_soft_seconds(60)
+    {
+    }
+};
+
+/**
+ * @brief responses are serialized into the last chunk of the queue
+ * until it holds this many bytes, a new chunk is started after that
+ * 
+ */
+#define OUTPUT_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief The responses of a connection that have not been written
+ * to its socket yet.
+ * 
+ * The responses are serialized directly into the last chunk of a
+ * queue, the chunks are written together with writev. A chunk that
+ * has been written is kept as a spare and the next responses are
+ * serialized into it, so a connection that keeps up with its
+ * responses reuses the same memory for all of them. A write that the socket only partially
+ * accepts leaves the rest in the queue, with m_offset marking where
+ * the first chunk continues, so a large response is never truncated
+ * and no thread waits for a slow client. The caller waits until the
+ * socket is writable and writes again.
+ * 
+ */
+class OutputBuffer
+{
+public:
+    /**
+     * @brief the serialized responses, in order
+     * 
+     */
+    std::deque<std::string>     m_chunks;
+
+    /**
+     * @brief number of bytes of the first chunk already written
+     * 
+     */
+    size_t                      m_offset;
+
+    /**
+     * @brief number of bytes still to be written
+     * 
+     */
+    size_t                      m_size;
+
+    /**
+     * @brief a chunk that has been written, kept with its memory
+     * for the next responses
+     * 
+     */
+    std::string                 m_spare;
+
+    /**
+     * @brief length of the last chunk when begin_append() returned
+     * it
+     * 
+     */
+    size_t                      m_append_start;
+
+    /**
+     * @brief set while more than the soft limit is waiting
+     * 
+     */
+    bool                        m_is_over_soft_limit;
+
+    /**
+     * @brief when the soft limit was first exceeded
+     * 
+     */
+    std::chrono::steady_clock::time_point   m_soft_limit_since;
+
+    OutputBuffer():
+        m_offset(0),
+        m_size(0),
+        m_append_start(0),
+        m_is_over_soft_limit(false)
+    {
+    }
+
+    /**
+     * @brief number of bytes still to be written
+     * 
+     * @return size_t the number of bytes
+     */
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * @brief is everything written
+     * 
+     * @return true if nothing is waiting
+     */
+    bool empty() const
+    {
+        return 0 == m_size;
+    }
+
+    /**
+     * @brief queue data to be written after the data already queued
+     * 
+     * @param data the data, it is moved
+     */
+    void append(std::string&& data)
+    {
+        if (data.empty())
+            return;
+        m_size += data.length();
+        m_chunks.push_back(std::move(data));
+    }
+
+    /**
+     * @brief start serializing in place. Data appended to the
+     * returned chunk is written after the data already queued. The
+     * chunk is valid until end_append(), which must be called before
+     * anything else is done with the buffer.
+     * 
+     * @return std::string& the chunk to append to
+     */
+    std::string& begin_append();
+
+    /**
+     * @brief account for the data appended since begin_append()
+     * 
+     */
+    void end_append();
+
+    /**
+     * @brief describe the data still to be written
+     * 
+     * @param iov receives the buffers
+     * @param max the number of entries in iov
+     * @return int the number of entries filled in
+     */
+    int fill_iovec(struct iovec* iov, int max) const;
+
+    /**
+     * @brief remove written bytes from the front
+     * 
+     * @param n the number of bytes
+     */
+    void consume(size_t n);
+
+    /**
+     * @brief drop everything
+     * 
+     */
+    void clear()
+    {
+        m_chunks.clear();
+        m_spare.clear();
+        m_offset = 0;
+        m_size = 0;
+        m_is_over_soft_limit = false;
+    }
+
+    /**
+     * @brief write as much as the socket accepts
+     * 
+     * @param fd the socket, it must be non-blocking
+     * @param stats the writes are counted in it
+     * @return output_status_t OUTPUT_DONE if everything was written,
+     * OUTPUT_PENDING if the socket is full, OUTPUT_ERROR if the
+     * write failed
+     */
+    output_status_t write_to(int fd, ServerStats& stats);
+
+    /**
+     * @brief check the amount of data waiting against the limits.
+     * The time spent over the soft limit is measured from the first
+     * call that found it exceeded.
+     * 
+     * @param limits the limits
+     * @return true if the client must be disconnected
+     */
+    bool exceeds_limits(const OutputLimits& limits);
+};
+
+#endif /* #ifndef OUTPUT_BUFFER_H_ */
@@ -0,0 +1,175 @@
+#include "output_buffer.h"
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+void test_append_consume()
+{
+    std::cout << std::endl << "Tests to validate queueing and consuming" << std::endl;
+    {
+        OutputBuffer buffer;
+        TEST(buffer.empty(), "A new buffer should be empty");
+
+        buffer.append("+OK\r\n");
+        buffer.append("");
+        buffer.append("$3\r\nabc\r\n");
+        TEST(14 == buffer.size() && 2 == buffer.m_chunks.size(), "Empty responses should not be queued");
+
+        struct iovec iov[4];
+        TEST(2 == buffer.fill_iovec(iov, 4), "Every response should get its own iovec");
+        TEST(1 == buffer.fill_iovec(iov, 1), "The number of iovecs should be limited");
+
+        buffer.consume(7);
+        TEST(7 == buffer.size() && 1 == buffer.m_chunks.size() && 2 == buffer.m_offset, \
+            "A partial write should continue in the middle of a response");
+        TEST(1 == buffer.fill_iovec(iov, 4) && 0 == memcmp(iov[0].iov_base, "\r\nabc\r\n", 7), \
+            "The rest of a partially written response should be written next");
+
+        buffer.consume(7);
+        TEST(buffer.empty() && 0 == buffer.m_offset, "A fully written buffer should be empty");
+    }
+}
+
+void test_append_in_place()
+{
+    std::cout << std::endl << "Tests to validate serializing into the buffer" << std::endl;
+    {
+        OutputBuffer buffer;
+        buffer.begin_append().append("+OK\r\n");
+        buffer.end_append();
+        buffer.begin_append().append(":1\r\n");
+        buffer.end_append();
+        TEST(9 == buffer.size() && 1 == buffer.m_chunks.size(), "Small responses should share a chunk");
+
+        buffer.begin_append();
+        buffer.end_append();
+        TEST(9 == buffer.size() && 1 == buffer.m_chunks.size(), "Appending nothing should change nothing");
+
+        buffer.consume(3);
+        buffer.begin_append().append("$-1\r\n");
+        buffer.end_append();
+        struct iovec iov[4];
+        TEST(1 == buffer.fill_iovec(iov, 4) && 11 == iov[0].iov_len && \
+            0 == memcmp(iov[0].iov_base, "\r\n:1\r\n$-1\r\n", 11), \
+            "Appending to a partially written chunk should keep the rest in order");
+
+        buffer.consume(11);
+        TEST(buffer.empty() && buffer.m_chunks.empty(), "A fully written buffer should be empty");
+    }
+    {
+        OutputBuffer buffer;
+        buffer.begin_append().append(std::string(OUTPUT_CHUNK_SIZE, 'x'));
+        buffer.end_append();
+        buffer.begin_append().append("+OK\r\n");
+        buffer.end_append();
+        TEST(2 == buffer.m_chunks.size(), "A full chunk should not be appended to");
+
+        buffer.consume(buffer.size());
+        const char* memory = buffer.m_spare.data();
+        TEST(buffer.m_spare.capacity() >= OUTPUT_CHUNK_SIZE, "A written chunk should be kept as a spare");
+
+        for (int i = 0; i < 4; i++)
+        {
+            buffer.begin_append().append("+OK\r\n");
+            buffer.end_append();
+            TEST(buffer.m_chunks.front().data() == memory, "The spare chunk should be reused");
+            buffer.consume(5);
+        }
+    }
+}
+
+void test_partial_write()
+{
+    std::cout << std::endl << "Tests to validate writing to a full socket" << std::endl;
+    {
+        int fds[2];
+        ServerStats stats;
+        TEST(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds), "Socket pair should be created");
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+        int size = 4096;
+        setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+        std::string large(1024 * 1024, 'x');
+        OutputBuffer buffer;
+        buffer.append(std::string(large));
+        TEST(OUTPUT_PENDING == buffer.write_to(fds[0], stats), "A write to a full socket should be pending");
+        TEST(buffer.size() > 0 && buffer.size() < large.length(), "The part that was not written should be kept");
+
+        std::string received;
+        char data[65536];
+        bool is_error = false;
+        while (received.length() < large.length() && !is_error)
+        {
+            ssize_t n = read(fds[1], data, sizeof(data));
+            if (n <= 0)
+                break;
+            received.append(data, n);
+            if (!buffer.empty())
+                is_error = (OUTPUT_ERROR == buffer.write_to(fds[0], stats));
+        }
+        TEST(!is_error, "Writing the rest should not fail");
+        TEST(buffer.empty() && received == large, "A large response should arrive complete");
+
+        close(fds[1]);
+        buffer.append("+OK\r\n");
+        TEST(OUTPUT_ERROR == buffer.write_to(fds[0], stats), "A write to a closed socket should fail");
+        close(fds[0]);
+    }
+}
+
+void test_limits()
+{
+    std::cout << std::endl << "Tests to validate the output limits" << std::endl;
+    {
+        OutputLimits limits;
+        limits.m_hard_limit = 100;
+        limits.m_soft_limit = 10;
+        limits.m_soft_seconds = 0;
+
+        OutputBuffer buffer;
+        buffer.append(std::string(5, 'x'));
+        TEST(!buffer.exceeds_limits(limits), "A buffer under the limits should be accepted");
+
+        buffer.append(std::string(10, 'x'));
+        TEST(!buffer.exceeds_limits(limits), "The soft limit should be exceeded for a while first");
+        TEST(buffer.exceeds_limits(limits), "A buffer over the soft limit for too long should be refused");
+
+        buffer.consume(10);
+        TEST(!buffer.exceeds_limits(limits), "Going back under the soft limit should reset it");
+
+        buffer.append(std::string(100, 'x'));
+        TEST(buffer.exceeds_limits(limits), "A buffer over the hard limit should be refused at once");
+
+        limits.m_hard_limit = 0;
+        limits.m_soft_limit = 0;
+        TEST(!buffer.exceeds_limits(limits), "A limit of 0 should mean no limit");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    test_append_consume();
+    test_append_in_place();
+    test_partial_write();
+    test_limits();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
@@ -0,0 +1,667 @@
+#include "reactor.h"
+#include "orchestrator.h"
+
+#include <sched.h>
+
+Reactor::~Reactor()
+{
+    if (m_epoll_fd >= 0)
+    {
+        uint64_t one = 1;
+        if (write(m_wakeup_fd, &one, sizeof(one)) < 0)
+            perror("write");
+        pthread_join(m_thread_id, nullptr);
+    }
+
+    // States still referenced by messages of other reactors must
+    // not come back to the wheel
+    for (auto& it: m_connections)
+    {
+        m_timers.cancel(it.second->m_timer);
+        close(it.first);
+    }
+    m_connections.clear();
+
+    if (m_listen_socket >= 0)
+        close(m_listen_socket);
+    if (m_wakeup_fd >= 0)
+        close(m_wakeup_fd);
+    if (m_epoll_fd >= 0)
+        close(m_epoll_fd);
+}
+
+bool Reactor::create_listen_socket()
+{
+    // Every reactor binds the same port, SO_REUSEPORT makes the
+    // kernel balance the incoming connections between them
+    m_listen_socket = m_porchestrator->create_listen_socket();
+    if (m_listen_socket < 0)
+    {
+        std::cerr << m_id << ": could not create the listening socket" \
+            << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool Reactor::start()
+{
+    struct epoll_event event;
+
+    if (!create_listen_socket())
+        return false;
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll_fd < 0 || m_wakeup_fd < 0)
+    {
+        perror("epoll_create/eventfd");
+        std::cerr << m_id << ": could not create epoll, errno = " \
+            << errno << std::endl;
+        return false;
+    }
+
+    event.data.u64 = 0;
+    event.data.fd = m_listen_socket;
+    event.events = EPOLLIN;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_listen_socket, &event))
+    {
+        perror("epoll_ctl");
+        return false;
+    }
+
+    // Every reactor waits on the shared Unix domain socket, with
+    // EPOLLEXCLUSIVE a new connection wakes up only one of them
+    m_unix_listen_socket = m_porchestrator->m_unix_server_socket;
+    if (m_unix_listen_socket >= 0)
+    {
+        event.data.u64 = 0;
+        event.data.fd = m_unix_listen_socket;
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_unix_listen_socket, &event))
+        {
+            perror("epoll_ctl");
+            return false;
+        }
+    }
+
+    event.data.u64 = 0;
+    event.data.fd = m_wakeup_fd;
+    event.events = EPOLLIN;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &event))
+    {
+        perror("epoll_ctl");
+        return false;
+    }
+
+    int retval = pthread_create(
+                    &m_thread_id,
+                    NULL,
+                    Reactor::reactor_pthread_fn,
+                    this);
+    if (0 != retval)
+    {
+        std::cerr << "pthread_create failed with rc = " << retval \
+                << " errno = " << errno << std::endl;
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+        return false;
+    }
+
+    if (m_cpu >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(m_cpu, &cpuset);
+        if (0 != pthread_setaffinity_np(m_thread_id, sizeof(cpuset), &cpuset))
+            std::cerr << m_id << ": could not pin to cpu " << m_cpu \
+                << std::endl;
+    }
+
+    return true;
+}
+
+bool Reactor::post(ReactorMessage& msg)
+{
+    if (!m_inbox.push(msg))
+        return false;
+
+    if (m_needs_wakeup.load() && m_needs_wakeup.exchange(false))
+    {
+        uint64_t one = 1;
+        ServerStats::add(m_porchestrator->m_stats.m_syscalls_other);
+        if (sizeof(one) != write(m_wakeup_fd, &one, sizeof(one)) &&
+            EAGAIN != errno)
+            perror("write");
+    }
+
+    return true;
+}
+
+void Reactor::loop()
+{
+    m_epoll_events.resize(MIN_EPOLL_EVENTS);
+    m_rehash_timer.m_callback = [this]() { on_rehash_timer(); };
+    m_timers.schedule(m_rehash_timer, TimerWheel::clock_ms() + REHASH_CRON_MS);
+
+    while (!m_porchestrator->m_is_destroying)
+    {
+        // Announce the sleep before looking at the inbox one last
+        // time, a message posted after that will wake us up
+        m_needs_wakeup.store(true);
+        process_inbox();
+
+        int timeout = m_timers.next_timeout(TimerWheel::clock_ms());
+        if (timeout < 0 || timeout > 1000)
+            timeout = 1000;
+        if (!m_unsent_replies.empty() || !m_unsent_requests.empty())
+            timeout = std::min(timeout, 1);
+
+        ServerStats::add(m_porchestrator->m_stats.m_syscalls_epoll_wait);
+        int n_fd = epoll_wait(
+                    m_epoll_fd,
+                    m_epoll_events.data(),
+                    m_epoll_events.size(),
+                    timeout);
+        m_needs_wakeup.store(false);
+        m_timers.advance(TimerWheel::clock_ms());
+
+        if (n_fd < 0)
+        {
+            if (EINTR != errno)
+            {
+                perror("epoll_wait");
+                std::cerr << m_id << ": epoll_wait failed, errno = " \
+                    << errno << std::endl;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < n_fd; i++)
+        {
+            int fd = m_epoll_events[i].data.fd;
+            if (fd == m_listen_socket || fd == m_unix_listen_socket)
+            {
+                accept_connections(fd);
+                continue;
+            }
+            if (fd == m_wakeup_fd)
+            {
+                uint64_t count;
+                ServerStats::add(m_porchestrator->m_stats.m_syscalls_other);
+                while (read(m_wakeup_fd, &count, sizeof(count)) > 0)
+                    ServerStats::add(m_porchestrator->m_stats.m_syscalls_other);
+                continue;
+            }
+
+            auto it = m_connections.find(fd);
+            if (it == m_connections.end())
+                continue;
+
+            auto pstate = it->second;
+            uint32_t events = m_epoll_events[i].events;
+            if (events & ~EPOLLOUT)
+                pstate->m_is_readable = true;
+
+            // A client that was too slow for its responses is not
+            // read until they have all been written
+            if (!pstate->m_output.empty())
+            {
+                if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                    handle_writable(pstate);
+                continue;
+            }
+
+            // While responses from other reactors are outstanding
+            // the connection is not read, it will be read once
+            // the response has been written
+            if (0 == pstate->m_outstanding_replies)
+                handle_readable(pstate);
+        }
+
+        process_inbox();
+        retry_unsent_replies();
+        retry_unsent_requests();
+
+        if ((size_t)n_fd == m_epoll_events.size() &&
+            m_epoll_events.size() < MAX_EPOLL_EVENTS)
+            m_epoll_events.resize(m_epoll_events.size() * 2);
+        else if ((size_t)n_fd < m_epoll_events.size() / 4 &&
+            m_epoll_events.size() > MIN_EPOLL_EVENTS)
+            m_epoll_events.resize(m_epoll_events.size() / 2);
+    }
+}
+
+void Reactor::accept_connections(int listen_socket)
+{
+    while (true)
+    {
+        ServerStats::add(m_porchestrator->m_stats.m_syscalls_accept);
+        int fd = accept4(
+                    listen_socket,
+                    nullptr,
+                    nullptr,
+                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+            {
+                perror("accept4");
+                std::cerr << m_id << ": accept failed, errno = " \
+                    << errno << std::endl;
+            }
+            return;
+        }
+
+        auto pstate = m_porchestrator->admit_client(fd);
+        if (!pstate)
+            continue;
+        pstate->m_state = STATE_WAITING_FOR_EPOLL;
+
+        struct epoll_event event;
+        event.data.u64 = 0;
+        event.data.fd = fd;
+        // Edge-triggered EPOLLOUT is only reported when the socket
+        // becomes writable again, so it can stay registered without
+        // waking the reactor up, and no epoll_ctl is needed when a
+        // client falls behind
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        m_porchestrator->m_stats.add_accepted(1,
+            listen_socket == m_unix_listen_socket);
+        ServerStats::add(m_porchestrator->m_stats.m_syscalls_epoll_ctl);
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event))
+        {
+            perror("epoll_ctl");
+            close(fd);
+            continue;
+        }
+
+        try
+        {
+            m_connections[fd] = pstate;
+        }
+        catch (...)
+        {
+            std::cerr << "Out of memory" << std::endl;
+            close(fd);
+            continue;
+        }
+        watch_connection(pstate);
+    }
+}
+
+void Reactor::handle_readable(std::shared_ptr<State> pstate)
+{
+    auto& input = pstate->m_input;
+    int fd = pstate->m_socket;
+    ssize_t read_bytes;
+
+    // Keep going while data arrives during the commands, the socket
+    // is edge-triggered and will not be reported again for it
+    while (pstate->m_is_readable && 0 == pstate->m_outstanding_replies &&
+           pstate->m_output.empty())
+    {
+        bool peer_closed = false;
+
+        pstate->m_state = STATE_IN_READ_LOOP;
+        while (true)
+        {
+            // A value that is streamed is read straight into its
+            // storage
+            auto [window, window_size] = pstate->m_parser.stream_window(input.size());
+            ServerStats::add(m_porchestrator->m_stats.m_syscalls_read);
+            if (window)
+                read_bytes = read(fd, window, window_size);
+            else
+            {
+                input.prepare_read(pstate->m_parser.expected_length());
+                read_bytes = read(fd, input.write_ptr(), input.writable());
+            }
+            if (read_bytes > 0)
+            {
+                if (window)
+                    pstate->m_parser.commit_streamed(read_bytes);
+                else
+                    input.commit(read_bytes);
+                pstate->m_last_activity = TimerWheel::clock_ms();
+                continue;
+            }
+            if (0 == read_bytes)
+                peer_closed = true;
+            else if (EAGAIN != errno && EWOULDBLOCK != errno)
+            {
+                if (EINTR == errno)
+                    continue;
+                peer_closed = true;
+            }
+            break;
+        }
+        pstate->m_is_readable = false;
+
+        // The peer is gone, answer what was received and then close
+        if (peer_closed)
+            pstate->m_is_peer_closed = true;
+
+        if (!dispatch(pstate))
+            return;
+    }
+}
+
+bool Reactor::dispatch(std::shared_ptr<State> pstate)
+{
+    auto& parser = pstate->m_parser;
+    pstate->m_state = STATE_PARSING;
+
+    // The commands run one after the other. A command on keys owned
+    // by another reactor suspends the loop until its response is
+    // back, so the responses stay in the order of the commands.
+    while (0 == pstate->m_outstanding_replies && !pstate->m_is_error)
+    {
+        auto err = parser.parse_command(
+                    pstate->m_input.data(),
+                    pstate->m_input.size(),
+                    pstate->m_argv);
+        if (ERROR_CURRENT_BEYOND_END == err)
+            break;
+
+        if (ERROR_SUCCESS != err)
+        {
+            pstate->m_is_error = true;
+            pstate->m_responses.push_back(
+                Orchestrator::make_parse_error(pstate, err));
+            break;
+        }
+
+        start_command(pstate);
+    }
+
+    // A forwarded command points into the input, it is only
+    // consumed once the response is back
+    if (pstate->m_outstanding_replies)
+        return false;
+
+    size_t parsed_length = parser.parsed_length();
+    if (parsed_length)
+    {
+        pstate->m_input.consume(parsed_length);
+        parser.discard(parsed_length);
+    }
+
+    return send_response(pstate);
+}
+
+void Reactor::start_command(std::shared_ptr<State> pstate)
+{
+    auto& argv = pstate->m_argv;
+
+    auto [is_valid, cmd_type] = m_porchestrator->is_valid_command(argv);
+    if (!is_valid || COMMAND_INFO == cmd_type)
+    {
+        // Commands without keys run here. For invalid commands, the
+        // orchestrator builds the error response.
+        pstate->m_outstanding_replies = 1;
+        run_or_forward(pstate, m_id);
+        return;
+    }
+
+    if (COMMAND_DEL != cmd_type)
+    {
+        int owner = m_porchestrator->get_owner_reactor(argv[1]);
+
+        // A GET on a local key is answered straight into the output
+        // buffer, there is no response to wait for
+        if (owner == m_id && COMMAND_GET == cmd_type)
+        {
+            m_porchestrator->queue_get(pstate, argv);
+            return;
+        }
+
+        pstate->m_outstanding_replies = 1;
+        run_or_forward(pstate, owner);
+        return;
+    }
+
+    // DEL may name keys owned by several reactors. Every owner gets
+    // a DEL with its own keys, and the counts are added up.
+    std::map<int, std::vector<std::string_view> > per_owner;
+    for (size_t i = 1; i < argv.size(); i++)
+    {
+        int owner = m_porchestrator->get_owner_reactor(argv[i]);
+        auto& sub_argv = per_owner[owner];
+        if (sub_argv.empty())
+            sub_argv.push_back(argv[0]);
+        sub_argv.push_back(argv[i]);
+    }
+
+    if (1 == per_owner.size())
+    {
+        pstate->m_outstanding_replies = 1;
+        run_or_forward(pstate, per_owner.begin()->first);
+        return;
+    }
+
+    // All the parts are counted before any of them runs, so that a
+    // part run locally does not complete the command early
+    pstate->m_sum_replies = true;
+    pstate->m_reply_sum = 0;
+    pstate->m_outstanding_replies = per_owner.size();
+    for (auto& it: per_owner)
+        run_or_forward(pstate, it.first, std::move(it.second));
+}
+
+void Reactor::run_or_forward(
+    std::shared_ptr<State>                  pstate,
+    int                                     owner,
+    std::vector<std::string_view>           sub_argv)
+{
+    if (owner != m_id)
+    {
+        ReactorMessage msg;
+        msg.m_type = REACTOR_MSG_REQUEST;
+        msg.m_origin = m_id;
+        msg.m_pstate = pstate;
+        msg.m_argv = std::move(sub_argv);
+        if (m_porchestrator->m_reactors[owner]->post(msg))
+            return;
+
+        // The owner is overloaded, its shard is not touched from
+        // here. The request waits until the inbox has room, and the
+        // connection waits for the response without being read.
+        try
+        {
+            m_unsent_requests.emplace_back(owner, std::move(msg));
+        }
+        catch (...)
+        {
+            std::cerr << "Out of memory" << std::endl;
+            complete(pstate, true, nullptr);
+        }
+        return;
+    }
+
+    auto [is_fatal, response] = m_porchestrator->do_operation(
+                                    sub_argv.empty() ? pstate->m_argv : sub_argv,
+                                    &pstate->m_arena,
+                                    sub_argv.empty() ? pstate->m_parser.streamed_value() : nullptr);
+    complete(pstate, is_fatal, response);
+}
+
+void Reactor::process_inbox()
+{
+    ReactorMessage msg;
+    while (m_inbox.pop(msg))
+    {
+        if (REACTOR_MSG_REQUEST == msg.m_type)
+        {
+            // The arena of the connection belongs to the origin, the
+            // response comes from the heap
+            auto [is_fatal, response] = \
+                m_porchestrator->do_operation(
+                    msg.get_argv(), nullptr, msg.get_streamed_value());
+            msg.m_type = REACTOR_MSG_REPLY;
+            msg.m_argv.clear();
+            msg.m_is_fatal = is_fatal;
+            msg.m_object = response;
+            if (!m_porchestrator->m_reactors[msg.m_origin]->post(msg))
+                m_unsent_replies.push_back(std::move(msg));
+        }
+        else if (REACTOR_MSG_REPLY == msg.m_type)
+        {
+            // Once the command is complete, carry on with the
+            // commands received after it
+            auto pstate = msg.m_pstate;
+            if (complete(pstate, msg.m_is_fatal, msg.m_object) &&
+                dispatch(pstate))
+                handle_readable(pstate);
+        }
+        msg = ReactorMessage();
+    }
+}
+
+void Reactor::retry_unsent_requests()
+{
+    while (!m_unsent_requests.empty())
+    {
+        auto& it = m_unsent_requests.front();
+        if (!m_porchestrator->m_reactors[it.first]->post(it.second))
+            return;
+        m_unsent_requests.pop_front();
+    }
+}
+
+void Reactor::retry_unsent_replies()
+{
+    while (!m_unsent_replies.empty())
+    {
+        auto& msg = m_unsent_replies.front();
+        if (!m_porchestrator->m_reactors[msg.m_origin]->post(msg))
+            return;
+        m_unsent_replies.pop_front();
+    }
+}
+
+bool Reactor::complete(
+    std::shared_ptr<State>                  pstate,
+    bool                                    is_fatal,
+    std::shared_ptr<AbstractRespObject>     response)
+{
+    if (is_fatal)
+        pstate->m_is_error = true;
+
+    if (pstate->m_sum_replies)
+    {
+        if (response && RESP_INTEGER == response->get_type())
+            pstate->m_reply_sum += \
+                static_cast<RespInteger*>(response.get())->m_value;
+    }
+    else
+        pstate->m_responses.push_back(response);
+
+    if (--pstate->m_outstanding_replies > 0)
+        return false;
+
+    if (pstate->m_sum_replies)
+    {
+        pstate->m_responses.push_back(
+            Orchestrator::make_integer(
+                &pstate->m_arena, pstate->m_reply_sum));
+        pstate->m_sum_replies = false;
+        pstate->m_reply_sum = 0;
+    }
+
+    return true;
+}
+
+bool Reactor::send_response(std::shared_ptr<State> pstate)
+{
+    pstate->m_state = STATE_IN_WRITE_LOOP;
+    auto status = m_porchestrator->write_responses(pstate);
+    if (OUTPUT_ERROR == status)
+    {
+        close_connection(pstate);
+        return false;
+    }
+
+    // The rest is written when epoll reports the socket writable
+    if (OUTPUT_PENDING == status)
+    {
+        pstate->m_state = STATE_WAITING_FOR_WRITE;
+        return false;
+    }
+
+    if (pstate->m_is_error || pstate->m_is_peer_closed)
+    {
+        close_connection(pstate);
+        return false;
+    }
+
+    pstate->m_state = STATE_WAITING_FOR_EPOLL;
+    pstate->m_input.shrink();
+    pstate->m_arena.release();
+    return true;
+}
+
+void Reactor::handle_writable(std::shared_ptr<State> pstate)
+{
+    // Once everything has been written, carry on with whatever the
+    // client sent in the meantime
+    if (send_response(pstate))
+        handle_readable(pstate);
+}
+
+void Reactor::close_connection(std::shared_ptr<State> pstate)
+{
+    int fd = pstate->m_socket;
+    struct epoll_event event;
+
+    pstate->m_state = STATE_CLOSING;
+    ServerStats::add(m_porchestrator->m_stats.m_syscalls_epoll_ctl);
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, &event);
+    m_connections.erase(fd);
+    close(fd);
+}
+
+void Reactor::watch_connection(std::shared_ptr<State> pstate)
+{
+    uint64_t check_ms = m_porchestrator->get_timeout_check_ms();
+    if (!check_ms)
+        return;
+
+    std::weak_ptr<State> weak = pstate;
+    pstate->m_timer.m_callback = [this, weak]() { on_connection_timer(weak); };
+    m_timers.schedule(pstate->m_timer, TimerWheel::clock_ms() + check_ms);
+}
+
+void Reactor::on_connection_timer(std::weak_ptr<State> weak)
+{
+    auto pstate = weak.lock();
+    if (!pstate || STATE_CLOSING == pstate->m_state)
+        return;
+
+    uint64_t now = TimerWheel::clock_ms();
+    if (pstate->m_outstanding_replies || !pstate->m_output.empty())
+    {
+        m_timers.schedule(pstate->m_timer,
+            now + m_porchestrator->get_timeout_check_ms());
+        return;
+    }
+
+    auto [is_expired, next] = m_porchestrator->check_timeout(pstate, now);
+    if (is_expired)
+    {
+        std::cerr << pstate->m_socket << ": Connection timed out" << std::endl;
+        m_porchestrator->count_timeout(pstate);
+        close_connection(pstate);
+        return;
+    }
+    m_timers.schedule(pstate->m_timer, next);
+}
+
+void Reactor::on_rehash_timer()
+{
+    // The reactor owns the shards whose index is its own modulo the
+    // number of reactors
+    m_porchestrator->rehash_datastores(m_id, m_porchestrator->m_reactors.size());
+    m_timers.schedule(m_rehash_timer, TimerWheel::clock_ms() + REHASH_CRON_MS);
+}
@@ -0,0 +1,454 @@
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+#include "common_include.h"
+#include "resp_parser.h"
+#include "state.h"
+#include "lockfree_queue.h"
+
+#include <sys/epoll.h>
+#include <pthread.h>
+
+class Orchestrator;
+
+/**
+ * @brief number of messages that can be waiting in the inbox
+ * of a reactor
+ * 
+ */
+#define REACTOR_INBOX_SIZE 65536
+
+/**
+ * @brief type of the messages exchanged between reactors
+ * 
+ */
+typedef enum
+{
+    REACTOR_MSG_INVALID,
+
+    /**
+     * @brief a command on keys owned by the receiving reactor
+     * 
+     */
+    REACTOR_MSG_REQUEST,
+
+    /**
+     * @brief the response to a request, sent back to the reactor
+     * that owns the connection
+     * 
+     */
+    REACTOR_MSG_REPLY
+} reactor_msg_type_t;
+
+/**
+ * @brief message passed from one reactor to another through
+ * the lock-free inbox of the receiver
+ * 
+ */
+struct ReactorMessage
+{
+    /**
+     * @brief request or reply
+     * 
+     */
+    reactor_msg_type_t                      m_type;
+
+    /**
+     * @brief the reactor that owns the connection, replies are
+     * sent to it
+     * 
+     */
+    int                                     m_origin;
+
+    /**
+     * @brief set in a reply if the connection must be closed
+     * after the response is written
+     * 
+     */
+    bool                                    m_is_fatal;
+
+    /**
+     * @brief the connection the command was received on. Only
+     * the origin reactor modifies it.
+     * 
+     */
+    std::shared_ptr<State>                  m_pstate;
+
+    /**
+     * @brief the part of a DEL that falls to the receiver when the
+     * keys of the DEL are owned by several reactors. It is empty
+     * when the request is the whole command.
+     * 
+     */
+    std::vector<std::string_view>           m_argv;
+
+    /**
+     * @brief the response in a reply
+     * 
+     */
+    std::shared_ptr<AbstractRespObject>     m_object;
+
+    ReactorMessage():
+        m_type(REACTOR_MSG_INVALID),
+        m_origin(-1),
+        m_is_fatal(false)
+    {
+    }
+
+    /**
+     * @brief the command of a request. Its arguments point into
+     * the input buffer of the connection, which the origin reactor
+     * leaves alone until the reply has arrived.
+     * 
+     * @return const std::vector<std::string_view>& the command and
+     * its arguments
+     */
+    const std::vector<std::string_view>& get_argv() const
+    {
+        return m_argv.empty() ? m_pstate->m_argv : m_argv;
+    }
+
+    /**
+     * @brief the last argument of the command if the parser of the
+     * connection streamed it, for a request with the whole command
+     * 
+     * @return std::string* the bytes of the argument, nullptr if
+     * there is none
+     */
+    std::string* get_streamed_value() const
+    {
+        return m_argv.empty() ? m_pstate->m_parser.streamed_value() : nullptr;
+    }
+};
+
+/**
+ * @brief One shard of the server in reactor mode.
+ * 
+ * Every reactor runs on its own thread, pinned to a core. It has
+ * its own listening socket (all reactors listen on the same port
+ * with SO_REUSEPORT and the kernel spreads the connections), its
+ * own epoll loop, and its own connections. A connection is read,
+ * parsed, executed and answered on the reactor that accepted it,
+ * without handing it over to another thread. The Unix domain
+ * socket, if there is one, is shared by all the reactors, and
+ * epoll wakes up only one of them for a new connection.
+ * 
+ * Every data store partition is owned by exactly one reactor. A
+ * command on keys owned by another reactor is forwarded to the
+ * owner through its lock-free inbox, and the owner sends the
+ * response back the same way. The commands of a connection run
+ * one after the other, a forwarded command holds back the ones
+ * received after it until its response has arrived, which keeps
+ * the responses in order. When the inbox of the owner is full, the
+ * request waits on the sender until there is room, and its
+ * connection is not read meanwhile.
+ * 
+ */
+class Reactor
+{
+public:
+    /**
+     * @brief index of this reactor
+     * 
+     */
+    int                                                 m_id;
+
+    /**
+     * @brief the cpu this reactor is pinned to, -1 if not pinned
+     * 
+     */
+    int                                                 m_cpu;
+
+    /**
+     * @brief the orchestrator, it owns the data stores
+     * 
+     */
+    Orchestrator*                                       m_porchestrator;
+
+    /**
+     * @brief this reactor's listening socket
+     * 
+     */
+    int                                                 m_listen_socket;
+
+    /**
+     * @brief the Unix domain socket listening for local clients,
+     * -1 if there is none. It is owned by the orchestrator.
+     * 
+     */
+    int                                                 m_unix_listen_socket;
+
+    /**
+     * @brief this reactor's epoll file descriptor
+     * 
+     */
+    int                                                 m_epoll_fd;
+
+    /**
+     * @brief eventfd in the epoll set, used by other reactors to
+     * wake this one up after posting to the inbox
+     * 
+     */
+    int                                                 m_wakeup_fd;
+
+    /**
+     * @brief the thread the reactor runs on
+     * 
+     */
+    pthread_t                                           m_thread_id;
+
+    /**
+     * @brief messages from other reactors
+     * 
+     */
+    LockFreeQueue<ReactorMessage>                       m_inbox;
+
+    /**
+     * @brief set while the reactor may be blocked in epoll_wait.
+     * A reactor that posts to the inbox clears it and writes to
+     * the eventfd, so at most one wakeup is sent per sleep.
+     * 
+     */
+    std::atomic<bool>                                   m_needs_wakeup;
+
+    /**
+     * @brief replies that could not be posted because the inbox of
+     * the origin was full. They are retried on every loop.
+     * 
+     */
+    std::deque<ReactorMessage>                          m_unsent_replies;
+
+    /**
+     * @brief requests that could not be posted because the inbox of
+     * their owner was full, with the owner. Their connections are
+     * not read meanwhile, they wait for the responses. They are
+     * retried on every loop.
+     * 
+     */
+    std::deque<std::pair<int, ReactorMessage> >         m_unsent_requests;
+
+    /**
+     * @brief the timers of this reactor's connections, driven by
+     * the reactor's loop. It outlives m_connections.
+     * 
+     */
+    TimerWheel                                          m_timers;
+
+    /**
+     * @brief the timer of the cron that moves on the growing data
+     * stores this reactor owns
+     * 
+     */
+    TimerEntry                                          m_rehash_timer;
+
+    /**
+     * @brief the connections accepted by this reactor, only ever
+     * accessed from the reactor's thread
+     * 
+     */
+    std::unordered_map<int, std::shared_ptr<State> >    m_connections;
+
+    /**
+     * @brief buffer that receives the events from epoll_wait
+     * 
+     */
+    std::vector<struct epoll_event>                     m_epoll_events;
+
+    Reactor(Orchestrator* porch, int id, int cpu):
+        m_id(id),
+        m_cpu(cpu),
+        m_porchestrator(porch),
+        m_listen_socket(-1),
+        m_unix_listen_socket(-1),
+        m_epoll_fd(-1),
+        m_wakeup_fd(-1),
+        m_inbox(REACTOR_INBOX_SIZE),
+        m_needs_wakeup(false)
+    {
+    }
+
+    ~Reactor();
+
+    /**
+     * @brief create the listening socket, epoll and eventfd, and
+     * spawn the reactor thread
+     * 
+     * @return true on success
+     * @return false on failure
+     */
+    bool start();
+
+    /**
+     * @brief the event loop of the reactor
+     * 
+     */
+    void loop();
+
+    /**
+     * @brief post a message to this reactor's inbox. This is
+     * called from other reactors.
+     * 
+     * @param msg the message, it is moved on success
+     * @return true on success
+     * @return false if the inbox is full
+     */
+    bool post(ReactorMessage& msg);
+
+    /**
+     * @brief execute all the messages in the inbox
+     * 
+     */
+    void process_inbox();
+
+    /**
+     * @brief retry the replies that could not be posted earlier
+     * 
+     */
+    void retry_unsent_replies();
+
+    /**
+     * @brief retry the requests that could not be posted earlier,
+     * in order
+     * 
+     */
+    void retry_unsent_requests();
+
+    /**
+     * @brief accept all pending connections on a listening socket
+     * 
+     * @param listen_socket the listening socket
+     */
+    void accept_connections(int listen_socket);
+
+    /**
+     * @brief read everything available on a connection, and run
+     * the commands that were received
+     * 
+     * @param pstate the connection
+     */
+    void handle_readable(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief run the complete commands in the data read from a
+     * connection, in order, and write their responses together.
+     * An incomplete command at the end is kept for the next read.
+     * 
+     * @param pstate the connection
+     * @return true if the connection can be read again
+     * @return false if it was closed, or if a command is waiting
+     * for a response from another reactor
+     */
+    bool dispatch(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief either run the command that was parsed last on a
+     * connection here, or forward it to the reactors that own its
+     * keys
+     * 
+     * @param pstate the connection
+     */
+    void start_command(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief run a command on this reactor, or forward it to another.
+     * The caller must have accounted for the response in
+     * m_outstanding_replies of the connection.
+     * 
+     * @param pstate the connection the command was received on
+     * @param owner the reactor that owns the keys of the command
+     * @param sub_argv the part of a DEL that the owner must run,
+     * empty to run the whole command of the connection
+     */
+    void run_or_forward(
+        std::shared_ptr<State>                  pstate,
+        int                                     owner,
+        std::vector<std::string_view>           sub_argv = {});
+
+    /**
+     * @brief account for one response to a command of the
+     * connection. Once all the responses are in, the response of
+     * the command is queued on the connection.
+     * 
+     * @param pstate the connection
+     * @param is_fatal whether the connection must be closed
+     * @param response the response
+     * @return true if the command is complete
+     */
+    bool complete(
+        std::shared_ptr<State>                  pstate,
+        bool                                    is_fatal,
+        std::shared_ptr<AbstractRespObject>     response);
+
+    /**
+     * @brief write the queued responses to the client
+     * 
+     * @param pstate the connection
+     * @return true on success
+     * @return false if the connection was closed, or if the client
+     * has not taken all of the responses yet
+     */
+    bool send_response(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief write the rest of the responses of a client that was
+     * too slow to take them, once its socket is writable again
+     * 
+     * @param pstate the connection
+     */
+    void handle_writable(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief close a connection and forget about it
+     * 
+     * @param pstate the connection
+     */
+    void close_connection(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief start the timer that closes a connection once it
+     * times out, if a timeout is enabled
+     * 
+     * @param pstate the connection
+     */
+    void watch_connection(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief the timer of a connection expired, close it if it
+     * timed out. A connection that waits for other reactors, or for
+     * the client to read its responses, is looked at again later.
+     * 
+     * @param weak the connection, if it still exists
+     */
+    void on_connection_timer(std::weak_ptr<State> weak);
+
+    /**
+     * @brief the timer of the rehash cron expired, move on the
+     * shards of this reactor
+     * 
+     */
+    void on_rehash_timer();
+
+    /**
+     * @brief the pthread function of the reactor thread. A static
+     * glue is required because pthread cannot deal object methods
+     * 
+     * @param arg pointer to the reactor
+     * @return void* nullptr
+     */
+    static void* reactor_pthread_fn(void* arg)
+    {
+        static_cast<Reactor*>(arg)->loop();
+        return nullptr;
+    }
+
+private:
+    /**
+     * @brief create the listening socket with SO_REUSEPORT
+     * 
+     * @return true on success
+     * @return false on failure
+     */
+    bool create_listen_socket();
+};
+
+#endif /* #ifndef REACTOR_H_ */
@@ -1,4 +1,7 @@
 #include "resp_parser.h"
+#include "resp_scan.h"
+#include <cstring>
+#include <climits>
 
 std::tuple<resp_parse_error_t, int>
 RespParser::get_type()
@@ -40,19 +43,23 @@ RespParser::get_type()
 std::tuple<resp_parse_error_t, int>
 RespParser::get_length()
 {
-    char*           endptr          = nullptr;
+    const char*     next            = nullptr;
     long int        thenum          = 0;
 
     if (m_state.current >= m_state.end)
         return std::make_tuple(ERROR_CURRENT_BEYOND_END, 0);
-        
-    thenum = strtol(m_state.current, &endptr, 10);
 
-    if (thenum == 0 && (endptr == m_state.current || \
-            (*m_state.current && endptr && *endptr == 0)))
+    // A number is always followed by CRLF, if the input ends right
+    // after the digits the rest of the number may still be coming
+    auto err = RespScanner::parse_decimal(
+                m_state.current, m_state.end, thenum, next);
+    if (ERROR_SUCCESS != err)
+        return std::make_tuple(err, 0);
+
+    if (thenum > INT_MAX || thenum < INT_MIN)
         return std::make_tuple(ERROR_INVALID_NUMBER, 0);
 
-    m_state.current = endptr;
+    m_state.current = const_cast<char*>(next);
     return std::make_tuple(ERROR_SUCCESS, (int)thenum);
 }
 
@@ -87,6 +94,15 @@ RespParser::get_bulk_string_internal(int& stringlength)
         return std::make_tuple(err2, retval);
     
     stringlength = length;
+
+    // The limits are checked before the data is looked at
+    if (length > 0)
+    {
+        size_t request_size = m_state.current - m_object_start + 2 + length + 2;
+        auto err = m_limits.check_bulk(length, request_size);
+        if (ERROR_SUCCESS != err)
+            return std::make_tuple(err, retval);
+    }
     
     auto err = skip_crlf();
     if (ERROR_SUCCESS != err)
@@ -106,13 +122,15 @@ RespParser::get_bulk_string_internal(int& stringlength)
     char* current = m_state.current;
     char* save_current = current;
 
-    for (int i = 0; i < length; i++, current++)
-    {
-        if (current >= m_state.end)
-            return std::make_tuple(ERROR_CURRENT_BEYOND_END, retval);
-        if ('\r' == *current || '\n' == *current)
-            return std::make_tuple(ERROR_STRING_CONTAINS_CRLF, retval);
-    }
+    // The part of the string that has arrived must not contain CR
+    // or LF, even if the rest of it is still missing
+    size_t available = m_state.end - current;
+    const char* data_end = current + std::min<size_t>(length, available);
+    if (RespScanner::find_line_break(current, data_end) != data_end)
+        return std::make_tuple(ERROR_STRING_CONTAINS_CRLF, retval);
+    if (available < (size_t)length)
+        return std::make_tuple(ERROR_CURRENT_BEYOND_END, retval);
+    current += length;
 
     m_state.current = current;
     err = skip_crlf();
@@ -122,12 +140,7 @@ RespParser::get_bulk_string_internal(int& stringlength)
         return make_tuple(err, retval);
     }
 
-    // Overwrite the string temporarily here to
-    // optimize duplication
-    auto savechar = *current;
-    *current = 0;
-    retval = save_current;
-    *current = savechar;
+    retval.assign(save_current, length);
 
     return std::make_tuple(ERROR_SUCCESS, retval);
 }
@@ -163,97 +176,99 @@ RespParser::get_bulk_string_object()
 std::tuple<resp_parse_error_t, std::shared_ptr<AbstractRespObject> >
 RespParser::get_array_object()
 {
+    // The arrays being filled in, the innermost is last. The type of
+    // the outermost one has been parsed already.
+    std::vector<RespStreamFrame> stack;
+    resp_datatype_t type = RESP_ARRAY;
 
-    auto [err, length] = get_length();
-    if (ERROR_SUCCESS != err)
-        return std::make_tuple(
-            ERROR_INVALID_ARRAY_LENGTH,
-            std::shared_ptr<AbstractRespObject>(nullptr));
-
-    auto arrp = new (std::nothrow) RespArray();
-    if (!arrp)
-        return std::make_tuple(
-            ERROR_NO_MEMORY,
-            std::shared_ptr<AbstractRespObject>(nullptr));
-    
-    // Empty array
-    if (length < 0)
-        return std::make_tuple(
-            skip_crlf(),
-            std::shared_ptr<AbstractRespObject>(arrp));
-    
-    err = skip_crlf();
-    if (ERROR_SUCCESS != err)
+    while (true)
     {
-        delete arrp;
-        return std::make_tuple(
-            err,
-            std::shared_ptr<AbstractRespObject>(nullptr));
-    }
+        std::shared_ptr<AbstractRespObject> obj;
 
-    for (int i = 0; i < length; i++)
-    {
-        auto [err, type] = get_type();
-        if (ERROR_SUCCESS != err || RESP_INVALID == type)
+        if (RESP_ARRAY == type)
         {
-            delete arrp;
-            return std::make_tuple(
-                err,
-                std::shared_ptr<AbstractRespObject>(nullptr)
-            );
+            auto [err, length] = get_length();
+            if (ERROR_SUCCESS != err)
+                return std::make_tuple(
+                    ERROR_CURRENT_BEYOND_END == err ? err : ERROR_INVALID_ARRAY_LENGTH,
+                    std::shared_ptr<AbstractRespObject>(nullptr));
+
+            err = m_limits.check_array(length, stack.size() + 1);
+            if (ERROR_SUCCESS != err)
+                return std::make_tuple(
+                    err,
+                    std::shared_ptr<AbstractRespObject>(nullptr));
+
+            err = skip_crlf();
+            if (ERROR_SUCCESS != err)
+                return std::make_tuple(
+                    err,
+                    std::shared_ptr<AbstractRespObject>(nullptr));
+
+            auto arrp = new (std::nothrow) RespArray();
+            if (!arrp)
+                return std::make_tuple(
+                    ERROR_NO_MEMORY,
+                    std::shared_ptr<AbstractRespObject>(nullptr));
+            std::shared_ptr<RespArray> array(arrp);
+
+            // Null and empty arrays are both empty
+            if (length <= 0)
+                obj = array;
+            else
+                stack.push_back({array, length});
+        }
+        else
+        {
+            auto [err, obj1] = get_bulk_string_object();
+            if (ERROR_SUCCESS != err)
+                return std::make_tuple(
+                    err,
+                    std::shared_ptr<AbstractRespObject>(nullptr));
+            obj = obj1;
         }
 
-        switch(type)
+        // A complete object is an element of the innermost array,
+        // which may be complete in turn
+        while (obj)
         {
-            case RESP_BULK_STRING:
-                {
-                    auto [err, obj1] = get_bulk_string_object();
-                    if (ERROR_SUCCESS != err)
-                    {
-                        delete arrp;
-                        return std::make_tuple(
-                            err,
-                            std::shared_ptr<AbstractRespObject>(nullptr)
-                        );
-                    }
-                    arrp->append(obj1);
-                }
-                break;
-            case RESP_ARRAY:
-                {
-                    auto [err, obj] = get_array_object();
-                    if (ERROR_SUCCESS != err)
-                    {
-                        delete arrp;
-                        return std::make_tuple(
-                            err,
-                            std::shared_ptr<AbstractRespObject>(nullptr)
-                        );
-                    }
-                    arrp->append(obj);
-                }
+            if (stack.empty())
+                return std::make_tuple(ERROR_SUCCESS, obj);
+
+            auto& frame = stack.back();
+            if (ERROR_SUCCESS != frame.m_array->append(obj))
+                return std::make_tuple(
+                    ERROR_NO_MEMORY,
+                    std::shared_ptr<AbstractRespObject>(nullptr));
+            if (--frame.m_remaining > 0)
                 break;
-            default:
-                {
-                    std::cerr << "Type " << type << " Not implemented. "\
-                            << std::endl;
-                    delete arrp;
-                    return std::make_tuple(
-                        ERROR_NOT_IMPLEMENTED,
-                        std::shared_ptr<AbstractRespObject>(nullptr)
-                    );
-                }
+
+            obj = frame.m_array;
+            stack.pop_back();
         }
-    }
 
-    return std::make_tuple(
-        ERROR_SUCCESS, 
-        std::shared_ptr<AbstractRespObject>(arrp));
+        auto [err, next_type] = get_type();
+        if (ERROR_SUCCESS != err || RESP_INVALID == next_type)
+            return std::make_tuple(
+                err,
+                std::shared_ptr<AbstractRespObject>(nullptr));
+
+        if (RESP_ARRAY != next_type && RESP_BULK_STRING != next_type)
+        {
+            std::cerr << "Type " << next_type << " Not implemented. "\
+                    << std::endl;
+            return std::make_tuple(
+                ERROR_NOT_IMPLEMENTED,
+                std::shared_ptr<AbstractRespObject>(nullptr));
+        }
+        type = (resp_datatype_t)next_type;
+    }
 }
 
 std::tuple<resp_parse_error_t, std::shared_ptr<AbstractRespObject> >
 RespParser::get_generic_object()
 {
+    m_object_start = m_state.current;
     auto [err, type] = get_type();
     if (ERROR_SUCCESS != err || RESP_INVALID == type)
     {
@@ -282,3 +297,248 @@ RespParser::get_generic_object()
             }
     }
 }
+
+resp_parse_error_t
+RespStreamParser::parse_length(const char* input, size_t length, long& value)
+{
+    const char* end = input + length;
+    const char* cr = nullptr;
+
+    // The number must end the line, a line that goes on after it
+    // fails without waiting for its end
+    auto err = RespScanner::parse_decimal(input + m_offset, end, value, cr);
+    if (ERROR_SUCCESS != err)
+        return err;
+    if ('\r' != *cr)
+        return ERROR_INVALID_NUMBER;
+    if (cr + 1 >= end)
+        return ERROR_CURRENT_BEYOND_END;
+    if ('\n' != cr[1])
+        return ERROR_CRLF_MISSING;
+
+    m_offset = cr + 2 - input;
+    return ERROR_SUCCESS;
+}
+
+resp_parse_error_t
+RespStreamParser::parse_command(
+    const char*                         input,
+    size_t                              input_length,
+    std::vector<std::string_view>&      argv)
+{
+    // The rest of a streamed argument may have been read into it
+    // directly, it can be complete without any input
+    if (RESP_STREAM_STREAMED_DATA == m_phase)
+        return stream_argument(input, input_length, argv);
+
+    while (m_offset < input_length)
+    {
+        switch (m_phase)
+        {
+            case RESP_STREAM_TYPE:
+                {
+                    // The command is an array, its arguments are bulk
+                    // strings
+                    char expected = m_args_remaining ? '$' : '*';
+                    if (expected != input[m_offset])
+                        return ERROR_INVALID_TYPE;
+                    m_type = m_args_remaining ? RESP_BULK_STRING : RESP_ARRAY;
+                    m_offset++;
+                    m_phase = RESP_STREAM_LENGTH;
+                }
+                break;
+            case RESP_STREAM_LENGTH:
+                {
+                    long length = 0;
+                    auto err = parse_length(input, input_length, length);
+                    if (ERROR_SUCCESS != err)
+                        return err;
+
+                    if (RESP_BULK_STRING == m_type)
+                    {
+                        // A null string is no argument
+                        if (length < 0)
+                            return ERROR_INVALID_NUMBER;
+                        err = m_limits.check_bulk(
+                                length, m_offset - m_command_start + length + 2);
+                        if (ERROR_SUCCESS != err)
+                            return err;
+
+                        if (1 == m_args_remaining && m_stream_threshold &&
+                            (size_t)length >= m_stream_threshold)
+                        {
+                            start_streaming(input, length);
+                            return stream_argument(input, input_length, argv);
+                        }
+
+                        m_bulk_length = length;
+                        m_phase = RESP_STREAM_BULK_DATA;
+                        break;
+                    }
+
+                    err = m_limits.check_array(length, 1);
+                    if (ERROR_SUCCESS != err)
+                        return err;
+
+                    // A streamed argument that the previous command
+                    // did not take is freed
+                    if (m_has_streamed)
+                    {
+                        m_has_streamed = false;
+                        std::string().swap(m_streamed);
+                    }
+
+                    m_args.clear();
+                    m_phase = RESP_STREAM_TYPE;
+                    if (length > 0)
+                    {
+                        m_args_remaining = length;
+                        break;
+                    }
+
+                    // Null and empty arrays are both empty commands
+                    argv.clear();
+                    m_command_start = m_offset;
+                    return ERROR_SUCCESS;
+                }
+                break;
+            case RESP_STREAM_BULK_DATA:
+                {
+                    // Nothing is looked at until all of the string
+                    // and its CRLF have arrived
+                    if (input_length - m_offset < m_bulk_length + 2)
+                        return ERROR_CURRENT_BEYOND_END;
+
+                    const char* data = input + m_offset;
+                    if ('\r' != data[m_bulk_length] ||
+                        '\n' != data[m_bulk_length + 1])
+                        return ERROR_CRLF_MISSING;
+
+                    m_args.push_back({m_offset - m_command_start, m_bulk_length});
+                    m_offset += m_bulk_length + 2;
+                    m_phase = RESP_STREAM_TYPE;
+                    if (--m_args_remaining > 0)
+                        break;
+
+                    // Only now that the command is complete do the
+                    // arguments point into the input
+                    const char* command = input + m_command_start;
+                    argv.clear();
+                    for (auto& arg: m_args)
+                        argv.emplace_back(command + arg.m_offset, arg.m_length);
+                    m_command_start = m_offset;
+                    return ERROR_SUCCESS;
+                }
+                break;
+            case RESP_STREAM_STREAMED_DATA:
+                break;
+        }
+    }
+
+    return ERROR_CURRENT_BEYOND_END;
+}
+
+void RespStreamParser::start_streaming(const char* input, size_t length)
+{
+    m_streamed_head.assign(input + m_command_start, m_offset - m_command_start);
+
+    // Nothing is allocated for the value until its bytes arrive, a
+    // header alone must not make the server commit its length
+    std::string().swap(m_streamed);
+    m_streamed_length = 0;
+
+    m_bulk_length = length;
+    m_command_start = m_offset;
+    m_phase = RESP_STREAM_STREAMED_DATA;
+}
+
+bool RespStreamParser::grow_streamed()
+{
+    // The CRLF is received into the allocation too, and cut off once
+    // checked, so that the value can be moved to the data store as
+    // it is. The last step makes room for exactly what is left, so
+    // the value ends up in an allocation of its own size.
+    size_t total = m_bulk_length + 2;
+    if (m_streamed.length() >= total)
+        return false;
+
+    // std::string::reserve() may round up, a new string gets the
+    // exact size
+    size_t size = std::min(total, std::max(m_streamed.length() * 2, m_stream_threshold));
+    std::string grown;
+    grown.reserve(size);
+    grown.append(m_streamed, 0, m_streamed_length);
+    grown.resize(size);
+    m_streamed.swap(grown);
+    return true;
+}
+
+resp_parse_error_t
+RespStreamParser::stream_argument(
+    const char*                         input,
+    size_t                              input_length,
+    std::vector<std::string_view>&      argv)
+{
+    while (m_offset < input_length &&
+           (m_streamed_length < m_streamed.length() || grow_streamed()))
+    {
+        size_t n = std::min(
+                    m_streamed.length() - m_streamed_length,
+                    input_length - m_offset);
+        memcpy(&m_streamed[m_streamed_length], input + m_offset, n);
+        m_streamed_length += n;
+        m_offset += n;
+    }
+    m_command_start = m_offset;
+
+    if (m_streamed_length < m_bulk_length + 2)
+        return ERROR_CURRENT_BEYOND_END;
+
+    if ('\r' != m_streamed[m_bulk_length] || '\n' != m_streamed[m_bulk_length + 1])
+        return ERROR_CRLF_MISSING;
+    m_streamed.resize(m_bulk_length);
+
+    argv.clear();
+    for (auto& arg: m_args)
+        argv.emplace_back(m_streamed_head.data() + arg.m_offset, arg.m_length);
+    argv.emplace_back(m_streamed.data(), m_bulk_length);
+
+    m_args_remaining = 0;
+    m_has_streamed = true;
+    m_phase = RESP_STREAM_TYPE;
+    return ERROR_SUCCESS;
+}
+
+std::shared_ptr<AbstractRespObject> RespReplies::ok()
+{
+    static RespPreencoded<RespString> reply(RESP_ENCODED_OK, "OK");
+    return reply.share();
+}
+
+std::shared_ptr<AbstractRespObject> RespReplies::null()
+{
+    static RespPreencoded<RespBulkString> reply = []() {
+        RespPreencoded<RespBulkString> reply(RESP_ENCODED_NULL, std::string());
+        reply.set_null(true);
+        return reply;
+    }();
+    return reply.share();
+}
+
+std::shared_ptr<AbstractRespObject> RespReplies::integer(int value)
+{
+    static RespPreencoded<RespInteger> zero(RESP_ENCODED_ZERO, 0);
+    static RespPreencoded<RespInteger> one(RESP_ENCODED_ONE, 1);
+
+    if (0 == value)
+        return zero.share();
+    if (1 == value)
+        return one.share();
+    return nullptr;
+}
+
+std::shared_ptr<AbstractRespObject> RespReplies::invalid_command()
+{
+    static RespPreencoded<RespError> reply(RESP_ENCODED_INVALID_COMMAND, "Invalid command");
+    return reply.share();
+}
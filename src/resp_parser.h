@@ -3,6 +3,7 @@
 
 #include "common_include.h"
 #include <cassert>
+#include <charconv>
 
 /**
  * @brief Type of each RESP object
@@ -31,8 +32,125 @@ typedef enum {
     ERROR_NO_MEMORY,
     ERROR_INVALID_ARRAY_LENGTH,
     ERROR_NOT_IMPLEMENTED,
+    ERROR_NESTING_TOO_DEEP,
+    ERROR_TOO_MANY_ARGUMENTS,
+    ERROR_BULK_TOO_LONG,
+    ERROR_REQUEST_TOO_LARGE,
 } resp_parse_error_t;
 
+/**
+ * @brief Limits on what a client may send, checked as soon as the
+ * headers that announce the sizes are parsed, so that the data is
+ * never buffered. A limit of 0 means there is no limit.
+ * 
+ */
+struct RespLimits
+{
+    /**
+     * @brief number of arrays that may be open at the same time
+     * 
+     */
+    size_t                      m_max_depth;
+
+    /**
+     * @brief number of elements of an array
+     * 
+     */
+    size_t                      m_max_arguments;
+
+    /**
+     * @brief length of a bulk string
+     * 
+     */
+    size_t                      m_max_bulk_length;
+
+    /**
+     * @brief length of a whole request, from its first byte to its
+     * last
+     * 
+     */
+    size_t                      m_max_request_size;
+
+    RespLimits():
+        m_max_depth(32),
+        m_max_arguments(1024 * 1024),
+        m_max_bulk_length(512 * 1024 * 1024),
+        m_max_request_size(1024 * 1024 * 1024)
+    {
+    }
+
+    /**
+     * @brief would a request that is this long so far exceed the
+     * limit
+     * 
+     * @param size the length of the request
+     * @return true if it is too long
+     */
+    bool is_request_too_large(size_t size) const
+    {
+        return m_max_request_size && size > m_max_request_size;
+    }
+
+    /**
+     * @brief check the header of a bulk string
+     * 
+     * @param length the length the header announces
+     * @param request_size the length the request will have once the
+     * bulk string and its CRLF are there
+     * @return resp_parse_error_t ERROR_SUCCESS, or the limit that is
+     * exceeded
+     */
+    resp_parse_error_t check_bulk(size_t length, size_t request_size) const
+    {
+        if (m_max_bulk_length && length > m_max_bulk_length)
+            return ERROR_BULK_TOO_LONG;
+        if (is_request_too_large(request_size))
+            return ERROR_REQUEST_TOO_LARGE;
+        return ERROR_SUCCESS;
+    }
+
+    /**
+     * @brief check the header of an array
+     * 
+     * @param length the number of elements the header announces
+     * @param depth the number of arrays open with this one
+     * @return resp_parse_error_t ERROR_SUCCESS, or the limit that is
+     * exceeded
+     */
+    resp_parse_error_t check_array(long length, size_t depth) const
+    {
+        if (m_max_depth && depth > m_max_depth)
+            return ERROR_NESTING_TOO_DEEP;
+        if (m_max_arguments && length > 0 && (size_t)length > m_max_arguments)
+            return ERROR_TOO_MANY_ARGUMENTS;
+        return ERROR_SUCCESS;
+    }
+
+    /**
+     * @brief the error to send to a client that exceeded a limit
+     * 
+     * @param err the parse error
+     * @return const char* the message, nullptr if the error is not
+     * about a limit
+     */
+    static const char* error_message(resp_parse_error_t err)
+    {
+        switch (err)
+        {
+            case ERROR_NESTING_TOO_DEEP:
+                return "ERR Protocol error: too many nested arrays";
+            case ERROR_TOO_MANY_ARGUMENTS:
+                return "ERR Protocol error: invalid multibulk length";
+            case ERROR_BULK_TOO_LONG:
+                return "ERR Protocol error: invalid bulk length";
+            case ERROR_REQUEST_TOO_LARGE:
+                return "ERR Protocol error: request too large";
+            default:
+                return nullptr;
+        }
+    }
+};
+
 /**
  * @brief The state that is used by the parser
  * 
@@ -96,7 +214,34 @@ public:
      * 
      * @return std::string serialized string
      */
-    virtual std::string serialize() = 0;
+    virtual std::string serialize()
+    {
+        std::string out;
+        serialize_to(out);
+        return out;
+    }
+
+    /**
+     * @brief Serialize the object at the end of a string, without
+     * building a string for it
+     * 
+     * @param out the string the object is appended to
+     */
+    virtual void serialize_to(std::string& out) = 0;
+
+    /**
+     * @brief append a number in decimal, without going through a
+     * stream
+     * 
+     * @param out the string the number is appended to
+     * @param value the number
+     */
+    static void append_decimal(std::string& out, long long value)
+    {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr - digits);
+    }
 
     /**
      * @brief Get the type of the object
@@ -141,13 +286,13 @@ public:
     /**
      * @brief Serialize for storage
      * 
-     * @return std::string a string that can be stored
+     * @param out the string the integer is appended to
      */
-    std::string serialize()
+    void serialize_to(std::string& out)
     {
-        std::stringstream ss;
-        ss << ":" << m_value << "\r\n";
-        return ss.str();
+        out += ':';
+        append_decimal(out, m_value);
+        out.append("\r\n", 2);
     }
 
     /**
@@ -194,13 +339,13 @@ public:
     /**
      * @brief serialize for storage
      * 
-     * @return std::string serialized string
+     * @param out the string the simple string is appended to
      */
-    std::string serialize()
+    void serialize_to(std::string& out)
     {
-        std::stringstream ss;
-        ss << "+" << m_value << "\r\n";
-        return ss.str();
+        out += '+';
+        out += m_value;
+        out.append("\r\n", 2);
     }
 };
 
@@ -256,17 +401,44 @@ public:
     /**
      * @brief Serialize for storage or transmission
      * 
-     * @return std::string serialized string
+     * @param out the string the bulk string is appended to
      */
-    std::string serialize()
+    void serialize_to(std::string& out)
     {
         if (m_isnull)
-            return "$-1\r\n";
+            out.append("$-1\r\n", 5);
+        else
+            encode_to(out, m_value);
+    }
 
-        std::stringstream ss;
-        ss << "$" << m_value.length() << "\r\n";
-        ss << m_value << "\r\n";
-        return ss.str();
+    /**
+     * @brief Serialize a value the way serialize() does, without
+     * building an object for it
+     * 
+     * @param value the value of the bulk string
+     * @return std::string serialized string
+     */
+    static std::string encode(std::string_view value)
+    {
+        std::string s;
+        s.reserve(1 + 20 + 2 + value.length() + 2);
+        encode_to(s, value);
+        return s;
+    }
+
+    /**
+     * @brief Serialize a value at the end of a string
+     * 
+     * @param out the string the bulk string is appended to
+     * @param value the value of the bulk string
+     */
+    static void encode_to(std::string& out, std::string_view value)
+    {
+        out += '$';
+        append_decimal(out, value.length());
+        out.append("\r\n", 2);
+        out += value;
+        out.append("\r\n", 2);
     }
 };
 
@@ -337,19 +509,18 @@ public:
     }
 
     /**
-     * @brief Serialize for transmission or storage
+     * @brief Serialize for transmission or storage, the elements
+     * are appended one after the other to the same string
      * 
-     * @return std::string serialized string
+     * @param out the string the array is appended to
      */
-    std::string serialize()
+    void serialize_to(std::string& out)
     {
-        std::stringstream ss;
-
-        ss << "*" << m_value.size() << "\r\n";
-        for (auto p: m_value)
-            ss << p->serialize();
-
-        return ss.str();
+        out += '*';
+        append_decimal(out, m_value.size());
+        out.append("\r\n", 2);
+        for (auto& p: m_value)
+            p->serialize_to(out);
     }
 
     /**
@@ -368,7 +539,7 @@ public:
  * @brief RESP object for errors
  * 
  */
-class RespError: AbstractRespObject
+class RespError: public AbstractRespObject
 {
 public:
     /**
@@ -397,16 +568,160 @@ public:
     /**
      * @brief serialize for transmission or storage
      * 
-     * @return std::string serialized string
+     * @param out the string the error is appended to
      */
-    std::string serialize()
+    void serialize_to(std::string& out)
     {
-        std::stringstream ss;
-        ss << "-" << m_value << "\r\n";
-        return ss.str();
+        out += '-';
+        out += m_value;
+        out.append("\r\n", 2);
+    }
+};
+
+/**
+ * @brief A bulk string whose data the reply does not own, such as a
+ * value copied from the data store into the arena of a connection.
+ * The data must live as long as the reply.
+ * 
+ */
+class RespBulkStringRef: public AbstractRespObject
+{
+public:
+    /**
+     * @brief the data of the bulk string
+     * 
+     */
+    std::string_view        m_data;
+
+    RespBulkStringRef(std::string_view data):
+        m_data(data)
+    {
+        m_is_aggregate = false;
+        m_datatype = RESP_BULK_STRING;
+    }
+
+    /**
+     * @brief Convert to a human readable string
+     * 
+     * @return std::string the data
+     */
+    std::string to_string()
+    {
+        return std::string(m_data);
+    }
+
+    /**
+     * @brief serialize the data as a bulk string
+     * 
+     * @param out the string the bulk string is appended to
+     */
+    void serialize_to(std::string& out)
+    {
+        RespBulkString::encode_to(out, m_data);
     }
 };
 
+/**
+ * @brief the serialized forms of the replies that are sent most
+ * often
+ * 
+ */
+constexpr std::string_view RESP_ENCODED_OK = "+OK\r\n";
+constexpr std::string_view RESP_ENCODED_NULL = "$-1\r\n";
+constexpr std::string_view RESP_ENCODED_ZERO = ":0\r\n";
+constexpr std::string_view RESP_ENCODED_ONE = ":1\r\n";
+constexpr std::string_view RESP_ENCODED_INVALID_COMMAND = "-Invalid command\r\n";
+
+/**
+ * @brief A reply whose serialized form is known when the program is
+ * built. It is still a T, so that the code that looks into replies,
+ * such as the sum of the replies of a split DEL, reads it like any
+ * other. It must not be modified.
+ * 
+ * @tparam T the type of the reply
+ */
+template<typename T>
+class RespPreencoded: public T
+{
+public:
+    /**
+     * @brief the serialized form, it is never copied until it is
+     * appended to the output
+     * 
+     */
+    std::string_view        m_encoded;
+
+    template<typename... Args>
+    RespPreencoded(std::string_view encoded, Args&&... args):
+        T(std::forward<Args>(args)...),
+        m_encoded(encoded)
+    {
+    }
+
+    /**
+     * @brief append the serialized form
+     * 
+     * @param out the string the reply is appended to
+     */
+    void serialize_to(std::string& out)
+    {
+        out.append(m_encoded.data(), m_encoded.length());
+    }
+
+    /**
+     * @brief a pointer to the reply that shares nothing. The reply
+     * lives as long as the program, so there is no reference count
+     * to allocate or to update from several threads.
+     * 
+     * @return std::shared_ptr<AbstractRespObject> the reply
+     */
+    std::shared_ptr<AbstractRespObject> share()
+    {
+        return std::shared_ptr<AbstractRespObject>(
+                std::shared_ptr<AbstractRespObject>(), this);
+    }
+};
+
+/**
+ * @brief The replies that are sent most often, created once for the
+ * whole program. Returning them allocates nothing.
+ * 
+ */
+class RespReplies
+{
+public:
+    /**
+     * @brief +OK
+     * 
+     * @return std::shared_ptr<AbstractRespObject> the reply
+     */
+    static std::shared_ptr<AbstractRespObject> ok();
+
+    /**
+     * @brief the null bulk string
+     * 
+     * @return std::shared_ptr<AbstractRespObject> the reply
+     */
+    static std::shared_ptr<AbstractRespObject> null();
+
+    /**
+     * @brief an integer reply, preencoded for 0 and 1
+     * 
+     * @param value the integer
+     * @return std::shared_ptr<AbstractRespObject> the reply, nullptr
+     * if the integer has no preencoded reply
+     */
+    static std::shared_ptr<AbstractRespObject> integer(int value);
+
+    /**
+     * @brief the error for commands that are not known or that have
+     * the wrong number of arguments
+     * 
+     * @return std::shared_ptr<AbstractRespObject> the reply
+     */
+    static std::shared_ptr<AbstractRespObject> invalid_command();
+};
+
 /**
  * @brief Parser that parses a string and produces a RESP object
  * 
@@ -427,13 +742,28 @@ public:
      */
     std::string                     m_parse_string;
 
-    RespParser(std::string parsestring)
+    /**
+     * @brief the limits on what is parsed
+     * 
+     */
+    RespLimits                      m_limits;
+
+    /**
+     * @brief where the object that get_generic_object() is parsing
+     * starts, the request size limit is checked from there
+     * 
+     */
+    char*                           m_object_start;
+
+    RespParser(std::string parsestring, const RespLimits& limits = RespLimits())
     {
         m_parse_string        = parsestring;
+        m_limits              = limits;
         m_state.begin         = const_cast<char*>(m_parse_string.c_str());
         m_state.end           = m_state.begin + m_parse_string.length();
         m_state.current       = m_state.begin;
         m_state.parse_error   = 0;
+        m_object_start        = m_state.begin;
     }
 
     /**
@@ -506,8 +836,9 @@ public:
         get_string_object();
 
     /**
-     * @brief parses the current token as an array object
-     * It then recurses for all elements of the array
+     * @brief parses the current token as an array object, and all
+     * the arrays nested in it. The arrays being filled in are kept
+     * on a stack whose depth is limited, rather than by recursion.
      * 
      * @return std::tuple<resp_parse_error_t, std::shared_ptr<AbstractRespObject> > 
      * A tuple containing
@@ -517,6 +848,28 @@ public:
     std::tuple<resp_parse_error_t, std::shared_ptr<AbstractRespObject> >
         get_array_object();
 
+    /**
+     * @brief number of bytes of the input that have been parsed so
+     * far. After get_generic_object succeeds, this is where the next
+     * command starts.
+     * 
+     * @return size_t number of bytes parsed
+     */
+    size_t get_parsed_length()
+    {
+        return m_state.current - m_state.begin;
+    }
+
+    /**
+     * @brief Is there input left after the current location
+     * 
+     * @return true if there is more input to parse
+     */
+    bool has_more_input()
+    {
+        return m_state.current < m_state.end;
+    }
+
     /**
      * @brief Parse the current token regardless of type and return an object
      * 
@@ -530,4 +883,380 @@ public:
 
 };
 
+/**
+ * @brief The part of a RESP object that the stream parser is
+ * waiting for
+ * 
+ */
+typedef enum {
+    /**
+     * @brief the type byte of the next object
+     * 
+     */
+    RESP_STREAM_TYPE,
+
+    /**
+     * @brief the line with the length of an array or bulk string
+     * 
+     */
+    RESP_STREAM_LENGTH,
+
+    /**
+     * @brief the data of a bulk string and the CRLF after it
+     * 
+     */
+    RESP_STREAM_BULK_DATA,
+
+    /**
+     * @brief the data of a large last argument and the CRLF after
+     * it, copied to its own allocation as it arrives
+     * 
+     */
+    RESP_STREAM_STREAMED_DATA
+} resp_stream_phase_t;
+
+/**
+ * @brief the last argument of a command is streamed into its own
+ * allocation, instead of being buffered with the command, from
+ * this length on
+ * 
+ */
+#define RESP_STREAM_THRESHOLD (256 * 1024)
+
+/**
+ * @brief An array that RespParser is filling in
+ * 
+ */
+struct RespStreamFrame
+{
+    /**
+     * @brief the array
+     * 
+     */
+    std::shared_ptr<RespArray>      m_array;
+
+    /**
+     * @brief number of elements that are still missing
+     * 
+     */
+    long                            m_remaining;
+};
+
+/**
+ * @brief An argument of the command that parse_command() is parsing.
+ * It is kept as an offset from the start of the command rather than
+ * a pointer, the input may move before the command is complete.
+ * 
+ */
+struct RespStreamArgument
+{
+    /**
+     * @brief where the argument starts, from the start of the command
+     * 
+     */
+    size_t                          m_offset;
+
+    /**
+     * @brief length of the argument
+     * 
+     */
+    size_t                          m_length;
+};
+
+/**
+ * @brief Resumable parser for a stream of RESP commands.
+ * 
+ * Unlike RespParser, it does not need the whole command to be
+ * present. When the input ends in the middle of a command, it
+ * remembers where it stopped and the arguments it has found so far,
+ * and the next call carries on from there once more data has been
+ * appended to the input. A bulk string is only looked at once all
+ * of it has arrived, so a large value that comes in many reads is
+ * never scanned again from the start.
+ * 
+ * It builds no objects at all: parse_command() returns the
+ * arguments as slices of the input. Commands are arrays of bulk
+ * strings, so there are no nested arrays to keep track of.
+ * 
+ */
+class RespStreamParser
+{
+public:
+    /**
+     * @brief where parsing continues in the input
+     * 
+     */
+    size_t                                  m_offset;
+
+    /**
+     * @brief where the command being parsed starts in the input,
+     * everything before it belongs to commands already returned
+     * 
+     */
+    size_t                                  m_command_start;
+
+    /**
+     * @brief what the parser expects next
+     * 
+     */
+    resp_stream_phase_t                     m_phase;
+
+    /**
+     * @brief type of the object whose length is being parsed
+     * 
+     */
+    resp_datatype_t                         m_type;
+
+    /**
+     * @brief length of the bulk string being parsed
+     * 
+     */
+    size_t                                  m_bulk_length;
+
+    /**
+     * @brief the arguments of the command that parse_command() is
+     * parsing, the vector is kept from one command to the next
+     * 
+     */
+    std::vector<RespStreamArgument>         m_args;
+
+    /**
+     * @brief number of arguments of that command that are still
+     * missing, 0 when its array has not been started
+     * 
+     */
+    long                                    m_args_remaining;
+
+    /**
+     * @brief the last argument is streamed from this length on, 0
+     * to never stream
+     * 
+     */
+    size_t                                  m_stream_threshold;
+
+    /**
+     * @brief the command up to the header of its streamed argument,
+     * the offsets in m_args are from its start
+     * 
+     */
+    std::string                             m_streamed_head;
+
+    /**
+     * @brief the bytes of the streamed argument, and the CRLF that
+     * follows it. Its length is the room made for them so far: it
+     * grows, doubling, as the data is copied or read into it, up to
+     * the length announced by the header.
+     * 
+     */
+    std::string                             m_streamed;
+
+    /**
+     * @brief number of bytes of m_streamed filled in so far
+     * 
+     */
+    size_t                                  m_streamed_length;
+
+    /**
+     * @brief set when the last argument of the command returned by
+     * parse_command() was streamed, until the next command starts
+     * 
+     */
+    bool                                    m_has_streamed;
+
+    RespStreamParser():
+        m_stream_threshold(RESP_STREAM_THRESHOLD)
+    {
+        reset();
+    }
+
+    /**
+     * @brief forget any partially parsed command
+     * 
+     */
+    void reset()
+    {
+        m_offset = 0;
+        m_command_start = 0;
+        m_phase = RESP_STREAM_TYPE;
+        m_type = RESP_INVALID;
+        m_bulk_length = 0;
+        m_args.clear();
+        m_args_remaining = 0;
+        m_streamed_head.clear();
+        std::string().swap(m_streamed);
+        m_streamed_length = 0;
+        m_has_streamed = false;
+    }
+
+    /**
+     * @brief parse the next command from the input without building
+     * any object. A command is an array of bulk strings, the way
+     * clients send them; anything else is a parse error. An empty
+     * array is a command without arguments.
+     * 
+     * @param input the data received so far. It must start where it
+     * started on the previous call, except for the bytes removed
+     * with discard(). It is read in place.
+     * @param length length of the input
+     * @param argv receives the arguments of the command, as slices
+     * of the input. They are valid until the input is modified or
+     * moved. Its capacity is reused, so once it has grown to the
+     * largest command nothing is allocated any more.
+     * @return resp_parse_error_t ERROR_SUCCESS, ERROR_CURRENT_BEYOND_END
+     * if the command is not complete yet, or the parse error. The
+     * parser must be reset after a parse error.
+     */
+    resp_parse_error_t parse_command(
+        const char*                         input,
+        size_t                              length,
+        std::vector<std::string_view>&      argv);
+
+    /**
+     * @brief how much input is needed before the parser can make
+     * progress, so that the buffer can be sized for a large value
+     * before it is read
+     * 
+     * @return size_t the total length the input must have, 0 if
+     * it is not known
+     */
+    size_t expected_length() const
+    {
+        if (RESP_STREAM_BULK_DATA == m_phase)
+            return m_offset + m_bulk_length + 2;
+        return 0;
+    }
+
+    /**
+     * @brief is the last argument of a command being streamed
+     * 
+     * @return true if it is
+     */
+    bool is_streaming() const
+    {
+        return RESP_STREAM_STREAMED_DATA == m_phase;
+    }
+
+    /**
+     * @brief where a read may write the rest of the streamed
+     * argument directly, once all the input has been parsed
+     * 
+     * @param input_length length of the input
+     * @return std::tuple<char*, size_t> where to write and how much,
+     * at most the rest of the argument and its CRLF. nullptr if
+     * nothing is streamed or there is input left to parse.
+     */
+    std::tuple<char*, size_t> stream_window(size_t input_length)
+    {
+        if (!is_streaming() || m_offset != input_length)
+            return {nullptr, 0};
+        if (m_streamed_length == m_streamed.length() && !grow_streamed())
+            return {nullptr, 0};
+        return {&m_streamed[m_streamed_length], m_streamed.length() - m_streamed_length};
+    }
+
+    /**
+     * @brief account for bytes written at stream_window()
+     * 
+     * @param n the number of bytes
+     */
+    void commit_streamed(size_t n)
+    {
+        m_streamed_length += n;
+    }
+
+    /**
+     * @brief the streamed argument of the command returned last
+     * 
+     * @return std::string* the bytes of the argument, nullptr if it
+     * was not streamed. It may be moved from.
+     */
+    std::string* streamed_value()
+    {
+        return m_has_streamed ? &m_streamed : nullptr;
+    }
+
+    /**
+     * @brief number of bytes at the start of the input that belong
+     * to commands that have been returned, they can be removed
+     * 
+     * @return size_t the number of bytes
+     */
+    size_t parsed_length() const
+    {
+        return m_command_start;
+    }
+
+    /**
+     * @brief account for bytes removed from the start of the input
+     * 
+     * @param n the number of bytes removed, at most parsed_length()
+     */
+    void discard(size_t n)
+    {
+        m_offset -= n;
+        m_command_start -= n;
+    }
+
+    /**
+     * @brief change the limits on what is parsed
+     * 
+     * @param limits the limits
+     */
+    void set_limits(const RespLimits& limits)
+    {
+        m_limits = limits;
+    }
+
+private:
+    /**
+     * @brief the limits on what is parsed
+     * 
+     */
+    RespLimits                              m_limits;
+
+    /**
+     * @brief parse the length line at the current offset
+     * 
+     * @param input the data received so far
+     * @param length length of the input
+     * @param value receives the length in the line
+     * @return resp_parse_error_t error or success
+     */
+    resp_parse_error_t parse_length(const char* input, size_t length, long& value);
+
+    /**
+     * @brief start streaming the last argument of the command, whose
+     * header has just been parsed. The command so far is copied, so
+     * that all of the input is parsed.
+     * 
+     * @param input the data received so far
+     * @param length the length of the argument
+     */
+    void start_streaming(const char* input, size_t length);
+
+    /**
+     * @brief make more room in m_streamed for the streamed argument,
+     * twice as much as there is, at least m_stream_threshold bytes,
+     * and never past the argument and its CRLF
+     * 
+     * @return true if there is more room
+     * @return false if m_streamed already has room for all of it
+     */
+    bool grow_streamed();
+
+    /**
+     * @brief copy what the input has of the streamed argument
+     * 
+     * @param input the data received so far
+     * @param input_length length of the input
+     * @param argv receives the arguments once the argument is
+     * complete
+     * @return resp_parse_error_t as for parse_command()
+     */
+    resp_parse_error_t stream_argument(
+        const char*                         input,
+        size_t                              input_length,
+        std::vector<std::string_view>&      argv);
+};
+
 #endif /* #ifndef RESP_OBJECT_ */
\ No newline at end of file
@@ -1,8 +1,35 @@
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 #include <pthread.h>
 #include "resp_parser.h"
 
+/**
+ * @brief number of allocations made by the program, to check that
+ * the common replies are serialized without any
+ * 
+ */
+static size_t num_allocations = 0;
+
+void* operator new(size_t size)
+{
+    num_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
 #define TEST(x, y) {\
     if (!(x))\
     {\
@@ -267,6 +294,425 @@ void test_array_serialization()
         TEST(ret->serialize() == s, "Serialization should yield the oriinal array back");
     }
 }
+void test_pipelined()
+{
+    std::cout << std::endl << "Tests to validate pipelined commands" << std::endl;
+    {
+        std::string first = "*2\r\n$3\r\nget\r\n$1\r\nx\r\n";
+        std::string second = "*2\r\n$3\r\nget\r\n$1\r\ny\r\n";
+        RespParser t1(first + second + "*2\r\n$3\r\nget\r\n$1");
+        auto [err, ret] = t1.get_generic_object();
+        TEST(ERROR_SUCCESS == err, "First pipelined command should be parsed");
+        TEST(first.length() == t1.get_parsed_length(), "Parsed length should end at the first command");
+        auto [err2, ret2] = t1.get_generic_object();
+        TEST(ERROR_SUCCESS == err2, "Second pipelined command should be parsed");
+        TEST(ret2->to_string() == std::string("[get, y]"), "Second command should be correct");
+        TEST(t1.has_more_input(), "The incomplete command should be left");
+        auto [err3, ret3] = t1.get_generic_object();
+        TEST(ERROR_CURRENT_BEYOND_END == err3, "Incomplete command should need more input");
+    }
+    {
+        RespParser t1("*1");
+        auto [err, ret] = t1.get_generic_object();
+        TEST(ERROR_CURRENT_BEYOND_END == err, "Incomplete array length should need more input");
+    }
+}
+
+void test_command_parser()
+{
+    std::cout << std::endl << "Tests to validate parsing commands into slices" << std::endl;
+    {
+        std::string command = "*3\r\n$3\r\nset\r\n$1\r\nx\r\n$5\r\nhello\r\n";
+        std::string input;
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        bool complete_early = false;
+
+        // The input moves as it grows, the arguments must still be
+        // found once it is complete
+        for (size_t i = 0; i + 1 < command.length(); i++)
+        {
+            input += command[i];
+            input.shrink_to_fit();
+            if (ERROR_CURRENT_BEYOND_END != parser.parse_command(input.data(), input.length(), argv))
+                complete_early = true;
+        }
+        TEST(!complete_early, "A command received byte by byte should not complete early");
+
+        input += command.back();
+        auto err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err, "The last byte should complete the command");
+        TEST(3 == argv.size() && "set" == argv[0] && "x" == argv[1] && "hello" == argv[2],
+            "Correct arguments should be returned");
+        TEST(argv[2].data() == input.data() + command.length() - 7, "The arguments should point into the input");
+        TEST(command.length() == parser.parsed_length(), "The whole command should be parsed");
+    }
+    {
+        std::string input = "*2\r\n$3\r\nget\r\n$1\r\na\r\n*2\r\n$3\r\nget\r\n$1\r\nb\r\n";
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+
+        auto err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err && "a" == argv[1], "The first pipelined command should be parsed");
+        const std::string_view* storage = argv.data();
+        err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err && "b" == argv[1], "The second pipelined command should be parsed");
+        TEST(storage == argv.data(), "The arguments vector should be reused");
+        err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_CURRENT_BEYOND_END == err, "Nothing should be left");
+    }
+    {
+        std::string input = "*1\r\n$4\r\ninfo\r\n*3\r\n$3\r\nset\r\n$1\r\nk\r\n$7\r\na\r\n";
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+
+        auto err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err && 1 == argv.size(), "A command without arguments should be parsed");
+        err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_CURRENT_BEYOND_END == err, "A split value should need more input");
+
+        size_t parsed = parser.parsed_length();
+        input.erase(0, parsed);
+        parser.discard(parsed);
+        input += "b\r\nc\r\n";
+        err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err, "The command should complete after discarding");
+        TEST(3 == argv.size() && "k" == argv[1] && "a\r\nb\r\nc" == argv[2],
+            "The arguments parsed before discarding should be kept");
+    }
+    {
+        std::string input = "*2\r\n$3\r\nset\r\n$10\r\n01234";
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        auto err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_CURRENT_BEYOND_END == err, "A split bulk string should need more input");
+        TEST(RESP_STREAM_BULK_DATA == parser.m_phase, "The parser should wait for the bulk data");
+        size_t offset = parser.m_offset;
+        input += "56789\r\n*1\r\n$4\r\nping\r\n";
+        err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err, "The rest of the bulk string should complete the command");
+        TEST(2 == argv.size() && "0123456789" == argv[1], "The bulk string should be joined");
+        TEST(offset + 12 == parser.parsed_length(), "Parsing should resume where it stopped");
+
+        size_t parsed = parser.parsed_length();
+        input.erase(0, parsed);
+        parser.discard(parsed);
+        err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err && 1 == argv.size() && "ping" == argv[0],
+            "The next command should be parsed after discarding");
+    }
+    {
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        TEST(ERROR_INVALID_NUMBER == parser.parse_command("*2\r\n$x\r\n", 8, argv),
+            "An invalid length should fail");
+        parser.reset();
+        TEST(ERROR_SUCCESS == parser.parse_command("*1\r\n$3\r\nabc\r\n", 13, argv),
+            "The parser should work again after a reset");
+    }
+    {
+        std::vector<std::string_view> argv = {"stale"};
+        RespStreamParser parser;
+        auto err = parser.parse_command("*0\r\n", 4, argv);
+        TEST(ERROR_SUCCESS == err && argv.empty(), "An empty array should be an empty command");
+    }
+    {
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        TEST(ERROR_INVALID_TYPE == parser.parse_command("$3\r\nget\r\n", 9, argv),
+            "A command that is not an array should fail");
+        parser.reset();
+        TEST(ERROR_INVALID_TYPE == parser.parse_command("*1\r\n*1\r\n", 8, argv),
+            "A nested array should fail");
+        parser.reset();
+        TEST(ERROR_INVALID_TYPE == parser.parse_command("*1\r\n:1\r\n", 8, argv),
+            "An argument that is not a bulk string should fail");
+        parser.reset();
+        TEST(ERROR_INVALID_NUMBER == parser.parse_command("*1\r\n$-1\r\n", 9, argv),
+            "A null argument should fail");
+        parser.reset();
+        TEST(ERROR_CRLF_MISSING == parser.parse_command("*1\r\n$1\r\nab\r\n", 11, argv),
+            "A bulk string longer than its length should fail");
+    }
+}
+
+void test_direct_serialization()
+{
+    std::cout << std::endl << "Tests to validate serialization into an existing string" << std::endl;
+    {
+        std::string out = "prefix";
+        RespInteger(-1234567).serialize_to(out);
+        RespString("hello").serialize_to(out);
+        RespError("ERR bad").serialize_to(out);
+        TEST(out == "prefix:-1234567\r\n+hello\r\n-ERR bad\r\n",
+            "Objects should be appended after what is already there");
+    }
+    {
+        auto inner = std::make_shared<RespArray>();
+        auto null = std::make_shared<RespBulkString>("");
+        null->set_null(true);
+        inner->append(std::make_shared<RespInteger>(1));
+        inner->append(null);
+        RespArray outer;
+        outer.append(inner);
+        outer.append(std::make_shared<RespBulkString>("hello"));
+
+        std::string out;
+        outer.serialize_to(out);
+        TEST(out == "*2\r\n*2\r\n:1\r\n$-1\r\n$5\r\nhello\r\n",
+            "Nested arrays should be serialized in place");
+    }
+    {
+        std::string out;
+        RespBulkString::encode_to(out, std::string_view("a\0b", 3));
+        TEST(out == std::string("$3\r\na\0b\r\n", 9), "Binary values should be encoded whole");
+
+        std::string stored("val\0e", 5);
+        RespBulkStringRef ref(stored);
+        TEST(ref.to_string() == stored, "A bulk string reference should give its data back");
+        TEST(ref.serialize() == std::string("$5\r\nval\0e\r\n", 11),
+            "A bulk string reference should be serialized as a bulk string");
+    }
+    {
+        TEST(RespReplies::ok()->serialize() == "+OK\r\n", "OK should be preencoded");
+        TEST(RespReplies::null()->serialize() == "$-1\r\n", "Null should be preencoded");
+        TEST(RespReplies::null()->to_string() == "nil", "Null should still be a null bulk string");
+        TEST(RespReplies::integer(0)->serialize() == ":0\r\n", "0 should be preencoded");
+        TEST(RespReplies::integer(1)->serialize() == ":1\r\n", "1 should be preencoded");
+        TEST(nullptr == RespReplies::integer(2), "2 should not be preencoded");
+        TEST(RespReplies::invalid_command()->serialize() == "-Invalid command\r\n",
+            "Invalid command should be preencoded");
+
+        auto one = RespReplies::integer(1);
+        TEST(RESP_INTEGER == one->get_type() &&
+            1 == static_cast<RespInteger*>(one.get())->m_value,
+            "A preencoded integer should be read like any other");
+        TEST(0 == one.use_count(), "A preencoded reply should not be reference counted");
+    }
+    {
+        std::string out;
+        out.reserve(256);
+        RespInteger integer(123456);
+        size_t before = num_allocations;
+        for (int i = 0; i < 4; i++)
+        {
+            out.clear();
+            RespReplies::ok()->serialize_to(out);
+            RespReplies::null()->serialize_to(out);
+            RespReplies::integer(0)->serialize_to(out);
+            RespReplies::integer(1)->serialize_to(out);
+            RespReplies::invalid_command()->serialize_to(out);
+            integer.serialize_to(out);
+        }
+        TEST(before == num_allocations, "Common replies should be serialized without allocating");
+        TEST(out == "+OK\r\n$-1\r\n:0\r\n:1\r\n-Invalid command\r\n:123456\r\n",
+            "Common replies should be serialized correctly");
+    }
+}
+
+void test_limits()
+{
+    std::cout << std::endl << "Tests to validate the limits on requests" << std::endl;
+    {
+        std::string nested;
+        for (int i = 0; i < 33; i++)
+            nested += "*1\r\n";
+        nested += "$1\r\nx\r\n";
+
+        RespParser t1(nested);
+        auto [err, obj] = t1.get_generic_object();
+        TEST(ERROR_NESTING_TOO_DEEP == err, "Arrays nested too deep should be rejected");
+
+        RespParser t2(nested.substr(4));
+        auto [err2, obj2] = t2.get_generic_object();
+        TEST(ERROR_SUCCESS == err2, "Arrays nested up to the limit should be parsed");
+
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        TEST(ERROR_INVALID_TYPE == parser.parse_command(nested.data(), nested.length(), argv),
+            "The stream parser should reject nested arrays before their depth matters");
+    }
+    {
+        std::string nested;
+        for (int i = 0; i < 10000; i++)
+            nested += "*2\r\n$1\r\na\r\n";
+        nested += "$1\r\nx\r\n";
+
+        RespLimits limits;
+        limits.m_max_depth = 0;
+        RespParser t1(nested, limits);
+        auto [err, obj] = t1.get_generic_object();
+        TEST(ERROR_SUCCESS == err && nested.length() == t1.get_parsed_length(),
+            "Deep nesting without a limit should be parsed without recursion");
+    }
+    {
+        std::vector<std::string_view> argv;
+        std::string header = "*2000000\r\n";
+        RespStreamParser parser;
+        TEST(ERROR_TOO_MANY_ARGUMENTS == parser.parse_command(header.data(), header.length(), argv),
+            "Too many arguments should be rejected before they arrive");
+
+        RespParser t1(header);
+        auto [err, obj] = t1.get_generic_object();
+        TEST(ERROR_TOO_MANY_ARGUMENTS == err, "RespParser should reject too many arguments");
+    }
+    {
+        std::vector<std::string_view> argv;
+        std::string header = "*3\r\n$3\r\nset\r\n$1\r\nx\r\n$600000000\r\n";
+        RespStreamParser parser;
+        TEST(ERROR_BULK_TOO_LONG == parser.parse_command(header.data(), header.length(), argv),
+            "A bulk string that is too long should be rejected before it arrives");
+
+        RespParser t1(header);
+        auto [err, obj] = t1.get_generic_object();
+        TEST(ERROR_BULK_TOO_LONG == err, "RespParser should reject a bulk string that is too long");
+    }
+    {
+        RespLimits limits;
+        limits.m_max_request_size = 32;
+        std::vector<std::string_view> argv;
+        std::string small = "*2\r\n$3\r\nget\r\n$3\r\nabc\r\n";
+        std::string large = "*3\r\n$3\r\nset\r\n$1\r\nx\r\n$10\r\n";
+
+        RespStreamParser parser;
+        parser.set_limits(limits);
+        TEST(ERROR_SUCCESS == parser.parse_command(small.data(), small.length(), argv),
+            "A request under the size limit should be parsed");
+        parser.reset();
+        TEST(ERROR_REQUEST_TOO_LARGE == parser.parse_command(large.data(), large.length(), argv),
+            "A request over the size limit should be rejected before its data arrives");
+
+        RespParser t1(large, limits);
+        auto [err, obj] = t1.get_generic_object();
+        TEST(ERROR_REQUEST_TOO_LARGE == err, "RespParser should reject a request over the size limit");
+    }
+    {
+        TEST(nullptr != RespLimits::error_message(ERROR_BULK_TOO_LONG) &&
+            nullptr == RespLimits::error_message(ERROR_INVALID_TYPE),
+            "Only the limits should have their own error message");
+    }
+}
+
+void test_streaming()
+{
+    std::cout << std::endl << "Tests to validate streaming large arguments" << std::endl;
+    {
+        std::string value(1000, 'v');
+        std::string command = "*3\r\n$3\r\nset\r\n$3\r\nkey\r\n$1000\r\n" + value + "\r\n";
+        std::string next = "*2\r\n$3\r\nget\r\n$3\r\nkey\r\n";
+        std::string input;
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        parser.m_stream_threshold = 100;
+        bool complete_early = false;
+        size_t max_input = 0;
+
+        // The input is discarded after every fragment, as the servers
+        // do. The value must not accumulate in it.
+        for (size_t i = 0; i + 1 < command.length(); i += 7)
+        {
+            input.append(command, i, std::min<size_t>(7, command.length() - 1 - i));
+            max_input = std::max(max_input, input.length());
+            if (ERROR_CURRENT_BEYOND_END != parser.parse_command(input.data(), input.length(), argv))
+                complete_early = true;
+            size_t parsed = parser.parsed_length();
+            input.erase(0, parsed);
+            parser.discard(parsed);
+        }
+        TEST(!complete_early, "A streamed command should not complete early");
+        TEST(parser.is_streaming() && max_input < 100, "The value should not be kept in the input");
+
+        input += command.back();
+        input += next;
+        auto err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err && 3 == argv.size() && "set" == argv[0] && "key" == argv[1] &&
+            value == argv[2], "The streamed command should have the right arguments");
+        TEST(nullptr != parser.streamed_value() && value == *parser.streamed_value(),
+            "The streamed value should hold the bytes of the argument");
+        TEST(argv[2].data() == parser.streamed_value()->data(),
+            "The argument should point into the streamed value");
+
+        err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_SUCCESS == err && 2 == argv.size() && "key" == argv[1],
+            "A pipelined command should follow the streamed one");
+        TEST(nullptr == parser.streamed_value(), "The streamed value should be freed by the next command");
+    }
+    {
+        std::string header = "*3\r\n$3\r\nset\r\n$1\r\nk\r\n$200\r\n";
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        parser.m_stream_threshold = 100;
+
+        auto err = parser.parse_command(header.data(), header.length(), argv);
+        TEST(ERROR_CURRENT_BEYOND_END == err && parser.is_streaming(),
+            "A large last argument should be streamed");
+        TEST(nullptr == std::get<0>(parser.stream_window(header.length() + 1)),
+            "There should be no window while input is left to parse");
+
+        auto [window, size] = parser.stream_window(header.length());
+        TEST(nullptr != window && 100 == size, "The first window should be as large as the threshold");
+        memset(window, 'w', 60);
+        parser.commit_streamed(60);
+        auto [window2, size2] = parser.stream_window(header.length());
+        TEST(window2 == window + 60 && 40 == size2, "The window should move past committed bytes");
+
+        // The window grows as it fills up, and ends with the CRLF
+        size_t total = 60;
+        while (true)
+        {
+            auto [w, n] = parser.stream_window(header.length());
+            if (!w)
+                break;
+            TEST(total + n <= 202, "A window should not go past the value and its CRLF");
+            for (size_t k = 0; k < n; k++, total++)
+                w[k] = (total < 200) ? 'w' : "\r\n"[total - 200];
+            parser.commit_streamed(n);
+        }
+        TEST(202 == total, "There should be no window once the value is complete");
+        TEST(202 == parser.m_streamed.capacity(), "The value should end up in an allocation of its size");
+
+        err = parser.parse_command(header.data(), header.length(), argv);
+        TEST(ERROR_SUCCESS == err && 3 == argv.size() && std::string(200, 'w') == argv[2],
+            "A value written to the window should complete the command");
+    }
+    {
+        std::string header = "*3\r\n$3\r\nset\r\n$1\r\nk\r\n$500000000\r\n";
+        std::string data(1000, 'd');
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        parser.m_stream_threshold = 100;
+
+        auto err = parser.parse_command(header.data(), header.length(), argv);
+        TEST(ERROR_CURRENT_BEYOND_END == err && parser.is_streaming() && parser.m_streamed.capacity() < 100,
+            "A header alone should not allocate the announced length");
+
+        std::string input = header + data;
+        err = parser.parse_command(input.data(), input.length(), argv);
+        TEST(ERROR_CURRENT_BEYOND_END == err && 1000 == parser.m_streamed_length &&
+            parser.m_streamed.capacity() < 2 * 1000 + 100,
+            "The value should only grow with the data received");
+    }
+    {
+        std::string command = "*3\r\n$3\r\nset\r\n$1\r\nk\r\n$200\r\n" + std::string(202, 'x');
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        parser.m_stream_threshold = 100;
+
+        auto err = parser.parse_command(command.data(), command.length(), argv);
+        TEST(ERROR_CRLF_MISSING == err, "A streamed value without its CRLF should be rejected");
+    }
+    {
+        std::string command = "*3\r\n$3\r\nset\r\n$200\r\n" + std::string(200, 'x') + "\r\n$1\r\nv\r\n";
+        std::vector<std::string_view> argv;
+        RespStreamParser parser;
+        parser.m_stream_threshold = 100;
+
+        auto err = parser.parse_command(command.data(), command.length(), argv);
+        TEST(ERROR_SUCCESS == err && nullptr == parser.streamed_value() && std::string(200, 'x') == argv[1],
+            "Only the last argument should be streamed");
+    }
+}
+
 int main(int argc, char** argv)
 {
     basic_tests();
@@ -280,6 +726,11 @@ int main(int argc, char** argv)
     test_bulk_string_serialization();
     test_error();
     test_array_serialization();
+    test_pipelined();
+    test_command_parser();
+    test_direct_serialization();
+    test_limits();
+    test_streaming();
 
     std::cout << std::endl << "All tests passed" << std::endl;
 }
\ No newline at end of file
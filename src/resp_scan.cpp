@@ -0,0 +1,224 @@
+#include "resp_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESP_SCAN_X86 1
+#endif
+
+/**
+ * @brief the scalar kernel, also used for the bytes after the last
+ * full vector
+ * 
+ * @param begin start of the range
+ * @param end end of the range
+ * @return const char* the first CR or LF, end if there is none
+ */
+static const char* find_line_break_scalar(const char* begin, const char* end)
+{
+    for (; begin < end; begin++)
+    {
+        if ('\r' == *begin || '\n' == *begin)
+            return begin;
+    }
+    return end;
+}
+
+#if defined(RESP_SCAN_X86) && defined(__SSE2__)
+/**
+ * @brief the SSE2 kernel, 16 bytes at a time
+ * 
+ * @param begin start of the range
+ * @param end end of the range
+ * @return const char* the first CR or LF, end if there is none
+ */
+static const char* find_line_break_sse2(const char* begin, const char* end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    for (; end - begin >= 16; begin += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)begin);
+        int mask = _mm_movemask_epi8(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_line_break_scalar(begin, end);
+}
+#endif
+
+#if defined(RESP_SCAN_X86)
+/**
+ * @brief the AVX2 kernel, 64 bytes per iteration in two vectors so
+ * that the loads of the second overlap the compares of the first
+ * 
+ * @param begin start of the range
+ * @param end end of the range
+ * @return const char* the first CR or LF, end if there is none
+ */
+__attribute__((target("avx2")))
+static const char* find_line_break_avx2(const char* begin, const char* end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    for (; end - begin >= 64; begin += 64)
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)begin);
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(begin + 32));
+        __m256i m0 = _mm256_or_si256(
+                        _mm256_cmpeq_epi8(v0, cr), _mm256_cmpeq_epi8(v0, lf));
+        __m256i m1 = _mm256_or_si256(
+                        _mm256_cmpeq_epi8(v1, cr), _mm256_cmpeq_epi8(v1, lf));
+        if (_mm256_testz_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m0, m1)))
+            continue;
+
+        uint32_t mask0 = (uint32_t)_mm256_movemask_epi8(m0);
+        if (mask0)
+            return begin + __builtin_ctz(mask0);
+        return begin + 32 + __builtin_ctz((uint32_t)_mm256_movemask_epi8(m1));
+    }
+
+    for (; end - begin >= 32; begin += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)begin);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                        _mm256_or_si256(
+                            _mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_line_break_scalar(begin, end);
+}
+#endif
+
+/**
+ * @brief the function of every kernel, nullptr if the build does
+ * not have it
+ * 
+ */
+static const char* (* const kernels[RESP_SCAN_NUM_KERNELS])(const char*, const char*) = {
+    find_line_break_scalar,
+#if defined(RESP_SCAN_X86) && defined(__SSE2__)
+    find_line_break_sse2,
+#else
+    nullptr,
+#endif
+#if defined(RESP_SCAN_X86)
+    find_line_break_avx2,
+#else
+    nullptr,
+#endif
+};
+
+resp_scan_kernel_t RespScanner::m_kernel = RESP_SCAN_SCALAR;
+
+const char* (*RespScanner::m_find_line_break)(const char*, const char*) =
+    find_line_break_scalar;
+
+/**
+ * @brief the best kernel is picked when the program starts, the
+ * scalar one is used until then
+ * 
+ */
+static bool is_kernel_picked = RespScanner::set_kernel(RespScanner::best_kernel());
+
+const char* RespScanner::find_line_break(
+    resp_scan_kernel_t                  kernel,
+    const char*                         begin,
+    const char*                         end)
+{
+    return kernels[kernel](begin, end);
+}
+
+resp_parse_error_t RespScanner::parse_decimal(
+    const char*                         begin,
+    const char*                         end,
+    long&                               value,
+    const char*&                        next)
+{
+    const char* current = begin;
+    bool negative = false;
+
+    if (current < end && '-' == *current)
+    {
+        negative = true;
+        current++;
+    }
+
+    // At most 18 digits, so that the number cannot overflow. One
+    // more byte is looked at, to see where the number ends.
+    const char* digits = current;
+    const char* limit = std::min(end, digits + 19);
+    long number = 0;
+    for (; current < limit; current++)
+    {
+        unsigned digit = (unsigned char)*current - '0';
+        if (digit > 9)
+            break;
+        number = number * 10 + digit;
+    }
+
+    if (current - digits > 18)
+        return ERROR_INVALID_NUMBER;
+    if (current == end)
+        return ERROR_CURRENT_BEYOND_END;
+    if (current == digits)
+        return ERROR_INVALID_NUMBER;
+
+    value = negative ? -number : number;
+    next = current;
+    return ERROR_SUCCESS;
+}
+
+bool RespScanner::is_supported(resp_scan_kernel_t kernel)
+{
+    if (kernel < 0 || kernel >= RESP_SCAN_NUM_KERNELS || !kernels[kernel])
+        return false;
+
+#if defined(RESP_SCAN_X86)
+    if (RESP_SCAN_AVX2 == kernel)
+    {
+        // This may run before main(), from a static initializer
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return true;
+}
+
+resp_scan_kernel_t RespScanner::best_kernel()
+{
+    for (int kernel = RESP_SCAN_NUM_KERNELS - 1; kernel > RESP_SCAN_SCALAR; kernel--)
+    {
+        if (is_supported((resp_scan_kernel_t)kernel))
+            return (resp_scan_kernel_t)kernel;
+    }
+    return RESP_SCAN_SCALAR;
+}
+
+bool RespScanner::set_kernel(resp_scan_kernel_t kernel)
+{
+    if (!is_supported(kernel))
+        return false;
+
+    m_kernel = kernel;
+    m_find_line_break = kernels[kernel];
+    return true;
+}
+
+const char* RespScanner::kernel_name(resp_scan_kernel_t kernel)
+{
+    switch (kernel)
+    {
+        case RESP_SCAN_SCALAR:
+            return "scalar";
+        case RESP_SCAN_SSE2:
+            return "sse2";
+        case RESP_SCAN_AVX2:
+            return "avx2";
+        default:
+            return "invalid";
+    }
+}
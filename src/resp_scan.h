@@ -0,0 +1,149 @@
+#ifndef RESP_SCAN_H_
+#define RESP_SCAN_H_
+
+#include "common_include.h"
+#include "resp_parser.h"
+
+/**
+ * @brief The implementations of the scanning kernels
+ * 
+ */
+typedef enum {
+    /**
+     * @brief one byte at a time, available everywhere
+     * 
+     */
+    RESP_SCAN_SCALAR = 0,
+
+    /**
+     * @brief 16 bytes at a time
+     * 
+     */
+    RESP_SCAN_SSE2,
+
+    /**
+     * @brief 32 bytes at a time, if the CPU has AVX2
+     * 
+     */
+    RESP_SCAN_AVX2,
+
+    RESP_SCAN_NUM_KERNELS
+} resp_scan_kernel_t;
+
+/**
+ * @brief The scanning primitives of the RESP parsers.
+ * 
+ * The search for CR and LF in the data of a bulk string is done
+ * with vector instructions. The best kernel the CPU supports is
+ * picked when the program starts, with a scalar fallback on CPUs
+ * and compilers without them. The numbers in the headers are parsed
+ * with a bounded parser that never reads past the end of the input,
+ * unlike strtol.
+ * 
+ */
+class RespScanner
+{
+public:
+    /**
+     * @brief find the first CR or LF in a range of bytes
+     * 
+     * @param begin start of the range
+     * @param end end of the range
+     * @return const char* the first CR or LF, end if there is none
+     */
+    static const char* find_line_break(const char* begin, const char* end)
+    {
+        return m_find_line_break(begin, end);
+    }
+
+    /**
+     * @brief find the first CR or LF in a range of bytes with a
+     * given kernel
+     * 
+     * @param kernel the kernel, it must be supported
+     * @param begin start of the range
+     * @param end end of the range
+     * @return const char* the first CR or LF, end if there is none
+     */
+    static const char* find_line_break(
+        resp_scan_kernel_t                  kernel,
+        const char*                         begin,
+        const char*                         end);
+
+    /**
+     * @brief parse the decimal number at the start of a range, an
+     * optional minus sign followed by at most 18 digits
+     * 
+     * @param begin start of the range
+     * @param end end of the range
+     * @param value receives the number
+     * @param next receives the first byte after the number
+     * @return resp_parse_error_t ERROR_SUCCESS,
+     * ERROR_CURRENT_BEYOND_END if the range ends in the number, or
+     * ERROR_INVALID_NUMBER if there is no number or it is too long
+     */
+    static resp_parse_error_t parse_decimal(
+        const char*                         begin,
+        const char*                         end,
+        long&                               value,
+        const char*&                        next);
+
+    /**
+     * @brief whether the CPU and the build support a kernel
+     * 
+     * @param kernel the kernel
+     * @return true if it can be used
+     */
+    static bool is_supported(resp_scan_kernel_t kernel);
+
+    /**
+     * @brief the fastest kernel that is supported
+     * 
+     * @return resp_scan_kernel_t the kernel
+     */
+    static resp_scan_kernel_t best_kernel();
+
+    /**
+     * @brief the kernel that find_line_break() uses
+     * 
+     * @return resp_scan_kernel_t the kernel
+     */
+    static resp_scan_kernel_t get_kernel()
+    {
+        return m_kernel;
+    }
+
+    /**
+     * @brief change the kernel that find_line_break() uses, for
+     * tests and benchmarks. It must not be called while another
+     * thread is parsing.
+     * 
+     * @param kernel the kernel
+     * @return true on success
+     * @return false if the kernel is not supported
+     */
+    static bool set_kernel(resp_scan_kernel_t kernel);
+
+    /**
+     * @brief the name of a kernel
+     * 
+     * @param kernel the kernel
+     * @return const char* its name
+     */
+    static const char* kernel_name(resp_scan_kernel_t kernel);
+
+private:
+    /**
+     * @brief the kernel in use
+     * 
+     */
+    static resp_scan_kernel_t                   m_kernel;
+
+    /**
+     * @brief the function of the kernel in use
+     * 
+     */
+    static const char* (*m_find_line_break)(const char*, const char*);
+};
+
+#endif /* #ifndef RESP_SCAN_H_ */
@@ -0,0 +1,140 @@
+#include "resp_scan.h"
+#include <cstdlib>
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+void test_find_line_break()
+{
+    std::cout << std::endl << "Tests to validate the CR/LF search" << std::endl;
+    TEST(RespScanner::is_supported(RESP_SCAN_SCALAR), "The scalar kernel should always be supported");
+    TEST(RespScanner::is_supported(RespScanner::get_kernel()), "The kernel in use should be supported");
+    TEST(!RespScanner::is_supported(RESP_SCAN_NUM_KERNELS), "An unknown kernel should not be supported");
+
+    for (int k = 0; k < RESP_SCAN_NUM_KERNELS; k++)
+    {
+        auto kernel = (resp_scan_kernel_t)k;
+        if (!RespScanner::is_supported(kernel))
+        {
+            std::cout << "SKIPPED: " << RespScanner::kernel_name(kernel) << " is not supported" << std::endl;
+            continue;
+        }
+
+        // Every length, start alignment and position of the break,
+        // around the vector sizes
+        std::string buffer(300, 'x');
+        bool is_correct = true;
+        for (size_t start = 0; start < 64 && is_correct; start++)
+        {
+            for (size_t length = 0; start + length <= 200 && is_correct; length++)
+            {
+                const char* begin = buffer.data() + start;
+                const char* end = begin + length;
+                if (RespScanner::find_line_break(kernel, begin, end) != end)
+                    is_correct = false;
+
+                for (size_t at = 0; at < length && is_correct; at++)
+                {
+                    buffer[start + at] = (at & 1) ? '\n' : '\r';
+                    if (RespScanner::find_line_break(kernel, begin, end) != begin + at)
+                        is_correct = false;
+                    buffer[start + at] = 'x';
+                }
+            }
+        }
+        TEST(is_correct, std::string(RespScanner::kernel_name(kernel)) + " should find the first CR or LF");
+
+        buffer = std::string(300, 'x');
+        buffer[100] = '\n';
+        buffer[150] = '\r';
+        const char* begin = buffer.data();
+        TEST(RespScanner::find_line_break(kernel, begin, begin + 300) == begin + 100,
+            std::string(RespScanner::kernel_name(kernel)) + " should stop at the first break");
+        TEST(RespScanner::find_line_break(kernel, begin, begin + 100) == begin + 100,
+            std::string(RespScanner::kernel_name(kernel)) + " should not look past the end");
+
+        buffer = std::string(300, '\r' + 128);
+        begin = buffer.data();
+        TEST(RespScanner::find_line_break(kernel, begin, begin + 300) == begin + 300,
+            std::string(RespScanner::kernel_name(kernel)) + " should not match bytes with the high bit set");
+    }
+
+    auto initial = RespScanner::get_kernel();
+    TEST(RespScanner::set_kernel(RESP_SCAN_SCALAR) && RESP_SCAN_SCALAR == RespScanner::get_kernel(),
+        "The kernel should be changed");
+    std::string input = "abc\r\n";
+    TEST(RespScanner::find_line_break(input.data(), input.data() + input.length()) == input.data() + 3,
+        "The kernel in use should find the break");
+    TEST(!RespScanner::set_kernel(RESP_SCAN_NUM_KERNELS), "An unknown kernel should be refused");
+    RespScanner::set_kernel(initial);
+}
+
+void test_parse_decimal()
+{
+    std::cout << std::endl << "Tests to validate the decimal parser" << std::endl;
+    long value = 0;
+    const char* next = nullptr;
+    {
+        std::string input = "1234\r\n";
+        auto err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_SUCCESS == err && 1234 == value, "A number should be parsed");
+        TEST(next == input.data() + 4, "The number should end at the CR");
+    }
+    {
+        std::string input = "-1\r\n";
+        auto err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_SUCCESS == err && -1 == value, "A negative number should be parsed");
+    }
+    {
+        std::string input = "123456789012345678\r\n";
+        auto err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_SUCCESS == err && 123456789012345678L == value, "18 digits should be parsed");
+    }
+    {
+        std::string input = "1234567890123456789\r\n";
+        auto err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_INVALID_NUMBER == err, "19 digits should fail");
+        err = RespScanner::parse_decimal(input.data(), input.data() + 19, value, next);
+        TEST(ERROR_INVALID_NUMBER == err, "19 digits should fail before the end of the line");
+    }
+    {
+        std::string input = "12";
+        auto err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_CURRENT_BEYOND_END == err, "A number at the end of the input may go on");
+        err = RespScanner::parse_decimal(input.data(), input.data() + 1, value, next);
+        TEST(ERROR_CURRENT_BEYOND_END == err, "The parser should not read past the end");
+        input = "-";
+        err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_CURRENT_BEYOND_END == err, "A minus sign at the end of the input may go on");
+        err = RespScanner::parse_decimal(input.data(), input.data(), value, next);
+        TEST(ERROR_CURRENT_BEYOND_END == err, "An empty input should need more input");
+    }
+    {
+        std::string input = "x1\r\n";
+        auto err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_INVALID_NUMBER == err, "A line without digits should fail");
+        input = "-\r\n";
+        err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_INVALID_NUMBER == err, "A minus sign alone should fail");
+        input = "12x\r\n";
+        err = RespScanner::parse_decimal(input.data(), input.data() + input.length(), value, next);
+        TEST(ERROR_SUCCESS == err && 'x' == *next, "The caller should see what follows the digits");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_find_line_break();
+    test_parse_decimal();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
@@ -3,9 +3,17 @@
 
 int main(int argc, char** argv)
 {
+    ServerConfig config;
+    if (!config.parse_command_line(argc, argv))
+        exit(1);
+
+    // A client that goes away while its responses are being written
+    // must only fail the write, not terminate the server
+    signal(SIGPIPE, SIG_IGN);
+
     std::cout << "Starting server ..." << std::endl;
 
-    Orchestrator orchestrator;
+    Orchestrator orchestrator(config);
     if (orchestrator.run_server())
     {
         std::cerr << "could not start server " << std::endl;
@@ -0,0 +1,303 @@
+#include "server_config.h"
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+
+/**
+ * @brief parse a non-negative integer option
+ * 
+ * @param value the string value of the option
+ * @param result receives the parsed number
+ * @return true on success
+ * @return false if the value is not a valid number
+ */
+static bool parse_number(const char* value, long& result)
+{
+    char* endptr = nullptr;
+    if (!value || !*value)
+        return false;
+    errno = 0;
+    result = strtol(value, &endptr, 10);
+    return 0 == errno && endptr && 0 == *endptr && result >= 0;
+}
+
+/**
+ * @brief parse a size option, in bytes or with a k, m or g suffix
+ * 
+ * @param value the string value of the option
+ * @param result receives the size in bytes
+ * @return true on success
+ * @return false if the value is not a valid size
+ */
+static bool parse_size(const char* value, size_t& result)
+{
+    char* endptr = nullptr;
+    if (!value || !*value || '-' == *value)
+        return false;
+    errno = 0;
+    unsigned long long size = strtoull(value, &endptr, 10);
+    if (0 != errno || endptr == value)
+        return false;
+
+    int shift = 0;
+    if ('k' == *endptr || 'K' == *endptr)
+        shift = 10;
+    else if ('m' == *endptr || 'M' == *endptr)
+        shift = 20;
+    else if ('g' == *endptr || 'G' == *endptr)
+        shift = 30;
+    if (shift)
+        endptr++;
+    if (*endptr)
+        return false;
+
+    size <<= shift;
+
+    result = (size_t)size;
+    return true;
+}
+
+/**
+ * @brief parse file permissions, in octal
+ * 
+ * @param value the string value of the option
+ * @param result receives the permissions
+ * @return true on success
+ * @return false if the value is not valid permissions
+ */
+static bool parse_mode(const char* value, mode_t& result)
+{
+    char* endptr = nullptr;
+    if (!value || !*value)
+        return false;
+    errno = 0;
+    long mode = strtol(value, &endptr, 8);
+    if (0 != errno || !endptr || *endptr || mode < 0 || mode > 0777)
+        return false;
+
+    result = (mode_t)mode;
+    return true;
+}
+
+/**
+ * @brief print the supported command line options
+ * 
+ * @param progname name of the executable
+ */
+void ServerConfig::print_usage(const char* progname)
+{
+    std::cerr << "Usage: " << progname << " [options]" << std::endl;
+    std::cerr << "  --mode pipeline|reactor   threading model "\
+        "(default pipeline)" << std::endl;
+    std::cerr << "  --reactors N              reactors in reactor mode, "\
+        "0 for one per core (default 0)" << std::endl;
+    std::cerr << "  --backend epoll|io_uring  network backend in pipeline "\
+        "mode (default epoll)" << std::endl;
+    std::cerr << "  --execution staged|run-to-completion" << std::endl;
+    std::cerr << "                            how the pipeline runs requests "\
+        "(default staged)" << std::endl;
+    std::cerr << "  --port N                  TCP port to listen on "\
+        "(default 6379)" << std::endl;
+    std::cerr << "  --bind ADDRESS            IPv4 address to listen on "\
+        "(default 0.0.0.0)" << std::endl;
+    std::cerr << "  --backlog N               length of the queue of pending "\
+        "connections (default " << SOMAXCONN << ")" << std::endl;
+    std::cerr << "  --acceptors N             accepting threads in pipeline "\
+        "mode (default 1)" << std::endl;
+    std::cerr << "  --unixsocket PATH         also listen on a Unix domain "\
+        "socket (default none)" << std::endl;
+    std::cerr << "  --unixsocketperm MODE     octal permissions of the Unix "\
+        "domain socket (default from umask)" << std::endl;
+    std::cerr << "  --timeout N               disconnect a client idle for "\
+        "N seconds, 0 for never (default 0)" << std::endl;
+    std::cerr << "  --request-timeout N       disconnect a client stalled in "\
+        "a command for N seconds, 0 for never (default 30)" << std::endl;
+    std::cerr << "  --maxclients N            clients connected at the same "\
+        "time, 0 for no limit (default 10000)" << std::endl;
+    std::cerr << "  --max-inflight N          connections with commands queued "\
+        "in pipeline mode, 0 for no limit (default 0)" << std::endl;
+    std::cerr << "  --shards N                data store shards, a power of "\
+        "two (default " << DEFAULT_NUM_SHARDS << ")" << std::endl;
+    std::cerr << "  --output-hard-limit SIZE  disconnect a client with more "\
+        "unsent data, 0 for no limit (default 256m)" << std::endl;
+    std::cerr << "  --output-soft-limit SIZE  disconnect a client with more "\
+        "unsent data for too long (default 64m)" << std::endl;
+    std::cerr << "  --output-soft-seconds N   how long the soft limit may "\
+        "be exceeded (default 60)" << std::endl;
+    std::cerr << "  --max-nesting N           arrays nested in a request, "\
+        "0 for no limit (default 32)" << std::endl;
+    std::cerr << "  --max-arguments N         elements of an array, "\
+        "0 for no limit (default 1048576)" << std::endl;
+    std::cerr << "  --max-bulk-length SIZE    length of a bulk string, "\
+        "0 for no limit (default 512m)" << std::endl;
+    std::cerr << "  --max-request-size SIZE   length of a request, "\
+        "0 for no limit (default 1g)" << std::endl;
+}
+
+/**
+ * @brief fill in the configuration from the command line
+ * 
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @return true on success
+ * @return false if the arguments are invalid, the usage has
+ * been printed in that case
+ */
+bool ServerConfig::parse_command_line(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* option = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        long number = 0;
+
+        if (0 == strcmp(option, "--mode") && value)
+        {
+            if (0 == strcmp(value, "pipeline"))
+                m_mode = SERVER_MODE_PIPELINE;
+            else if (0 == strcmp(value, "reactor"))
+                m_mode = SERVER_MODE_REACTOR;
+            else
+            {
+                std::cerr << "Unknown mode '" << value << "'" << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+            i++;
+        }
+        else if (0 == strcmp(option, "--backend") && value)
+        {
+            if (0 == strcmp(value, "epoll"))
+                m_backend = NETWORK_BACKEND_EPOLL;
+            else if (0 == strcmp(value, "io_uring"))
+                m_backend = NETWORK_BACKEND_IO_URING;
+            else
+            {
+                std::cerr << "Unknown backend '" << value << "'" << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+            i++;
+        }
+        else if (0 == strcmp(option, "--execution") && value)
+        {
+            if (0 == strcmp(value, "staged"))
+                m_execution = EXECUTION_STAGED;
+            else if (0 == strcmp(value, "run-to-completion"))
+                m_execution = EXECUTION_RUN_TO_COMPLETION;
+            else
+            {
+                std::cerr << "Unknown execution mode '" << value << "'" << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+            i++;
+        }
+        else if (0 == strcmp(option, "--reactors") &&
+                 parse_number(value, number))
+        {
+            m_num_reactors = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--port") &&
+                 parse_number(value, number) && number > 0 && number < 65536)
+        {
+            m_port = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--bind") && value)
+        {
+            m_bind_address = value;
+            i++;
+        }
+        else if (0 == strcmp(option, "--backlog") &&
+                 parse_number(value, number) && number > 0 && number <= INT_MAX)
+        {
+            m_backlog = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--acceptors") &&
+                 parse_number(value, number) && number > 0 && number <= 64)
+        {
+            m_num_acceptors = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--unixsocket") && value && *value)
+        {
+            m_unix_socket = value;
+            i++;
+        }
+        else if (0 == strcmp(option, "--unixsocketperm") &&
+                 parse_mode(value, m_unix_socket_perm))
+            i++;
+        else if (0 == strcmp(option, "--timeout") &&
+                 parse_number(value, number) && number <= INT_MAX / 1000)
+        {
+            m_idle_timeout = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--request-timeout") &&
+                 parse_number(value, number) && number <= INT_MAX / 1000)
+        {
+            m_request_timeout = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--maxclients") &&
+                 parse_number(value, number) && number <= INT_MAX)
+        {
+            m_max_clients = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--max-inflight") &&
+                 parse_number(value, number) && number <= INT_MAX)
+        {
+            m_max_inflight = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--shards") &&
+                 parse_number(value, number) && number > 0 &&
+                 number <= MAX_NUM_SHARDS && 0 == (number & (number - 1)))
+        {
+            m_num_shards = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--output-hard-limit") &&
+                 parse_size(value, m_output_limits.m_hard_limit))
+            i++;
+        else if (0 == strcmp(option, "--output-soft-limit") &&
+                 parse_size(value, m_output_limits.m_soft_limit))
+            i++;
+        else if (0 == strcmp(option, "--output-soft-seconds") &&
+                 parse_number(value, number))
+        {
+            m_output_limits.m_soft_seconds = (int)number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--max-nesting") &&
+                 parse_number(value, number))
+        {
+            m_request_limits.m_max_depth = number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--max-arguments") &&
+                 parse_number(value, number))
+        {
+            m_request_limits.m_max_arguments = number;
+            i++;
+        }
+        else if (0 == strcmp(option, "--max-bulk-length") &&
+                 parse_size(value, m_request_limits.m_max_bulk_length))
+            i++;
+        else if (0 == strcmp(option, "--max-request-size") &&
+                 parse_size(value, m_request_limits.m_max_request_size))
+            i++;
+        else
+        {
+            std::cerr << "Invalid option '" << option << "'" << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
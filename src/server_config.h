@@ -0,0 +1,247 @@
+#ifndef SERVER_CONFIG_H_
+#define SERVER_CONFIG_H_
+
+#include "common_include.h"
+#include "output_buffer.h"
+#include "resp_parser.h"
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/**
+ * @brief The different ways in which the server can run
+ * 
+ */
+typedef enum
+{
+    /**
+     * @brief accept thread, epoll thread and worker pools that
+     * read, parse and write in separate stages
+     * 
+     */
+    SERVER_MODE_PIPELINE,
+
+    /**
+     * @brief one shared-nothing reactor per core, every reactor
+     * has its own listener, its own epoll loop and owns a slice
+     * of the data stores
+     * 
+     */
+    SERVER_MODE_REACTOR
+} server_mode_t;
+
+/**
+ * @brief The network backend used by the pipeline
+ * 
+ */
+typedef enum
+{
+    /**
+     * @brief accept thread, epoll thread, read jobs and write jobs
+     * 
+     */
+    NETWORK_BACKEND_EPOLL,
+
+    /**
+     * @brief a single thread that drives an io_uring, falls back to
+     * epoll if the kernel does not support it
+     * 
+     */
+    NETWORK_BACKEND_IO_URING
+} network_backend_t;
+
+/**
+ * @brief How the pipeline hands a request from one stage to the next
+ * 
+ */
+typedef enum
+{
+    /**
+     * @brief the read, the commands and the write run as separate
+     * jobs in separate thread pools
+     * 
+     */
+    EXECUTION_STAGED,
+
+    /**
+     * @brief one job reads, runs the commands and writes the
+     * responses on the same thread. Only slow commands are handed
+     * over to the parse and write pools.
+     * 
+     */
+    EXECUTION_RUN_TO_COMPLETION
+} execution_mode_t;
+
+/**
+ * @brief number of data store shards when it is not configured
+ * 
+ */
+#define DEFAULT_NUM_SHARDS 16
+
+/**
+ * @brief largest number of data store shards
+ * 
+ */
+#define MAX_NUM_SHARDS 65536
+
+/**
+ * @brief Configuration of the server, it is filled in from
+ * the command line
+ * 
+ */
+struct ServerConfig
+{
+    /**
+     * @brief the mode that the server runs in
+     * 
+     */
+    server_mode_t                   m_mode;
+
+    /**
+     * @brief number of reactors in reactor mode, 0 means one
+     * reactor per available core
+     * 
+     */
+    int                             m_num_reactors;
+
+    /**
+     * @brief the network backend of the pipeline mode
+     * 
+     */
+    network_backend_t               m_backend;
+
+    /**
+     * @brief how the pipeline runs the requests with the epoll
+     * backend
+     * 
+     */
+    execution_mode_t                m_execution;
+
+    /**
+     * @brief limits on the responses waiting to be written to a
+     * client, a client that exceeds them is disconnected
+     * 
+     */
+    OutputLimits                    m_output_limits;
+
+    /**
+     * @brief limits on the requests of a client, a client that
+     * exceeds them gets an error and is disconnected
+     * 
+     */
+    RespLimits                      m_request_limits;
+
+    /**
+     * @brief the TCP port to listen on
+     * 
+     */
+    int                             m_port;
+
+    /**
+     * @brief the IPv4 address to listen on
+     * 
+     */
+    std::string                     m_bind_address;
+
+    /**
+     * @brief length of the queue of connections that have not been
+     * accepted yet
+     * 
+     */
+    int                             m_backlog;
+
+    /**
+     * @brief number of accepting threads in pipeline mode with the
+     * epoll backend. Every one of them has its own listening socket
+     * on the same port.
+     * 
+     */
+    int                             m_num_acceptors;
+
+    /**
+     * @brief path of a Unix domain socket to listen on as well,
+     * for clients on the same host. Empty if there is none.
+     * 
+     */
+    std::string                     m_unix_socket;
+
+    /**
+     * @brief permissions given to the Unix domain socket, 0 leaves
+     * the ones the process umask gives it
+     * 
+     */
+    mode_t                          m_unix_socket_perm;
+
+    /**
+     * @brief seconds after which a client that has sent nothing is
+     * disconnected, 0 to keep idle clients forever
+     * 
+     */
+    int                             m_idle_timeout;
+
+    /**
+     * @brief seconds after which a client that stopped in the middle
+     * of a command is disconnected, 0 to wait forever
+     * 
+     */
+    int                             m_request_timeout;
+
+    /**
+     * @brief clients connected at the same time, beyond it new
+     * clients get an error and are disconnected. 0 for no limit.
+     * 
+     */
+    int                             m_max_clients;
+
+    /**
+     * @brief Pipeline mode: connections whose commands may be queued
+     * or running at the same time. Beyond it the commands are
+     * answered with an error instead of being queued. 0 for no limit.
+     * 
+     */
+    int                             m_max_inflight;
+
+    /**
+     * @brief number of data store shards, a power of two. In reactor
+     * mode it is raised to at least the number of reactors.
+     * 
+     */
+    int                             m_num_shards;
+
+    ServerConfig():
+        m_mode(SERVER_MODE_PIPELINE),
+        m_num_reactors(0),
+        m_backend(NETWORK_BACKEND_EPOLL),
+        m_execution(EXECUTION_STAGED),
+        m_port(6379),
+        m_bind_address("0.0.0.0"),
+        m_backlog(SOMAXCONN),
+        m_num_acceptors(1),
+        m_unix_socket_perm(0),
+        m_idle_timeout(0),
+        m_request_timeout(30),
+        m_max_clients(10000),
+        m_max_inflight(0),
+        m_num_shards(DEFAULT_NUM_SHARDS)
+    {
+    }
+
+    /**
+     * @brief fill in the configuration from the command line
+     * 
+     * @param argc number of arguments
+     * @param argv the arguments
+     * @return true on success
+     * @return false if the arguments are invalid, the usage has
+     * been printed in that case
+     */
+    bool parse_command_line(int argc, char** argv);
+
+    /**
+     * @brief print the supported command line options
+     * 
+     * @param progname name of the executable
+     */
+    static void print_usage(const char* progname);
+};
+
+#endif /* #ifndef SERVER_CONFIG_H_ */
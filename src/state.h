@@ -3,6 +3,10 @@
 
 #include "common_include.h"
 #include "resp_parser.h"
+#include "input_buffer.h"
+#include "output_buffer.h"
+#include "timer_wheel.h"
+#include "arena.h"
 #include <cstring>
 
 typedef enum
@@ -15,6 +19,7 @@ typedef enum
     STATE_WAITING_FOR_PARSING,
     STATE_PARSING,
     STATE_IN_WRITE_LOOP,
+    STATE_WAITING_FOR_WRITE,
     STATE_CLOSING
 } StateState;
 
@@ -26,37 +31,97 @@ typedef enum
  * worker queues. There must be a way to pass the state
  * through all the queues, and this class helps with that
  * 
- * An object of this class is also present in a map that
+ * An object of this class is also present in a table that
  * is available in the orchestrator object, and given an fd
  * it is always possible to lookup this structure.
  * 
  */
-struct State
+struct State: public std::enable_shared_from_this<State>
 {
     /**
-     * @brief at what stage is this socket now
+     * @brief at what stage is this socket now. The epoll thread
+     * reads it without taking m_mutex.
      * 
      */
-    StateState                              m_state;
+    std::atomic<StateState>                 m_state;
 
     /**
-     * @brief The data that was read from the socket
+     * @brief Pipeline mode: the generation of the fd in the
+     * connection table when this connection got it
      * 
      */
-    std::string                             m_read_data;
+    uint32_t                                m_generation;
 
     /**
-     * @brief parsed object from the data read from the
-     * socket. This is the command (and not the response).
+     * @brief when data was last read from the client, on the clock
+     * of TimerWheel::clock_ms()
      * 
      */
-    std::shared_ptr<AbstractRespObject>     m_object;
+    std::atomic<uint64_t>                   m_last_activity;
 
     /**
-     * @brief 
+     * @brief checks that the client has not been idle, or stalled in
+     * the middle of a command, for too long
      * 
      */
-    std::shared_ptr<AbstractRespObject>     m_response;
+    TimerEntry                              m_timer;
+
+    /**
+     * @brief the count of connected clients this connection is
+     * counted in, if any. It is decremented when the state goes away.
+     * 
+     */
+    std::atomic<uint64_t>*                  m_pclient_count;
+
+    /**
+     * @brief The data that was read from the socket and has not
+     * been parsed yet. Once the complete commands are parsed, only
+     * the incomplete command at the end, if any, is left here.
+     * m_parser remembers how much of it has been parsed already.
+     * 
+     */
+    InputBuffer                             m_input;
+
+    /**
+     * @brief parser for the commands in m_input. It keeps the
+     * position and the partially parsed command when a command
+     * has not been received completely.
+     * 
+     */
+    RespStreamParser                        m_parser;
+
+    /**
+     * @brief the command parsed last from m_input, as slices of
+     * m_input. The vector is reused from one command to the next,
+     * so that parsing a command allocates nothing.
+     * 
+     */
+    std::vector<std::string_view>           m_argv;
+
+    /**
+     * @brief the arena the responses are allocated from. It is
+     * released when the state is reset, once the responses have
+     * been written. It is declared before m_responses, so that it
+     * outlives them.
+     * 
+     */
+    Arena                                   m_arena;
+
+    /**
+     * @brief responses to the commands parsed from m_input,
+     * in the order in which the commands were received. They are
+     * written to the client together.
+     * 
+     */
+    std::vector<std::shared_ptr<AbstractRespObject> >   m_responses;
+
+    /**
+     * @brief the serialized responses that the socket has not
+     * accepted yet
+     * 
+     */
+    OutputBuffer                            m_output;
+
     int                                     m_socket;
     mutable std::mutex                      m_mutex;
 
@@ -72,31 +137,85 @@ struct State
      */
     char m_special_error[64];
 
+    /**
+     * @brief Reactor mode: number of responses still expected
+     * from other reactors for the current command
+     * 
+     */
+    int                                     m_outstanding_replies;
+
+    /**
+     * @brief Reactor mode: set when the command is a DEL whose keys
+     * are owned by several reactors. The counts returned by each
+     * of them are added up in m_reply_sum.
+     * 
+     */
+    bool                                    m_sum_replies;
+
+    /**
+     * @brief Reactor mode: sum of the counts returned so far
+     * 
+     */
+    int                                     m_reply_sum;
+
+    /**
+     * @brief Reactor mode: the socket is edge-triggered, this is set
+     * when it became readable and cleared once a read returns EAGAIN
+     * 
+     */
+    bool                                    m_is_readable;
+
+    /**
+     * @brief Reactor mode: the peer has closed its side, the
+     * connection is closed once the commands received before
+     * that have been answered
+     * 
+     */
+    bool                                    m_is_peer_closed;
+
     State(int fd)
     {
-        m_object = std::shared_ptr<AbstractRespObject>(nullptr);
-        m_response = std::shared_ptr<AbstractRespObject>(nullptr);
         m_state = STATE_INVALID;
+        m_generation = 0;
+        m_last_activity = TimerWheel::clock_ms();
+        m_pclient_count = nullptr;
         m_socket = fd;
         m_special_error[0] = 0;
         m_is_error = false;
+        m_outstanding_replies = 0;
+        m_sum_replies = false;
+        m_reply_sum = 0;
+        m_is_readable = false;
+        m_is_peer_closed = false;
+    }
+
+    ~State()
+    {
+        if (m_pclient_count)
+            m_pclient_count->fetch_sub(1, std::memory_order_relaxed);
     }
 
     /**
      * @brief Once a write has been completed, a new set of data
      * must be read.
      * This resets the state so that it can start again from a clean
-     * slate.
+     * slate. An incomplete command left in m_input is kept, the
+     * rest of it will come with the next read.
      * 
+     * @param state the state that the connection is left in
      */
-    void reset()
+    void reset(StateState state = STATE_INVALID)
     {
-        m_state = STATE_INVALID;
-        m_read_data = std::string("");
-        m_object = std::shared_ptr<AbstractRespObject>(nullptr);
-        m_response = std::shared_ptr<AbstractRespObject>(nullptr);
+        m_state = state;
+        m_input.shrink();
+        m_argv.clear();
+        m_responses.clear();
+        m_arena.release();
         m_is_error = false;
         m_special_error[0] = 0;
+        m_outstanding_replies = 0;
+        m_sum_replies = false;
+        m_reply_sum = 0;
         m_mutex.unlock();
     }
 
@@ -126,6 +245,49 @@ struct State
         m_is_error = true;
     }
 
+    /**
+     * @brief serialize the responses that are ready to be written,
+     * in order, directly into m_output. A special error, if set, is
+     * written last.
+     * 
+     */
+    void queue_responses()
+    {
+        std::string* pout = &m_output.begin_append();
+        for (auto& response: m_responses)
+        {
+            if (response)
+                response->serialize_to(*pout);
+            else
+                pout->append("-ERROR\r\n");
+
+            if (pout->length() >= OUTPUT_CHUNK_SIZE)
+            {
+                m_output.end_append();
+                pout = &m_output.begin_append();
+            }
+        }
+        m_responses.clear();
+
+        if (m_special_error[0])
+        {
+            pout->append(m_special_error);
+            m_special_error[0] = 0;
+        }
+        m_output.end_append();
+    }
+
+    /**
+     * @brief whether part of a request has been received, in the
+     * input or streamed by the parser
+     * 
+     * @return true if a request is being received
+     */
+    bool is_in_request() const
+    {
+        return !m_input.empty() || m_parser.is_streaming();
+    }
+
     /**
      * @brief Set the default special error object
      * This indicates that the error is unrecoverable and
@@ -0,0 +1,306 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include "common_include.h"
+#include "arena.h"
+#include <cstdint>
+#include <chrono>
+
+/**
+ * @brief Measures how many times per second something happens.
+ *
+ * Events are counted in the current second. When the first event
+ * of a new second arrives, the count of the second that just ended
+ * becomes the rate. Events that race with the change of second may
+ * be counted in the wrong one, which is good enough for a metric.
+ *
+ */
+struct RateMeter
+{
+    /**
+     * @brief the second that m_count is counting
+     *
+     */
+    std::atomic<uint64_t>       m_second;
+
+    /**
+     * @brief events in m_second
+     *
+     */
+    std::atomic<uint64_t>       m_count;
+
+    /**
+     * @brief events in the second before m_second
+     *
+     */
+    std::atomic<uint64_t>       m_last;
+
+    RateMeter():
+        m_second(0),
+        m_count(0),
+        m_last(0)
+    {
+    }
+
+    /**
+     * @brief the current second, on a clock that never goes back
+     *
+     * @return uint64_t seconds
+     */
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief count events
+     *
+     * @param n the number of events
+     */
+    void add(uint64_t n = 1)
+    {
+        uint64_t current = now();
+        uint64_t second = m_second.load(std::memory_order_relaxed);
+        if (current != second && m_second.compare_exchange_strong(second, current))
+        {
+            uint64_t count = m_count.exchange(0);
+            m_last.store((current == second + 1) ? count : 0);
+        }
+        m_count.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief events in the last complete second
+     *
+     * @return uint64_t the rate
+     */
+    uint64_t rate() const
+    {
+        uint64_t current = now();
+        uint64_t second = m_second.load(std::memory_order_relaxed);
+        if (current == second)
+            return m_last.load(std::memory_order_relaxed);
+        if (current == second + 1)
+            return m_count.load(std::memory_order_relaxed);
+        return 0;
+    }
+};
+
+/**
+ * @brief Counters describing the activity of the server.
+ *
+ * They are updated with relaxed atomics from every thread, and
+ * reported to clients by the INFO command.
+ *
+ */
+struct ServerStats
+{
+    /**
+     * @brief number of commands that were executed
+     *
+     */
+    std::atomic<uint64_t>       m_commands_processed;
+
+    /**
+     * @brief number of connections that were accepted
+     *
+     */
+    std::atomic<uint64_t>       m_connections_accepted;
+
+    /**
+     * @brief number of clients connected right now
+     *
+     */
+    std::atomic<uint64_t>       m_connected_clients;
+
+    /**
+     * @brief connections that were closed as soon as they were
+     * accepted, because of the limit on connected clients
+     *
+     */
+    std::atomic<uint64_t>       m_rejected_connections;
+
+    /**
+     * @brief commands that were answered with an error instead of
+     * being run, because the server was overloaded
+     *
+     */
+    std::atomic<uint64_t>       m_rejected_commands;
+
+    /**
+     * @brief connections accepted per second
+     *
+     */
+    RateMeter                   m_accept_rate;
+
+    /**
+     * @brief number of the accepted connections that came through
+     * the Unix domain socket
+     *
+     */
+    std::atomic<uint64_t>       m_unix_connections_accepted;
+
+    /**
+     * @brief connections accepted per second on the Unix domain
+     * socket
+     *
+     */
+    RateMeter                   m_unix_accept_rate;
+
+    /**
+     * @brief calls to accept() or accept4()
+     *
+     */
+    std::atomic<uint64_t>       m_syscalls_accept;
+
+    /**
+     * @brief calls to read() on client sockets
+     *
+     */
+    std::atomic<uint64_t>       m_syscalls_read;
+
+    /**
+     * @brief calls to write() on client sockets
+     *
+     */
+    std::atomic<uint64_t>       m_syscalls_write;
+
+    /**
+     * @brief calls to epoll_wait()
+     *
+     */
+    std::atomic<uint64_t>       m_syscalls_epoll_wait;
+
+    /**
+     * @brief calls to epoll_ctl()
+     *
+     */
+    std::atomic<uint64_t>       m_syscalls_epoll_ctl;
+
+    /**
+     * @brief calls to io_uring_enter()
+     *
+     */
+    std::atomic<uint64_t>       m_syscalls_io_uring_enter;
+
+    /**
+     * @brief any other system call made on the request path,
+     * like fcntl() or reads and writes on an eventfd
+     *
+     */
+    std::atomic<uint64_t>       m_syscalls_other;
+
+    /**
+     * @brief clients disconnected because too many of their
+     * responses were waiting to be written
+     *
+     */
+    std::atomic<uint64_t>       m_output_limit_disconnects;
+
+    /**
+     * @brief clients disconnected because they sent nothing for
+     * too long
+     *
+     */
+    std::atomic<uint64_t>       m_idle_disconnects;
+
+    /**
+     * @brief clients disconnected because they stopped in the
+     * middle of a command for too long
+     *
+     */
+    std::atomic<uint64_t>       m_request_timeout_disconnects;
+
+    /**
+     * @brief counters of the arenas the responses are allocated from
+     *
+     */
+    ArenaStats                  m_arena;
+
+    ServerStats():
+        m_commands_processed(0),
+        m_connections_accepted(0),
+        m_connected_clients(0),
+        m_rejected_connections(0),
+        m_rejected_commands(0),
+        m_unix_connections_accepted(0),
+        m_syscalls_accept(0),
+        m_syscalls_read(0),
+        m_syscalls_write(0),
+        m_syscalls_epoll_wait(0),
+        m_syscalls_epoll_ctl(0),
+        m_syscalls_io_uring_enter(0),
+        m_syscalls_other(0),
+        m_output_limit_disconnects(0),
+        m_idle_disconnects(0),
+        m_request_timeout_disconnects(0)
+    {
+    }
+
+    /**
+     * @brief increment a counter
+     *
+     * @param counter the counter to increment
+     * @param n the amount to add
+     */
+    static void add(std::atomic<uint64_t>& counter, uint64_t n = 1)
+    {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief count accepted connections
+     *
+     * @param n the number of connections
+     * @param is_unix true if they came through the Unix domain
+     * socket, they are counted in the totals as well
+     */
+    void add_accepted(uint64_t n = 1, bool is_unix = false)
+    {
+        add(m_connections_accepted, n);
+        m_accept_rate.add(n);
+        if (is_unix)
+        {
+            add(m_unix_connections_accepted, n);
+            m_unix_accept_rate.add(n);
+        }
+    }
+
+    /**
+     * @brief format the counters the way INFO reports them, one
+     * "name:value" line per counter
+     *
+     * @return std::string the formatted counters
+     */
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << "# Stats\r\n";
+        ss << "total_commands_processed:" << m_commands_processed << "\r\n";
+        ss << "total_connections_received:" << m_connections_accepted << "\r\n";
+        ss << "instantaneous_accepts_per_sec:" << m_accept_rate.rate() << "\r\n";
+        ss << "total_unix_connections_received:" << m_unix_connections_accepted << "\r\n";
+        ss << "instantaneous_unix_accepts_per_sec:" << m_unix_accept_rate.rate() << "\r\n";
+        ss << "connected_clients:" << m_connected_clients << "\r\n";
+        ss << "rejected_connections:" << m_rejected_connections << "\r\n";
+        ss << "rejected_commands:" << m_rejected_commands << "\r\n";
+        ss << "syscalls_accept:" << m_syscalls_accept << "\r\n";
+        ss << "syscalls_read:" << m_syscalls_read << "\r\n";
+        ss << "syscalls_write:" << m_syscalls_write << "\r\n";
+        ss << "syscalls_epoll_wait:" << m_syscalls_epoll_wait << "\r\n";
+        ss << "syscalls_epoll_ctl:" << m_syscalls_epoll_ctl << "\r\n";
+        ss << "syscalls_io_uring_enter:" << m_syscalls_io_uring_enter << "\r\n";
+        ss << "syscalls_other:" << m_syscalls_other << "\r\n";
+        ss << "client_output_limit_disconnections:" << m_output_limit_disconnects << "\r\n";
+        ss << "client_idle_disconnections:" << m_idle_disconnects << "\r\n";
+        ss << "client_request_timeout_disconnections:" << m_request_timeout_disconnects << "\r\n";
+        ss << "arena_allocations:" << m_arena.m_allocations << "\r\n";
+        ss << "arena_bytes_allocated:" << m_arena.m_bytes << "\r\n";
+        ss << "arena_chunks_allocated:" << m_arena.m_chunks << "\r\n";
+        ss << "arena_releases:" << m_arena.m_releases << "\r\n";
+        return ss.str();
+    }
+};
+
+#endif /* #ifndef STATS_H_ */
@@ -59,6 +59,7 @@ void ThreadPool::process_job_unsafe(bool& lock_held)
         }
 
         p_job->run();
+        m_num_inflight--;
     }
 
     if (lock_held)
@@ -105,8 +106,15 @@ void ThreadPool::loop()
         }
         else
         {
-            // wait 100 milliseconds
-            struct timespec timout = {0, 100000000};
+            // wait 100 milliseconds, the timeout is an absolute time
+            struct timespec timout;
+            clock_gettime(CLOCK_REALTIME, &timout);
+            timout.tv_nsec += 100000000;
+            if (timout.tv_nsec >= 1000000000)
+            {
+                timout.tv_sec++;
+                timout.tv_nsec -= 1000000000;
+            }
 
             int rc = pthread_cond_timedwait(
                 &m_job_queue_cond,
@@ -147,7 +155,7 @@ out:
     }
 }
 
-int ThreadPool::add_job(std::shared_ptr<JobInterface> p_job)
+int ThreadPool::add_job(std::shared_ptr<JobInterface> p_job, bool is_limited)
 {
     bool    lock_held   = false;
     int     rc          = 0;
@@ -156,6 +164,15 @@ int ThreadPool::add_job(std::shared_ptr<JobInterface> p_job)
     if (!p_job)
         return 0;
 
+    // The slot is taken before the job is queued, a job that is
+    // done in the meantime only frees one
+    size_t inflight = m_num_inflight.load();
+    do
+    {
+        if (is_limited && m_max_inflight && inflight >= m_max_inflight)
+            return THREAD_POOL_SATURATED;
+    } while (!m_num_inflight.compare_exchange_weak(inflight, inflight + 1));
+
     if (0 != pthread_mutex_lock(&m_job_queue_mutex))
     {
         std::cerr << __FILE__ << ":" << __LINE__ << ": ";
@@ -178,9 +195,9 @@ int ThreadPool::add_job(std::shared_ptr<JobInterface> p_job)
     }
 
     if (0 == retval)
-    {
         pthread_cond_signal(&m_job_queue_cond);
-    }
+    else
+        m_num_inflight--;
 
     pthread_mutex_unlock(&m_job_queue_mutex);
 
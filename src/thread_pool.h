@@ -4,6 +4,14 @@
 #include "common_include.h"
 #include <pthread.h>
 
+/**
+ * @brief returned by ThreadPool::add_job() when a job that is limited
+ * was not added, because the pool already has m_max_inflight jobs
+ * queued or running
+ * 
+ */
+#define THREAD_POOL_SATURATED 2
+
 /**
  * @brief Jobs posted to the thread pool must
  * derive from this class
@@ -127,6 +135,20 @@ public:
      */
     std::atomic<std::uint64_t>                      m_job_sequence_number;
 
+    /**
+     * @brief number of jobs that are queued or running
+     * 
+     */
+    std::atomic<size_t>                             m_num_inflight;
+
+    /**
+     * @brief the pool is saturated once this many jobs are queued or
+     * running, add_job() refuses the jobs that are limited until one
+     * of them is done. 0 for no limit.
+     * 
+     */
+    size_t                                          m_max_inflight;
+
     /**
      * @brief print additional debug logs if this is true
      * 
@@ -146,6 +168,8 @@ public:
         m_job_queue_cond(PTHREAD_COND_INITIALIZER),
         m_is_destroying(false),
         m_job_sequence_number(0),
+        m_num_inflight(0),
+        m_max_inflight(0),
         m_is_debug(false),
         m_is_debug_verbose(false)
     {
@@ -185,13 +209,32 @@ public:
     void destroy();
 
     /**
-     * @brief add a new job for processing
+     * @brief add a new job for processing. A job that is limited
+     * takes one of the m_max_inflight slots, it is reserved with a
+     * compare and swap, so that threads adding jobs at the same time
+     * cannot take more slots than there are.
      * 
      * @param p_job the job for processing, must derive
      * from JobInterface
-     * @return int 0 on success
+     * @param is_limited whether the job counts against
+     * m_max_inflight. Jobs that are not limited are always added,
+     * they still count as in flight.
+     * @return int 0 on success, THREAD_POOL_SATURATED if the job is
+     * limited and there is no slot left for it
      */
-    int add_job(std::shared_ptr<JobInterface> p_job);
+    int add_job(std::shared_ptr<JobInterface> p_job, bool is_limited = false);
+
+    /**
+     * @brief whether the pool has as many jobs queued or running as
+     * it is allowed to. The answer may be stale by the time it is
+     * used, add_job() is what enforces the limit.
+     * 
+     * @return true if m_max_inflight is reached
+     */
+    bool is_saturated() const
+    {
+        return m_max_inflight && m_num_inflight >= m_max_inflight;
+    }
 
     /* Detructor */
     ~ThreadPool()
@@ -125,8 +125,62 @@ void test_jobs2()
     }
 }
 
+void test_saturation()
+{
+    auto tpf = ThreadPoolFactory();
+    auto tp = tpf.create_thread_pool(2, false);
+
+    const int NUM_JOBS = 4;
+
+    std::cout << std::endl << __FILE__ << ":" << __LINE__ << " Executing test 3" << std::endl;
+
+    if (tp)
+    {
+        std::atomic<int>        job_constructor_count   = 0;
+        std::atomic<int>        job_destructor_count    = 0;
+        std::atomic<int>        job_run_count           = 0;
+
+        tp->m_max_inflight = NUM_JOBS;
+        TEST(!tp->is_saturated(), "An idle pool is not saturated.");
+
+        for (int i = 0; i < NUM_JOBS; i++)
+        {
+            auto bt = new BasicTest(&job_constructor_count, &job_destructor_count, &job_run_count);
+            bt->m_is_debug = false;
+            TEST(0 == tp->add_job(std::shared_ptr<JobInterface>(bt), true),
+                "A limited job is added while there is a slot.");
+        }
+
+        TEST(tp->is_saturated(), "Queued and running jobs count towards the limit.");
+
+        auto limited = new BasicTest(&job_constructor_count, &job_destructor_count, &job_run_count);
+        limited->m_is_debug = false;
+        TEST(THREAD_POOL_SATURATED == tp->add_job(std::shared_ptr<JobInterface>(limited), true),
+            "A limited job is refused once the pool is saturated.");
+        TEST(NUM_JOBS == (int)tp->m_num_inflight, "A refused job takes no slot.");
+
+        sleep(3);
+
+        TEST(job_run_count == NUM_JOBS, "All jobs must be run.");
+        TEST(0 == tp->m_num_inflight, "Finished jobs are not in flight.");
+        TEST(!tp->is_saturated(), "The pool is no longer saturated.");
+
+        tp->m_max_inflight = 0;
+        for (int i = 0; i < NUM_JOBS; i++)
+        {
+            auto bt = new BasicTest(&job_constructor_count, &job_destructor_count, &job_run_count);
+            bt->m_is_debug = false;
+            tp->add_job(std::shared_ptr<JobInterface>(bt));
+        }
+        TEST(!tp->is_saturated(), "A pool without a limit is never saturated.");
+
+        delete tp;
+    }
+}
+
 int main(int argc, char** argv)
 {
     test_jobs();
     test_jobs2();
+    test_saturation();
 }
\ No newline at end of file
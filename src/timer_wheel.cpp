@@ -0,0 +1,209 @@
+#include "timer_wheel.h"
+#include <time.h>
+#include <climits>
+#include <cassert>
+
+TimerEntry::~TimerEntry()
+{
+    if (m_wheel)
+        m_wheel->cancel(*this);
+}
+
+TimerWheel::TimerWheel(uint64_t tick_ms):
+    m_tick_ms(tick_ms ? tick_ms : 1),
+    m_start_ms(clock_ms()),
+    m_current(0),
+    m_count(0)
+{
+    for (auto& level: m_slots)
+    {
+        for (auto& slot: level)
+        {
+            slot.m_prev = &slot;
+            slot.m_next = &slot;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    // The timers that are still scheduled must not come back to
+    // the wheel once it is gone
+    for (auto& level: m_slots)
+    {
+        for (auto& slot: level)
+        {
+            while (slot.m_next != &slot)
+            {
+                auto entry = static_cast<TimerEntry*>(slot.m_next);
+                unlink(entry);
+                entry->m_wheel = nullptr;
+            }
+        }
+    }
+}
+
+uint64_t TimerWheel::clock_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void TimerWheel::unlink(TimerNode* entry)
+{
+    entry->m_prev->m_next = entry->m_next;
+    entry->m_next->m_prev = entry->m_prev;
+    entry->m_prev = nullptr;
+    entry->m_next = nullptr;
+}
+
+void TimerWheel::place(TimerEntry* entry)
+{
+    const uint64_t max_delta = (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+    if (entry->m_expires - m_current > max_delta)
+        entry->m_expires = m_current + max_delta;
+
+    uint64_t delta = entry->m_expires - m_current;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1))))
+        level++;
+
+    int index = (entry->m_expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+    TimerNode* head = &m_slots[level][index];
+    entry->m_prev = head->m_prev;
+    entry->m_next = head;
+    head->m_prev->m_next = entry;
+    head->m_prev = entry;
+}
+
+void TimerWheel::cascade(int level, int index)
+{
+    TimerNode* head = &m_slots[level][index];
+    TimerNode list;
+
+    if (head->m_next == head)
+        return;
+
+    // Detach the whole slot first, placing a timer may put it back
+    // in a slot of the same level
+    list.m_next = head->m_next;
+    list.m_prev = head->m_prev;
+    list.m_next->m_prev = &list;
+    list.m_prev->m_next = &list;
+    head->m_next = head;
+    head->m_prev = head;
+
+    while (list.m_next != &list)
+    {
+        auto entry = static_cast<TimerEntry*>(list.m_next);
+        unlink(entry);
+        place(entry);
+    }
+}
+
+void TimerWheel::schedule(TimerEntry& entry, uint64_t expires_ms)
+{
+    std::unique_lock lock(m_mutex);
+
+    assert(!entry.m_wheel || this == entry.m_wheel);
+    if (entry.m_next)
+        unlink(&entry);
+    else
+        m_count++;
+
+    // Round up, a timer must not expire early
+    uint64_t tick = (expires_ms > m_start_ms) ?
+        (expires_ms - m_start_ms + m_tick_ms - 1) / m_tick_ms : 0;
+    entry.m_expires = std::max(tick, m_current + 1);
+    entry.m_wheel = this;
+    place(&entry);
+}
+
+void TimerWheel::cancel(TimerEntry& entry)
+{
+    std::unique_lock lock(m_mutex);
+
+    if (entry.m_next)
+    {
+        unlink(&entry);
+        m_count--;
+    }
+    entry.m_wheel = nullptr;
+}
+
+size_t TimerWheel::size()
+{
+    std::unique_lock lock(m_mutex);
+    return m_count;
+}
+
+int TimerWheel::next_timeout(uint64_t now_ms)
+{
+    std::unique_lock lock(m_mutex);
+
+    if (!m_count)
+        return -1;
+
+    // Look for the next tick with timers in the first level, the
+    // wrap around of the first level must be handled in any case
+    uint64_t tick = m_current + 1;
+    while (tick & (TIMER_WHEEL_SLOTS - 1))
+    {
+        auto& slot = m_slots[0][tick & (TIMER_WHEEL_SLOTS - 1)];
+        if (slot.m_next != &slot)
+            break;
+        tick++;
+    }
+
+    uint64_t at = m_start_ms + tick * m_tick_ms;
+    if (at <= now_ms)
+        return 0;
+    return (int)std::min<uint64_t>(at - now_ms, INT_MAX);
+}
+
+int TimerWheel::advance(uint64_t now_ms)
+{
+    std::vector<std::function<void()> > expired;
+
+    {
+        std::unique_lock lock(m_mutex);
+
+        uint64_t target = (now_ms > m_start_ms) ? (now_ms - m_start_ms) / m_tick_ms : 0;
+        while (m_current < target && m_count)
+        {
+            m_current++;
+
+            // Every time a level wraps around, the next slot of the
+            // level above comes down
+            for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+            {
+                if (m_current & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1))
+                    break;
+                cascade(level,
+                    (m_current >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+            }
+
+            // The callbacks are copied, the timers may be destroyed
+            // as soon as the lock is released
+            TimerNode* head = &m_slots[0][m_current & (TIMER_WHEEL_SLOTS - 1)];
+            while (head->m_next != head)
+            {
+                auto entry = static_cast<TimerEntry*>(head->m_next);
+                unlink(entry);
+                m_count--;
+                expired.push_back(entry->m_callback);
+            }
+        }
+
+        // Nothing is scheduled, there is nothing to walk through
+        if (m_current < target)
+            m_current = target;
+    }
+
+    for (auto& callback: expired)
+        callback();
+
+    return expired.size();
+}
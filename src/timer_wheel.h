@@ -0,0 +1,235 @@
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include "common_include.h"
+#include <functional>
+
+/**
+ * @brief number of bits of a tick that every level of the wheel
+ * covers
+ *
+ */
+#define TIMER_WHEEL_BITS 6
+
+/**
+ * @brief number of slots in every level of the wheel
+ *
+ */
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+
+/**
+ * @brief number of levels, the wheel holds timers up to
+ * TIMER_WHEEL_SLOTS ^ TIMER_WHEEL_LEVELS ticks ahead
+ *
+ */
+#define TIMER_WHEEL_LEVELS 4
+
+/**
+ * @brief default length of a tick, in milliseconds
+ *
+ */
+#define TIMER_TICK_MS 100
+
+class TimerWheel;
+
+/**
+ * @brief link of a doubly linked list of timers
+ *
+ */
+struct TimerNode
+{
+    TimerNode*                              m_prev;
+    TimerNode*                              m_next;
+
+    TimerNode():
+        m_prev(nullptr),
+        m_next(nullptr)
+    {
+    }
+};
+
+/**
+ * @brief A timer. It is embedded in the object it belongs to, so
+ * that scheduling and cancelling it allocate nothing. A timer that
+ * is destroyed while it is scheduled cancels itself.
+ *
+ */
+struct TimerEntry: public TimerNode
+{
+    /**
+     * @brief the tick at which the timer expires
+     *
+     */
+    uint64_t                                m_expires;
+
+    /**
+     * @brief the wheel the timer was scheduled on
+     *
+     */
+    TimerWheel*                             m_wheel;
+
+    /**
+     * @brief called once the timer expires. It is called on the
+     * thread that advances the wheel, without any lock held, and
+     * it may schedule the timer again.
+     *
+     */
+    std::function<void()>                   m_callback;
+
+    TimerEntry():
+        m_expires(0),
+        m_wheel(nullptr)
+    {
+    }
+
+    TimerEntry(const TimerEntry&) = delete;
+    TimerEntry& operator=(const TimerEntry&) = delete;
+
+    ~TimerEntry();
+};
+
+/**
+ * @brief A hierarchical timing wheel.
+ *
+ * Time is counted in ticks. The first level has a slot for every one
+ * of the next TIMER_WHEEL_SLOTS ticks, every level above it has a
+ * slot for TIMER_WHEEL_SLOTS times as many ticks as the one below.
+ * A timer goes to the level that covers its delay, and every time
+ * the lower level wraps around, the timers of the next slot of the
+ * level above are spread down. Scheduling and cancelling a timer
+ * are O(1), whatever the number of timers.
+ *
+ * The wheel is driven by an event loop: it waits at most
+ * next_timeout() milliseconds, then calls advance(), which runs the
+ * callbacks of the timers that expired. Timers may be scheduled and
+ * cancelled from any thread.
+ *
+ */
+class TimerWheel
+{
+public:
+    TimerWheel(uint64_t tick_ms = TIMER_TICK_MS);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    ~TimerWheel();
+
+    /**
+     * @brief a cheap monotonic clock, precise to a few milliseconds
+     *
+     * @return uint64_t the time in milliseconds
+     */
+    static uint64_t clock_ms();
+
+    /**
+     * @brief schedule a timer, or move it if it is already scheduled.
+     * A timer never expires early. One beyond the range of the wheel
+     * expires at the end of the range.
+     *
+     * @param entry the timer, its callback must be set
+     * @param expires_ms when it expires, on the clock of clock_ms()
+     */
+    void schedule(TimerEntry& entry, uint64_t expires_ms);
+
+    /**
+     * @brief cancel a timer, if it is scheduled
+     *
+     * @param entry the timer
+     */
+    void cancel(TimerEntry& entry);
+
+    /**
+     * @brief number of scheduled timers
+     *
+     * @return size_t the number of timers
+     */
+    size_t size();
+
+    /**
+     * @brief the time of tick 0
+     *
+     * @return uint64_t the time in milliseconds, on the clock of
+     * clock_ms()
+     */
+    uint64_t get_start_ms() const
+    {
+        return m_start_ms;
+    }
+
+    /**
+     * @brief how long the event loop may wait before it must call
+     * advance()
+     *
+     * @param now_ms the current time, from clock_ms()
+     * @return int the time in milliseconds, -1 if no timer is
+     * scheduled
+     */
+    int next_timeout(uint64_t now_ms);
+
+    /**
+     * @brief move the wheel up to the current time, and run the
+     * callbacks of the timers that expired
+     *
+     * @param now_ms the current time, from clock_ms()
+     * @return int the number of timers that expired
+     */
+    int advance(uint64_t now_ms);
+
+private:
+    /**
+     * @brief length of a tick in milliseconds
+     *
+     */
+    uint64_t                                m_tick_ms;
+
+    /**
+     * @brief the time of tick 0
+     *
+     */
+    uint64_t                                m_start_ms;
+
+    /**
+     * @brief the last tick whose timers have been run
+     *
+     */
+    uint64_t                                m_current;
+
+    /**
+     * @brief number of scheduled timers
+     *
+     */
+    size_t                                  m_count;
+
+    /**
+     * @brief the slots, every slot is the head of a circular list
+     *
+     */
+    TimerNode                               m_slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+    std::mutex                              m_mutex;
+
+    /**
+     * @brief put a timer in the slot of the level that covers it
+     *
+     * @param entry the timer, it is not in any slot
+     */
+    void place(TimerEntry* entry);
+
+    /**
+     * @brief take a timer out of its slot
+     *
+     * @param entry the timer
+     */
+    static void unlink(TimerNode* entry);
+
+    /**
+     * @brief spread the timers of a slot over the lower levels
+     *
+     * @param level the level of the slot
+     * @param index the index of the slot
+     */
+    void cascade(int level, int index);
+};
+
+#endif /* #ifndef TIMER_WHEEL_H_ */
@@ -0,0 +1,126 @@
+#include "timer_wheel.h"
+#include <cstdlib>
+
+#define TEST(x, y) {\
+    if (!(x))\
+    {\
+        std::cout << "FAILED: " << y << std::endl;\
+        exit(1);\
+    }\
+    else\
+    {\
+        std::cout << "PASSED: " << y << std::endl;\
+    }\
+}
+
+void test_expiry()
+{
+    std::cout << std::endl << "Tests to validate when timers expire" << std::endl;
+    {
+        TimerWheel wheel(1);
+        uint64_t start = wheel.get_start_ms();
+        std::vector<uint64_t> delays = {1, 5, 63, 64, 65, 100, 4095, 4096, 5000, 300000};
+        std::vector<uint64_t> fired(delays.size(), 0);
+        std::vector<TimerEntry> timers(delays.size());
+        uint64_t now = start;
+
+        for (size_t i = 0; i < delays.size(); i++)
+        {
+            timers[i].m_callback = [i, &fired, &now]() { fired[i] = now; };
+            wheel.schedule(timers[i], start + delays[i]);
+        }
+        TEST(delays.size() == wheel.size(), "Every timer should be scheduled");
+        TEST(1 == wheel.next_timeout(start), "The first timer should be due in one tick");
+
+        // Step through time unevenly, a timer must expire on the
+        // first advance past its time, never before
+        bool is_error = false;
+        while (now < start + 300000 + 10)
+        {
+            now += (now % 7) + 1;
+            wheel.advance(now);
+            for (size_t i = 0; i < delays.size(); i++)
+            {
+                bool is_due = (now >= start + delays[i]);
+                if (is_due != (0 != fired[i]))
+                    is_error = true;
+            }
+        }
+        TEST(!is_error, "Timers should expire on time, across the levels");
+        TEST(0 == wheel.size() && -1 == wheel.next_timeout(now), "An empty wheel should not need a timeout");
+    }
+}
+
+void test_cancel()
+{
+    std::cout << std::endl << "Tests to validate cancelling and moving timers" << std::endl;
+    {
+        TimerWheel wheel(1);
+        uint64_t start = wheel.get_start_ms();
+        int count = 0;
+
+        TimerEntry first;
+        first.m_callback = [&count]() { count++; };
+        wheel.schedule(first, start + 10);
+        wheel.cancel(first);
+        wheel.advance(start + 20);
+        TEST(0 == count && 0 == wheel.size(), "A cancelled timer should not expire");
+
+        wheel.schedule(first, start + 30);
+        wheel.schedule(first, start + 5000);
+        TEST(1 == wheel.size(), "A timer scheduled twice should be moved");
+        wheel.advance(start + 4999);
+        TEST(0 == count, "A moved timer should not expire at its old time");
+        wheel.advance(start + 5000);
+        TEST(1 == count, "A moved timer should expire at its new time");
+
+        {
+            TimerEntry second;
+            second.m_callback = [&count]() { count++; };
+            wheel.schedule(second, start + 6000);
+        }
+        TEST(0 == wheel.size(), "A destroyed timer should cancel itself");
+        wheel.advance(start + 7000);
+        TEST(1 == count, "A destroyed timer should not expire");
+
+        wheel.schedule(first, start);
+        wheel.advance(start + 7000);
+        TEST(1 == count, "A timer in the past should expire on the next tick");
+        wheel.advance(start + 7001);
+        TEST(2 == count, "A timer in the past should expire");
+    }
+}
+
+void test_reschedule()
+{
+    std::cout << std::endl << "Tests to validate timers that schedule themselves again" << std::endl;
+    {
+        TimerWheel wheel(10);
+        uint64_t start = wheel.get_start_ms();
+        uint64_t now = start;
+        int count = 0;
+
+        TimerEntry timer;
+        timer.m_callback = [&]() {
+            count++;
+            if (count < 5)
+                wheel.schedule(timer, now + 100);
+        };
+        wheel.schedule(timer, start + 100);
+        while (now < start + 1000)
+        {
+            now += 10;
+            wheel.advance(now);
+        }
+        TEST(5 == count && 0 == wheel.size(), "A callback should be able to schedule its timer again");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_expiry();
+    test_cancel();
+    test_reschedule();
+
+    std::cout << std::endl << "All tests passed" << std::endl;
+}
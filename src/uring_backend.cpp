@@ -0,0 +1,798 @@
+#include "uring_backend.h"
+#include "orchestrator.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+ * The user data of every submission encodes the operation in the
+ * low 4 bits, the fd in the next 28 bits and the generation of the
+ * connection in the high 32 bits.
+ */
+static inline uint64_t make_user_data(uring_op_t op, int fd, uint32_t generation)
+{
+    return ((uint64_t)generation << 32) | ((uint64_t)(fd & 0xfffffff) << 4) | op;
+}
+
+static inline uring_op_t user_data_op(uint64_t user_data)
+{
+    return (uring_op_t)(user_data & 0xf);
+}
+
+static inline int user_data_fd(uint64_t user_data)
+{
+    return (int)((user_data >> 4) & 0xfffffff);
+}
+
+static inline uint32_t user_data_generation(uint64_t user_data)
+{
+    return (uint32_t)(user_data >> 32);
+}
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/*
+ * Same as io_uring_enter with IORING_ENTER_GETEVENTS, but the wait
+ * for the completion ends after timeout_ms with ETIME.
+ */
+static int io_uring_enter_timeout(int fd, unsigned to_submit, int timeout_ms)
+{
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)&ts;
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, 1,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+IoUring::~IoUring()
+{
+    if (m_sqes)
+        munmap(m_sqes, m_params.sq_entries * sizeof(struct io_uring_sqe));
+    if (m_cq_ptr && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr)
+        munmap(m_sq_ptr, m_sq_size);
+    if (m_ring_fd >= 0)
+        close(m_ring_fd);
+}
+
+bool IoUring::setup(unsigned entries)
+{
+    memset(&m_params, 0, sizeof(m_params));
+    m_params.flags = IORING_SETUP_CQSIZE;
+    m_params.cq_entries = entries * 2;
+
+    m_ring_fd = io_uring_setup(entries, &m_params);
+    if (m_ring_fd < 0)
+    {
+        std::cerr << "io_uring_setup failed, errno = " << errno << std::endl;
+        return false;
+    }
+
+    m_sq_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+    m_cq_size = m_params.cq_off.cqes + m_params.cq_entries * sizeof(struct io_uring_cqe);
+    if (m_params.features & IORING_FEAT_SINGLE_MMAP)
+        m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+    m_sq_ptr = mmap(
+                nullptr, m_sq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == m_sq_ptr)
+    {
+        m_sq_ptr = nullptr;
+        perror("mmap");
+        return false;
+    }
+
+    if (m_params.features & IORING_FEAT_SINGLE_MMAP)
+        m_cq_ptr = m_sq_ptr;
+    else
+    {
+        m_cq_ptr = mmap(
+                    nullptr, m_cq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == m_cq_ptr)
+        {
+            m_cq_ptr = nullptr;
+            perror("mmap");
+            return false;
+        }
+    }
+
+    void* sqes = mmap(
+                    nullptr, m_params.sq_entries * sizeof(struct io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == sqes)
+    {
+        perror("mmap");
+        return false;
+    }
+    m_sqes = (struct io_uring_sqe*)sqes;
+
+    char* sq = (char*)m_sq_ptr;
+    m_sq_head = (unsigned*)(sq + m_params.sq_off.head);
+    m_sq_tail = (unsigned*)(sq + m_params.sq_off.tail);
+    m_sq_mask = (unsigned*)(sq + m_params.sq_off.ring_mask);
+    m_sq_array = (unsigned*)(sq + m_params.sq_off.array);
+
+    char* cq = (char*)m_cq_ptr;
+    m_cq_head = (unsigned*)(cq + m_params.cq_off.head);
+    m_cq_tail = (unsigned*)(cq + m_params.cq_off.tail);
+    m_cq_mask = (unsigned*)(cq + m_params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)(cq + m_params.cq_off.cqes);
+
+    m_sqe_head = m_sqe_tail = *m_sq_tail;
+    return true;
+}
+
+bool IoUring::supports(const std::vector<int>& opcodes)
+{
+    const int num_ops = 256;
+    size_t size = sizeof(struct io_uring_probe) +
+                    num_ops * sizeof(struct io_uring_probe_op);
+    std::vector<char> buffer(size, 0);
+    auto probe = (struct io_uring_probe*)buffer.data();
+
+    if (io_uring_register(m_ring_fd, IORING_REGISTER_PROBE, probe, num_ops) < 0)
+        return false;
+
+    for (auto op: opcodes)
+    {
+        if (op > probe->last_op ||
+            !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    }
+    return true;
+}
+
+struct io_uring_sqe* IoUring::get_sqe()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_params.sq_entries)
+        return nullptr;
+
+    auto sqe = &m_sqes[m_sqe_tail & *m_sq_mask];
+    m_sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned IoUring::flush_sq()
+{
+    unsigned tail = *m_sq_tail;
+    unsigned mask = *m_sq_mask;
+
+    while (m_sqe_head != m_sqe_tail)
+    {
+        m_sq_array[tail & mask] = m_sqe_head & mask;
+        tail++;
+        m_sqe_head++;
+    }
+    __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+    return tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+}
+
+struct io_uring_cqe* IoUring::peek_cqe()
+{
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        return nullptr;
+    return &m_cqes[head & *m_cq_mask];
+}
+
+void IoUring::cqe_seen()
+{
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+UringBackend::~UringBackend()
+{
+    if (m_listen_socket >= 0)
+    {
+        uint64_t one = 1;
+        if (write(m_wakeup_fd, &one, sizeof(one)) < 0)
+            perror("write");
+        pthread_join(m_thread_id, nullptr);
+    }
+
+    // States still held by the parse workers must not come back
+    // to the wheel
+    for (auto& it: m_connections)
+    {
+        if (it.second.m_is_busy)
+            it.second.m_pstate->m_mutex.unlock();
+        m_timers.cancel(it.second.m_pstate->m_timer);
+        close(it.first);
+    }
+    m_connections.clear();
+
+    if (m_buf_ring)
+        munmap(m_buf_ring, URING_NUM_BUFFERS * sizeof(struct io_uring_buf));
+    free(m_buffers);
+    if (m_wakeup_fd >= 0)
+        close(m_wakeup_fd);
+}
+
+bool UringBackend::init()
+{
+    if (!m_ring.setup(URING_SQ_ENTRIES))
+        return false;
+
+    if (!m_ring.supports({IORING_OP_ACCEPT, IORING_OP_RECV,
+                          IORING_OP_SENDMSG, IORING_OP_READ,
+                          IORING_OP_ASYNC_CANCEL}))
+    {
+        std::cerr << "io_uring lacks the required opcodes" << std::endl;
+        return false;
+    }
+
+    // The wait for completions is bounded by the next timer
+    if (!(m_ring.m_params.features & IORING_FEAT_EXT_ARG))
+    {
+        std::cerr << "io_uring lacks timed waits" << std::endl;
+        return false;
+    }
+
+    size_t ring_size = URING_NUM_BUFFERS * sizeof(struct io_uring_buf);
+    void* ring = mmap(
+                    nullptr, ring_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == ring)
+    {
+        perror("mmap");
+        return false;
+    }
+    m_buf_ring = (struct io_uring_buf_ring*)ring;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)m_buf_ring;
+    reg.ring_entries = URING_NUM_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (io_uring_register(m_ring.m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1))
+    {
+        std::cerr << "io_uring provided buffer rings are not supported, errno = " \
+            << errno << std::endl;
+        return false;
+    }
+
+    if (posix_memalign(
+            (void**)&m_buffers, 4096,
+            (size_t)URING_NUM_BUFFERS * URING_BUFFER_SIZE))
+    {
+        m_buffers = nullptr;
+        std::cerr << "Out of memory" << std::endl;
+        return false;
+    }
+
+    m_buf_ring->tail = 0;
+    for (unsigned bid = 0; bid < URING_NUM_BUFFERS; bid++)
+        recycle_buffer(bid);
+
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup_fd < 0)
+    {
+        perror("eventfd");
+        return false;
+    }
+
+    return true;
+}
+
+bool UringBackend::start(int listen_socket, int unix_listen_socket)
+{
+    m_listen_socket = listen_socket;
+    m_unix_listen_socket = unix_listen_socket;
+
+    int retval = pthread_create(
+                    &m_thread_id,
+                    NULL,
+                    UringBackend::uring_pthread_fn,
+                    this);
+    if (0 != retval)
+    {
+        std::cerr << "pthread_create failed with rc = " << retval \
+                << " errno = " << errno << std::endl;
+        m_listen_socket = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void UringBackend::recycle_buffer(unsigned bid)
+{
+    // The entries are indexed from the start of the ring, the
+    // flexible array of the kernel header is offset when it is
+    // compiled as C++
+    unsigned short tail = m_buf_ring->tail;
+    auto bufs = (struct io_uring_buf*)m_buf_ring;
+    auto buf = &bufs[tail & (URING_NUM_BUFFERS - 1)];
+
+    buf->addr = (uint64_t)(m_buffers + (size_t)bid * URING_BUFFER_SIZE);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    __atomic_store_n(&m_buf_ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe* UringBackend::get_sqe()
+{
+    struct io_uring_sqe* sqe;
+
+    while (!(sqe = m_ring.get_sqe()))
+    {
+        unsigned to_submit = m_ring.flush_sq();
+        ServerStats::add(m_porchestrator->m_stats.m_syscalls_io_uring_enter);
+        if (io_uring_enter(m_ring.m_ring_fd, to_submit, 0, 0) < 0 &&
+            EINTR != errno && EAGAIN != errno && EBUSY != errno)
+        {
+            perror("io_uring_enter");
+            exit(1);
+        }
+    }
+
+    return sqe;
+}
+
+void UringBackend::submit_accept(int listen_socket)
+{
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_socket;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (m_use_multishot_accept)
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = make_user_data(URING_OP_ACCEPT, listen_socket, 0);
+}
+
+void UringBackend::submit_recv(int fd, UringConnection& conn)
+{
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    if (m_use_multishot_recv)
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+    else
+        sqe->len = URING_BUFFER_SIZE;
+    sqe->user_data = make_user_data(URING_OP_RECV, fd, conn.m_generation);
+    conn.m_is_recv_armed = true;
+}
+
+void UringBackend::submit_cancel_recv(int fd, UringConnection& conn)
+{
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = make_user_data(URING_OP_RECV, fd, conn.m_generation);
+    sqe->user_data = make_user_data(URING_OP_CANCEL, fd, conn.m_generation);
+}
+
+void UringBackend::submit_send(int fd, UringConnection& conn)
+{
+    auto& output = conn.m_pstate->m_output;
+    memset(&conn.m_send_msg, 0, sizeof(conn.m_send_msg));
+    conn.m_send_msg.msg_iov = conn.m_send_iov;
+    conn.m_send_msg.msg_iovlen = output.fill_iovec(conn.m_send_iov, URING_SEND_IOV);
+
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)&conn.m_send_msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = make_user_data(URING_OP_SEND, fd, conn.m_generation);
+    conn.m_is_sending = true;
+    conn.m_send_activity = TimerWheel::clock_ms();
+}
+
+void UringBackend::submit_wakeup_read()
+{
+    auto sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_wakeup_fd;
+    sqe->addr = (uint64_t)&m_wakeup_value;
+    sqe->len = sizeof(m_wakeup_value);
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = make_user_data(URING_OP_WAKEUP, 0, 0);
+}
+
+void UringBackend::queue_send(std::shared_ptr<State> pstate)
+{
+    {
+        std::unique_lock lock(m_send_queue_mtx);
+        m_send_queue.push_back(pstate);
+    }
+
+    if (m_needs_wakeup.load() && m_needs_wakeup.exchange(false))
+    {
+        uint64_t one = 1;
+        ServerStats::add(m_porchestrator->m_stats.m_syscalls_other);
+        if (sizeof(one) != write(m_wakeup_fd, &one, sizeof(one)) &&
+            EAGAIN != errno)
+            perror("write");
+    }
+}
+
+void UringBackend::drain_send_queue()
+{
+    std::vector<std::shared_ptr<State> > ready;
+    {
+        std::unique_lock lock(m_send_queue_mtx);
+        ready.swap(m_send_queue);
+    }
+
+    for (auto& pstate: ready)
+    {
+        int fd = pstate->m_socket;
+        auto it = m_connections.find(fd);
+        if (it == m_connections.end() || it->second.m_pstate != pstate)
+            continue;
+
+        auto& conn = it->second;
+
+        pstate->m_state = STATE_IN_WRITE_LOOP;
+        pstate->queue_responses();
+
+        // Only part of a command was received, there is nothing to
+        // send
+        if (pstate->m_output.empty())
+            finish_request(fd, conn);
+        else
+            submit_send(fd, conn);
+    }
+}
+
+void UringBackend::loop()
+{
+    submit_accept(m_listen_socket);
+    if (m_unix_listen_socket >= 0)
+        submit_accept(m_unix_listen_socket);
+    submit_wakeup_read();
+    m_rehash_timer.m_callback = [this]() { on_rehash_timer(); };
+    m_timers.schedule(m_rehash_timer, TimerWheel::clock_ms() + REHASH_CRON_MS);
+
+    while (!m_porchestrator->m_is_destroying)
+    {
+        // Announce the wait before looking at the queue one last
+        // time, a response queued after that writes to the eventfd
+        m_needs_wakeup.store(true);
+        drain_send_queue();
+
+        // A single system call submits everything that was queued
+        // and waits for the next completion, or the next timer
+        unsigned to_submit = m_ring.flush_sq();
+        int timeout = m_timers.next_timeout(TimerWheel::clock_ms());
+        ServerStats::add(m_porchestrator->m_stats.m_syscalls_io_uring_enter);
+        int ret = (timeout < 0) ?
+            io_uring_enter(
+                m_ring.m_ring_fd,
+                to_submit,
+                1,
+                IORING_ENTER_GETEVENTS) :
+            io_uring_enter_timeout(m_ring.m_ring_fd, to_submit, timeout);
+        m_needs_wakeup.store(false);
+        m_timers.advance(TimerWheel::clock_ms());
+
+        if (ret < 0 && EINTR != errno && EAGAIN != errno && EBUSY != errno &&
+            ETIME != errno)
+        {
+            perror("io_uring_enter");
+            std::cerr << "io_uring_enter failed, errno = " << errno << std::endl;
+            continue;
+        }
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = m_ring.peek_cqe()))
+        {
+            handle_cqe(cqe);
+            m_ring.cqe_seen();
+        }
+    }
+}
+
+void UringBackend::handle_cqe(struct io_uring_cqe* cqe)
+{
+    uint64_t user_data = cqe->user_data;
+    int res = cqe->res;
+    unsigned flags = cqe->flags;
+    auto op = user_data_op(user_data);
+
+    if (URING_OP_ACCEPT == op)
+    {
+        on_accept(user_data_fd(user_data), res, flags);
+        return;
+    }
+
+    if (URING_OP_WAKEUP == op)
+    {
+        submit_wakeup_read();
+        return;
+    }
+
+    // The recv that was cancelled completes on its own
+    if (URING_OP_CANCEL == op)
+        return;
+
+    int fd = user_data_fd(user_data);
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end() ||
+        it->second.m_generation != user_data_generation(user_data))
+    {
+        // Completion for a connection that was already closed
+        if (flags & IORING_CQE_F_BUFFER)
+            recycle_buffer(flags >> IORING_CQE_BUFFER_SHIFT);
+        return;
+    }
+
+    if (URING_OP_RECV == op)
+        on_recv(fd, it->second, res, flags);
+    else if (URING_OP_SEND == op)
+        on_send(fd, it->second, res);
+}
+
+void UringBackend::on_accept(int listen_socket, int res, unsigned flags)
+{
+    if (res >= 0)
+    {
+        int fd = res;
+        std::shared_ptr<State> pstate;
+        if (fd > 0xfffffff)
+        {
+            std::cerr << fd << ": could not create state" << std::endl;
+            close(fd);
+        }
+        else if ((pstate = m_porchestrator->admit_client(fd)))
+        {
+            pstate->m_state = STATE_ACCEPTED;
+            auto& conn = m_connections[fd];
+            conn = UringConnection();
+            conn.m_pstate = pstate;
+            conn.m_generation = ++m_next_generation;
+            m_porchestrator->m_stats.add_accepted(1,
+                listen_socket == m_unix_listen_socket);
+            submit_recv(fd, conn);
+            watch_connection(fd, conn);
+        }
+    }
+    else if (-EINVAL == res && m_use_multishot_accept)
+    {
+        std::cerr << "multishot accept not supported, "\
+            "using single shot accepts" << std::endl;
+        m_use_multishot_accept = false;
+    }
+    else
+        std::cerr << "accept failed, err = " << -res << std::endl;
+
+    if (!(flags & IORING_CQE_F_MORE))
+        submit_accept(listen_socket);
+}
+
+void UringBackend::on_recv(int fd, UringConnection& conn, int res, unsigned flags)
+{
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (res > 0)
+        {
+            conn.m_pending_input.append(
+                m_buffers + (size_t)bid * URING_BUFFER_SIZE, res);
+            conn.m_pstate->m_last_activity = TimerWheel::clock_ms();
+        }
+        recycle_buffer(bid);
+    }
+
+    if (0 == res)
+        conn.m_is_closing = true;
+    else if (-EINVAL == res && m_use_multishot_recv)
+    {
+        std::cerr << "multishot recv not supported, "\
+            "using single shot receives" << std::endl;
+        m_use_multishot_recv = false;
+    }
+    else if (res < 0 && -ENOBUFS != res && -ECANCELED != res)
+        conn.m_is_closing = true;
+
+    // A multishot recv stops when it runs out of buffers, or when it
+    // is cancelled, a single shot recv after every completion
+    if (!(flags & IORING_CQE_F_MORE))
+        conn.m_is_recv_armed = false;
+
+    // A busy connection does not take its data, a client that keeps
+    // sending is not read any more until it does. Nothing is
+    // received meanwhile but what the kernel had already picked up.
+    bool is_full = conn.m_pending_input.length() >= URING_MAX_PENDING_INPUT;
+    if (is_full && conn.m_is_recv_armed && -ECANCELED != res)
+        submit_cancel_recv(fd, conn);
+    else if (!is_full && !conn.m_is_recv_armed && !conn.m_is_closing)
+        submit_recv(fd, conn);
+
+    if (conn.m_is_busy)
+        return;
+
+    if (conn.m_pending_input.length())
+        start_request(fd, conn);
+    else if (conn.m_is_closing)
+        close_connection(fd);
+}
+
+void UringBackend::start_request(int fd, UringConnection& conn)
+{
+    auto pstate = conn.m_pstate;
+
+    pstate->m_mutex.lock();
+    pstate->m_input.append(
+        conn.m_pending_input.data(),
+        conn.m_pending_input.length());
+    conn.m_pending_input.clear();
+
+    // The data has been taken, the client can be read again
+    if (!conn.m_is_recv_armed && !conn.m_is_closing)
+        submit_recv(fd, conn);
+    conn.m_is_busy = true;
+    pstate->m_state = STATE_WAITING_FOR_PARSING;
+
+    // The parse pool is overloaded, the commands are answered with
+    // an error from here instead of waiting in its queue
+    int rc = m_porchestrator->add_to_parse_and_run_queue(pstate);
+    if (THREAD_POOL_SATURATED == rc)
+    {
+        m_porchestrator->run_pipelined_commands(pstate, false, true);
+        queue_send(pstate);
+        return;
+    }
+
+    if (0 != rc)
+    {
+        std::cerr << fd << ": Adding to parse queue failed" << std::endl;
+        close_connection(fd);
+    }
+}
+
+void UringBackend::on_send(int fd, UringConnection& conn, int res)
+{
+    if (res < 0)
+    {
+        std::cerr << fd << ": send failed, err = " << -res << std::endl;
+        close_connection(fd);
+        return;
+    }
+
+    // The socket took part of the responses, send the rest unless
+    // the client has fallen too far behind
+    conn.m_is_sending = false;
+    auto& output = conn.m_pstate->m_output;
+    output.consume(res);
+    if (!output.empty())
+    {
+        if (m_porchestrator->exceeds_output_limits(conn.m_pstate))
+            close_connection(fd);
+        else
+            submit_send(fd, conn);
+        return;
+    }
+
+    finish_request(fd, conn);
+}
+
+void UringBackend::finish_request(int fd, UringConnection& conn)
+{
+    auto pstate = conn.m_pstate;
+    if (pstate->m_is_error ||
+        (conn.m_is_closing && conn.m_pending_input.empty()))
+    {
+        close_connection(fd);
+        return;
+    }
+
+    pstate->reset();
+    conn.m_is_busy = false;
+
+    if (conn.m_pending_input.length())
+        start_request(fd, conn);
+}
+
+void UringBackend::close_connection(int fd)
+{
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end())
+        return;
+
+    if (it->second.m_is_busy)
+        it->second.m_pstate->m_mutex.unlock();
+    it->second.m_pstate->m_state = STATE_CLOSING;
+    m_connections.erase(it);
+
+    // Shutting the socket down ends the outstanding recv, its
+    // completion is ignored since the generation is gone
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+}
+
+void UringBackend::watch_connection(int fd, UringConnection& conn)
+{
+    uint64_t check_ms = m_porchestrator->get_timeout_check_ms();
+    if (!check_ms)
+        return;
+
+    uint32_t generation = conn.m_generation;
+    conn.m_pstate->m_timer.m_callback = [this, fd, generation]() {
+        on_connection_timer(fd, generation);
+    };
+    m_timers.schedule(conn.m_pstate->m_timer, TimerWheel::clock_ms() + check_ms);
+}
+
+void UringBackend::on_connection_timer(int fd, uint32_t generation)
+{
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end() || it->second.m_generation != generation)
+        return;
+
+    auto& conn = it->second;
+    uint64_t now = TimerWheel::clock_ms();
+
+    // A send is in flight on a blocking socket, it only completes
+    // once the client takes the responses. A client that takes
+    // nothing for the request timeout, or lets too much wait, is
+    // disconnected: shutting the socket down fails the send, whose
+    // completion closes the connection.
+    if (conn.m_is_sending && !conn.m_is_closing)
+    {
+        uint64_t timeout_ms = (uint64_t)m_porchestrator->m_config.m_request_timeout * 1000;
+        bool is_stalled = timeout_ms && now >= conn.m_send_activity + timeout_ms;
+        if (is_stalled)
+        {
+            std::cerr << fd << ": Send timed out" << std::endl;
+            ServerStats::add(m_porchestrator->m_stats.m_request_timeout_disconnects);
+        }
+        if (is_stalled || m_porchestrator->exceeds_output_limits(conn.m_pstate))
+        {
+            conn.m_is_closing = true;
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    // The state belongs to a parse worker, or a send is in flight
+    if (conn.m_is_busy)
+    {
+        m_timers.schedule(conn.m_pstate->m_timer,
+            now + m_porchestrator->get_timeout_check_ms());
+        return;
+    }
+
+    auto [is_expired, next] = m_porchestrator->check_timeout(conn.m_pstate, now);
+    if (is_expired)
+    {
+        std::cerr << fd << ": Connection timed out" << std::endl;
+        m_porchestrator->count_timeout(conn.m_pstate);
+        close_connection(fd);
+        return;
+    }
+    m_timers.schedule(conn.m_pstate->m_timer, next);
+}
+
+void UringBackend::on_rehash_timer()
+{
+    m_porchestrator->rehash_datastores(0, 1);
+    m_timers.schedule(m_rehash_timer, TimerWheel::clock_ms() + REHASH_CRON_MS);
+}
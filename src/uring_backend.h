@@ -0,0 +1,646 @@
+#ifndef URING_BACKEND_H_
+#define URING_BACKEND_H_
+
+#include "common_include.h"
+#include "state.h"
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <pthread.h>
+
+class Orchestrator;
+
+/**
+ * @brief number of submission queue entries of the ring
+ *
+ */
+#define URING_SQ_ENTRIES 4096
+
+/**
+ * @brief number of buffers in the provided buffer ring that
+ * multishot recv picks its buffers from, must be a power of 2
+ *
+ */
+#define URING_NUM_BUFFERS 256
+
+/**
+ * @brief size of each provided buffer
+ *
+ */
+#define URING_BUFFER_SIZE 16384
+
+/**
+ * @brief the recv of a busy connection is stopped once this much
+ * data is waiting for it, and started again when the connection
+ * takes the data
+ *
+ */
+#define URING_MAX_PENDING_INPUT (64 * URING_BUFFER_SIZE)
+
+/**
+ * @brief buffer group id of the provided buffer ring
+ *
+ */
+#define URING_BUFFER_GROUP 0
+
+/**
+ * @brief largest number of responses sent by one sendmsg
+ *
+ */
+#define URING_SEND_IOV 64
+
+/**
+ * @brief The operation a submission was for, it is stored in
+ * the low bits of the user data
+ *
+ */
+typedef enum
+{
+    URING_OP_INVALID,
+    URING_OP_ACCEPT,
+    URING_OP_RECV,
+    URING_OP_SEND,
+    URING_OP_WAKEUP,
+    URING_OP_CANCEL
+} uring_op_t;
+
+/**
+ * @brief A minimal io_uring, set up directly with the system
+ * calls. It maps the submission and completion rings and
+ * provides access to the entries.
+ *
+ */
+class IoUring
+{
+public:
+    /**
+     * @brief the ring file descriptor
+     *
+     */
+    int                         m_ring_fd;
+
+    /**
+     * @brief parameters returned by io_uring_setup
+     *
+     */
+    struct io_uring_params      m_params;
+
+    /**
+     * @brief the mapped submission ring
+     *
+     */
+    void*                       m_sq_ptr;
+
+    /**
+     * @brief size of the mapped submission ring
+     *
+     */
+    size_t                      m_sq_size;
+
+    /**
+     * @brief the mapped completion ring, same as m_sq_ptr if the
+     * kernel maps both rings together
+     *
+     */
+    void*                       m_cq_ptr;
+
+    /**
+     * @brief size of the mapped completion ring
+     *
+     */
+    size_t                      m_cq_size;
+
+    /**
+     * @brief the mapped submission queue entries
+     *
+     */
+    struct io_uring_sqe*        m_sqes;
+
+    /**
+     * @brief pointers into the submission ring
+     *
+     */
+    unsigned*                   m_sq_head;
+    unsigned*                   m_sq_tail;
+    unsigned*                   m_sq_mask;
+    unsigned*                   m_sq_array;
+
+    /**
+     * @brief pointers into the completion ring
+     *
+     */
+    unsigned*                   m_cq_head;
+    unsigned*                   m_cq_tail;
+    unsigned*                   m_cq_mask;
+    struct io_uring_cqe*        m_cqes;
+
+    /**
+     * @brief tail of the entries handed out by get_sqe but not
+     * yet submitted
+     *
+     */
+    unsigned                    m_sqe_tail;
+
+    /**
+     * @brief head of the entries already submitted to the kernel
+     *
+     */
+    unsigned                    m_sqe_head;
+
+    IoUring():
+        m_ring_fd(-1),
+        m_sq_ptr(nullptr),
+        m_sq_size(0),
+        m_cq_ptr(nullptr),
+        m_cq_size(0),
+        m_sqes(nullptr),
+        m_sqe_tail(0),
+        m_sqe_head(0)
+    {
+    }
+
+    ~IoUring();
+
+    /**
+     * @brief create the ring and map it
+     *
+     * @param entries number of submission queue entries
+     * @return true on success
+     * @return false if io_uring is not available
+     */
+    bool setup(unsigned entries);
+
+    /**
+     * @brief check that the kernel supports all the given opcodes
+     *
+     * @param opcodes the opcodes
+     * @return true if all of them are supported
+     */
+    bool supports(const std::vector<int>& opcodes);
+
+    /**
+     * @brief get a free submission queue entry
+     *
+     * @return struct io_uring_sqe* a zeroed entry, nullptr if the
+     * submission queue is full
+     */
+    struct io_uring_sqe* get_sqe();
+
+    /**
+     * @brief make the entries returned by get_sqe visible to the
+     * kernel
+     *
+     * @return unsigned number of entries made visible
+     */
+    unsigned flush_sq();
+
+    /**
+     * @brief the next completion, without removing it
+     *
+     * @return struct io_uring_cqe* the completion, nullptr if there
+     * are none
+     */
+    struct io_uring_cqe* peek_cqe();
+
+    /**
+     * @brief remove the completion returned by peek_cqe
+     *
+     */
+    void cqe_seen();
+};
+
+/**
+ * @brief state of a connection, as seen by the io_uring backend
+ *
+ */
+struct UringConnection
+{
+    /**
+     * @brief the state that is passed to the parse workers
+     *
+     */
+    std::shared_ptr<State>      m_pstate;
+
+    /**
+     * @brief incremented every time the fd is reused, so that
+     * completions for an old connection can be told apart
+     *
+     */
+    uint32_t                    m_generation;
+
+    /**
+     * @brief set while the state is owned by a parse worker or a
+     * send is in flight
+     *
+     */
+    bool                        m_is_busy;
+
+    /**
+     * @brief the peer has closed its side, or the socket failed
+     *
+     */
+    bool                        m_is_closing;
+
+    /**
+     * @brief a recv is submitted and will complete again
+     *
+     */
+    bool                        m_is_recv_armed;
+
+    /**
+     * @brief a send is in flight
+     *
+     */
+    bool                        m_is_sending;
+
+    /**
+     * @brief when the send in flight was submitted or last made
+     * progress
+     *
+     */
+    uint64_t                    m_send_activity;
+
+    /**
+     * @brief data received while the connection was busy, at most
+     * about URING_MAX_PENDING_INPUT
+     *
+     */
+    std::string                 m_pending_input;
+
+    /**
+     * @brief the responses in flight, they point into the output
+     * buffer of the state
+     *
+     */
+    struct iovec                m_send_iov[URING_SEND_IOV];
+
+    /**
+     * @brief the message of the sendmsg in flight
+     *
+     */
+    struct msghdr               m_send_msg;
+
+    UringConnection():
+        m_generation(0),
+        m_is_busy(false),
+        m_is_closing(false),
+        m_is_recv_armed(false),
+        m_is_sending(false),
+        m_send_activity(0)
+    {
+        memset(&m_send_msg, 0, sizeof(m_send_msg));
+    }
+};
+
+/**
+ * @brief Network backend based on io_uring.
+ *
+ * It replaces the accept thread, the epoll thread, the read jobs
+ * and the write jobs of the pipeline with a single thread that
+ * drives one ring:
+ * 1. a multishot accept on the listening socket, and one on the
+ *    Unix domain socket if there is one
+ * 2. a multishot recv on every connection, which picks its
+ *    buffers from a provided buffer ring
+ * 3. sends for the responses computed by the parse pool, all the
+ *    responses of a batch of pipelined commands go out in one
+ *    sendmsg, and the sends of all the connections that are ready
+ *    are submitted with one system call. A send the socket only
+ *    partially accepts is continued from the output buffer of the
+ *    connection, and a client that falls too far behind is
+ *    disconnected.
+ *
+ * Parsing and running the commands still happens in the parse
+ * and run thread pool.
+ *
+ */
+class UringBackend
+{
+public:
+    /**
+     * @brief the orchestrator that owns this backend
+     *
+     */
+    Orchestrator*                                   m_porchestrator;
+
+    /**
+     * @brief the ring
+     *
+     */
+    IoUring                                         m_ring;
+
+    /**
+     * @brief the listening socket
+     *
+     */
+    int                                             m_listen_socket;
+
+    /**
+     * @brief the Unix domain socket listening for local clients,
+     * -1 if there is none
+     *
+     */
+    int                                             m_unix_listen_socket;
+
+    /**
+     * @brief the provided buffer ring shared with the kernel
+     *
+     */
+    struct io_uring_buf_ring*                       m_buf_ring;
+
+    /**
+     * @brief memory backing the provided buffers
+     *
+     */
+    char*                                           m_buffers;
+
+    /**
+     * @brief eventfd written by the parse workers when a response
+     * is ready
+     *
+     */
+    int                                             m_wakeup_fd;
+
+    /**
+     * @brief target of the read on the eventfd
+     *
+     */
+    uint64_t                                        m_wakeup_value;
+
+    /**
+     * @brief set while the ring thread may be waiting for
+     * completions, so that the workers only write to the
+     * eventfd when needed
+     *
+     */
+    std::atomic<bool>                               m_needs_wakeup;
+
+    /**
+     * @brief states whose response is ready to be sent
+     *
+     */
+    std::vector<std::shared_ptr<State> >            m_send_queue;
+
+    /**
+     * @brief mutex protecting m_send_queue
+     *
+     */
+    std::mutex                                      m_send_queue_mtx;
+
+    /**
+     * @brief the timers of the connections, driven by the ring
+     * thread. It outlives m_connections.
+     *
+     */
+    TimerWheel                                      m_timers;
+
+    /**
+     * @brief the timer of the cron that moves on the data stores
+     * that are growing
+     *
+     */
+    TimerEntry                                      m_rehash_timer;
+
+    /**
+     * @brief the connections, indexed by fd, only accessed from
+     * the ring thread
+     *
+     */
+    std::unordered_map<int, UringConnection>        m_connections;
+
+    /**
+     * @brief generation counter for the connections
+     *
+     */
+    uint32_t                                        m_next_generation;
+
+    /**
+     * @brief false once the kernel rejected a multishot recv, single
+     * shot receives are used from then on
+     *
+     */
+    bool                                            m_use_multishot_recv;
+
+    /**
+     * @brief false once the kernel rejected a multishot accept
+     *
+     */
+    bool                                            m_use_multishot_accept;
+
+    /**
+     * @brief the ring thread
+     *
+     */
+    pthread_t                                       m_thread_id;
+
+    UringBackend(Orchestrator* porch):
+        m_porchestrator(porch),
+        m_listen_socket(-1),
+        m_unix_listen_socket(-1),
+        m_buf_ring(nullptr),
+        m_buffers(nullptr),
+        m_wakeup_fd(-1),
+        m_wakeup_value(0),
+        m_needs_wakeup(false),
+        m_next_generation(0),
+        m_use_multishot_recv(true),
+        m_use_multishot_accept(true)
+    {
+    }
+
+    ~UringBackend();
+
+    /**
+     * @brief set up the ring and the provided buffers
+     *
+     * @return true on success
+     * @return false if the kernel lacks the required io_uring
+     * features, the epoll path must be used instead
+     */
+    bool init();
+
+    /**
+     * @brief start serving connections from a listening socket
+     *
+     * @param listen_socket the listening socket
+     * @param unix_listen_socket the Unix domain socket listening
+     * for local clients, -1 if there is none
+     * @return true on success
+     * @return false on failure
+     */
+    bool start(int listen_socket, int unix_listen_socket = -1);
+
+    /**
+     * @brief hand a state whose response is ready to the ring
+     * thread, which sends it. Called from the parse workers.
+     *
+     * @param pstate the state
+     */
+    void queue_send(std::shared_ptr<State> pstate);
+
+    /**
+     * @brief the loop of the ring thread
+     *
+     */
+    void loop();
+
+    /**
+     * @brief the pthread function of the ring thread
+     *
+     * @param arg pointer to the backend
+     * @return void* nullptr
+     */
+    static void* uring_pthread_fn(void* arg)
+    {
+        static_cast<UringBackend*>(arg)->loop();
+        return nullptr;
+    }
+
+private:
+    /**
+     * @brief get a submission queue entry, submitting the queued
+     * entries first if the queue is full
+     *
+     * @return struct io_uring_sqe* the entry
+     */
+    struct io_uring_sqe* get_sqe();
+
+    /**
+     * @brief submit an accept on a listening socket
+     *
+     * @param listen_socket the listening socket
+     */
+    void submit_accept(int listen_socket);
+
+    /**
+     * @brief submit a recv on a connection
+     *
+     * @param fd the connection
+     * @param conn the connection state
+     */
+    void submit_recv(int fd, UringConnection& conn);
+
+    /**
+     * @brief cancel the recv of a connection, so that no more of its
+     * data is received until it is submitted again
+     *
+     * @param fd the connection
+     * @param conn the connection state
+     */
+    void submit_cancel_recv(int fd, UringConnection& conn);
+
+    /**
+     * @brief submit a send of the remaining response of a connection
+     *
+     * @param fd the connection
+     * @param conn the connection state
+     */
+    void submit_send(int fd, UringConnection& conn);
+
+    /**
+     * @brief submit a read on the eventfd
+     *
+     */
+    void submit_wakeup_read();
+
+    /**
+     * @brief give a provided buffer back to the kernel
+     *
+     * @param bid the buffer id
+     */
+    void recycle_buffer(unsigned bid);
+
+    /**
+     * @brief move the responses queued by the workers into sends
+     *
+     */
+    void drain_send_queue();
+
+    /**
+     * @brief handle one completion
+     *
+     * @param cqe the completion
+     */
+    void handle_cqe(struct io_uring_cqe* cqe);
+
+    /**
+     * @brief handle a completed accept
+     *
+     * @param listen_socket the listening socket of the accept
+     * @param res result of the accept
+     * @param flags flags of the completion
+     */
+    void on_accept(int listen_socket, int res, unsigned flags);
+
+    /**
+     * @brief handle a completed recv
+     *
+     * @param fd the connection
+     * @param conn the connection state
+     * @param res result of the recv
+     * @param flags flags of the completion
+     */
+    void on_recv(int fd, UringConnection& conn, int res, unsigned flags);
+
+    /**
+     * @brief handle a completed send
+     *
+     * @param fd the connection
+     * @param conn the connection state
+     * @param res result of the send
+     */
+    void on_send(int fd, UringConnection& conn, int res);
+
+    /**
+     * @brief once the responses of a request are sent, start the
+     * next request or close the connection
+     * 
+     * @param fd the connection
+     * @param conn the connection state
+     */
+    void finish_request(int fd, UringConnection& conn);
+
+    /**
+     * @brief hand the received data to the parse pool, if the
+     * connection is not busy with a previous request
+     *
+     * @param fd the connection
+     * @param conn the connection state
+     */
+    void start_request(int fd, UringConnection& conn);
+
+    /**
+     * @brief start the timer that closes a connection once it
+     * times out, if a timeout is enabled
+     *
+     * @param fd the connection
+     * @param conn the connection state
+     */
+    void watch_connection(int fd, UringConnection& conn);
+
+    /**
+     * @brief the timer of a connection expired, close it if it
+     * timed out. A busy connection is looked at again later.
+     *
+     * @param fd the connection
+     * @param generation the generation of the connection the timer
+     * was started for
+     */
+    void on_connection_timer(int fd, uint32_t generation);
+
+    /**
+     * @brief the timer of the rehash cron expired, move on every
+     * shard
+     *
+     */
+    void on_rehash_timer();
+
+    /**
+     * @brief close a connection
+     *
+     * @param fd the connection
+     */
+    void close_connection(int fd);
+};
+
+#endif /* #ifndef URING_BACKEND_H_ */